@@ -10,7 +10,9 @@
 #
 # Before it begins, it decides if the TFT display needs
 # to be on or off, based on the TSL2561 light sensor.
-# Threshold is 1 lux.
+# Threshold is 1 lux. The sensor is read by the luxd
+# daemon, started at boot with this crontab line:
+# @reboot /home/pi/pi-display/bin/luxd -o /dev/shm/lux.txt
 #
 # For management of the 20x4 character LCD display, a call
 # to sensor.py is made, which drives the LCD ouput.
@@ -18,11 +20,16 @@
 HOME="/home/pi/pi-display"
 
 ##########################################################
-# Get the environment light data, return code from "lux"
+# Get the environment light data, published by "luxd" as
+# "<time> Lux=<lux> ...". Without a recent value (luxd is
+# not running), LUX stays empty, and the display stays on.
 ##########################################################
-#$HOME/bin/lux
-#LUX=$?
-#echo "Brightness (Lux): $LUX"
+LUXFILE="/dev/shm/lux.txt"
+LUX=""
+if [ -f $LUXFILE ] && [ $(( $(date +%s) - $(date -r $LUXFILE +%s) )) -lt 120 ]; then
+   LUX=`sed -n 's/.* Lux=\([0-9.]*\) .*/\1/p' $LUXFILE`
+   echo "Brightness (Lux): $LUX"
+fi
 
 ##########################################################
 # Get the current TFT display power state 
@@ -38,19 +45,17 @@ python $HOME/bin/sensor.py
 ##########################################################
 # If environmental light is low, turn off the TFT display
 ##########################################################
-#if [ $LUX -lt 1 ] && [ "$DISPLAY" == "display_power=1" ]; then
-#   vcgencmd display_power 0 > /dev/null
-#   echo "Start night mode, TFT display off"
-#   exit 0
-#fi
+if [ -n "$LUX" ] && [ "${LUX%%.*}" -lt 1 ]; then
+   if [ "$DISPLAY" == "display_power=1" ]; then
+      vcgencmd display_power 0 > /dev/null
+      echo "Start night mode, TFT display off"
+   fi
+   exit 0
+fi
 
 ##########################################################
 # If environmental light brightens, enable the TFT display
 ##########################################################
-#if [ $LUX -ge 1 ] && [ "$DISPLAY" == "display_power=0" ]; then
-#   DISPLAY=`vcgencmd display_power`
-#fi
-
 DISPLAY=`vcgencmd display_power`
 if [ "$DISPLAY" == "display_power=0" ]; then
   echo "Start day mode, TFT display on"
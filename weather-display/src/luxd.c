@@ -0,0 +1,344 @@
+/* ------------------------------------------------------------ *
+ * file:        luxd.c                                          *
+ * purpose:     Light sensor daemon for the weather display. It *
+ *              keeps the TSL2561 powered on and open, the ADC  *
+ *              integrates continuously, and each read only     *
+ *              gets the last completed cycle without waiting.  *
+ *                                                              *
+ *              Gain and integration time are picked from the   *
+ *              previous reading: the most sensitive setting    *
+ *              that does not clip the predicted counts. Strong *
+ *              light goes to 1x/13ms, darkness to 16x/402ms.   *
+ *                                                              *
+ *              The lux value is published in a fixed interval, *
+ *              written to a temp file and renamed, so readers  *
+ *              never see a partial line. The default file is   *
+ *              in /dev/shm, to spare the SD card. Line format: *
+ *              <time> Lux=<lux> Broadband=<ch0> IR=<ch1>       *
+ *              Gain=<gain>x Integ=<ms>ms                       *
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ *                                                              *
+ * compile:     gcc tsl2561.o luxd.c -o luxd -lm                *
+ *                                                              *
+ * example run: pi@pi-display:~$ ./luxd -o /dev/shm/lux.txt &   *
+ *              pi@pi-display:~$ cat /dev/shm/lux.txt           *
+ * 1792378800 Lux=312.405 Broadband=4211 IR=1380 Gain=1x ...    *
+ * ------------------------------------------------------------ */
+#define _DEFAULT_SOURCE 1
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include "tsl2561.h"
+
+/* ------------------------------------------------------------ *
+ * The gain and integration time ladder, most sensitive first.  *
+ * sens is the count scale against 16x/402ms (datasheet scale   *
+ * 322/11 for 13.7ms, 322/81 for 101ms, 1/16 for 1x gain), max  *
+ * is the highest count the ADC reaches at that integration.    *
+ * ------------------------------------------------------------ */
+typedef struct {
+   int gain;                     // TSL2561_GAIN_*
+   int integ;                    // TSL2561_INTEGRATION_TIME_*
+   double sens;                  // counts relative to 16x/402ms
+   int max;                      // ADC counts at saturation
+} setting_t;
+
+static const setting_t ladder[] = {
+   { TSL2561_GAIN_16X, TSL2561_INTEGRATION_TIME_402MS, 1.0,       65535 },
+   { TSL2561_GAIN_16X, TSL2561_INTEGRATION_TIME_101MS, 81.0/322,  37177 },
+   { TSL2561_GAIN_0X,  TSL2561_INTEGRATION_TIME_402MS, 1.0/16,    65535 },
+   { TSL2561_GAIN_16X, TSL2561_INTEGRATION_TIME_13MS,  11.0/322,  5047  },
+   { TSL2561_GAIN_0X,  TSL2561_INTEGRATION_TIME_101MS, 81.0/5152, 37177 },
+   { TSL2561_GAIN_0X,  TSL2561_INTEGRATION_TIME_13MS,  11.0/5152, 5047  }
+};
+#define LADDER_CNT  (int) (sizeof(ladder) / sizeof(setting_t))
+#define LEVEL_HIGH  0.90         // step down when counts reach 90% of max
+#define LEVEL_UP    0.50         // step up only if predicted under 50% of max
+#define MAX_ERRORS  10           // reopen the device after 10 failed reads
+
+/* ------------------------------------------------------------ *
+ * Global variables and defaults                                *
+ * ------------------------------------------------------------ */
+int verbose = 0;
+int address = TSL2561_I2C_ADDR_DEFAULT;
+int pkgtype = 0;                  // 0 = T/FN/CL package, 1 = CS
+long interval = 1000;             // publish interval in ms
+char i2cbus[256] = "/dev/i2c-1";
+char outfile[256] = "/dev/shm/lux.txt";
+volatile sig_atomic_t stop = 0;
+extern char *optarg;
+extern int optind, opterr, optopt;
+
+/* ------------------------------------------------------------ *
+ * print_usage() prints the programs commandline instructions.  *
+ * ------------------------------------------------------------ */
+void usage() {
+   static char const usage[] = "Usage: luxd [-a addr] [-b i2c-bus] [-i ms] [-o lux-file] [-t type] [-v]\n\
+   Command line parameters have the following format:\n\
+   -a   optional, sensor I2C address 0x29, 0x39 or 0x49, default 0x39\n\
+   -b   optional, I2C bus device, default /dev/i2c-1\n\
+   -i   optional, publish interval in milliseconds, 500..60000, default 1000\n\
+   -o   optional, lux output file, default /dev/shm/lux.txt\n\
+   -t   optional, sensor package 0 = T/FN/CL, 1 = CS, default 0\n\
+   -h   optional, display this message\n\
+   -v   optional, enables debug output\n\
+   Usage examples:\n\
+./luxd -o /dev/shm/lux.txt &\n\
+./luxd -a 0x49 -i 5000 -o /home/pi/pi-display/var/lux.txt -v\n";
+   printf(usage);
+}
+
+/* ------------------------------------------------------------ *
+ * parseargs() checks the commandline arguments with C getopt   *
+ * ------------------------------------------------------------ */
+void parseargs(int argc, char* argv[]) {
+   int arg;
+   opterr = 0;
+
+   while ((arg = (int) getopt (argc, argv, "a:b:i:o:t:vh")) != -1)
+      switch (arg) {
+         // arg -a + I2C address, type: hex int
+         // optional, example: 0x39
+         case 'a':
+            if(verbose == 1) printf("Debug: arg -a, value %s\n", optarg);
+            address = (int) strtol(optarg, NULL, 0);
+            break;
+
+         // arg -b + I2C bus device, type: string
+         // optional, example: /dev/i2c-1
+         case 'b':
+            if(verbose == 1) printf("Debug: arg -b, value %s\n", optarg);
+            snprintf(i2cbus, sizeof(i2cbus), "%s", optarg);
+            break;
+
+         // arg -i + publish interval, type: long
+         // optional, example: 1000
+         case 'i':
+            if(verbose == 1) printf("Debug: arg -i, value %s\n", optarg);
+            interval = atol(optarg);
+            break;
+
+         // arg -o + lux output file, type: string
+         // optional, example: /dev/shm/lux.txt
+         case 'o':
+            if(verbose == 1) printf("Debug: arg -o, value %s\n", optarg);
+            snprintf(outfile, sizeof(outfile), "%s", optarg);
+            break;
+
+         // arg -t + sensor package type, type: int
+         // optional, example: 1
+         case 't':
+            if(verbose == 1) printf("Debug: arg -t, value %s\n", optarg);
+            pkgtype = atoi(optarg);
+            break;
+
+         // arg -v verbose, type: flag, optional
+         case 'v':
+            verbose = 1; break;
+
+         // arg -h usage, type: flag, optional
+         case 'h':
+            usage(); exit(0);
+
+         case '?':
+            if (isprint (optopt))
+               printf ("Error: Unknown option `-%c'.\n", optopt);
+            else
+               printf ("Error: Unknown option character `\\x%x'.\n", optopt);
+
+         default:
+            usage(); exit(-1);
+    }
+    if (address != TSL2561_I2C_ADDR_LOW && address != TSL2561_I2C_ADDR_DEFAULT
+        && address != TSL2561_I2C_ADDR_HIGH) {
+       printf("Error: Cannot get valid -a sensor address argument.\n");
+       exit(-1);
+    }
+    if (interval < 500 || interval > 60000) {
+       printf("Error: Cannot get valid -i interval argument.\n");
+       exit(-1);
+    }
+    if (strlen(outfile) < 3) {
+       printf("Error: Cannot get valid -o lux file argument.\n");
+       exit(-1);
+    }
+    if (pkgtype != 0 && pkgtype != 1) {
+       printf("Error: Cannot get valid -t sensor type argument.\n");
+       exit(-1);
+    }
+}
+
+/* ------------------------------------------------------------ *
+ * stop_handler() ends the main loop on SIGTERM and SIGINT      *
+ * ------------------------------------------------------------ */
+void stop_handler(int sig) {
+   stop = 1;
+}
+
+/* ------------------------------------------------------------ *
+ * add_ms() moves a timespec forward by ms milliseconds         *
+ * ------------------------------------------------------------ */
+void add_ms(struct timespec *ts, long ms) {
+   ts->tv_sec += ms / 1000;
+   ts->tv_nsec += (ms % 1000) * 1000000;
+   if(ts->tv_nsec >= 1000000000) {
+      ts->tv_sec++;
+      ts->tv_nsec -= 1000000000;
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * open_sensor() powers on the sensor with the ladder setting,  *
+ * it stays on and integrates continuously until we exit.       *
+ * ------------------------------------------------------------ */
+void *open_sensor(int level) {
+   void *tsl = tsl2561_init(address, i2cbus);
+   if(tsl == NULL) return NULL;
+   tsl2561_set_type(tsl, pkgtype);
+   tsl2561_disable_autogain(tsl);
+   tsl2561_set_timing(tsl, ladder[level].integ, ladder[level].gain);
+   tsl2561_enable(tsl);
+   return tsl;
+}
+
+/* ------------------------------------------------------------ *
+ * next_level() picks the ladder setting for the next reading.  *
+ * A clipped reading goes to the least sensitive setting. Else, *
+ * the counts are scaled to the other settings: step down if we *
+ * are close to the max, step up to the most sensitive setting  *
+ * that stays under half its max. The gap between both limits   *
+ * keeps the setting from flapping at a light level.            *
+ * ------------------------------------------------------------ */
+int next_level(int level, int ch0, int ch1) {
+   int counts = (ch0 > ch1) ? ch0 : ch1;
+   int k;
+
+   if(counts >= ladder[level].max * LEVEL_HIGH) {
+      if(counts >= ladder[level].max) return LADDER_CNT - 1;
+      for(k=level+1; k<LADDER_CNT; k++)
+         if(counts / ladder[level].sens * ladder[k].sens < ladder[k].max * LEVEL_UP) return k;
+      return LADDER_CNT - 1;
+   }
+   for(k=0; k<level; k++)
+      if(counts / ladder[level].sens * ladder[k].sens < ladder[k].max * LEVEL_UP) return k;
+   return level;
+}
+
+/* ------------------------------------------------------------ *
+ * publish() writes the line to a temp file, then renames it    *
+ * ------------------------------------------------------------ */
+int publish(time_t now, unsigned long mlux, int ch0, int ch1, int level) {
+   char tmpfile[272];
+   snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", outfile);
+
+   FILE *fp = fopen(tmpfile, "w");
+   if(fp == NULL) return -1;
+   fprintf(fp, "%lld Lux=%lu.%03lu Broadband=%d IR=%d Gain=%dx Integ=%dms\n",
+           (long long) now, mlux / 1000, mlux % 1000, ch0, ch1,
+           (ladder[level].gain == TSL2561_GAIN_16X) ? 16 : 1,
+           (ladder[level].integ == TSL2561_INTEGRATION_TIME_13MS) ? 13 :
+           (ladder[level].integ == TSL2561_INTEGRATION_TIME_101MS) ? 101 : 402);
+   if(fclose(fp) != 0 || rename(tmpfile, outfile) != 0) {
+      unlink(tmpfile);
+      return -1;
+   }
+   return 0;
+}
+
+int main(int argc, char *argv[]) {
+   struct timespec next, ready, now;
+   int level = LADDER_CNT - 1;           // start fast, with 1x/13ms
+   int errors = 0, ch0, ch1;
+
+   /* ------------------------------------------------------------ *
+    * Process the cmdline parameters                               *
+    * ------------------------------------------------------------ */
+   parseargs(argc, argv);
+
+   signal(SIGTERM, stop_handler);
+   signal(SIGINT, stop_handler);
+
+   void *tsl = open_sensor(level);
+   if(tsl == NULL) {
+      printf("Error: cannot open TSL2561 at %#x on %s.\n", address, i2cbus);
+      exit(-1);
+   }
+   if(verbose == 1) printf("Debug: TSL2561 at %#x on %s, publish to %s every %ld ms\n",
+                           address, i2cbus, outfile, interval);
+
+   /* ------------------------------------------------------------ *
+    * The first reading is valid after one full integration time,  *
+    * plus one more, as the cycle in progress at the timing change *
+    * can be a mix of both settings. Same after every change.      *
+    * ------------------------------------------------------------ */
+   clock_gettime(CLOCK_MONOTONIC, &ready);
+   add_ms(&ready, 2 * tsl2561_integration_us(tsl) / 1000 + 1);
+   next = ready;
+
+   while(stop == 0) {
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+      if(stop) break;
+      add_ms(&next, interval);
+
+      /* a timing change inside the interval delays this reading */
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if(now.tv_sec < ready.tv_sec || (now.tv_sec == ready.tv_sec && now.tv_nsec < ready.tv_nsec))
+         clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ready, NULL);
+
+      /* ------------------------------------------------------------ *
+       * Read the last ADC cycle. After repeated errors, e.g. a loose *
+       * cable, close the device and open it again.                   *
+       * ------------------------------------------------------------ */
+      if(tsl == NULL || tsl2561_fetch(tsl, &ch0, &ch1) != 0) {
+         errors++;
+         if(verbose == 1) printf("Debug: TSL2561 read error %d\n", errors);
+         if(errors >= MAX_ERRORS) {
+            printf("Error: TSL2561 failed %d reads, reopen %s.\n", errors, i2cbus);
+            if(tsl) tsl2561_close(tsl);
+            tsl = open_sensor(level);
+            errors = 0;
+            clock_gettime(CLOCK_MONOTONIC, &ready);
+            if(tsl) add_ms(&ready, 2 * tsl2561_integration_us(tsl) / 1000 + 1);
+         }
+         continue;
+      }
+      errors = 0;
+
+      /* ------------------------------------------------------------ *
+       * A clipped reading is not published, except at the least      *
+       * sensitive setting, where it is the max we can measure.       *
+       * ------------------------------------------------------------ */
+      int clipped = (ch0 >= ladder[level].max || ch1 >= ladder[level].max);
+      if(clipped == 0 || level == LADDER_CNT - 1) {
+         unsigned long mlux = tsl2561_compute_millilux(tsl, ch0, ch1);
+         if(publish(time(NULL), mlux, ch0, ch1, level) != 0)
+            printf("Error: cannot write %s.\n", outfile);
+         if(verbose == 1) printf("Debug: lux [%lu.%03lu] ch0 [%d] ch1 [%d] level [%d]\n",
+                                 mlux / 1000, mlux % 1000, ch0, ch1, level);
+      }
+
+      /* ------------------------------------------------------------ *
+       * Adjust gain and integration time for the next reading        *
+       * ------------------------------------------------------------ */
+      int newlevel = next_level(level, ch0, ch1);
+      if(newlevel != level) {
+         if(verbose == 1) printf("Debug: change level [%d] -> [%d]\n", level, newlevel);
+         level = newlevel;
+         tsl2561_set_timing(tsl, ladder[level].integ, ladder[level].gain);
+         clock_gettime(CLOCK_MONOTONIC, &ready);
+         add_ms(&ready, 2 * tsl2561_integration_us(tsl) / 1000 + 1);
+      }
+   }
+
+   if(tsl) {
+      tsl2561_disable(tsl);
+      tsl2561_close(tsl);
+   }
+   if(verbose == 1) printf("Debug: luxd stopped\n");
+   exit(0);
+}
@@ -184,7 +184,7 @@ typedef struct {
 int tsl2561_set_addr(void*);
 uint8_t tsl2561_write_byte_data(void *_tsl, uint8_t reg, uint8_t value);
 uint16_t tsl2561_write_word_data(void *_tsl, uint8_t reg, uint8_t value) ;
-int16_t tsl2561_read_word_data(void *_tsl, uint8_t cmd);
+int32_t tsl2561_read_word_data(void *_tsl, uint8_t cmd);
 unsigned long tsl2561_compute_lux(void *_tsl, int visible, int channel1);
 void tsl2561_init_error_cleanup(void *_tsl);
 
@@ -241,19 +241,20 @@ uint16_t tsl2561_write_word_data(void *_tsl, uint8_t reg, uint8_t value) {
 
 /*
  * Reads a word from the i2c bus.
+ * The ADC counts use the full 16 bit, 0..65535.
  * 
  * @param tsl sensor
  * @param register
- * @return data
+ * @return data, or -1 on errors
  */
-int16_t tsl2561_read_word_data(void *_tsl, uint8_t reg) {
+int32_t tsl2561_read_word_data(void *_tsl, uint8_t reg) {
 	tsl2561_t *tsl = TO_TSL(_tsl);
 
 	int error = tsl2561_set_addr(_tsl);
 	if(error < 0)
 		return -1;
 
-	int16_t data = i2c_smbus_read_word_data(tsl->file, reg);
+	int32_t data = i2c_smbus_read_word_data(tsl->file, reg);
 	DEBUG("device %#x: read %#x from register %#x\n", tsl->address, data, reg);
  
 	return data;
@@ -565,6 +566,51 @@ void tsl2561_read(void *_tsl, int *broadband, int *ir) {
 }
 
 
+/**
+ * Reads the last completed ADC cycle of this TSL2561 sensor.
+ * Other than tsl2561_read(), it does not wait for the integration
+ * time, and does not power down the sensor. The sensor must be
+ * enabled, it then integrates continuously. After a timing change,
+ * the caller waits one full integration time before the first read.
+ *
+ * @param tsl sensor
+ * @param broadband channel 0 counts
+ * @param ir channel 1 counts
+ * @return 0 on success, -1 on i2c errors
+ */
+int tsl2561_fetch(void *_tsl, int *broadband, int *ir) {
+	*broadband = tsl2561_read_word_data(_tsl, TSL2561_CMD_BIT | TSL2561_WORD_BIT | TSL2561_REG_CH0_LOW);
+	*ir = tsl2561_read_word_data(_tsl, TSL2561_CMD_BIT | TSL2561_WORD_BIT | TSL2561_REG_CH1_LOW);
+
+	if( *broadband < 0 || *ir < 0){
+		DEBUG("error: i2c_smbus_read_word_data() failed\n");
+		return -1;
+	}
+	DEBUG("bb=%i, ir=%i\n", *broadband, *ir);
+	return 0;
+}
+
+
+/**
+ * Returns the integration time of this TSL2561 sensor in microseconds.
+ *
+ * @param tsl sensor
+ * @return integration time
+ */
+int tsl2561_integration_us(void *_tsl) {
+	tsl2561_t *tsl = TO_TSL(_tsl);
+
+	switch(tsl->integration_time) {
+		case TSL2561_INTEGRATION_TIME_13MS:
+			return 0.014 * TSL2561_FACTOR_US;
+		case TSL2561_INTEGRATION_TIME_101MS:
+			return 0.102 * TSL2561_FACTOR_US;
+		default:
+			return 0.403 * TSL2561_FACTOR_US;
+	}
+}
+
+
 /*
  * Computes a lux value for this TSL2561 sensor.
  *
@@ -645,9 +691,10 @@ void tsl2561_luminosity(void *_tsl, int *channel0, int *channel1) {
 /*
  * Helper function for computing lux values.
  * It uses a lux equation approximation without floating point calculations.
+ * Returns the lux value scaled by 2^LUX_SCALE, before rounding.
  *
  */
-unsigned long tsl2561_compute_lux(void *_tsl, int ch0, int ch1) {
+static unsigned long tsl2561_compute_scaled(void *_tsl, int ch0, int ch1) {
 	tsl2561_t *tsl = TO_TSL(_tsl);
 	unsigned long ch_scale, channel0, channel1;
 
@@ -732,13 +779,40 @@ unsigned long tsl2561_compute_lux(void *_tsl, int ch0, int ch1) {
 			break;
 	}	
 	
-	unsigned long tmp = (channel0 * b) - (channel1 * m);
+	// the unsigned difference must not wrap below zero
+	if((channel1 * m) > (channel0 * b))
+		return 0;
+
+	return (channel0 * b) - (channel1 * m);
+}
 
-	if(tmp < 0) 
-		tmp = 0;
+
+/*
+ * Computes the lux value from the channel counts, rounded to full lux.
+ *
+ */
+unsigned long tsl2561_compute_lux(void *_tsl, int ch0, int ch1) {
+	unsigned long tmp = tsl2561_compute_scaled(_tsl, ch0, ch1);
 
 	tmp += (1 << (LUX_SCALE-1));
 	unsigned long lux = (tmp >> LUX_SCALE);
 
 	return lux;		
 }
+
+
+/**
+ * Computes the lux value from the channel counts in 1/1000 lux,
+ * for the full resolution at low light.
+ *
+ * @param tsl sensor
+ * @param ch0 broadband channel counts
+ * @param ch1 ir channel counts
+ * @return millilux
+ */
+unsigned long tsl2561_compute_millilux(void *_tsl, int ch0, int ch1) {
+	unsigned long long tmp = tsl2561_compute_scaled(_tsl, ch0, ch1);
+
+	tmp = tmp * 1000 + (1 << (LUX_SCALE-1));
+	return (unsigned long) (tmp >> LUX_SCALE);
+}
@@ -40,6 +40,11 @@ void tsl2561_set_type(void *_tsl, int type);
 void tsl2561_read(void *_tsl, int *visible, int *ir);
 long tsl2561_lux(void *_tsl);
 void tsl2561_luminosity(void *_tsl, int *visible, int *ir);
+
+int tsl2561_fetch(void *_tsl, int *broadband, int *ir);
+int tsl2561_integration_us(void *_tsl);
+unsigned long tsl2561_compute_lux(void *_tsl, int ch0, int ch1);
+unsigned long tsl2561_compute_millilux(void *_tsl, int ch0, int ch1);
 	
 void tsl2561_enable_autogain(void *_tsl);
 void tsl2561_disable_autogain(void *_tsl);
@@ -126,9 +126,9 @@ echo "Done."
 echo
 
 echo "##########################################################"
-echo "# 7. Install video creation tools: ffmpeg, imagemagick, zip"
+echo "# 7. Install video creation tools: ffmpeg, imagemagick, zip, libjpeg"
 echo "##########################################################"
-APPLIST="ffmpeg imagemagick zip"
+APPLIST="ffmpeg imagemagick zip libjpeg62-turbo-dev"
 EXECUTE="sudo apt-get install $APPLIST -y -q"
 echo "Getting SW packages [$APPLIST]. Please wait ..."
 $EXECUTE
@@ -565,11 +565,11 @@ EOM
 echo "Done."
 echo
 
-echo "Create the SFTP batch file for RRD XML backup upload"
-cat <<EOM >$HOMEDIR/etc/sftp-xml.bat
+echo "Create the SFTP batch file for RRD delta upload"
+cat <<EOM >$HOMEDIR/etc/sftp-rrd.bat
 cd var
-put $HOMEDIR/var/rrdcopy.xml.gz rrdcopy.xml.gz.tmp
-rename rrdcopy.xml.gz.tmp rrdcopy.xml.gz
+put $HOMEDIR/var/rrdcopy.delta rrdcopy.delta.tmp
+rename rrdcopy.delta.tmp rrdcopy.delta
 quit
 EOM
 
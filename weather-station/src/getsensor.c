@@ -11,6 +11,8 @@
  *                   and humidity                               *
  *              -j = write results into JSON file               *
  *              -o = write results into html file               *
+ *              -f = append a binary frame (wsframe.h) to file  *
+ *              -i = station ID for the frame, e.g. pi-ws01     *
  *                                                              *
  * return:      0 on success, and -1 on errors.                 *
  *                                                              *
@@ -26,6 +28,8 @@
 #include <string.h>
 #include <getopt.h>
 #include <time.h>
+#include <fcntl.h>
+#include "wsframe.h"
 
 #define DHT11 11
 #define DHT22 22
@@ -38,6 +42,8 @@ int outflag = 0;
 char sentype[256];
 char senaddr[256];
 char outfile[256];
+char framefile[256];
+char station[WSF_SIDSIZE];
 int sensorpin = 0;
 int tempcalib = 0;
 int humicalib = 0;
@@ -68,12 +74,15 @@ Command line parameters have the following format:\n\
    -d   optional, humidity calibration offset, Example: -d -2\n\
    -j   optional, write sensor data to JSON file, Example: -j ./getsensor.json\n\
    -o   optional, write sensor data to HTML file, Example: -o ./getsensor.html\n\
+   -f   optional, append a binary sensor frame to file, Example: -f ./sensor.wsf\n\
+   -i   station ID for the -f frame, Example: -i pi-ws01\n\
    -h   optional, display this message\n\
    -v   optional, enables debug output\n\
 \n\
 Usage examples:\n\
 ./getsensor -t bme280 -a 0x76 -b 50 -c -1 -d -2 -j ./getsensor.json -v\n\
-./getsensor -t am2302 -a 0x76 -p 4 -c -1 -o ./getsensor.html -v\n";
+./getsensor -t am2302 -a 0x76 -p 4 -c -1 -o ./getsensor.html -v\n\
+./getsensor -t bme280 -a 0x76 -j ./getsensor.json -f ./sensor.wsf -i pi-ws01\n";
    printf(usage);
 }
 
@@ -86,7 +95,7 @@ void parseargs(int argc, char* argv[]) {
 
    if(argc == 1) { usage(); exit(-1); }
 
-   while ((arg = (int) getopt (argc, argv, "t:a:p:b:c:d:j:o:vh")) != -1) {
+   while ((arg = (int) getopt (argc, argv, "t:a:p:b:c:d:j:o:f:i:vh")) != -1) {
       switch (arg) {
          // arg -t + sensor type, type: string
          // mandatory, example: bme280
@@ -146,6 +155,20 @@ void parseargs(int argc, char* argv[]) {
             strncpy(outfile, optarg, sizeof(outfile)-1);
             break;
 
+         // arg -f + dst frame file, type: string
+         // optional, example: /home/pi/pi-ws01/var/sensor.wsf
+         case 'f':
+            if(verbose == 1) printf("Debug: arg -f, value %s\n", optarg);
+            strncpy(framefile, optarg, sizeof(framefile)-1);
+            break;
+
+         // arg -i + station ID, type: string
+         // optional, needed with -f, example: pi-ws01
+         case 'i':
+            if(verbose == 1) printf("Debug: arg -i, value %s\n", optarg);
+            strncpy(station, optarg, sizeof(station)-1);
+            break;
+
          // arg -v verbose, type: flag, optional
          case 'v':
             verbose = 1; break;
@@ -174,6 +197,46 @@ void parseargs(int argc, char* argv[]) {
       printf("Error: Cannot get valid -a sensor address argument.\n");
       exit(-1);
    }
+   if (strlen(framefile) > 0 && strlen(station) < 3) {
+      printf("Error: Cannot get valid -i station ID argument for -f.\n");
+      exit(-1);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * write_frame() appends one binary sensor frame to the frame   *
+ * file. The frame is written with a single O_APPEND write, so  *
+ * a frame is never mixed with an upload that renames the file. *
+ * A failed write is not fatal, the reading still gets printed. *
+ * ------------------------------------------------------------ */
+void write_frame(time_t ts, float temp, float humi, float bmpr) {
+   wsf_frame_t f;
+   memset(&f, 0, sizeof(f));
+   f.magic = WSF_MAGIC;
+   f.version = WSF_VERSION;
+   f.ds_cnt = 3;
+   if(strcmp(sentype, "bme280") == 0) f.flags |= WSF_F_BME280;
+   if(strcmp(sentype, "am2302") == 0) f.flags |= WSF_F_AM2302;
+   if(tempcalib != 0 || humicalib != 0 || bmprcalib != 0) f.flags |= WSF_F_CALIB;
+   memcpy(f.station, station, sizeof(f.station));
+   f.tstamp = ts;
+   f.value[0] = temp;
+   f.value[1] = humi;
+   f.value[2] = bmpr;
+   f.crc = wsf_crc32(0, &f, offsetof(wsf_frame_t, crc));
+
+   int fd = open(framefile, O_WRONLY | O_CREAT | O_APPEND, 0644);
+   if(fd == -1) {
+      fprintf(stderr, "Error open %s for writing.\n", framefile);
+      return;
+   }
+   if(write(fd, &f, sizeof(f)) != sizeof(f)) {
+      fprintf(stderr, "Error writing frame to %s.\n", framefile);
+      close(fd);
+      return;
+   }
+   close(fd);
+   if(verbose == 1) printf("Debug: frame written to %s, flags [0x%x] crc [0x%08x]\n", framefile, f.flags, f.crc);
 }
 
 int main(int argc, char *argv[]) {
@@ -293,6 +356,8 @@ int main(int argc, char *argv[]) {
       fclose(json);
    }
 
+   if(strlen(framefile) > 0) write_frame(tsnow, temp, humi, bmpr);
+
    /* ----------------------------------------------------------- *
     * print the formatted output string to stdout (Example below) *              
     * 1498385783 Temp=27.34*C Humidity=55.82% Pressure=99702.00Pa *
@@ -6,6 +6,20 @@
  *              itself, turning the webcam into a light sensor. *
  *              Outputs the brightness value between 0 and 1.   *
  *                                                              *
+ *              With -j or -r, it calculates metrics for image  *
+ *              regions (e.g. sky and ground band) in the same  *
+ *              decode pass: mean, variance, the fraction of    *
+ *              saturated pixels and a sharpness score, printed *
+ *              as one JSON line for camera gating decisions.   *
+ *                                                              *
+ *              With -b or -l, it runs in batch mode over a day *
+ *              archive folder or a file list. The images get   *
+ *              decoded in parallel by a pool of threads, each  *
+ *              thread reusing its own decompressor. The region *
+ *              metrics are written as CSV, one line per image, *
+ *              the status column is "error" for images that    *
+ *              could not be read. Debug output goes to stderr. *
+ *                                                              *
  * return:      Returns 0 if jpeg image can be read. Returns -1 *
  *              for errors.                                     *
  *                                                              *
@@ -14,7 +28,7 @@
  *                                                              *
  * author:      03/15/2018 Frank4DD                             *
  *                                                              *
- * compile: gcc jpglight.c -o jpglight -ljpeg                   *
+ * compile: gcc jpglight.c -o jpglight -ljpeg -lpthread         *
  * ------------------------------------------------------------ */
 #include <stdio.h>
 #include <jpeglib.h>
@@ -22,33 +36,134 @@
 #include <string.h>
 #include <getopt.h>
 #include <ctype.h>
+#include <setjmp.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* ------------------------------------------------------------ *
+ * Region of interest limits. A luma value at or above SATLEVEL *
+ * counts as saturated (overexposed) pixel.                     *
+ * ------------------------------------------------------------ */
+#define MAXROI   8
+#define SATLEVEL 250
+#define MAXTHREAD 16
+
+/* ------------------------------------------------------------ *
+ * roi_t defines a image region in percent of width and height, *
+ * metric_t holds the results calculated for one image region.  *
+ * ------------------------------------------------------------ */
+typedef struct {
+   char name[16];                       // region name, e.g. "sky"
+   int left, top, right, bottom;        // region borders in percent
+} roi_t;
+
+typedef struct {
+   double mean;                         // avg luma value (0 = black, 1 = white)
+   double var;                          // luma variance, low value means fog or black
+   double sat;                          // fraction of saturated pixels (0..1)
+   double sharp;                        // Laplacian variance, low value means blur
+} metric_t;
 
 /* ------------------------------------------------------------ *
  * global variables                                             *
  * ------------------------------------------------------------ */
-unsigned char *raw_image = NULL;	// stores the raw, uncompressed image 
 int width;				// image width
 int height;                             // image height
 int bytes_per_pixel;                    // or 1 for GRACYSCALE images
 int color_space;       			// or JCS_GRAYSCALE for grayscale images
 int verbose = 0;			// debug flag
+int jsonout = 0;                        // region metrics JSON output flag
 char filename[256];                     // the source jpeg file
 float lightavg = 0;                     // the avg value of light (0 = black)
+roi_t roi[MAXROI];                      // the list of image regions
+int roi_cnt = 0;                        // the number of image regions
+char batchdir[256];                     // batch mode: image archive folder
+char listfile[256];                     // batch mode: file with image list
+char csvfile[256];                      // batch mode: CSV output file
+int threads = 0;                        // batch mode: decoder threads
+
+/* ------------------------------------------------------------ *
+ * batch_t holds one batch mode image and its results. Workers  *
+ * take the next image index from the shared counter next_img.  *
+ * ------------------------------------------------------------ */
+typedef struct {
+   char path[512];                      // image file and path
+   time_t tstamp;                       // image time from name or mtime
+   int status;                          // 0 = OK, -1 = decode error
+   metric_t res[MAXROI];                // the region metrics
+} batch_t;
+
+batch_t *batch = NULL;                  // the list of images to process
+int batch_cnt = 0;                      // the number of images
+int next_img = 0;                       // next image to process
+pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------------ *
+ * jpeg_jmp_mgr extends the libjpeg error handler, so a broken  *
+ * image returns to the caller instead of calling exit().       *
+ * ------------------------------------------------------------ */
+typedef struct {
+   struct jpeg_error_mgr pub;
+   jmp_buf jmpbuf;
+} jpeg_jmp_mgr;
 
 /* ------------------------------------------------------------ *
  * print_usage() prints the programs commandline instructions.  *
  * ------------------------------------------------------------ */
 void usage() {
-   static char const usage[] = "Usage: jpglight -s file [-v]\n\
+   static char const usage[] = "Usage: jpglight -s file [-j] [-r name:left:top:right:bottom] [-v]\n\
+       jpglight -b dir | -l list [-o csv] [-t threads] [-r name:left:top:right:bottom] [-v]\n\
    Command line parameters have the following format:\n\
-   -s   mandatory, the jpeg file path\n\
+   -s   mandatory for single images, the jpeg file path\n\
+   -b   batch mode, process all .jpg files in the folder, e.g. wcam/2018/03/15\n\
+   -l   batch mode, process all jpeg files listed in the file, one path per line\n\
+   -o   optional, batch mode CSV output file, default is stdout\n\
+   -t   optional, batch mode decoder threads, default is the number of CPU cores\n\
+   -j   optional, output region metrics as one JSON line\n\
+   -r   optional, define a region in percent of the image, can be repeated up to 8x\n\
+        without -r, the regions full:0:0:100:100 sky:0:0:100:40 ground:0:60:100:100 are used\n\
    -h   optional, display this message\n\
    -v   optional, enables debug output\n\
    Usage examples:\n\
-./jpglight -s /home/pi/pi-ws01/var/camera.jpg\n";
+./jpglight -s /home/pi/pi-ws01/var/camera.jpg\n\
+./jpglight -s /home/pi/pi-ws01/var/camera.jpg -j\n\
+./jpglight -s /home/pi/pi-ws01/var/camera.jpg -r sky:0:0:100:30 -r road:20:70:80:100\n\
+./jpglight -b /home/pi/pi-ws01/web/wcam/2018/03/15 -o /tmp/20180315.csv -t 4\n";
    printf(usage);
 }
 
+/* ------------------------------------------------------------ *
+ * add_roi() parses a region string "name:left:top:right:bottom"*
+ * ------------------------------------------------------------ */
+int add_roi(const char *arg) {
+   roi_t r;
+   memset(&r, 0, sizeof(r));
+
+   if(roi_cnt >= MAXROI) {
+      printf("Error: Too many regions, max is %d.\n", MAXROI);
+      return -1;
+   }
+   if(sscanf(arg, "%15[^:]:%d:%d:%d:%d", r.name, &r.left, &r.top, &r.right, &r.bottom) != 5) {
+      printf("Error: Cannot parse region [%s], format name:left:top:right:bottom.\n", arg);
+      return -1;
+   }
+   /* the name goes unquoted into the JSON keys and CSV header */
+   if(strspn(r.name, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-") != strlen(r.name)) {
+      printf("Error: Region name [%s] may only use A-Z, a-z, 0-9, _ and -.\n", r.name);
+      return -1;
+   }
+   if(r.left < 0 || r.top < 0 || r.right > 100 || r.bottom > 100
+      || r.left >= r.right || r.top >= r.bottom) {
+      printf("Error: Region [%s] borders must be within 0..100 percent.\n", arg);
+      return -1;
+   }
+   roi[roi_cnt++] = r;
+   return 0;
+}
+
 /* ------------------------------------------------------------ *
  * parseargs() checks the commandline arguments with C getopt   *
  * ------------------------------------------------------------ */
@@ -58,15 +173,59 @@ void parseargs(int argc, char* argv[]) {
 
   if(argc == 1) { usage(); exit(-1); }
 
-  while ((arg = (int) getopt (argc, argv, "s:vh")) != -1) {
+  while ((arg = (int) getopt (argc, argv, "s:r:b:l:o:t:jvh")) != -1) {
     switch (arg) {
       // arg -s + source jpeg file, type: string
       // mandatory, example: /home/pi/pi-ws01/var/camera.jpg
       case 's':
-        if(verbose == 1) printf("Debug: arg -s, value %s\n", optarg);
-          strncpy(filename, optarg, sizeof(filename));
+        if(verbose == 1) fprintf(stderr, "Debug: arg -s, value %s\n", optarg);
+          strncpy(filename, optarg, sizeof(filename)-1);
           break;
 
+      // arg -r + image region, type: string
+      // optional, example: sky:0:0:100:40
+      case 'r':
+        if(verbose == 1) fprintf(stderr, "Debug: arg -r, value %s\n", optarg);
+        if(add_roi(optarg) != 0) exit(-1);
+        jsonout = 1;
+        break;
+
+      // arg -b + image archive folder, type: string
+      // batch mode, example: /home/pi/pi-ws01/web/wcam/2018/03/15
+      case 'b':
+        if(verbose == 1) fprintf(stderr, "Debug: arg -b, value %s\n", optarg);
+        strncpy(batchdir, optarg, sizeof(batchdir)-1);
+        break;
+
+      // arg -l + image list file, type: string
+      // batch mode, example: /tmp/imglist.txt
+      case 'l':
+        if(verbose == 1) fprintf(stderr, "Debug: arg -l, value %s\n", optarg);
+        strncpy(listfile, optarg, sizeof(listfile)-1);
+        break;
+
+      // arg -o + CSV output file, type: string
+      // optional, example: /tmp/20180315.csv
+      case 'o':
+        if(verbose == 1) fprintf(stderr, "Debug: arg -o, value %s\n", optarg);
+        strncpy(csvfile, optarg, sizeof(csvfile)-1);
+        break;
+
+      // arg -t + number of decoder threads, type: int
+      // optional, example: 4
+      case 't':
+        if(verbose == 1) fprintf(stderr, "Debug: arg -t, value %s\n", optarg);
+        threads = atoi(optarg);
+        if(threads < 1 || threads > MAXTHREAD) {
+          printf("Error: thread count %s must be within 1..%d.\n", optarg, MAXTHREAD);
+          exit(-1);
+        }
+        break;
+
+      // arg -j JSON output, type: flag, optional
+      case 'j':
+        jsonout = 1; break;
+
       // arg -v verbose, type: flag, optional
       case 'v':
         verbose = 1; break;
@@ -85,18 +244,370 @@ void parseargs(int argc, char* argv[]) {
          usage();
     }
   }
-  if (strlen(filename) < 3) {
+  if (strlen(batchdir) == 0 && strlen(listfile) == 0 && strlen(filename) < 3) {
     printf("Error: Cannot get valid -s jpeg file argument.\n");
     exit(-1);
   }
+  /* without -r regions, use the full image, sky and ground band */
+  if((jsonout == 1 || strlen(batchdir) > 0 || strlen(listfile) > 0) && roi_cnt == 0) {
+    add_roi("full:0:0:100:100");
+    add_roi("sky:0:0:100:40");
+    add_roi("ground:0:60:100:100");
+  }
+}
+
+/* ------------------------------------------------------------ *
+ * jpg_metrics() decodes the image as grayscale in a single pass*
+ * and calculates the metrics for all regions. The sharpness is *
+ * the variance of the 4-neighbour Laplacian, calculated from a *
+ * three-row luma window. Expects the jpeg header already read. *
+ * ------------------------------------------------------------ */
+int jpg_metrics(struct jpeg_decompress_struct *cinfo, metric_t *res) {
+  double sum[MAXROI], sumsq[MAXROI], lapsum[MAXROI], lapsq[MAXROI];
+  unsigned long cnt[MAXROI], satcnt[MAXROI], lapcnt[MAXROI];
+  int x0[MAXROI], y0[MAXROI], x1[MAXROI], y1[MAXROI];
+  JSAMPARRAY rows;
+  int r, x, y;
+
+  /* ------------------------------------------------------------ *
+   * Grayscale output skips the color conversion, the jpeg luma   *
+   * channel is all we need for the region metrics.               *
+   * ------------------------------------------------------------ */
+  cinfo->out_color_space = JCS_GRAYSCALE;
+  jpeg_start_decompress(cinfo);
+
+  int w = cinfo->output_width;
+  int h = cinfo->output_height;
+
+  for(r=0; r<roi_cnt; r++) {
+    x0[r] = w * roi[r].left / 100;
+    x1[r] = w * roi[r].right / 100;
+    y0[r] = h * roi[r].top / 100;
+    y1[r] = h * roi[r].bottom / 100;
+    sum[r] = sumsq[r] = lapsum[r] = lapsq[r] = 0;
+    cnt[r] = satcnt[r] = lapcnt[r] = 0;
+    if(verbose == 1) fprintf(stderr, "Debug: region %-8s x %d..%d y %d..%d\n", roi[r].name, x0[r], x1[r], y0[r], y1[r]);
+  }
+
+  /* the row buffers come from the libjpeg image pool, which gets */
+  /* released in jpeg_finish_decompress() or jpeg_abort()         */
+  rows = (*cinfo->mem->alloc_sarray)((j_common_ptr) cinfo, JPOOL_IMAGE, w, 3);
+
+  /* ------------------------------------------------------------ *
+   * Read one scan line at a time into a 3-row ring. The row y is *
+   * used for mean, variance and saturation, the row above (y-1)  *
+   * gets the Laplacian once its lower neighbour row is in place. *
+   * ------------------------------------------------------------ */
+  for(y=0; y<h; y++) {
+    JSAMPROW cur = rows[y % 3];
+    jpeg_read_scanlines(cinfo, &cur, 1);
+
+    for(r=0; r<roi_cnt; r++) {
+      if(y < y0[r] || y >= y1[r]) continue;
+      for(x=x0[r]; x<x1[r]; x++) {
+        sum[r] += cur[x];
+        sumsq[r] += cur[x] * cur[x];
+        if(cur[x] >= SATLEVEL) satcnt[r]++;
+      }
+      cnt[r] += x1[r] - x0[r];
+    }
+
+    if(y < 2) continue;
+    JSAMPROW up  = rows[(y-2) % 3];
+    JSAMPROW mid = rows[(y-1) % 3];
+    for(r=0; r<roi_cnt; r++) {
+      if(y-1 < y0[r] || y-1 >= y1[r]) continue;
+      int xs = (x0[r] < 1) ? 1 : x0[r];
+      int xe = (x1[r] > w-1) ? w-1 : x1[r];
+      for(x=xs; x<xe; x++) {
+        int lap = 4 * mid[x] - mid[x-1] - mid[x+1] - up[x] - cur[x];
+        lapsum[r] += lap;
+        lapsq[r] += lap * lap;
+      }
+      if(xe > xs) lapcnt[r] += xe - xs;
+    }
+  }
+
+  jpeg_finish_decompress(cinfo);
+
+  /* ------------------------------------------------------------ *
+   * Mean and variance are scaled to the 0..1 range like the avg  *
+   * light value, the sharpness stays in 8-bit luma units.        *
+   * ------------------------------------------------------------ */
+  for(r=0; r<roi_cnt; r++) {
+    memset(&res[r], 0, sizeof(metric_t));
+    if(cnt[r] > 0) {
+      double m = sum[r] / cnt[r];
+      res[r].mean = m / 255;
+      res[r].var = (sumsq[r] / cnt[r] - m * m) / (255.0 * 255.0);
+      res[r].sat = (double) satcnt[r] / cnt[r];
+    }
+    if(lapcnt[r] > 0) {
+      double lm = lapsum[r] / lapcnt[r];
+      res[r].sharp = lapsq[r] / lapcnt[r] - lm * lm;
+    }
+  }
+  return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * print_json() writes the region metrics as a single line:     *
+ * {"file":"cam.jpg","width":640,"height":480,"roi":{"sky":{..}}*
+ * ------------------------------------------------------------ */
+void print_json(const char *file, int w, int h, metric_t *res) {
+  int r;
+  const char *c;
+
+  printf("{\"file\":\"");
+  for(c=file; *c; c++) {
+    if(*c == '"' || *c == '\\') putchar('\\');
+    putchar(*c);
+  }
+  printf("\",\"width\":%d,\"height\":%d,\"roi\":{", w, h);
+  for(r=0; r<roi_cnt; r++) {
+    printf("%s\"%s\":{\"mean\":%.6f,\"var\":%.6f,\"sat\":%.6f,\"sharp\":%.2f}",
+           (r > 0) ? "," : "", roi[r].name, res[r].mean, res[r].var, res[r].sat, res[r].sharp);
+  }
+  printf("}}\n");
+}
+
+/* ------------------------------------------------------------ *
+ * jpeg_jmp_exit() replaces the libjpeg error_exit() handler in *
+ * batch mode. It prints the error and jumps back to the worker *
+ * ------------------------------------------------------------ */
+void jpeg_jmp_exit(j_common_ptr cinfo) {
+  jpeg_jmp_mgr *err = (jpeg_jmp_mgr *) cinfo->err;
+  char msg[JMSG_LENGTH_MAX];
+  (*cinfo->err->format_message)(cinfo, msg);
+  fprintf(stderr, "Error: jpeg decode: %s\n", msg);
+  longjmp(err->jmpbuf, 1);
+}
+
+/* ---------------------------------------------------------- *
+ * scandir filter returns 1/true if name of file ends in .jpg *
+ * ---------------------------------------------------------- */
+int filter(const struct dirent *entry) {
+  const char *s = entry->d_name;
+  int len = strlen(s) - 4; // index of start of . in .jpg
+  if(len > 0 && strncmp(s + len, ".jpg", 4) == 0) return(1);
+  return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * img_time() gets the image time from the wcam-archive naming  *
+ * wcam-yyyymmdd_hhmmss.jpg, or from the file modification time *
+ * ------------------------------------------------------------ */
+time_t img_time(const char *path) {
+  const char *base = strrchr(path, '/');
+  struct tm tm;
+  struct stat st;
+  int d, t;
+
+  base = (base == NULL) ? path : base+1;
+  if(sscanf(base, "wcam-%8d_%6d", &d, &t) == 2) {
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year  = d / 10000 - 1900;
+    tm.tm_mon   = (d / 100) % 100 - 1;
+    tm.tm_mday  = d % 100;
+    tm.tm_hour  = t / 10000;
+    tm.tm_min   = (t / 100) % 100;
+    tm.tm_sec   = t % 100;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+  }
+  if(stat(path, &st) == 0) return st.st_mtime;
+  return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * add_batch() appends one image path to the batch list         *
+ * ------------------------------------------------------------ */
+void add_batch(const char *path) {
+  static int batch_max = 0;
+  if(batch_cnt == batch_max) {
+    batch_max = (batch_max == 0) ? 1024 : batch_max * 2;
+    batch = (batch_t *) realloc(batch, batch_max * sizeof(batch_t));
+    if(batch == NULL) { printf("Error: cannot allocate batch list.\n"); exit(-1); }
+  }
+  memset(&batch[batch_cnt], 0, sizeof(batch_t));
+  strncpy(batch[batch_cnt].path, path, sizeof(batch[batch_cnt].path)-1);
+  batch[batch_cnt].tstamp = img_time(path);
+  batch_cnt++;
+}
+
+/* ------------------------------------------------------------ *
+ * load_batch() builds the image list from -b folder, sorted by *
+ * name (= time), or from the -l list file in the given order.  *
+ * ------------------------------------------------------------ */
+int load_batch() {
+  char path[512];
+  int i;
+
+  if(strlen(batchdir) > 0) {
+    struct dirent **imgfile_list;
+    int file_counter = scandir(batchdir, &imgfile_list, filter, alphasort);
+    if(file_counter < 0) {
+      fprintf(stderr, "Error: Cannot read folder %s\n", batchdir);
+      return -1;
+    }
+    for(i=0; i<file_counter; i++) {
+      snprintf(path, sizeof(path), "%s/%s", batchdir, imgfile_list[i]->d_name);
+      add_batch(path);
+      free(imgfile_list[i]);
+    }
+    free(imgfile_list);
+  }
+
+  if(strlen(listfile) > 0) {
+    FILE *list = fopen(listfile, "r");
+    if(list == NULL) {
+      fprintf(stderr, "Error: Cannot open list file %s\n", listfile);
+      return -1;
+    }
+    while(fgets(path, sizeof(path), list) != NULL) {
+      path[strcspn(path, "\r\n")] = '\0';
+      if(strlen(path) > 0) add_batch(path);
+    }
+    fclose(list);
+  }
+  if(verbose == 1) fprintf(stderr, "Debug: batch list has %d images\n", batch_cnt);
+  return batch_cnt;
+}
+
+/* ------------------------------------------------------------ *
+ * batch_worker() is the decoder thread. It creates one libjpeg *
+ * decompressor, and reuses it for all the images it processes. *
+ * ------------------------------------------------------------ */
+void *batch_worker(void *arg) {
+  struct jpeg_decompress_struct cinfo;
+  jpeg_jmp_mgr jerr;
+  int done = 0;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = jpeg_jmp_exit;
+  jpeg_create_decompress(&cinfo);
+
+  for(;;) {
+    pthread_mutex_lock(&next_lock);
+    int n = next_img++;
+    pthread_mutex_unlock(&next_lock);
+    if(n >= batch_cnt) break;
+
+    batch_t *img = &batch[n];
+    FILE *infile = fopen(img->path, "rb");
+    if(infile == NULL) {
+      fprintf(stderr, "Error opening jpeg file %s\n", img->path);
+      img->status = -1;
+      continue;
+    }
+
+    /* ---------------------------------------------------------- *
+     * On decode errors we land here again, reset the decompress  *
+     * object for the next image instead of destroying it.        *
+     * ---------------------------------------------------------- */
+    if(setjmp(jerr.jmpbuf)) {
+      jpeg_abort_decompress(&cinfo);
+      fclose(infile);
+      fprintf(stderr, "Error: skipping image %s\n", img->path);
+      img->status = -1;
+      continue;
+    }
+
+    jpeg_stdio_src(&cinfo, infile);
+    jpeg_read_header(&cinfo, TRUE);
+    jpg_metrics(&cinfo, img->res);
+    fclose(infile);
+    done++;
+  }
+
+  jpeg_destroy_decompress(&cinfo);
+  if(verbose == 1) fprintf(stderr, "Debug: decoder thread finished %d images\n", done);
+  return NULL;
+}
+
+/* ------------------------------------------------------------ *
+ * csv_quote() writes a CSV field in double quotes, and doubles *
+ * the quotes inside, so that paths with a comma stay one field *
+ * ------------------------------------------------------------ */
+void csv_quote(FILE *csv, const char *field) {
+  fputc('"', csv);
+  for(; *field; field++) {
+    if(*field == '"') fputc('"', csv);
+    fputc(*field, csv);
+  }
+  fputc('"', csv);
+}
+
+/* ------------------------------------------------------------ *
+ * run_batch() starts the decoder threads, waits for them, and  *
+ * writes the CSV file: timestamp,file,<roi>_mean,<roi>_var,... *
+ * ending with the status "ok", or "error" with empty metrics.  *
+ * ------------------------------------------------------------ */
+int run_batch() {
+  pthread_t tid[MAXTHREAD];
+  int i, r, failed = 0;
+
+  if(load_batch() < 0) return -1;
+
+  if(threads == 0) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if(threads < 1) threads = 1;
+  if(threads > MAXTHREAD) threads = MAXTHREAD;
+  if(threads > batch_cnt && batch_cnt > 0) threads = batch_cnt;
+  if(verbose == 1) fprintf(stderr, "Debug: starting %d decoder threads\n", threads);
+
+  for(i=0; i<threads; i++) {
+    if(pthread_create(&tid[i], NULL, batch_worker, NULL) != 0) {
+      fprintf(stderr, "Error: Cannot create decoder thread %d\n", i);
+      return -1;
+    }
+  }
+  for(i=0; i<threads; i++) pthread_join(tid[i], NULL);
+
+  FILE *csv = stdout;
+  if(strlen(csvfile) > 0 && (csv = fopen(csvfile, "w")) == NULL) {
+    fprintf(stderr, "Error open %s for writing.\n", csvfile);
+    return -1;
+  }
+
+  fprintf(csv, "timestamp,file");
+  for(r=0; r<roi_cnt; r++)
+    fprintf(csv, ",%s_mean,%s_var,%s_sat,%s_sharp", roi[r].name, roi[r].name, roi[r].name, roi[r].name);
+  fprintf(csv, ",status\n");
+
+  for(i=0; i<batch_cnt; i++) {
+    fprintf(csv, "%lld,", (long long) batch[i].tstamp);
+    csv_quote(csv, batch[i].path);
+    if(batch[i].status != 0) {
+      failed++;
+      for(r=0; r<roi_cnt; r++) fprintf(csv, ",,,,");
+      fprintf(csv, ",error\n");
+      continue;
+    }
+    for(r=0; r<roi_cnt; r++)
+      fprintf(csv, ",%.6f,%.6f,%.6f,%.2f", batch[i].res[r].mean, batch[i].res[r].var,
+              batch[i].res[r].sat, batch[i].res[r].sharp);
+    fprintf(csv, ",ok\n");
+  }
+  if(csv != stdout) fclose(csv);
+
+  if(verbose == 1) fprintf(stderr, "Debug: batch processed %d images, %d failed\n", batch_cnt, failed);
+  free(batch);
+  return 0;
 }
 
 int main(int argc,char **argv) {
-  int ret = 0;
   /* ------------------------------------------------------------ *
    * Process the cmdline parameters                               *
    * ------------------------------------------------------------ */
   parseargs(argc, argv);
+
+  /* ------------------------------------------------------------ *
+   * With -b or -l, process the image list in batch mode          *
+   * ------------------------------------------------------------ */
+  if(strlen(batchdir) > 0 || strlen(listfile) > 0) {
+    if(run_batch() != 0) return -1;
+    return 0;
+  }
   if(verbose == 1) printf("Debug for jpg file:\t%s\n", filename);
 
   /* ------------------------------------------------------------ *
@@ -107,7 +618,7 @@ int main(int argc,char **argv) {
   struct jpeg_error_mgr jerr;
   /* libjpeg data structure, storing one scanline (image row) */
   JSAMPROW row_pointer[1];
- 
+
   /* ------------------------------------------------------------ *
    * Try to open the jpeg image file                              *
    * ------------------------------------------------------------ */
@@ -131,39 +642,46 @@ int main(int argc,char **argv) {
    * Reading the image header (contains image information)        *
    * ------------------------------------------------------------ */
   jpeg_read_header(&cinfo, TRUE);
+  width = cinfo.image_width;
+  height = cinfo.image_height;
+  bytes_per_pixel = cinfo.num_components;
 
   /* ------------------------------------------------------------ *
    * Debug: display the JPEG image information                    *
    * ------------------------------------------------------------ */
   if(verbose == 1) {
-    printf("Img width x height:\t%d pixels x %d pixels\n", width=cinfo.image_width, height=cinfo.image_height);
-    printf("# Colors per pixel:\t%d\n", bytes_per_pixel = cinfo.num_components);
+    printf("Img width x height:\t%d pixels x %d pixels\n", width, height);
+    printf("# Colors per pixel:\t%d\n", bytes_per_pixel);
     printf(" Color space count:\t%d (3 = JCS_RGB)\n", cinfo.jpeg_color_space);
   }
 
   /* ------------------------------------------------------------ *
-   * Start image decompression                                    *
+   * With -j or -r, calculate the region metrics and return JSON  *
    * ------------------------------------------------------------ */
-  jpeg_start_decompress(&cinfo);
+  if(jsonout == 1) {
+    metric_t res[MAXROI];
+    jpg_metrics(&cinfo, res);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(infile);
+    print_json(filename, width, height, res);
+    return 0;
+  }
 
   /* ------------------------------------------------------------ *
-   * Allocate memory to hold the uncompressed image               *
+   * Start image decompression                                    *
    * ------------------------------------------------------------ */
-  size_t img_size = cinfo.output_width * cinfo.output_height * cinfo.num_components;
-  raw_image = (unsigned char*)malloc(img_size);
-  if(verbose == 1) printf(" Uncompressed size:\t%d bytes\n", img_size);
+  jpeg_start_decompress(&cinfo);
 
   /* ------------------------------------------------------------ *
-   * Allocate memory to hold the uncompressed image               *
+   * Allocate memory to hold a single uncompressed image row      *
    * ------------------------------------------------------------ */
   size_t row_size = cinfo.output_width * cinfo.num_components;
   row_pointer[0] = (unsigned char *)malloc(row_size);
-  if(verbose == 1) printf( "Size of single row:\t%d bytes\n", row_size);
+  if(verbose == 1) printf( "Size of single row:\t%zu bytes\n", row_size);
 
   /* ------------------------------------------------------------ *
    * Variables for in-file positioning                            *
    * ------------------------------------------------------------ */
-  unsigned long location = 0; // byte location in jpeg file
   int line = 0;               // row counter variable
   int i = 0;                  // byte location in scanline (row)
   float rowavg = 0;           // the average from all data in one row
@@ -188,7 +706,6 @@ int main(int argc,char **argv) {
     rowavg = 0;
 
     for(i=0; i<row_size; i++) {
-      raw_image[location] = row_pointer[0][i];
       rowavg = rowavg + (float) row_pointer[0][i]/255;
 
       /* ------------------------------------------------------------ *
@@ -207,7 +724,6 @@ int main(int argc,char **argv) {
     }
 
     line++;
-    location++;
     lightavg = lightavg + (rowavg/row_size);
   }
 
@@ -221,7 +737,6 @@ int main(int argc,char **argv) {
   jpeg_destroy_decompress(&cinfo);
   free(row_pointer[0]);
   fclose(infile);
-  free(raw_image);
 
   if(verbose == 1) printf("Result average light: %.6f\n", lightavg);
   else printf("%.6f\n", lightavg);
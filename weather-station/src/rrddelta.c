@@ -0,0 +1,275 @@
+/* ------------------------------------------------------------ *
+ * file:        rrddelta.c                                      *
+ * purpose:     Export the RRA rows that changed after a given  *
+ *              time into a compact binary delta file, which    *
+ *              the web server merges into its RRD copy with    *
+ *              rrdmerge. It replaces the nightly full XML dump *
+ *              of weather.rrd in send-night.sh, only the rows  *
+ *              of the last day(s) are read and sent.           *
+ *                                                              *
+ *              The RRA rows are read straight from the file at *
+ *              their offset, the RRA row time is calculated    *
+ *              from the last update, the same way rrd_fetch()  *
+ *              does it. See rrddelta.h for the file layout.    *
+ *                                                              *
+ * return:      Returns 0 on success, and -1 on errors.         *
+ *                                                              *
+ * RRD API:     http://oss.oetiker.ch/rrdtool/doc/librrd.en.html*
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ *                                                              *
+ * compile: gcc rrddelta.c -o rrddelta -lrrd                    *
+ * ------------------------------------------------------------ */
+#define HAVE_STDINT_H
+#define RRD_EXPORT_DEPRECATED  // required to include rrd_format.h
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <rrd.h>
+#include <rrd_format.h>        // required to get rrd_t object
+#include "rrddelta.h"
+
+/* ------------------------------------------------------------ *
+ * Global variables and defaults                                *
+ * ------------------------------------------------------------ */
+#define RRD_READONLY    (1<<0)
+int verbose = 0;
+char rrdfile[256];                // the rrd file name and path
+char outfile[256];                // the delta output file
+long long since = -1;             // export rows after this time
+extern char *optarg;
+extern int optind, opterr, optopt;
+
+rrd_file_t *rrd_open(const char *const file_name, rrd_t *rrd, unsigned rdwr);
+void rrd_init(rrd_t *rrd);
+void rrd_free(rrd_t *rrd);
+int rrd_close(rrd_file_t *rrd_file);
+
+/* ------------------------------------------------------------ *
+ * print_usage() prints the programs commandline instructions.  *
+ * ------------------------------------------------------------ */
+void usage() {
+   static char const usage[] = "Usage: rrddelta -s [rrd-file] -t [since] -o [delta-file] [-v]\n\
+   Command line parameters have the following format:\n\
+   -s   RRD file and path, Example: -s /home/pi/pi-ws01/rrd/weather.rrd\n\
+   -t   export rows newer than this time (seconds since 1970), 0 = all\n\
+   -o   delta output file, Example: -o /home/pi/pi-ws01/var/rrdcopy.delta\n\
+   -h   optional, display this message\n\
+   -v   optional, enables debug output\n\
+   Usage examples:\n\
+./rrddelta -s /home/pi/pi-ws01/rrd/weather.rrd -t 1790035200 -o /tmp/rrdcopy.delta\n";
+   printf(usage);
+}
+
+/* ------------------------------------------------------------ *
+ * parseargs() checks the commandline arguments with C getopt   *
+ * ------------------------------------------------------------ */
+void parseargs(int argc, char* argv[]) {
+   int arg;
+   opterr = 0;
+
+   if(argc == 1) {
+      usage();
+      exit(-1);
+   }
+
+   while ((arg = (int) getopt (argc, argv, "s:t:o:vh")) != -1)
+      switch (arg) {
+         // arg -s + RRD file, type: string
+         // mandatory, example: /home/pi/pi-ws01/rrd/weather.rrd
+         case 's':
+            if(verbose == 1) printf("Debug: arg -s, value %s\n", optarg);
+            snprintf(rrdfile, sizeof(rrdfile), "%s", optarg);
+            break;
+
+         // arg -t + since timestamp, type: long
+         // mandatory, example: 1790035200
+         case 't':
+            if(verbose == 1) printf("Debug: arg -t, value %s\n", optarg);
+            since = atoll(optarg);
+            break;
+
+         // arg -o + delta output file, type: string
+         // mandatory, example: /home/pi/pi-ws01/var/rrdcopy.delta
+         case 'o':
+            if(verbose == 1) printf("Debug: arg -o, value %s\n", optarg);
+            snprintf(outfile, sizeof(outfile), "%s", optarg);
+            break;
+
+         // arg -v verbose, type: flag, optional
+         case 'v':
+            verbose = 1; break;
+
+         // arg -h usage, type: flag, optional
+         case 'h':
+            usage(); exit(0);
+
+         case '?':
+            if (isprint (optopt))
+               printf ("Error: Unknown option `-%c'.\n", optopt);
+            else
+               printf ("Error: Unknown option character `\\x%x'.\n", optopt);
+
+         default:
+            usage(); exit(-1);
+    }
+    if (strlen(rrdfile) < 3) {
+       printf("Error: Cannot get valid -s RRD file argument.\n");
+       exit(-1);
+    }
+    if (since < 0) {
+       printf("Error: Cannot get valid -t since time argument.\n");
+       exit(-1);
+    }
+    if (strlen(outfile) < 3) {
+       printf("Error: Cannot get valid -o delta file argument.\n");
+       exit(-1);
+    }
+}
+
+/* ------------------------------------------------------------ *
+ * write_crc() writes data to fp, and adds it to the file CRC   *
+ * ------------------------------------------------------------ */
+int write_crc(FILE *fp, const void *data, size_t len, uint32_t *crc) {
+   *crc = rdl_crc32(*crc, data, len);
+   return fwrite(data, 1, len, fp) == len ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+   rrd_t rrd;
+   char tmpfile[272];
+   uint32_t crc = 0;
+   long total = 0;
+   int i;
+
+   /* ------------------------------------------------------------ *
+    * Process the cmdline parameters                               *
+    * ------------------------------------------------------------ */
+   parseargs(argc, argv);
+
+   /* ------------------------------------------------------------ *
+    * Read the RRD header: DS, RRA definitions and the row pointer *
+    * ------------------------------------------------------------ */
+   rrd_init(&rrd);
+   rrd_file_t *rrdf = rrd_open(rrdfile, &rrd, RRD_READONLY);
+   if(rrdf == NULL) {
+      printf("Error: cannot open %s: %s\n", rrdfile, rrd_get_error());
+      exit(-1);
+   }
+   unsigned long ds_cnt = rrd.stat_head->ds_cnt;
+   unsigned long step = rrd.stat_head->pdp_step;
+   time_t last_up = rrd.live_head->last_up;
+   off_t rra_start = rrdf->header_len;
+   if(verbose == 1) printf("Debug: ds count [%lu] rra count [%lu] step [%lu] last update [%lld] data offset [%lld]\n",
+                           ds_cnt, rrd.stat_head->rra_cnt, step, (long long) last_up, (long long) rra_start);
+
+   int fd = open(rrdfile, O_RDONLY);
+   if(fd == -1) {
+      printf("Error: cannot open %s for reading.\n", rrdfile);
+      exit(-1);
+   }
+
+   snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", outfile);
+   FILE *fp = fopen(tmpfile, "w");
+   if(fp == NULL) {
+      printf("Error: cannot create %s.\n", tmpfile);
+      exit(-1);
+   }
+
+   /* ------------------------------------------------------------ *
+    * Write the header and the DS names                            *
+    * ------------------------------------------------------------ */
+   rdl_header_t hdr;
+   memset(&hdr, 0, sizeof(hdr));
+   memcpy(hdr.magic, RDL_MAGIC, sizeof(hdr.magic));
+   hdr.version = RDL_VERSION;
+   hdr.ds_cnt = ds_cnt;
+   hdr.rra_cnt = rrd.stat_head->rra_cnt;
+   hdr.pdp_step = step;
+   hdr.since = since;
+   hdr.last_up = last_up;
+   int err = write_crc(fp, &hdr, sizeof(hdr), &crc);
+   for(i=0; i<ds_cnt; i++) {
+      char name[RDL_NAMSIZE];
+      memset(name, 0, sizeof(name));
+      snprintf(name, sizeof(name), "%s", rrd.ds_def[i].ds_nam);
+      err |= write_crc(fp, name, sizeof(name), &crc);
+   }
+
+   /* ------------------------------------------------------------ *
+    * For each RRA, the row at cur_row holds the time rra_end, the *
+    * rows before it go back one RRA step each. The rows after the *
+    * since time are at most two ranges in the ring buffer.        *
+    * ------------------------------------------------------------ */
+   for(i=0; i<rrd.stat_head->rra_cnt; i++) {
+      rra_def_t *rra = &rrd.rra_def[i];
+      unsigned long row_cnt = rra->row_cnt;
+      unsigned long cur_row = rrd.rra_ptr[i].cur_row;
+      time_t rra_step = step * rra->pdp_cnt;
+      time_t rra_end = last_up - (last_up % rra_step);
+      size_t rowsize = ds_cnt * sizeof(rrd_value_t);
+
+      unsigned long rows = 0;
+      if(rra_end > since) rows = (rra_end - since + rra_step - 1) / rra_step;
+      if(rows > row_cnt) rows = row_cnt;
+
+      rdl_rra_t blk;
+      memset(&blk, 0, sizeof(blk));
+      snprintf(blk.cf_nam, sizeof(blk.cf_nam), "%s", rra->cf_nam);
+      blk.pdp_cnt = rra->pdp_cnt;
+      blk.row_cnt = rows;
+      blk.first = rra_end - (time_t) (rows - 1) * rra_step;
+      err |= write_crc(fp, &blk, sizeof(blk), &crc);
+      if(verbose == 1) printf("Debug: rra [%d] %s pdp_cnt [%lu] rows [%lu] cur_row [%lu] export [%lu] rows\n",
+                              i, rra->cf_nam, rra->pdp_cnt, row_cnt, cur_row, rows);
+
+      if(rows > 0) {
+         unsigned char *buf = malloc(rows * rowsize);
+         if(buf == NULL) {
+            printf("Error: cannot allocate %lu rows.\n", rows);
+            exit(-1);
+         }
+         /* the oldest row to export, and the rows up to the ring end */
+         unsigned long first = (cur_row + row_cnt - (rows - 1)) % row_cnt;
+         unsigned long part = row_cnt - first;
+         if(part > rows) part = rows;
+         if(pread(fd, buf, part * rowsize, rra_start + first * rowsize) != (ssize_t) (part * rowsize)
+            || (rows > part && pread(fd, buf + part * rowsize, (rows - part) * rowsize, rra_start)
+                != (ssize_t) ((rows - part) * rowsize))) {
+            printf("Error: cannot read RRA %d rows from %s.\n", i, rrdfile);
+            exit(-1);
+         }
+         err |= write_crc(fp, buf, rows * rowsize, &crc);
+         free(buf);
+         total += rows;
+      }
+      rra_start += row_cnt * rowsize;
+   }
+
+   /* ------------------------------------------------------------ *
+    * Write the trailer, and move the completed file into place    *
+    * ------------------------------------------------------------ */
+   rdl_trailer_t trl;
+   memset(&trl, 0, sizeof(trl));
+   memcpy(trl.magic, RDL_ENDMAGIC, sizeof(RDL_ENDMAGIC));
+   trl.crc = crc;
+   if(fwrite(&trl, sizeof(trl), 1, fp) != 1) err = -1;
+   if(fclose(fp) != 0 || err != 0 || rename(tmpfile, outfile) != 0) {
+      printf("Error: cannot write %s.\n", outfile);
+      unlink(tmpfile);
+      exit(-1);
+   }
+   close(fd);
+   rrd_close(rrdf);
+   rrd_free(&rrd);
+
+   printf("rrddelta: exported %ld rows after %lld until %lld into %s\n",
+          total, since, (long long) last_up, outfile);
+   exit(0);
+}
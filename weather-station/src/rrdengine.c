@@ -0,0 +1,888 @@
+/* ------------------------------------------------------------ *
+ * file:        rrdengine.c                                     *
+ * purpose:     Process the latest sensor data into the RRD and *
+ *              create the graph images, replacing rrdupdate.sh *
+ *              with a single process. It reads pi-weather.conf *
+ *              once, parses var/sensor.txt, checks the values  *
+ *              for outliers against the last RRD row, sets the *
+ *              day/night flag (same calculation as daytcalc),  *
+ *              updates the RRD and renders the graphs through  *
+ *              the librrd API, without forking rrdtool.        *
+ *                                                              *
+ *              Each graph is only rendered when its new window *
+ *              end falls into a new pixel column, given by the *
+ *              graph time span / width. The daily graphs end   *
+ *              with the latest sensor data, the 3-week, yearly *
+ *              and 18-year graphs end at midnight. The render  *
+ *              time of each graph is kept in rrdengine.state.  *
+ *              The min/max htm files and daytime.htm are only  *
+ *              created once per day, after midnight.           *
+ *                                                              *
+ * return:      Returns 0 on success, and -1 on errors.         *
+ *                                                              *
+ * RRD API:     http://oss.oetiker.ch/rrdtool/doc/librrd.en.html*
+ *                                                              *
+ * cron entry:  * * * * * /home/pi/pi-ws01/bin/rrdengine        *
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ *                                                              *
+ * compile: gcc rrdengine.c -o rrdengine -lrrd -lm              *
+ * ------------------------------------------------------------ */
+#define _DEFAULT_SOURCE 1
+#define PI 3.141592
+#define ZENITH -.83
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <math.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <rrd.h>
+
+/* ------------------------------------------------------------ *
+ * Outlier limits per data source, as used with rrdupdate.sh    *
+ * ------------------------------------------------------------ */
+#define TEMPLIMIT  5
+#define HUMILIMIT  15
+#define BMPRLIMIT  12000
+/* ------------------------------------------------------------ *
+ * Max number of config file entries, and their key/value size  *
+ * ------------------------------------------------------------ */
+#define MAXCONF    64
+#define MAXCLEN    256
+/* ------------------------------------------------------------ *
+ * Max number of arguments we hand to rrd_graph_v()             *
+ * ------------------------------------------------------------ */
+#define MAXGARGS   64
+/* ------------------------------------------------------------ *
+ * Start delay in seconds, lets send-data.sh update sensor.txt  *
+ * ------------------------------------------------------------ */
+#define STARTDELAY 10
+/* ------------------------------------------------------------ *
+ * Graph widths, and the span of rrdtool "mon" and "years" used *
+ * to get the seconds per pixel column for the graph scheduler  *
+ * ------------------------------------------------------------ */
+#define GRAPHWIDTH 1119
+#define CPUGWIDTH  619
+#define MONTHSEC   2629800L
+#define YEARSEC    31557600L
+#define STATEFILE  "rrdengine.state"
+#define CPUTEMP    "/sys/class/thermal/thermal_zone0/temp"
+
+/* ------------------------------------------------------------ *
+ * Global variables and defaults                                *
+ * ------------------------------------------------------------ */
+int verbose = 0;
+int startdelay = STARTDELAY;          // seconds to wait before start
+char conffile[MAXCLEN];               // the pi-weather.conf file
+char conf_key[MAXCONF][MAXCLEN];      // the config file keys
+char conf_val[MAXCONF][MAXCLEN];      // the config file values
+int conf_cnt = 0;                     // the number of config entries
+char wdir[MAXCLEN];                   // pi-weather-dir
+char rrdfile[MAXCLEN*2];              // the weather RRD file and path
+char rpirrd[MAXCLEN*2];               // the Raspberry Pi CPU temp RRD
+char imgpath[MAXCLEN*2];              // the graph image directory
+float latitude = 0;                   // pi-weather-lat
+float longitude = 0;                  // pi-weather-lon
+long tzoffset = 0;                    // local timezone offset in sec
+time_t midnight;                      // todays local midnight
+extern char *optarg;
+extern int optind, opterr, optopt;
+
+/* ------------------------------------------------------------ *
+ * RRDtool default parameters for graph image creation          *
+ * --slope-mode -> smoothens the default stair case curves      *
+ * --units-exponent=0 -->No y-axis value scaling (Kilo/Mega)    *
+ * this is only important for hPa not showing as 1.014k         *
+ * ------------------------------------------------------------ */
+const char *graph_params[] = {
+   "--imgformat", "PNG", "--no-gridfit", "--slope-mode",
+   "--width=1119", "--height=147",
+   "--font", "AXIS:12:", "--font", "TITLE:15:",
+   "--font", "LEGEND:14:", "--font", "WATERMARK:10:",
+   "--units-exponent=0", "--border=1",
+   "--color", "SHADEA#000000", "--color", "SHADEB#000000", NULL
+};
+
+/* ------------------------------------------------------------ *
+ * The graph list. DEF: args get the RRD file set in for %s.    *
+ * ------------------------------------------------------------ */
+typedef struct {
+   const char *png;        // the image file name in web/images
+   long span;              // the graph time span in seconds
+   int width;              // the graph width in pixel (--width)
+   int tomidnight;         // 1 = graph ends at 00:00, 0 = at now
+   int rpi;                // 1 = use rpitemp.rrd, own size params
+   const char *args[32];   // the graph specific args
+} graph_t;
+
+graph_t graphs[] = {
+   { "daily_temp.png", 57600, GRAPHWIDTH, 0, 0, {
+     "--start", "-16h", "--title=Temperature", "--step=60s",
+     "DEF:temp1=%s:temp:AVERAGE", "DEF:dayt1=%s:dayt:AVERAGE",
+     "CDEF:dayt2=dayt1,0,GT,INF,UNKN,IF", "AREA:dayt2#cfcfcf",
+     "CDEF:tneg1=dayt1,0,GT,NEGINF,UNKN,IF", "AREA:tneg1#cfcfcf",
+     "CDEF:tminus=temp1,0.0,LE,temp1,UNKN,IF",
+     "CDEF:tplus=temp1,0.0,GE,temp1,UNKN,IF",
+     "AREA:tminus#004477:", "AREA:tplus#99001F:Temperature in °C",
+     "GPRINT:temp1:MIN:Min\\: %3.2lf", "GPRINT:temp1:MAX:Max\\: %3.2lf",
+     "GPRINT:temp1:LAST:Last\\: %3.2lf", NULL } },
+   { "daily_humi.png", 57600, GRAPHWIDTH, 0, 0, {
+     "--start", "-16h", "--title=Relative Humidity", "--step=60s",
+     "--upper-limit=100", "--lower-limit=0",
+     "DEF:humi1=%s:humi:AVERAGE", "DEF:dayt1=%s:dayt:AVERAGE",
+     "CDEF:dayt2=dayt1,0,GT,INF,UNKN,IF", "AREA:dayt2#cfcfcf",
+     "AREA:humi1#004477:Humidity in percent",
+     "GPRINT:humi1:MIN:Min\\: %3.2lf", "GPRINT:humi1:MAX:Max\\: %3.2lf",
+     "GPRINT:humi1:LAST:Last\\: %3.2lf", NULL } },
+   { "daily_bmpr.png", 57600, GRAPHWIDTH, 0, 0, {
+     "--start", "-16h", "--title=Barometric Pressure", "--step=60s",
+     "--alt-autoscale", "--alt-y-grid",
+     "DEF:bmpr1=%s:bmpr:AVERAGE", "DEF:dayt1=%s:dayt:AVERAGE",
+     "CDEF:bmpr2=bmpr1,100,/",
+     "CDEF:dayt2=dayt1,0,GT,INF,UNKN,IF", "AREA:dayt2#cfcfcf",
+     "AREA:bmpr2#007744:Barometric Pressure in hPa",
+     "GPRINT:bmpr2:MIN:Min\\: %3.2lf", "GPRINT:bmpr2:MAX:Max\\: %3.2lf",
+     "GPRINT:bmpr2:LAST:Last\\: %3.2lf", NULL } },
+   { "monthly_temp.png", 1814400, GRAPHWIDTH, 1, 0, {
+     "--start", "end-21d", "--end", "00:00",
+     "--title=Temperature, 3 Weeks",
+     "--x-grid", "HOUR:8:DAY:1:DAY:1:86400:%d",
+     "DEF:temp1=%s:temp:AVERAGE",
+     "CDEF:tplus=temp1,0.0,GE,temp1,UNKN,IF",
+     "CDEF:tminus=temp1,0.0,LE,temp1,UNKN,IF",
+     "AREA:tplus#99001F:Temperature in °C", "AREA:tminus#004477:",
+     "GPRINT:temp1:MIN:Min\\: %3.2lf", "GPRINT:temp1:MAX:Max\\: %3.2lf",
+     "GPRINT:temp1:LAST:Last\\: %3.2lf", NULL } },
+   { "monthly_humi.png", 1814400, GRAPHWIDTH, 1, 0, {
+     "--start", "end-21d", "--end", "00:00",
+     "--title=Relative Humidity, 3 Weeks",
+     "--x-grid", "HOUR:8:DAY:1:DAY:1:86400:%d",
+     "--upper-limit=100", "--lower-limit=0",
+     "DEF:humi1=%s:humi:AVERAGE",
+     "AREA:humi1#004477:Humidity in percent",
+     "GPRINT:humi1:MIN:Min\\: %3.2lf", "GPRINT:humi1:MAX:Max\\: %3.2lf",
+     "GPRINT:humi1:LAST:Last\\: %3.2lf", NULL } },
+   { "monthly_bmpr.png", 1814400, GRAPHWIDTH, 1, 0, {
+     "--start", "end-21d", "--end", "00:00",
+     "--title=Barometric Pressure, 3 Weeks",
+     "--x-grid", "HOUR:8:DAY:1:DAY:1:86400:%d",
+     "--alt-autoscale", "--alt-y-grid",
+     "DEF:bmpr1=%s:bmpr:AVERAGE", "CDEF:bmpr2=bmpr1,100,/",
+     "AREA:bmpr2#007744:Barometric Pressure in hPa",
+     "GPRINT:bmpr2:MIN:Min\\: %3.2lf", "GPRINT:bmpr2:MAX:Max\\: %3.2lf",
+     "GPRINT:bmpr2:LAST:Last\\: %3.2lf", NULL } },
+   { "yearly_temp.png", 18*MONTHSEC, GRAPHWIDTH, 1, 0, {
+     "--start", "end-18mon", "--end", "00:00",
+     "--x-grid", "MONTH:1:YEAR:1:MONTH:1:2592000:%b",
+     "--title=Temperature, Yearly View",
+     "DEF:temp1=%s:temp:AVERAGE",
+     "CDEF:tplus=temp1,0,GE,temp1,UNKN,IF",
+     "CDEF:tminus=temp1,0,LE,temp1,UNKN,IF",
+     "AREA:tplus#99001F:Temperature in °C", "AREA:tminus#004477:",
+     "GPRINT:temp1:MIN:Min\\: %3.2lf", "GPRINT:temp1:MAX:Max\\: %3.2lf",
+     "GPRINT:temp1:LAST:Last\\: %3.2lf", NULL } },
+   { "yearly_humi.png", 18*MONTHSEC, GRAPHWIDTH, 1, 0, {
+     "--start", "end-18mon", "--end", "00:00",
+     "--x-grid", "MONTH:1:YEAR:1:MONTH:1:2592000:%b",
+     "--title=Relative Humidity, Yearly View",
+     "--upper-limit=100", "--lower-limit=0",
+     "DEF:humi1=%s:humi:AVERAGE",
+     "AREA:humi1#004477:Humidity in percent",
+     "GPRINT:humi1:MIN:Min\\: %3.2lf", "GPRINT:humi1:MAX:Max\\: %3.2lf",
+     "GPRINT:humi1:LAST:Last\\: %3.2lf", NULL } },
+   { "yearly_bmpr.png", 18*MONTHSEC, GRAPHWIDTH, 1, 0, {
+     "--start", "end-18mon", "--end", "00:00",
+     "--x-grid", "MONTH:1:YEAR:1:MONTH:1:2592000:%b",
+     "--title=Barometric Pressure, Yearly View",
+     "--alt-autoscale", "--alt-y-grid", "--units-exponent=0",
+     "DEF:bmpr1=%s:bmpr:AVERAGE", "CDEF:bmpr2=bmpr1,100,/",
+     "AREA:bmpr2#007744:Barometric Pressure in hPa",
+     "GPRINT:bmpr2:MIN:Min\\: %3.2lf", "GPRINT:bmpr2:MAX:Max\\: %3.2lf",
+     "GPRINT:bmpr2:LAST:Last\\: %3.2lf", NULL } },
+   { "twyear_temp.png", 18*YEARSEC, GRAPHWIDTH, 1, 0, {
+     "--start", "end-18years", "--end", "00:00",
+     "--x-grid", "YEAR:1:YEAR:10:YEAR:1:31536000:%Y",
+     "--title=Temperature, 18-Year View",
+     "DEF:temp1=%s:temp:AVERAGE",
+     "CDEF:tplus=temp1,0,GE,temp1,UNKN,IF",
+     "CDEF:tminus=temp1,0,LE,temp1,UNKN,IF",
+     "AREA:tplus#99001F:Temperature in °C", "AREA:tminus#004477:",
+     "GPRINT:temp1:MIN:Min\\: %3.2lf", "GPRINT:temp1:MAX:Max\\: %3.2lf",
+     "GPRINT:temp1:LAST:Last\\: %3.2lf", NULL } },
+   { "twyear_humi.png", 18*YEARSEC, GRAPHWIDTH, 1, 0, {
+     "--start", "end-18years", "--end", "00:00",
+     "--x-grid", "YEAR:1:YEAR:10:YEAR:1:31536000:%Y",
+     "--title=Humidity, 18-Year View",
+     "--upper-limit=100", "--lower-limit=0",
+     "DEF:humi1=%s:humi:AVERAGE",
+     "AREA:humi1#004477:Humidity in percent",
+     "GPRINT:humi1:MIN:Min\\: %3.2lf", "GPRINT:humi1:MAX:Max\\: %3.2lf",
+     "GPRINT:humi1:LAST:Last\\: %3.2lf", NULL } },
+   { "twyear_bmpr.png", 18*YEARSEC, GRAPHWIDTH, 1, 0, {
+     "--start", "end-18years", "--end", "00:00",
+     "--x-grid", "YEAR:1:YEAR:10:YEAR:1:31536000:%Y",
+     "--title=Barometric Pressure, 18-Year View",
+     "--alt-autoscale", "--alt-y-grid",
+     "DEF:bmpr1=%s:bmpr:AVERAGE", "CDEF:bmpr2=bmpr1,100,/",
+     "AREA:bmpr2#007744:Barometric Pressure in hPa",
+     "GPRINT:bmpr2:MIN:Min\\: %3.2lf", "GPRINT:bmpr2:MAX:Max\\: %3.2lf",
+     "GPRINT:bmpr2:LAST:Last\\: %3.2lf", NULL } },
+   { "daily_ctmp.png", 57600, CPUGWIDTH, 0, 1, {
+     "-a", "PNG", "--start", "-16h",
+     "--title=Raspberry Pi CPU Temperature", "--step=60s",
+     "--width=619", "--height=77", "--border=1",
+     "--color", "SHADEA#000000", "--color", "SHADEB#000000",
+     "DEF:temp1=%s:temp:AVERAGE",
+     "AREA:temp1#99001F:Temperature in °C",
+     "GPRINT:temp1:MIN:Min\\: %3.2lf", "GPRINT:temp1:MAX:Max\\: %3.2lf",
+     "GPRINT:temp1:LAST:Last\\: %3.2lf", NULL } },
+   { NULL, 0, 0, 0, 0, { NULL } }
+};
+
+/* ------------------------------------------------------------ *
+ * The once per day min/max htm files created through momimax   *
+ * ------------------------------------------------------------ */
+const char *mimax_htm[4][2] = {
+   { "allmimax.htm", "-a" }, { "yearmimax.htm", "-y" },
+   { "momimax.htm", "-m" }, { "daymimax.htm", "-d" }
+};
+
+/* ------------------------------------------------------------ *
+ * The per graph scheduler state, kept in var/rrdengine.state.  *
+ * A graph is only rendered when the pixel column of its window *
+ * end moves, and each render records its time cost.            *
+ * ------------------------------------------------------------ */
+typedef struct {
+   long column;            // window end / seconds per pixel column
+   time_t rendered;        // the time of the last render
+   double last_ms;         // the last render time in milliseconds
+   double avg_ms;          // the average render time in milliseconds
+   long renders;           // the number of renders
+   long skips;             // the number of skipped runs
+} gstate_t;
+gstate_t gstate[sizeof(graphs)/sizeof(graph_t)];
+
+/* ------------------------------------------------------------ *
+ * print_usage() prints the programs commandline instructions.  *
+ * ------------------------------------------------------------ */
+void usage() {
+   static char const usage[] = "Usage: rrdengine [-c config-file] [-w seconds] [-v]\n\
+   Command line parameters have the following format:\n\
+   -c   pi-weather config file, optional, defaults to ../etc/pi-weather.conf\n\
+        relative to the rrdengine program directory\n\
+   -w   seconds to wait for send-data.sh before start, optional, default 10\n\
+   -h   optional, display this message\n\
+   -v   optional, enables debug output\n\
+   Usage examples:\n\
+./rrdengine -c /home/pi/pi-ws01/etc/pi-weather.conf -w 0 -v\n";
+   printf(usage);
+}
+
+/* ------------------------------------------------------------ *
+ * parseargs() checks the commandline arguments with C getopt   *
+ * ------------------------------------------------------------ */
+void parseargs(int argc, char* argv[]) {
+   int arg;
+   opterr = 0;
+
+   while ((arg = (int) getopt (argc, argv, "c:w:vh")) != -1)
+      switch (arg) {
+         // arg -c + config file, type: string
+         // optional, example: /home/pi/pi-ws01/etc/pi-weather.conf
+         case 'c':
+            if(verbose == 1) printf("Debug: arg -c, value %s\n", optarg);
+            snprintf(conffile, sizeof(conffile), "%s", optarg);
+            break;
+
+         // arg -w + start delay in seconds, type: int
+         // optional, example: 0
+         case 'w':
+            if(verbose == 1) printf("Debug: arg -w, value %s\n", optarg);
+            startdelay = atoi(optarg);
+            if(startdelay < 0 || startdelay > 50) {
+               printf("Error: Cannot get valid -w start delay argument.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg -v verbose, type: flag, optional
+         case 'v':
+            verbose = 1; break;
+
+         // arg -h usage, type: flag, optional
+         case 'h':
+            usage(); exit(0);
+
+         case '?':
+            if (isprint (optopt))
+               printf ("Error: Unknown option `-%c'.\n", optopt);
+            else
+               printf ("Error: Unknown option character `\\x%x'.\n", optopt);
+
+         default:
+            usage(); exit(-1);
+    }
+
+   /* ------------------------------------------------------------ *
+    * Without -c, get the config from our own program directory    *
+    * ------------------------------------------------------------ */
+   if(strlen(conffile) == 0) {
+      char exe[MAXCLEN];
+      ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe)-1);
+      if(len < 1) {
+         printf("Error: Cannot get program path, please use -c.\n");
+         exit(-1);
+      }
+      exe[len] = '\0';
+      snprintf(conffile, sizeof(conffile), "%s/../etc/pi-weather.conf", dirname(exe));
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * readconfig() loads the key=value lines of pi-weather.conf.   *
+ * Lines starting with # are comments, quotes are stripped.     *
+ * ------------------------------------------------------------ */
+void readconfig(const char *file) {
+   FILE *fp;
+   char line[MAXCLEN];
+
+   if(! (fp=fopen(file, "r"))) {
+      printf("Error: cannot find config file [%s]\n", file);
+      exit(-1);
+   }
+
+   while(fgets(line, sizeof(line), fp) != NULL && conf_cnt < MAXCONF) {
+      if(line[0] == '#') continue;
+      char *val = strchr(line, '=');
+      if(val == NULL || val == line) continue;
+      *val++ = '\0';
+      val[strcspn(val, "\r\n")] = '\0';
+      /* strip surrounding quotes, e.g. pi-weather-tzs="Asia/Tokyo" */
+      size_t vlen = strlen(val);
+      if(vlen >= 2 && val[0] == '"' && val[vlen-1] == '"') {
+         val[vlen-1] = '\0';
+         val++;
+      }
+      if(strlen(val) == 0) continue;
+      snprintf(conf_key[conf_cnt], MAXCLEN, "%s", line);
+      snprintf(conf_val[conf_cnt], MAXCLEN, "%s", val);
+      if(verbose == 1) printf("Debug: config [%s]=[%s]\n", conf_key[conf_cnt], conf_val[conf_cnt]);
+      conf_cnt++;
+   }
+   fclose(fp);
+}
+
+/* ------------------------------------------------------------ *
+ * getconfig() returns the value for key, or NULL if not found  *
+ * ------------------------------------------------------------ */
+const char *getconfig(const char *key) {
+   int i;
+   for(i=0; i<conf_cnt; i++)
+      if(strcmp(conf_key[i], key) == 0) return conf_val[i];
+   return NULL;
+}
+
+/* ------------------------------------------------------------ *
+ * checkconfig() validates the config values needed to run      *
+ * ------------------------------------------------------------ */
+void checkconfig() {
+   const char *val;
+   char *endptr;
+   struct stat st;
+
+   if((val = getconfig("pi-weather-dir")) == NULL || stat(val, &st) != 0
+      || ! S_ISDIR(st.st_mode)) {
+      printf("Error: cannot find pi-weather-dir [%s].\n", val ? val : "");
+      exit(-1);
+   }
+   snprintf(wdir, sizeof(wdir), "%s", val);
+
+   if((val = getconfig("pi-weather-rrd")) == NULL) {
+      printf("Error: cannot find pi-weather-rrd in config.\n");
+      exit(-1);
+   }
+   snprintf(rrdfile, sizeof(rrdfile), "%s/rrd/%s", wdir, val);
+   if(stat(rrdfile, &st) != 0) {
+      printf("Error: cannot find RRD database [%s].\n", rrdfile);
+      exit(-1);
+   }
+   snprintf(rpirrd, sizeof(rpirrd), "%s/rrd/rpitemp.rrd", wdir);
+   snprintf(imgpath, sizeof(imgpath), "%s/web/images", wdir);
+
+   val = getconfig("pi-weather-lat");
+   if(val == NULL || (latitude = strtof(val, &endptr), endptr == val)
+      || latitude < -90.0f || latitude > 90.0f) {
+      printf("Error: cannot get valid pi-weather-lat [%s].\n", val ? val : "");
+      exit(-1);
+   }
+   val = getconfig("pi-weather-lon");
+   if(val == NULL || (longitude = strtof(val, &endptr), endptr == val)
+      || longitude < -180.0f || longitude > 180.0f) {
+      printf("Error: cannot get valid pi-weather-lon [%s].\n", val ? val : "");
+      exit(-1);
+   }
+   if(verbose == 1) printf("Debug: rrd [%s] lat [%f] lon [%f]\n", rrdfile, latitude, longitude);
+}
+
+/* ------------------------------------------------------------ *
+ * read_sensor() parses var/sensor.txt, written by getsensor:   *
+ * 1493799157 Temp=24.46*C Humidity=35.82% Pressure=100784.00Pa *
+ * ------------------------------------------------------------ */
+int read_sensor(long long *ts, double *temp, double *humi, double *bmpr) {
+   FILE *fp;
+   char file[MAXCLEN*2];
+   char line[MAXCLEN];
+
+   snprintf(file, sizeof(file), "%s/var/sensor.txt", wdir);
+   if(! (fp=fopen(file, "r"))) {
+      printf("Error: cannot find sensor data file [%s].\n", file);
+      return -1;
+   }
+   if(fgets(line, sizeof(line), fp) == NULL) line[0] = '\0';
+   fclose(fp);
+   line[strcspn(line, "\r\n")] = '\0';
+   printf("rrdengine: Sensor Data [%s]\n", line);
+
+   int n = sscanf(line, "%lld Temp=%lf*C Humidity=%lf%% Pressure=%lf",
+                  ts, temp, humi, bmpr);
+   if(n < 1) { printf("Error getting timestamp from sensor data\n"); return -1; }
+   if(n < 2) { printf("Error getting temperature from sensor data\n"); return -1; }
+   if(n < 3) { printf("Error getting humidity from sensor data\n"); return -1; }
+   if(n < 4) { printf("Error getting pressure from sensor data\n"); return -1; }
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * get_lastrow() fetches the previous value of each data source *
+ * from the RRD in one rrd_fetch_r() call, as outlier.c does it *
+ * per data source. Values not found are set to NaN.            *
+ * ------------------------------------------------------------ */
+void get_lastrow(const char *dsname[], double oldval[], int num) {
+   time_t tend = rrd_last_r(rrdfile);
+   time_t tstart = tend - 100;
+   unsigned long step = 60;
+   unsigned long ds_cnt = 0;
+   char **ds_namv;
+   rrd_value_t *data;
+   int i, j;
+
+   for(j=0; j<num; j++) oldval[j] = NAN;
+
+   if(rrd_fetch_r(rrdfile, "AVERAGE", &tstart, &tend, &step, &ds_cnt, &ds_namv, &data) != 0) {
+      printf("Error: cannot fetch data from RRD: %s\n", rrd_get_error());
+      rrd_clear_error();
+      return;
+   }
+   if(verbose == 1) printf("Debug: rrd_fetch_r ds count=%lu step=%lu\n", ds_cnt, step);
+
+   /* the 2nd returned row holds the last stored value */
+   unsigned long rows = (tend - tstart) / step;
+   for(i=0; i<ds_cnt; i++) {
+      for(j=0; j<num; j++) {
+         if(strcmp(ds_namv[i], dsname[j]) == 0 && rows > 1)
+            oldval[j] = data[ds_cnt + i];
+      }
+      rrd_freemem(ds_namv[i]);
+   }
+   rrd_freemem(ds_namv);
+   rrd_freemem(data);
+}
+
+/* ------------------------------------------------------------ *
+ * check_outlier() compares diff of newval vs oldval to limit,  *
+ * logs an outlier into log/outlier.log, and returns 1 if it is *
+ * outside the limit.                                           *
+ * ------------------------------------------------------------ */
+int check_outlier(const char *ds, double newval, double oldval, double limit, const char *sensordata) {
+   double diff = fabs(newval - oldval);
+   if(verbose == 1) printf("Debug: %s new [%f] old [%f] diff [%f] limit [%f]\n", ds, newval, oldval, diff, limit);
+
+   if(! (diff > 0 && diff > limit)) {
+      printf("rrdengine: %s [%.2f] outlier detection OK.\n", ds, newval);
+      return 0;
+   }
+
+   printf("rrdengine: Error %s [%.2f] is a outlier.\n", ds, newval);
+   char logfile[MAXCLEN*2];
+   snprintf(logfile, sizeof(logfile), "%s/log/outlier.log", wdir);
+   FILE *log = fopen(logfile, "a");
+   if(log) {
+      char date[64];
+      time_t now = time(NULL);
+      strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S %z", localtime(&now));
+      fprintf(log, "%s [%s] -> %s outlier [%.2f].\n", date, sensordata, ds, newval);
+      fclose(log);
+   }
+   return 1;
+}
+
+/* ------------------------------------------------------------ *
+ * sun_event() is calculateSunrise()/calculateSunset() from     *
+ * daytcalc.c, returns the local time in hours. rising=1 gets   *
+ * the sunrise, rising=0 the sunset.                            *
+ * ------------------------------------------------------------ */
+float sun_event(int day, float lat, float lng, int rising) {
+   float lngHour = lng / 15.0;
+   float t = day + (((rising ? 6 : 18) - lngHour) / 24);
+   float M = (0.9856 * t) - 3.289;
+   float L = fmod(M + (1.916 * sin((PI/180)*M)) + (0.020 * sin(2 *(PI/180) * M)) + 282.634,360.0);
+   float RA = fmod(180/PI*atan(0.91764 * tan((PI/180)*L)),360.0);
+   float Lquadrant  = floor( L/90) * 90;
+   float RAquadrant = floor(RA/90) * 90;
+   RA = RA + (Lquadrant - RAquadrant);
+   RA = RA / 15;
+   float sinDec = 0.39782 * sin((PI/180)*L);
+   float cosDec = cos(asin(sinDec));
+   float cosH = (sin((PI/180)*ZENITH) - (sinDec * sin((PI/180)*lat))) / (cosDec * cos((PI/180)*lat));
+   float H = (180/PI)*acos(cosH);
+   if(rising) H = 360 - H;
+   H = H / 15;
+   float T = H + RA - (0.06571 * t) - 6.622;
+   float UT = fmod(T - lngHour,24.0);
+   UT = UT + (((float) tzoffset)/3600);
+   return UT;
+}
+
+/* ------------------------------------------------------------ *
+ * sun_times() returns the local timestamp for ts, and sets the *
+ * sunrise and sunset times of that day, same as daytcalc.c.    *
+ * ------------------------------------------------------------ */
+time_t sun_times(time_t ts, struct tm *rise, struct tm *set) {
+   time_t ttz = ts + tzoffset;
+   struct tm calc_tm = *gmtime(&ttz);
+   double hr, min;
+   int i;
+
+   for(i=0; i<2; i++) {
+      struct tm *ev = (i == 0) ? rise : set;
+      float ut = sun_event(calc_tm.tm_yday+1, latitude, longitude, i == 0);
+      min = modf(fmod(24+ut,24.0), &hr)*60;
+      memset(ev, 0, sizeof(struct tm));
+      ev->tm_year = calc_tm.tm_year;
+      ev->tm_mon = calc_tm.tm_mon;
+      ev->tm_mday = calc_tm.tm_mday;
+      ev->tm_hour = (int) hr;
+      ev->tm_min = (int) (min+0.5);
+   }
+   return ttz;
+}
+
+/* ------------------------------------------------------------ *
+ * get_dayt() returns 1 for nighttime, 0 for daytime at ts      *
+ * ------------------------------------------------------------ */
+int get_dayt(time_t ts) {
+   struct tm rise, set;
+   time_t ttz = sun_times(ts, &rise, &set);
+   time_t sunrise = timegm(&rise);
+   time_t sunset = timegm(&set);
+   int dayt = (ttz < sunrise || ttz > sunset) ? 1 : 0;
+   if(verbose == 1) printf("Debug: ts %lld sr %lld ss %lld dayt %d\n", (long long) ttz, (long long) sunrise, (long long) sunset, dayt);
+   return dayt;
+}
+
+/* ------------------------------------------------------------ *
+ * write_daytime() creates daytime.htm, same as daytcalc -f     *
+ * ------------------------------------------------------------ */
+void write_daytime(const char *file, time_t ts) {
+   struct tm rise, set;
+   char srise[6], sset[6];
+   FILE *fp;
+
+   sun_times(ts, &rise, &set);
+   long daytime = timegm(&set) - timegm(&rise);
+   strftime(srise, sizeof(srise), "%H:%M", &rise);
+   strftime(sset, sizeof(sset), "%H:%M", &set);
+
+   if(! (fp=fopen(file, "w"))) {
+      printf("Error open %s for writing.\n", file);
+      return;
+   }
+   fprintf(fp, "&nbsp; &#9788; %s &#9790; %s &#9788; &#10142; &#9790; %.2d:%.2d\n",
+           srise, sset, (int) (daytime / 3600), (int) ((daytime % 3600) / 60));
+   fclose(fp);
+}
+
+/* ------------------------------------------------------------ *
+ * is_stale() returns 1 if file is missing or older than today  *
+ * ------------------------------------------------------------ */
+int is_stale(const char *file) {
+   struct stat st;
+   if(stat(file, &st) != 0) return 1;
+   return (st.st_mtime < midnight) ? 1 : 0;
+}
+
+/* ------------------------------------------------------------ *
+ * update_rrd() writes one "ts:val:val" string into a RRD file  *
+ * ------------------------------------------------------------ */
+int update_rrd(const char *file, const char *values) {
+   const char *argv[1] = { values };
+   printf("rrdengine: update %s %s\n", file, values);
+   if(rrd_update_r(file, NULL, 1, argv) != 0) {
+      printf("Error: RRD update %s failed: %s\n", file, rrd_get_error());
+      rrd_clear_error();
+      return -1;
+   }
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * make_graph() builds the argument list for graph g and hands  *
+ * it to rrd_graph_v(), which renders the PNG in this process.  *
+ * ------------------------------------------------------------ */
+int make_graph(graph_t *g, gstate_t *gs) {
+   char *argv[MAXGARGS];
+   char png[MAXCLEN*3];
+   char defs[4][MAXCLEN*3];
+   int argc = 0, ndef = 0, i;
+
+   snprintf(png, sizeof(png), "%s/%s", imgpath, g->png);
+   argv[argc++] = "graph";
+   argv[argc++] = png;
+   if(g->rpi == 0)
+      for(i=0; graph_params[i] != NULL; i++) argv[argc++] = (char *) graph_params[i];
+
+   for(i=0; g->args[i] != NULL && argc < MAXGARGS-1; i++) {
+      if(strncmp(g->args[i], "DEF:", 4) == 0 && ndef < 4) {
+         snprintf(defs[ndef], sizeof(defs[ndef]), g->args[i], g->rpi ? rpirrd : rrdfile);
+         argv[argc++] = defs[ndef++];
+      }
+      else argv[argc++] = (char *) g->args[i];
+   }
+   argv[argc] = NULL;
+
+   if(verbose == 1) printf("Debug: Creating image %s with %d args\n", png, argc);
+   struct timespec t1, t2;
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   rrd_info_t *info = rrd_graph_v(argc, argv);
+   if(info == NULL) {
+      printf("Error: cannot create %s: %s\n", png, rrd_get_error());
+      rrd_clear_error();
+      return -1;
+   }
+   rrd_info_free(info);
+   clock_gettime(CLOCK_MONOTONIC, &t2);
+
+   /* ------------------------------------------------------------ *
+    * record the render cost for this graph                        *
+    * ------------------------------------------------------------ */
+   gs->last_ms = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_nsec - t1.tv_nsec) / 1000000.0;
+   gs->avg_ms = (gs->avg_ms * gs->renders + gs->last_ms) / (gs->renders + 1);
+   gs->renders++;
+   gs->rendered = time(NULL);
+   printf("rrdengine: Created image %s in %.1f ms\n", png, gs->last_ms);
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * read_state() loads the graph scheduler state file, one line  *
+ * per graph: png column rendered last_ms avg_ms renders skips  *
+ * ------------------------------------------------------------ */
+void read_state(const char *file) {
+   FILE *fp;
+   char line[MAXCLEN], png[MAXCLEN];
+   long column, renders, skips;
+   long long rendered;
+   double last_ms, avg_ms;
+   int i;
+
+   for(i=0; graphs[i].png != NULL; i++) gstate[i].column = -1;
+   if(! (fp=fopen(file, "r"))) return;
+
+   while(fgets(line, sizeof(line), fp) != NULL) {
+      if(sscanf(line, "%255s %ld %lld %lf %lf %ld %ld", png, &column, &rendered,
+                &last_ms, &avg_ms, &renders, &skips) != 7) continue;
+      for(i=0; graphs[i].png != NULL; i++) {
+         if(strcmp(graphs[i].png, png) != 0) continue;
+         gstate[i].column = column;
+         gstate[i].rendered = (time_t) rendered;
+         gstate[i].last_ms = last_ms;
+         gstate[i].avg_ms = avg_ms;
+         gstate[i].renders = renders;
+         gstate[i].skips = skips;
+      }
+   }
+   fclose(fp);
+}
+
+/* ------------------------------------------------------------ *
+ * write_state() saves the graph scheduler state through a temp *
+ * file and rename, so a crash never leaves a half written file *
+ * ------------------------------------------------------------ */
+void write_state(const char *file) {
+   FILE *fp;
+   char tmpfile[MAXCLEN*3];
+   int i;
+
+   snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", file);
+   if(! (fp=fopen(tmpfile, "w"))) {
+      printf("Error open %s for writing.\n", tmpfile);
+      return;
+   }
+   for(i=0; graphs[i].png != NULL; i++)
+      fprintf(fp, "%s %ld %lld %.1f %.1f %ld %ld\n", graphs[i].png, gstate[i].column,
+              (long long) gstate[i].rendered, gstate[i].last_ms, gstate[i].avg_ms,
+              gstate[i].renders, gstate[i].skips);
+   fclose(fp);
+   if(rename(tmpfile, file) != 0) printf("Error: cannot rename %s to %s.\n", tmpfile, file);
+}
+
+/* ------------------------------------------------------------ *
+ * filecopy() is the cp equivalent to copy files                *
+ * ------------------------------------------------------------ */
+int filecopy(char from[],char to[]) {
+   FILE* oldfile;
+   FILE* newfile;
+
+   if(! (oldfile=fopen(from, "r"))) {
+      printf("Error open %s for reading.\n", from);
+      return -1;
+   }
+
+   umask(022);
+   if(! (newfile=fopen(to, "w"))) {
+      printf("Error open %s for writing.\n", to);
+      fclose(oldfile);
+      return -1;
+   }
+
+   int bytes = 0;
+   for (;;) {
+      int onechar = fgetc(oldfile);
+      if (onechar != EOF) fputc(onechar,newfile);
+      else break;
+      bytes++;
+   }
+   fclose(oldfile);
+   fclose(newfile);
+   return bytes;
+}
+
+int main(int argc, char *argv[]) {
+   long long ts;
+   double temp, humi, bmpr;
+   char values[MAXCLEN];
+   char sensordata[MAXCLEN];
+   int i;
+
+   /* ------------------------------------------------------------ *
+    * Process the cmdline parameters, read and check the config    *
+    * ------------------------------------------------------------ */
+   parseargs(argc, argv);
+   if(startdelay > 0) sleep(startdelay);
+   time_t tsnow = time(NULL);
+   printf("rrdengine: Run at %s", ctime(&tsnow));
+   printf("rrdengine: Config file [%s]\n", conffile);
+   readconfig(conffile);
+   checkconfig();
+
+   /* ------------------------------------------------------------ *
+    * Get the local timezone offset and todays midnight timestamp  *
+    * ------------------------------------------------------------ */
+   struct tm lt = {0};
+   localtime_r(&tsnow, &lt);
+   tzoffset = lt.tm_gmtoff;
+   lt.tm_hour = 0; lt.tm_min = 0; lt.tm_sec = 0; lt.tm_isdst = -1;
+   midnight = mktime(&lt);
+
+   /* ------------------------------------------------------------ *
+    * Read the sensor data, check it for outliers. An outlier is   *
+    * stored as unknown (U), the same as an empty value with the   *
+    * previous rrdupdate.sh.                                       *
+    * ------------------------------------------------------------ */
+   if(read_sensor(&ts, &temp, &humi, &bmpr) != 0) exit(-1);
+   snprintf(sensordata, sizeof(sensordata), "%lld Temp=%.2f*C Humidity=%.2f%% Pressure=%.2fPa", ts, temp, humi, bmpr);
+
+   const char *dsname[3] = { "temp", "humi", "bmpr" };
+   double newval[3] = { temp, humi, bmpr };
+   double limit[3] = { TEMPLIMIT, HUMILIMIT, BMPRLIMIT };
+   double oldval[3];
+   char strval[3][32];
+
+   get_lastrow(dsname, oldval, 3);
+   for(i=0; i<3; i++) {
+      if(check_outlier(dsname[i], newval[i], oldval[i], limit[i], sensordata) == 1)
+         snprintf(strval[i], sizeof(strval[i]), "U");
+      else
+         snprintf(strval[i], sizeof(strval[i]), "%.2f", newval[i]);
+   }
+
+   /* ------------------------------------------------------------ *
+    * Set the day/night flag, TZ is taken from the local system    *
+    * ------------------------------------------------------------ */
+   int dayt = get_dayt((time_t) ts);
+   printf("rrdengine: dayt for %lld returned [%d] [%s].\n", ts, dayt, dayt ? "night" : "day");
+
+   /* ------------------------------------------------------------ *
+    * write new data into the RRD DB                               *
+    * ------------------------------------------------------------ */
+   snprintf(values, sizeof(values), "%lld:%s:%s:%s:%d", ts, strval[0], strval[1], strval[2], dayt);
+   update_rrd(rrdfile, values);
+
+   /* ------------------------------------------------------------ *
+    * Update the Raspberry Pi CPU temperature RRD                  *
+    * ------------------------------------------------------------ */
+   FILE *fp;
+   long millideg;
+   if((fp = fopen(CPUTEMP, "r")) != NULL && fscanf(fp, "%ld", &millideg) == 1) {
+      snprintf(values, sizeof(values), "%lld:%f", ts, (double) millideg / 1000);
+      update_rrd(rpirrd, values);
+   }
+   else printf("rrdengine: Error getting Raspberry Pi CPU temperature\n");
+   if(fp) fclose(fp);
+
+   /* ------------------------------------------------------------ *
+    * Create the graph images. The pixel column of the window end  *
+    * is the window end time / seconds per pixel. If it is still   *
+    * the same as for the last render, the image would not change. *
+    * ------------------------------------------------------------ */
+   char png[MAXCLEN*3], state[MAXCLEN*2];
+   snprintf(state, sizeof(state), "%s/var/%s", wdir, STATEFILE);
+   read_state(state);
+
+   for(i=0; graphs[i].png != NULL; i++) {
+      time_t wend = graphs[i].tomidnight ? midnight : (time_t) ts;
+      long column = wend / (graphs[i].span / graphs[i].width);
+      snprintf(png, sizeof(png), "%s/%s", imgpath, graphs[i].png);
+      if(column == gstate[i].column && access(png, F_OK) == 0) {
+         if(verbose == 1) printf("Debug: %s column %ld unchanged, skip\n", graphs[i].png, column);
+         gstate[i].skips++;
+         continue;
+      }
+      if(make_graph(&graphs[i], &gstate[i]) == 0) gstate[i].column = column;
+   }
+   write_state(state);
+
+   /* ------------------------------------------------------------ *
+    * Daily update of the Min/Max Temperature htm files. momimax   *
+    * runs only once per day, so we keep it as a separate program. *
+    * ------------------------------------------------------------ */
+   char htm[MAXCLEN*2], var[MAXCLEN*2], cmd[MAXCLEN*6];
+   for(i=0; i<4; i++) {
+      snprintf(htm, sizeof(htm), "%s/web/%s", wdir, mimax_htm[i][0]);
+      if(is_stale(htm) == 0) continue;
+      printf("rrdengine: Creating %s\n", htm);
+      snprintf(cmd, sizeof(cmd), "%s/bin/momimax -s %s %s %s", wdir, rrdfile, mimax_htm[i][1], htm);
+      if(system(cmd) != 0) printf("Error: [%s] failed.\n", cmd);
+      snprintf(var, sizeof(var), "%s/var/%s", wdir, mimax_htm[i][0]);
+      filecopy(htm, var);
+   }
+
+   /* ------------------------------------------------------------ *
+    * Daily update of the sunrise/sunset data file                 *
+    * ------------------------------------------------------------ */
+   snprintf(htm, sizeof(htm), "%s/web/daytime.htm", wdir);
+   if(is_stale(htm) == 1) {
+      printf("rrdengine: Creating %s\n", htm);
+      write_daytime(htm, tsnow);
+   }
+
+   tsnow = time(NULL);
+   printf("rrdengine: Finished %s", ctime(&tsnow));
+   exit(0);
+}
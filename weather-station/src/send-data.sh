@@ -62,13 +62,20 @@ TCALI=${MYCONFIG[pi-weather-tcal]} # temp correction
 PCALI=${MYCONFIG[pi-weather-pcal]} # bmpr correction
 HCALI=${MYCONFIG[pi-weather-hcal]} # humi correction
 
+# The binary frames are only collected for the upload, with
+# pi-weather-sftp=none nobody would pick up var/sensor.wsf.
+FRAMEOPT=""
+if [ "${MYCONFIG[pi-weather-sftp]}" != "none" ]; then
+   FRAMEOPT="-f $WHOME/var/sensor.wsf -i $STATION"
+fi
+
 echo "send-data.sh: Getting sensor data for $STYPE $SADDR";
 if [ "$STYPE" == "bme280" ]; then
-   EXECUTE="$WHOME/bin/getsensor -t $STYPE -a $SADDR -b $PCALI -c $TCALI -d $HCALI -j $WHOME/web/getsensor.json"
+   EXECUTE="$WHOME/bin/getsensor -t $STYPE -a $SADDR -b $PCALI -c $TCALI -d $HCALI -j $WHOME/web/getsensor.json $FRAMEOPT"
 fi
 if [ "$STYPE" == "am2302" ]; then
    GPIO=${MYCONFIG[sensor-gpio]}    # am2302/dht22 gpio pin number, e.g. 4
-   EXECUTE="$WHOME/bin/getsensor -t $STYPE -a $SADDR -p $GPIO -b $PCALI -c $TCALI -d $HCALI -o $WHOME/web/getsensor.htm"
+   EXECUTE="$WHOME/bin/getsensor -t $STYPE -a $SADDR -p $GPIO -b $PCALI -c $TCALI -d $HCALI -o $WHOME/web/getsensor.htm $FRAMEOPT"
 fi
 echo "send-data.sh: $EXECUTE";
 SENSORDATA=`$EXECUTE`
@@ -161,4 +168,28 @@ if [ -f $WHOME/etc/sftp-dat.bat ]; then
 else
    echo "send-data.sh: Cannot find $WHOME/etc/sftp-dat.bat"
 fi
+
+##########################################################
+# 5. Send the binary sensor frames. Readings are appended
+# to var/sensor.wsf until an upload succeeds, so after a
+# network outage the backlog goes in one file. The server
+# wsingest program only reads the file after the rename.
+##########################################################
+if [ -f $WHOME/var/sensor.wsf ]; then
+   FRAMES=frames-`date +%s`.wsf
+   mv $WHOME/var/sensor.wsf $WHOME/var/$FRAMES
+   echo "send-data.sh: Sending frames $FRAMES to $SFTPDEST"
+   sftp -q -b - $SFTPDEST <<EOM
+cd var
+put $WHOME/var/$FRAMES $FRAMES.tmp
+rename $FRAMES.tmp $FRAMES
+EOM
+   if [ $? == 0 ]; then
+      rm $WHOME/var/$FRAMES
+   else
+      # keep the frames for the next upload
+      cat $WHOME/var/$FRAMES >> $WHOME/var/sensor.wsf
+      rm $WHOME/var/$FRAMES
+   fi
+fi
 ############# end of send-data.sh ########################
@@ -4,7 +4,7 @@
 #
 # This script runs daily after midnight, sending two
 # files to the Internet server:
-#       1. RRD database XML export    -> var/rrdcopy.xml
+#       1. RRD database delta export  -> var/rrdcopy.delta
 #       2. daily MP4 timelapse movie  -> var/yesterday.mp4
 #
 # Please set config file path to your installations value!
@@ -47,19 +47,25 @@ WHOME=${MYCONFIG[pi-weather-dir]}
 STATION=${MYCONFIG[pi-weather-sid]}
 
 ##########################################################
-# Create a database export into $WSHOME/var/rrdcopy.xml.gz
-# Sends a nightly DB for import on the Internet server,
-# its import there clears out upload gaps should the exist
-##########################################################
-if [ -f $WHOME/var/rrdcopy.xml.gz ]; then
-   echo "`date`: Deleting old file $WHOME/var/rrdcopy.xml.gz"
-   rm $WHOME/var/rrdcopy.xml.gz
+# Create a database delta export $WHOME/var/rrdcopy.delta
+# with the RRA rows changed since the last upload, it is
+# merged on the Internet server to clear out upload gaps.
+# var/rrddelta.ts has the time of the last upload, if it
+# doesn't exist, the delta contains the full RRD data.
+# If the export fails, no delta is uploaded, and the old
+# timestamp stays so that the next run covers the gap.
+##########################################################
+DELTATS=0
+if [ -f $WHOME/var/rrddelta.ts ]; then
+   DELTATS=`cat $WHOME/var/rrddelta.ts`
 fi
+NEWTS=`rrdtool last $WHOME/rrd/weather.rrd`
 
-echo "`date`: Creating new XML export into $WHOME/var/rrdcopy.xml"
-rrdtool dump $WHOME/rrd/weather.rrd $WHOME/var/rrdcopy.xml
-echo "`date`: Compressing XML export file $WHOME/var/rrdcopy.xml"
-gzip $WHOME/var/rrdcopy.xml
+echo "`date`: Creating RRD delta export after $DELTATS into $WHOME/var/rrdcopy.delta"
+if [ -z "$NEWTS" ] || ! $WHOME/bin/rrddelta -s $WHOME/rrd/weather.rrd -t $DELTATS -o $WHOME/var/rrdcopy.delta; then
+   echo "send-night.sh: Error - RRD delta export failed, skipping the RRD upload" >&2
+   rm -f $WHOME/var/rrdcopy.delta
+fi
 
 ##########################################################
 # Check if destination is set, exit of set to "none"
@@ -72,13 +78,26 @@ fi
 SFTPDEST=$STATION@${MYCONFIG[pi-weather-sftp]}
 
 ##########################################################
-# Upload xml DB archive /tmp/rrdcopy.xml.gz to the server
+# Upload the RRD delta file, stations upgraded from the
+# XML export don't have the SFTP batch file yet.
 ##########################################################
-if [ -f $WHOME/var/rrdcopy.xml.gz ]; then
-   echo "`date`: Uploading XML export file to $SFTPDEST"
-   /usr/bin/sftp -b $WHOME/etc/sftp-xml.bat $SFTPDEST
+if [ ! -f $WHOME/etc/sftp-rrd.bat ]; then
+   cat <<EOM >$WHOME/etc/sftp-rrd.bat
+cd var
+put $WHOME/var/rrdcopy.delta rrdcopy.delta.tmp
+rename rrdcopy.delta.tmp rrdcopy.delta
+quit
+EOM
+fi
+
+if [ -f $WHOME/var/rrdcopy.delta ]; then
+   echo "`date`: Uploading RRD delta file to $SFTPDEST"
+   if /usr/bin/sftp -b $WHOME/etc/sftp-rrd.bat $SFTPDEST; then
+      echo $NEWTS > $WHOME/var/rrddelta.ts
+      rm $WHOME/var/rrdcopy.delta
+   fi
 else
-   echo "`date`: No upload, can't find $WHOME/var/rrdcopy.xml.gz"
+   echo "`date`: No upload, can't find $WHOME/var/rrdcopy.delta"
 fi
 
 ##########################################################
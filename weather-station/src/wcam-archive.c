@@ -1,5 +1,5 @@
 /* ------------------------------------------------------------ *
- * file:	wcam-archive.c v1.3                             *
+ * file:	wcam-archive.c v1.6                             *
  *                                                              *
  * author:	20170708 Frank4DD [fm4dd.com]                   *
  *                                                              *
@@ -11,16 +11,48 @@
  *              but only copies files during active time, e.g.  *
  *              between 6:00 and 22:00 o'clock.                 *
  *                                                              *
+ *              With -m link|move, frames are hardlinked or re- *
+ *              named into the archive instead of being copied. *
+ *              Link mode requires that the camera replaces the *
+ *              image file (new inode), e.g. write tmp + rename *
+ *              rewriting it in place would change the archive. *
+ *              Across filesystems, or in the default copy mode *
+ *              the kernel copies the data (copy_file_range, or *
+ *              sendfile) without passing it through userspace. *
+ *                                                              *
  *              /etc/crontab entry                              *
  *              * * * * * pi /home/bin/wcam-archive             *
  *                                                              *
- * compile:	gcc wcam-archive.c -o wcam-archive              *
+ *              With -D, it runs as daemon instead of from cron *
+ *              every minute. It watches the image folder with  *
+ *              inotify, and archives each new image as soon as *
+ *              the camera finished writing it. The archive dir *
+ *              handles stay open, the start and end hours and  *
+ *              the daily retention cleanup are handled inside. *
+ *                                                              *
+ *              /etc/crontab entry                              *
+ *              @reboot pi /home/bin/wcam-archive -D [args]     *
+ *                                                              *
+ *              Each ingested frame is appended to the day dirs *
+ *              index file wcam-index.txt, one line per frame:  *
+ *              <timestamp> <filename> <size> <brightness> <ok> *
+ *              The brightness (0..255) comes from a 1/8 scaled *
+ *              grayscale decode. Empty or broken frames are    *
+ *              not archived, but listed with status "bad", and *
+ *              a <frame>.bad marker with the size is left, so  *
+ *              cron runs do not log the same bad frame again.  *
+ *                                                              *
+ * compile:	gcc wcam-archive.c -o wcam-archive -ljpeg       *
  *                                                              *
  * v1.0 20050307 initial release                                *
  * v1.1 20160904 restrict time with hardcoded start and end hr  *
  * v1.2 20170618 convert hardcoded params to cmdline arguments  *
  * v1.3 20170708 add function for space retention after x days  *
+ * v1.4 20261019 add zero-copy ingest modes link, move, copy    *
+ * v1.5 20261019 add inotify daemon mode, keep dir handles open *
+ * v1.6 20261019 add per-day frame index file with brightness   *
  * ------------------------------------------------------------ */
+#define _GNU_SOURCE     /* for copy_file_range() */
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -30,6 +62,25 @@
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <signal.h>
+#include <libgen.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+/* ------------------------------------------------------------ *
+ * Ingest modes: how the image gets into the archive directory  *
+ * ------------------------------------------------------------ */
+#define INGEST_COPY 0             // kernel copy, source unchanged
+#define INGEST_LINK 1             // hardlink, source unchanged
+#define INGEST_MOVE 2             // rename, source gets removed
+/* ------------------------------------------------------------ *
+ * The per-day frame index file, written into each day folder   *
+ * ------------------------------------------------------------ */
+#define INDEXFILE "wcam-index.txt"
 
 /* ------------------------------------------------------------ *
  * Global variables and defaults                                *
@@ -41,6 +92,23 @@ int shour = 0;                    // the start time collect pics
 int ehour = 23;                   // the end time to collect pics
 int keepd = 0;                    // folder retention in days
                                   // if unset, 0 means unlimited
+int ingest = INGEST_COPY;         // the ingest mode, default copy
+int daemon_mode = 0;              // inotify daemon mode flag
+mode_t dirmode = 0755;            // archive folder create mode
+volatile sig_atomic_t stop = 0;   // daemon mode, set by SIGTERM
+
+/* ------------------------------------------------------------ *
+ * The archive folder handles are kept open between images. In  *
+ * daemon mode they only get re-opened when the date changes.   *
+ * ------------------------------------------------------------ */
+int base_fd = -1;                 // archive base folder handle
+int year_fd = -1;                 // archive year folder handle
+int mon_fd = -1;                  // archive month folder handle
+int day_fd = -1;                  // archive day folder handle
+char open_year[5];                // the year of year_fd
+char open_mon[3];                 // the month of mon_fd
+char open_day[3];                 // the day of day_fd
+static const char *ingest_name[] = { "copy", "link", "move" };
 
 /* ------------------------------------------------------------ *
  * print_usage() prints the programs commandline instructions.  *
@@ -54,11 +122,16 @@ Command line parameters have the following format:\n\
    -e   end hour to stop creating the archive file, example: 21\n\
    -r   optional: retention days, delete folders older than today-x, example: 30\n\
         if unset, data grows approx 150MB/day and needs outside housekeeping.\n\
+   -m   optional: ingest mode copy, link or move, default: copy\n\
+        link and move avoid the data copy if image and archive share a filesystem.\n\
+   -D   optional: run as daemon, archive each new image file as soon as it is written\n\
    -v   verbose output flag\n\
    -h   print usage flag\n\n\
 Usage example:\n\
 ./wcam-archive -i /home/pi/pi-ws01/var/raspicam.jpg -d /home/pi/pi-ws01/web/wcam-arch -s 6 -e 21 -v\n\
-./wcam-archive -i /home/pi/pi-ws01/var/raspicam.jpg -d /home/pi/pi-ws01/web/wcam-arch -s 6 -e 21 -r 30 -v\n";
+./wcam-archive -i /home/pi/pi-ws01/var/raspicam.jpg -d /home/pi/pi-ws01/web/wcam-arch -s 6 -e 21 -r 30 -v\n\
+./wcam-archive -i /home/pi/pi-ws01/var/raspicam.jpg -d /home/pi/pi-ws01/web/wcam-arch -s 6 -e 21 -m link\n\
+./wcam-archive -i /home/pi/pi-ws01/var/raspicam.jpg -d /home/pi/pi-ws01/web/wcam-arch -s 6 -e 21 -r 30 -D\n";
    printf(usage);
 }
 
@@ -71,7 +144,7 @@ void parseargs(int argc, char* argv[]) {
 
    if(argc == 1) { usage(); exit(-1); }
 
-   while ((arg = (int) getopt (argc, argv, "i:d:s:e:r:vh")) != -1)
+   while ((arg = (int) getopt (argc, argv, "i:d:s:e:r:m:Dvh")) != -1)
       switch (arg) {
          // arg -i + source image file, type: string
          // mandatory, example: pi-ws01/var/raspicam.jpg
@@ -108,6 +181,23 @@ void parseargs(int argc, char* argv[]) {
             keepd = atoi(optarg);
             break;
 
+         // arg -m ingest mode, type: string
+         // optional, example: link
+         case 'm':
+            if(verbose == 1) printf("Debug: arg -m, value %s\n", optarg);
+            if(strcmp(optarg, "copy") == 0) ingest = INGEST_COPY;
+            else if(strcmp(optarg, "link") == 0) ingest = INGEST_LINK;
+            else if(strcmp(optarg, "move") == 0) ingest = INGEST_MOVE;
+            else {
+               printf("Error: Unknown ingest mode [%s], use copy, link or move.\n", optarg);
+               exit(-1);
+            }
+            break;
+
+         // arg -D daemon mode, type: flag, optional
+         case 'D':
+            daemon_mode = 1; break;
+
          // arg -v verbose, type: flag, optional
          case 'v':
             verbose = 1; break;
@@ -128,181 +218,547 @@ void parseargs(int argc, char* argv[]) {
 }
 
 /* ------------------------------------------------------------ *
- * filecopy() is the cp equivalent to copy files                *
+ * kernelcopy() copies the file data inside the kernel. It uses *
+ * copy_file_range(), falls back to sendfile() if unsupported,  *
+ * and then to plain read/write. Returns the bytes, -1 on error *
+ * ------------------------------------------------------------ */
+long kernelcopy(int src, int dst, off_t size) {
+   long bytes = 0;
+   ssize_t ret = 0;
+   char buf[65536];
+
+   while(bytes < size) {
+      ret = copy_file_range(src, NULL, dst, NULL, size-bytes, 0);
+      if(ret <= 0) break;
+      bytes += ret;
+   }
+   if(bytes == size) return bytes;
+   if(ret < 0 && bytes == 0 && (errno == ENOSYS || errno == EXDEV
+      || errno == EINVAL || errno == EOPNOTSUPP)) {
+      if(verbose == 1) printf("Debug: copy_file_range unsupported, using sendfile\n");
+      while(bytes < size) {
+         ret = sendfile(dst, src, NULL, size-bytes);
+         if(ret <= 0) break;
+         bytes += ret;
+      }
+      if(bytes == size) return bytes;
+   }
+   if(ret < 0 && bytes == 0 && (errno == EINVAL || errno == ENOSYS)) {
+      if(verbose == 1) printf("Debug: sendfile unsupported, using read/write\n");
+      while((ret = read(src, buf, sizeof(buf))) > 0) {
+         if(write(dst, buf, ret) != ret) return -1;
+         bytes += ret;
+      }
+   }
+   if(ret < 0) return -1;
+   return bytes;
+}
+
+/* ------------------------------------------------------------ *
+ * ingest_file() puts the image into the archive folder dirfd.  *
+ * Link and move modes only create a new directory entry, they  *
+ * fall back to a kernel copy if the archive is on another file *
+ * system. Only the directory gets fsync'ed, which persists the *
+ * new entry. Returns the image size in bytes, or -1 for error. *
  * ------------------------------------------------------------ */
-int filecopy(char from[],char to[]) {
-   FILE* oldfile;
-   FILE* newfile;
+long ingest_file(const char *from, int dirfd, const char *name, int mode) {
+   struct stat src_stat;
+   long bytes = -1;
+   int unlink_src = 0;
 
-   if(! (oldfile=fopen(from, "r"))) {
-      printf("Error open %s for writing.\n", from);
+   if(stat(from, &src_stat) == -1) {
+      printf("Error: Cannot stat %s: %s\n", from, strerror(errno));
       return -1;
    }
 
-   umask(022);
-   if(! (newfile=fopen(to, "w"))) {
-      printf("Error open %s for writing.\n", to);
-      return -1;
+   /* an existing archive file (same second) gets replaced */
+   if(unlinkat(dirfd, name, 0) == 0 && verbose == 1)
+      printf("Debug: Replacing existing archive file [%s]\n", name);
+
+   if(mode == INGEST_LINK) {
+      if(linkat(AT_FDCWD, from, dirfd, name, 0) == 0) bytes = src_stat.st_size;
+      else if(errno == EXDEV || errno == EPERM || errno == EMLINK) {
+         if(verbose == 1) printf("Debug: Cannot link (%s), using copy\n", strerror(errno));
+         mode = INGEST_COPY;
+      }
+      else printf("Error: Cannot link %s: %s\n", from, strerror(errno));
    }
 
-   int bytes = 0;
-   for (;;) {
-      int onechar = fgetc(oldfile);
-      if (onechar != EOF) fputc(onechar,newfile);
-      else break;
-      bytes++;
+   if(mode == INGEST_MOVE) {
+      if(renameat(AT_FDCWD, from, dirfd, name) == 0) bytes = src_stat.st_size;
+      else if(errno == EXDEV) {
+         if(verbose == 1) printf("Debug: Cannot rename across filesystems, using copy\n");
+         mode = INGEST_COPY;
+         unlink_src = 1;
+      }
+      else printf("Error: Cannot rename %s: %s\n", from, strerror(errno));
+   }
+
+   if(mode == INGEST_COPY) {
+      int src = open(from, O_RDONLY);
+      if(src == -1) {
+         printf("Error open %s for reading.\n", from);
+         return -1;
+      }
+      int dst = openat(dirfd, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if(dst == -1) {
+         printf("Error open %s for writing.\n", name);
+         close(src);
+         return -1;
+      }
+      bytes = kernelcopy(src, dst, src_stat.st_size);
+      /* keep the source mtime, it identifies the image later */
+      struct timespec times[2] = { src_stat.st_atim, src_stat.st_mtim };
+      futimens(dst, times);
+      close(dst);
+      close(src);
+      if(bytes != src_stat.st_size) {
+         printf("Error: Copied %ld of %lld bytes to %s.\n", bytes, (long long) src_stat.st_size, name);
+         unlinkat(dirfd, name, 0);
+         return -1;
+      }
+      if(unlink_src == 1) unlink(from);
    }
-   fclose(oldfile);
-   fclose(newfile);
+
+   if(bytes >= 0) fsync(dirfd);
    return bytes;
 }
 
-int main(int argc, char *argv[]) {
+/* ------------------------------------------------------------ *
+ * open_subdir() opens the sub folder "name" below the parent   *
+ * handle, and creates it with mode first unless it is there.   *
+ * ------------------------------------------------------------ */
+int open_subdir(int parent, const char *name, int fd, mode_t mode) {
+  if(fd != -1) close(fd);
+  if(mkdirat(parent, name, mode) == -1 && errno != EEXIST) {
+    printf("Error: Cannot create archive dir %s: %s\n", name, strerror(errno));
+    return -1;
+  }
+  fd = openat(parent, name, O_RDONLY | O_DIRECTORY);
+  if(fd == -1) printf("Error: Cannot open archive dir %s: %s\n", name, strerror(errno));
+  return fd;
+}
 
-  time_t wcam_tstamp;
-  struct stat wcam_stat;
-  struct stat arch_stat;
-  char wcam_ydir[261];
-  char wcam_mdir[264];
-  char wcam_ddir[267];
-  char wcam_name[26];
-  char newfile[300];
-  mode_t mode;
+/* ------------------------------------------------------------ *
+ * open_daydir() returns the handle of the <year><month><day>   *
+ * archive folder for the timestamp, creating it if necessary.  *
+ * Already open handles for the same date are returned as-is.   *
+ * ------------------------------------------------------------ */
+int open_daydir(time_t tstamp) {
   char year[5];
   char month[3];
   char day[3];
-  char hourstr[3];
-  int hour;
+  struct tm tm = * localtime(&tstamp);
 
-  /* ------------------------------------------------------------ *
-   * Process the cmdline parameters                               *
-   * ------------------------------------------------------------ */
-  parseargs(argc, argv);
+  strftime(year, sizeof(year), "%Y", &tm);
+  strftime(month, sizeof(month), "%m", &tm);
+  strftime(day, sizeof(day), "%d", &tm);
 
-  /* ------------------------------------------------------------ *
-   * Check if our dst base directory exists                       *
-   * ------------------------------------------------------------ */
-  if (stat(archive, &wcam_stat) == -1) {
-    if(verbose == 1) printf("Debug: Cannot find archive dir %s\n", archive);
-    exit(-1);
+  if(year_fd == -1 || strcmp(year, open_year) != 0) {
+    if((year_fd = open_subdir(base_fd, year, year_fd, dirmode)) == -1) return -1;
+    strcpy(open_year, year);
+    open_mon[0] = '\0';
+  }
+  if(mon_fd == -1 || strcmp(month, open_mon) != 0) {
+    if((mon_fd = open_subdir(year_fd, month, mon_fd, dirmode)) == -1) return -1;
+    strcpy(open_mon, month);
+    open_day[0] = '\0';
+  }
+  if(day_fd == -1 || strcmp(day, open_day) != 0) {
+    if((day_fd = open_subdir(mon_fd, day, day_fd, dirmode)) == -1) return -1;
+    strcpy(open_day, day);
+    if(verbose == 1) printf("Debug: Opened archive dir [%s/%s/%s/%s]\n", archive, year, month, day);
+  }
+  return day_fd;
+}
+
+/* ------------------------------------------------------------ *
+ * libjpeg error handler: jump back instead of calling exit()   *
+ * ------------------------------------------------------------ */
+struct jpeg_jmp_mgr {
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+};
+
+void jpeg_jmp_exit(j_common_ptr cinfo) {
+  struct jpeg_jmp_mgr *err = (struct jpeg_jmp_mgr *) cinfo->err;
+  longjmp(err->setjmp_buffer, 1);
+}
+
+/* ------------------------------------------------------------ *
+ * jpg_brightness() returns the mean luma 0..255 of a jpg file. *
+ * The image gets decoded as grayscale at 1/8 scale, which only *
+ * needs the DC coefficients. Returns -1 if the file is broken. *
+ * ------------------------------------------------------------ */
+int jpg_brightness(const char *file) {
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_jmp_mgr jerr;
+  unsigned long long sum = 0;
+  unsigned long pixels = 0;
+  FILE *fp;
+
+  if((fp = fopen(file, "rb")) == NULL) return -1;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = jpeg_jmp_exit;
+  if(setjmp(jerr.setjmp_buffer)) {
+    jpeg_destroy_decompress(&cinfo);
+    fclose(fp);
+    return -1;
   }
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, fp);
+  jpeg_read_header(&cinfo, TRUE);
+  cinfo.out_color_space = JCS_GRAYSCALE;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = 8;
+  cinfo.dct_method = JDCT_IFAST;
+  jpeg_start_decompress(&cinfo);
+
+  JSAMPARRAY row = (*cinfo.mem->alloc_sarray)
+                   ((j_common_ptr) &cinfo, JPOOL_IMAGE, cinfo.output_width, 1);
+  while(cinfo.output_scanline < cinfo.output_height) {
+    jpeg_read_scanlines(&cinfo, row, 1);
+    unsigned int x;
+    for(x = 0; x < cinfo.output_width; x++) sum += row[0][x];
+    pixels += cinfo.output_width;
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  fclose(fp);
+  if(pixels == 0) return -1;
+  return (int) (sum / pixels);
+}
+
+/* ------------------------------------------------------------ *
+ * write_index() appends one frame line to the day index file.  *
+ * A single write() on an O_APPEND handle keeps lines complete. *
+ * ------------------------------------------------------------ */
+void write_index(int dirfd, time_t tstamp, const char *name, long size, int bright) {
+  char line[128];
+  int fd = openat(dirfd, INDEXFILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+  if(fd == -1) {
+    printf("Error: Cannot open index file %s: %s\n", INDEXFILE, strerror(errno));
+    return;
+  }
+  int len = snprintf(line, sizeof(line), "%lld %s %ld %d %s\n", (long long) tstamp,
+                     name, size, bright, (bright < 0) ? "bad" : "ok");
+  if(write(fd, line, len) != len)
+    printf("Error: Cannot write index file %s: %s\n", INDEXFILE, strerror(errno));
+  close(fd);
+}
+
+/* ------------------------------------------------------------ *
+ * bad_frame() checks for the .bad marker of a rejected frame,  *
+ * it holds the frame size. With mark=1, it creates the marker. *
+ * Returns 1 if the frame with this size was rejected before.   *
+ * ------------------------------------------------------------ */
+int bad_frame(int dirfd, const char *name, off_t size, int mark) {
+  char marker[32], line[32];
+  snprintf(marker, sizeof(marker), "%.20s.bad", name);
+
+  if(mark == 1) {
+    int fd = openat(dirfd, marker, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1) return 0;
+    int len = snprintf(line, sizeof(line), "%lld\n", (long long) size);
+    if(write(fd, line, len) != len)
+      printf("Error: Cannot write marker %s: %s\n", marker, strerror(errno));
+    close(fd);
+    return 1;
+  }
+  int fd = openat(dirfd, marker, O_RDONLY);
+  if(fd == -1) return 0;
+  ssize_t len = read(fd, line, sizeof(line)-1);
+  close(fd);
+  if(len <= 0) return 0;
+  line[len] = '\0';
+  return (strtoll(line, NULL, 10) == (long long) size);
+}
+
+/* ------------------------------------------------------------ *
+ * archive_image() checks the image time against the start and  *
+ * end hour, and ingests the image into the archive day folder. *
+ * Returns the bytes archived, 0 if outside hours or if it was  *
+ * already archived, -1 on error.                               *
+ * ------------------------------------------------------------ */
+long archive_image(time_t wcam_tstamp, off_t wcam_size) {
+  char wcam_name[26];
+  struct tm tm = * localtime(&wcam_tstamp);
 
   /* ------------------------------------------------------------ *
-   * Check if our source img file exists                          *
+   * Check if the imgfile time is between start hour and end hour * 
+   * and return if the time is outside operational hours.         *
    * ------------------------------------------------------------ */
-  if (stat(imgfile, &wcam_stat) == -1) {
-    if(verbose == 1) printf("Debug: Cannot find raspicam file %s\n", imgfile);
-    exit(-1);
+  if(tm.tm_hour < shour || tm.tm_hour > (ehour-1)) {
+    if(verbose == 1) printf("Debug: File creation hour %d is outside %d..%d\n", tm.tm_hour, shour, ehour);
+    return 0;
   }
+  if(verbose == 1) printf("Debug: File creation hour %d is between %d..%d\n", tm.tm_hour, shour, ehour);
 
   /* ------------------------------------------------------------ *
-   * Get the image files creation time stamp                      *
+   * Create archive file name, format <wcam-yyyymmdd_hhmmss.jpg>  *
    * ------------------------------------------------------------ */
-  wcam_tstamp = wcam_stat.st_mtime;
+  strftime(wcam_name, sizeof(wcam_name), "wcam-%Y%m%d_%H%M%S.jpg", &tm);
+  if(verbose == 1) printf("Debug: Archive file name is [%s]\n", wcam_name);
 
-  strftime(hourstr, sizeof(hourstr), "%H", localtime(&wcam_tstamp));
-  hour = atoi(hourstr);
+  /* ------------------------------------------------------------ *
+   * Get archive directory structure <base><year><month><day>     *
+   * ------------------------------------------------------------ */
+  int ddir_fd = open_daydir(wcam_tstamp);
+  if(ddir_fd == -1) return -1;
 
   /* ------------------------------------------------------------ *
-   * Check if the imgfile time is between start hour and end hour * 
-   * and exit if the time is outside operational hours.           *
+   * In cron mode, an unchanged raspicam.jpg is seen again. If it *
+   * is archived with the same mtime and size, we are done, and   *
+   * the index does not get a duplicate line.                     *
    * ------------------------------------------------------------ */
-  if(hour < shour || hour > (ehour-1)) {
-    if(verbose == 1) printf("Debug: File creation hour %d is outside %d..%d\n", hour, shour, ehour);
-    exit(0);
+  struct stat arch_stat;
+  if(fstatat(ddir_fd, wcam_name, &arch_stat, 0) == 0
+     && arch_stat.st_mtime == wcam_tstamp && arch_stat.st_size == wcam_size) {
+    if(verbose == 1) printf("Debug: Image [%s] is already archived\n", wcam_name);
+    return 0;
+  }
+  if(bad_frame(ddir_fd, wcam_name, wcam_size, 0) == 1) {
+    if(verbose == 1) printf("Debug: Image [%s] was already rejected\n", wcam_name);
+    return 0;
   }
-  if(verbose == 1) printf("Debug: File creation hour %d is between %d..%d\n", hour, shour, ehour);
 
   /* ------------------------------------------------------------ *
-   * Create archive file name, format <wcam-yyyymmdd_hhmmss.jpg>  *
+   * Get the frame brightness before the source is moved away. An *
+   * empty or broken frame is only listed in the index as "bad",  *
+   * and gets a marker so that it is rejected only once.          *
    * ------------------------------------------------------------ */
-  strftime(wcam_name, sizeof(wcam_name), "wcam-%Y%m%d_%H%M%S.jpg", localtime(&wcam_tstamp));
-  if(verbose == 1) printf("Debug: Archive file name is [%s]\n", wcam_name);
+  int bright = -1;
+  if(wcam_size > 0) bright = jpg_brightness(imgfile);
+  if(verbose == 1) printf("Debug: Image size [%lld] brightness [%d]\n", (long long) wcam_size, bright);
+  if(bright < 0) {
+    printf("Error: Image [%s] is empty or broken, size [%lld]\n", imgfile, (long long) wcam_size);
+    write_index(ddir_fd, wcam_tstamp, wcam_name, (long) wcam_size, bright);
+    bad_frame(ddir_fd, wcam_name, wcam_size, 1);
+    return -1;
+  }
 
   /* ------------------------------------------------------------ *
-   * Create archive directory structure <base><year><month><day>  *
-   * unless it is already there.                                  *
+   * ingest the image file from temp to archive                   *
    * ------------------------------------------------------------ */
-  mode= 0777 & ~umask(0);
+  long bytes=ingest_file(imgfile, ddir_fd, wcam_name, ingest);
+  if(bytes > 0) {
+    if(verbose == 1) printf("Debug: Ingested [%ld] bytes to [%s/%s/%s/%s/%s] with mode %s\n",
+                            bytes, archive, open_year, open_mon, open_day, wcam_name, ingest_name[ingest]);
+  }
+  else {
+    printf ("Error: Could not %s [%s] to [%s].\n", ingest_name[ingest], imgfile, wcam_name);
+    return -1;
+  }
+  write_index(ddir_fd, wcam_tstamp, wcam_name, bytes, bright);
+  return bytes;
+}
+
+/* ------------------------------------------------------------ *
+ * retention() deletes old archive directories (past retention  *
+ * time in days) for disk space housekeeping (if it exists).    *
+ * ------------------------------------------------------------ */
+void retention() {
+  struct stat arch_stat;
+  char wcam_ydir[261];
+  char wcam_mdir[264];
+  char wcam_ddir[267];
+  char year[5];
+  char month[3];
+  char day[3];
 
-  strftime(year, sizeof(year), "%Y", localtime(&wcam_tstamp));
-  strftime(month, sizeof(month), "%m", localtime(&wcam_tstamp));
-  strftime(day, sizeof(day), "%d", localtime(&wcam_tstamp));
+  time_t reten_tstamp = (time(NULL) - (keepd * 86400));
+  strftime(year, sizeof(year), "%Y", localtime(&reten_tstamp));
+  strftime(month, sizeof(month), "%m", localtime(&reten_tstamp));
+  strftime(day, sizeof(day), "%d", localtime(&reten_tstamp));
+  int dircount = 0;
+  int filecount = 0;
 
+  if(verbose == 1) printf("Debug: Delete files from [%s-%s-%s]\n", year, month, day);
   snprintf(wcam_ydir, sizeof(wcam_ydir), "%s/%s", archive, year);
-  if(stat(wcam_ydir, &arch_stat) == -1) mkdir(wcam_ydir, mode);
 
-  snprintf(wcam_mdir, sizeof(wcam_mdir), "%s/%s/%s", archive, year, month);
-  if(stat(wcam_mdir, &arch_stat) == -1) mkdir(wcam_mdir, mode);
+  if(stat(wcam_ydir, &arch_stat) == 0) {
+    snprintf(wcam_mdir, sizeof(wcam_mdir), "%s/%s/%s", archive, year, month);
+
+    if(stat(wcam_mdir, &arch_stat) == 0) {
+      snprintf(wcam_ddir, sizeof(wcam_ddir), "%s/%s/%s/%s", archive, year, month, day);
 
-  snprintf(wcam_ddir, sizeof(wcam_ddir), "%s/%s/%s/%s", archive, year, month, day);
-  if(stat(wcam_ddir, &arch_stat) == -1) mkdir(wcam_ddir, mode);
+      if(stat(wcam_ddir, &arch_stat) == 0) {
+        if(verbose == 1) printf("Debug: Found expired image folder [%s]\n", wcam_ddir);
+        DIR *reten_dir = opendir(wcam_ddir);
+        struct dirent *next_file;
+        char filepath[1024];
+
+        while ((next_file = readdir(reten_dir)) != NULL) {
+          snprintf(filepath, sizeof(filepath), "%s/%s", wcam_ddir, next_file->d_name);
+          unlink(filepath);
+          filecount++;
+        }
+        closedir(reten_dir);
+        if(verbose == 1) printf("Debug: Deleted %d images in folder [%s]\n", filecount, wcam_ddir);
+        rmdir(wcam_ddir);
+        if(verbose == 1) printf("Debug: Deleted image folder [%s]\n", wcam_ddir);
+        dircount++;
+      }
+      if(strcmp(day, "01") == 0) {
+        rmdir(wcam_mdir);
+        if(verbose == 1) printf("Debug: Deleted image folder [%s]\n", wcam_mdir);
+        dircount++;
+      }
+    }
+    if((strcmp(month, "01") == 0) && (strcmp(day, "01") == 0)) {
+        rmdir(wcam_ydir);
+        if(verbose == 1) printf("Debug: Deleted image folder [%s]\n", wcam_ydir);
+        dircount++;
+    }
+  }
+  if(verbose == 1 && dircount == 0 && filecount == 0) printf("Debug: Nothing to delete.\n");
+}
+
+/* ------------------------------------------------------------ *
+ * sig_stop() ends the daemon loop on SIGTERM and SIGINT        *
+ * ------------------------------------------------------------ */
+void sig_stop(int sig) {
+  stop = 1;
+}
+
+/* ------------------------------------------------------------ *
+ * run_daemon() watches the image folder with inotify. A watch  *
+ * on the folder (not the file) also sees images that the cam   *
+ * writes to a temp file and renames. New images are archived   *
+ * as soon as they are closed or moved in. Duplicate events for *
+ * the same image time stamp are skipped.                       *
+ * ------------------------------------------------------------ */
+int run_daemon() {
+  char imgdir[256];
+  char imgname[256];
+  char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  struct stat wcam_stat;
+  time_t last_tstamp = 0;
+  int last_yday = -1;
+
+  char tmp[256];
+  snprintf(tmp, sizeof(tmp), "%s", imgfile);
+  snprintf(imgdir, sizeof(imgdir), "%s", dirname(tmp));
+  snprintf(tmp, sizeof(tmp), "%s", imgfile);
+  snprintf(imgname, sizeof(imgname), "%s", basename(tmp));
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = sig_stop;
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGINT, &sa, NULL);
+
+  int ifd = inotify_init1(IN_CLOEXEC);
+  if(ifd == -1) {
+    printf("Error: inotify_init1 failed: %s\n", strerror(errno));
+    return -1;
+  }
+  if(inotify_add_watch(ifd, imgdir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+    printf("Error: Cannot watch folder %s: %s\n", imgdir, strerror(errno));
+    close(ifd);
+    return -1;
+  }
+  printf("wcam-archive: daemon watching [%s] for [%s], hours %d..%d\n", imgdir, imgname, shour, ehour);
+  fflush(stdout);
+
+  while(stop == 0) {
+    ssize_t len = read(ifd, buf, sizeof(buf));
+    if(len <= 0) {
+      if(len == -1 && errno == EINTR) continue;
+      printf("Error: inotify read failed: %s\n", strerror(errno));
+      break;
+    }
+
+    /* ------------------------------------------------------------ *
+     * Check the event list if our image file was (re)written       *
+     * ------------------------------------------------------------ */
+    int newimg = 0;
+    char *ptr;
+    for(ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event *) ptr)->len) {
+      struct inotify_event *event = (struct inotify_event *) ptr;
+      if(event->len > 0 && strcmp(event->name, imgname) == 0) newimg = 1;
+    }
+    if(newimg == 0) continue;
+
+    if(stat(imgfile, &wcam_stat) == -1) {
+      if(verbose == 1) printf("Debug: Cannot find raspicam file %s\n", imgfile);
+      continue;
+    }
+    if(wcam_stat.st_mtime == last_tstamp) {
+      if(verbose == 1) printf("Debug: Skip duplicate event for image time %lld\n", (long long) last_tstamp);
+      continue;
+    }
+    last_tstamp = wcam_stat.st_mtime;
+    archive_image(last_tstamp, wcam_stat.st_size);
+
+    /* ------------------------------------------------------------ *
+     * Once per day, run the retention cleanup for the archive      *
+     * ------------------------------------------------------------ */
+    struct tm tm = * localtime(&last_tstamp);
+    if(keepd > 0 && tm.tm_yday != last_yday) retention();
+    last_yday = tm.tm_yday;
+    fflush(stdout);
+  }
+
+  close(ifd);
+  printf("wcam-archive: daemon stopped\n");
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+
+  time_t wcam_tstamp;
+  struct stat wcam_stat;
 
   /* ------------------------------------------------------------ *
-   * copy the image file from temp to archive                     *
+   * Process the cmdline parameters                               *
    * ------------------------------------------------------------ */
-  snprintf(newfile, sizeof(newfile), "%s/%s", wcam_ddir, wcam_name);
-  if(verbose == 1) printf("Debug: Archive file name and path is [%s]\n", newfile);
+  parseargs(argc, argv);
 
-  int bytes=filecopy(imgfile, newfile);
-  if(bytes > 0) {
-    if(verbose == 1) printf("Debug: Copied [%d] bytes to [%s]\n", bytes, newfile);
+  /* ------------------------------------------------------------ *
+   * Read the umask once, umask() can only be read by setting it. *
+   * Archive folders get created with the mode it leaves us.      *
+   * ------------------------------------------------------------ */
+  mode_t mask = umask(0);
+  umask(mask);
+  dirmode = 0777 & ~mask;
+
+  /* ------------------------------------------------------------ *
+   * Check if our dst base directory exists, and keep it open     *
+   * ------------------------------------------------------------ */
+  base_fd = open(archive, O_RDONLY | O_DIRECTORY);
+  if (base_fd == -1) {
+    if(verbose == 1) printf("Debug: Cannot find archive dir %s\n", archive);
+    exit(-1);
   }
-  else {
-    printf ("Error: Could not copy [%s] to [%s].\n", imgfile, newfile);
+
+  /* ------------------------------------------------------------ *
+   * In daemon mode, process new images until we get stopped      *
+   * ------------------------------------------------------------ */
+  if(daemon_mode == 1) {
+    if(run_daemon() != 0) exit(-1);
+    exit(0);
+  }
+
+  /* ------------------------------------------------------------ *
+   * Check if our source img file exists                          *
+   * ------------------------------------------------------------ */
+  if (stat(imgfile, &wcam_stat) == -1) {
+    if(verbose == 1) printf("Debug: Cannot find raspicam file %s\n", imgfile);
+    exit(-1);
   }
 
+  /* ------------------------------------------------------------ *
+   * Get the image files creation time stamp, and archive it      *
+   * ------------------------------------------------------------ */
+  wcam_tstamp = wcam_stat.st_mtime;
+  if(archive_image(wcam_tstamp, wcam_stat.st_size) == 0) exit(0);
+
   /* ------------------------------------------------------------ *
    * Delete old archive directories (past retention time in days) *
    * for disk space housekeeping (if it exists).                  *
    * ------------------------------------------------------------ */
-  if(keepd > 0) {
-    time_t reten_tstamp = (time(NULL) - (keepd * 86400));
-    strftime(year, sizeof(year), "%Y", localtime(&reten_tstamp));
-    strftime(month, sizeof(month), "%m", localtime(&reten_tstamp));
-    strftime(day, sizeof(day), "%d", localtime(&reten_tstamp));
-    int dircount = 0;
-    int filecount = 0;
-
-    if(verbose == 1) printf("Debug: Delete files from [%s-%s-%s]\n", year, month, day);
-    snprintf(wcam_ydir, sizeof(wcam_ydir), "%s/%s", archive, year);
-
-    if(stat(wcam_ydir, &arch_stat) == 0) {
-      snprintf(wcam_mdir, sizeof(wcam_mdir), "%s/%s/%s", archive, year, month);
-
-      if(stat(wcam_mdir, &arch_stat) == 0) {
-        snprintf(wcam_ddir, sizeof(wcam_ddir), "%s/%s/%s/%s", archive, year, month, day);
-
-        if(stat(wcam_ddir, &arch_stat) == 0) {
-          if(verbose == 1) printf("Debug: Found expired image folder [%s]\n", wcam_ddir);
-          DIR *reten_dir = opendir(wcam_ddir);
-          struct dirent *next_file;
-          char filepath[1024];
-
-          while ((next_file = readdir(reten_dir)) != NULL) {
-            snprintf(filepath, sizeof(filepath), "%s/%s", wcam_ddir, next_file->d_name);
-            unlink(filepath);
-            filecount++;
-          }
-          closedir(reten_dir);
-          if(verbose == 1) printf("Debug: Deleted %d images in folder [%s]\n", filecount, wcam_ddir);
-          rmdir(wcam_ddir);
-          if(verbose == 1) printf("Debug: Deleted image folder [%s]\n", wcam_ddir);
-          dircount++;
-        }
-        if(strcmp(day, "01") == 0) {
-          rmdir(wcam_mdir);
-          if(verbose == 1) printf("Debug: Deleted image folder [%s]\n", wcam_mdir);
-          dircount++;
-        }
-      }
-      if((strcmp(month, "01") == 0) && (strcmp(day, "01") == 0)) {
-          rmdir(wcam_ydir);
-          if(verbose == 1) printf("Debug: Deleted image folder [%s]\n", wcam_ydir);
-          dircount++;
-      }
-    }
-    if(verbose == 1 && dircount == 0 && filecount == 0) printf("Debug: Nothing to delete.\n");
-  }
+  if(keepd > 0) retention();
   exit(0);
 }
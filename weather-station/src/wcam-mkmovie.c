@@ -1,41 +1,94 @@
 /* ------------------------------------------------------------ *
- * file:	wcam-mkmovie.c v1.4                             *
+ * file:	wcam-mkmovie.c v2.1                             *
  *                                                              *
  * author:	20160911 Frank4DD (fm4dd.com)                   *
  *                                                              *
  * purpose:	This program processes archived and timestamped *
- * 		.jpg images of a day by creating frameXXX.jpg   *
- * 		sequence files in a temp folder. Next it calls  *
- * 		ffmpeg for the conversion to a .mp4 movie and   *
- * 		then removes the temporary set of frameXXX.jpg  *
- * 		files. wcam-mkmovie runs from cron once per day *
+ * 		.jpg images of a day by decoding each image and *
+ * 		imprinting the date and time with a built-in    *
+ * 		5x7 font. The raw frames are streamed through a *
+ * 		pipe into ffmpeg for the conversion to a .mp4   *
+ * 		movie. A reader thread loads the image files,   *
+ * 		worker threads (-t) decode and imprint them in  *
+ * 		parallel, a reorder buffer keeps frame order.   *
+ * 		wcam-mkmovie runs from cron once per day        *
  *              shortly after midnight. With option -o we get a *
  *              copy to a second movie file e.g. yesterday.mp4  *
  *              that is used to be send to the main web server. *
+ *              The frame list comes from the day index file    *
+ *              wcam-index.txt written by wcam-archive. Without *
+ *              index, it falls back to scanning the directory. *
+ *                                                              *
+ *              With -s, it runs hourly and encodes the closed  *
+ *              hours of today into segments wcam-<day>-HH.mp4. *
+ *              The nightly run then only encodes the last hour *
+ *              and joins all segments without re-encoding.     *
+ *                                                              *
+ *              Frames darker than -b, and frames that show no  *
+ *              change to the previous frame (-u), are dropped  *
+ *              before decoding, using the index brightness and *
+ *              a signature made from the jpg DC coefficients   *
+ *              of the luma channel, taken in the workers.      *
+ *                                                              *
+ *              After the movie is done, the day's jpg files go *
+ *              into the frame container wcam-<day>.wpk (see    *
+ *              wcam-pack.h), which web/wcamframe.php reads.    *
  *                                                              *
  * cron entry: 	30 0 * * * /home/bin/wcam-mkmovie               *
+ *              5 * * * * /home/bin/wcam-mkmovie -s             *
  *                                                              *
- * compilation: gcc wcam-mkmovie.c -o wcam-mkmovie              *
+ * compilation: gcc wcam-mkmovie.c wcam-pack.c -o wcam-mkmovie  *
+ *                  -ljpeg -lpthread                            *
  *                                                              *
- * Requires: 	libav, imagemagick for mogrify (time imprint)   *
+ * Requires: 	ffmpeg, libjpeg, font5x7.h, wcam-pack.c/.h      *
  *                                                              *
  * v1.0 20050307 initial write                                  *
  * v1.1 20160911 adding cmdline args, time imprint              *
  * v1.2 20170708 switching ffmpeg to acconv, changing tmp dir   *
  * v1.3 20170722 adding movie icon creation, 90x68px PNG file   *
  * v1.4 20230103 switching avconf to ffmpeg per RPI OS bullseye *
+ * v1.5 20261019 read the frame list from the day index file    *
+ * v1.6 20261019 in-process time imprint, pipe frames to ffmpeg *
+ * v1.7 20261019 add reader thread with a bounded frame queue   *
+ * v1.8 20261019 add parallel decode workers, ordered writer    *
+ * v1.9 20261019 add hourly segment mode, join segments nightly *
+ * v2.0 20261019 skip dark and duplicate frames before encoding *
+ * v2.1 20261019 pack the day's jpg files into a .wpk, not .zip *
  * ------------------------------------------------------------ */
 #define FFMPEGBIN "/usr/bin/ffmpeg"
-#define ZIPBIN    "/usr/bin/zip"
 /* ------------------------------------------------------------ *
  * Define the movie parameters: frame rate, codec, quality, etc *
  * ------------------------------------------------------------ */
-#define AVOUTARGS "-r 25 -c:v libx264 -s 640x480"
+#define AVOUTARGS "-r 25 -c:v libx264 -pix_fmt yuv420p -s 640x480"
 #define AVSILENCE "-nostats -loglevel 0"
 /* ------------------------------------------------------------ *
  * Define the icon image parameters: time offset, size, amount  *
  * ------------------------------------------------------------ */
 #define AVIMGARGS "-ss 00:00:15 -s 90x68 -vframes 1 -f image2"
+/* ------------------------------------------------------------ *
+ * The per-day frame index file, as written by wcam-archive     *
+ * ------------------------------------------------------------ */
+#define INDEXFILE "wcam-index.txt"
+/* ------------------------------------------------------------ *
+ * Define the time imprint: font scale and offset from corner   *
+ * ------------------------------------------------------------ */
+#define FONTSCALE  3
+#define TEXTOFFSET 20
+/* ------------------------------------------------------------ *
+ * Define the number of frames queued between reader and coder  *
+ * ------------------------------------------------------------ */
+#define QUEUELEN   8
+/* ------------------------------------------------------------ *
+ * Define the max number of parallel frame decode threads       *
+ * ------------------------------------------------------------ */
+#define MAXTHREAD  8
+/* ------------------------------------------------------------ *
+ * Define the frame filter: signature grid size, the defaults   *
+ * for the min brightness and the duplicate frame difference    *
+ * ------------------------------------------------------------ */
+#define SIGSIZE    16
+#define MINBRIGHT  16
+#define MAXDIFF    0.5
 
 #include <stdio.h>
 #include <string.h>
@@ -49,6 +102,13 @@
 #include <utime.h>
 #include <getopt.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#include "font5x7.h"
+#include "wcam-pack.h"
 
 /* ------------------------------------------------------------ *
  * global variables                                             *
@@ -61,6 +121,19 @@ char avsilencer[256] = AVSILENCE;     // the extra args to prevent ffmpeg output
 char target_day[11];                  // the target day to process (yyyy-mm-dd\0)
 char movie_file[1024];                // the generated movie file
 int verbose = 0;                      // debug output, default "off"
+char srcimg_dir[268];                 // the archive folder of the target day
+char **imgfile_list;                  // the frame file names, sorted by time
+int *imgbright_list = NULL;           // the frame brightness from the index
+int file_counter = 0;                 // the number of frame files in the list
+int indexed = 1;                      // 1 if the list came from the index file
+int threads = 0;                      // decode threads, 0 = one per CPU core
+int min_bright = MINBRIGHT;           // skip frames darker than this, 0 = off
+double max_diff = MAXDIFF;            // skip frames closer to the last, 0 = off
+int f_first = 0;                      // the first list entry to encode
+int f_last = 0;                       // the list entry after the last to encode
+int segment_mode = 0;                 // encode the closed hours of the day only
+char meta_date[36];                   // the movie creation_time meta data
+char meta_title[128];                 // the movie title meta data
 extern char *optarg;
 extern int optind, opterr, optopt;
 
@@ -74,6 +147,10 @@ Options:\n\
   -f   the path to the ffmpeg program  (optional, default: " FFMPEGBIN ")\n\
   -d   the day to create the movie for (optional, default: yesterday), format yyyy-mm-dd\n\
   -o   the path and name for 2nd movie (optional, e.g. /home/pi/pi-ws03/var/yesterday.mp4)\n\
+  -t   the number of decode threads    (optional, default: one per CPU core)\n\
+  -s   segment mode: encode closed hours (optional, default day: today), -o gets the movie so far\n\
+  -b   skip frames below this brightness (optional, 0..255, default: 16, 0 = off)\n\
+  -u   skip frames with a mean luma difference to the previous frame below (optional, default: 0.5, 0 = off)\n\
   -h   print program usage and exit\n\
   -v   enable debug output\n\
 \n\
@@ -82,7 +159,8 @@ Video Output Args: " AVOUTARGS " \n\
 Usage examples:\n\
 ./wcam-mkmovie -a /home/pi/pi-ws03/web/wcam \n\
 ./wcam-mkmovie -d 2017-03-25 -a /home/pi/pi-ws03/web/wcam \n\
-./wcam-mkmovie -a /home/pi/pi-ws03/web/wcam -o /home/pi/pi-ws03/var/yesterday.mp4 \n";
+./wcam-mkmovie -a /home/pi/pi-ws03/web/wcam -o /home/pi/pi-ws03/var/yesterday.mp4 \n\
+./wcam-mkmovie -a /home/pi/pi-ws03/web/wcam -s -o /home/pi/pi-ws03/web/wcam/today.mp4 \n";
    printf(usage);
 }
 
@@ -95,7 +173,7 @@ void parseargs(int argc, char *argv[]) {
 
    if(argc == 1) { usage(); exit(-1); }
 
-   while ((arg = (int) getopt (argc, argv, "a:f:d:o:vh")) != -1) {
+   while ((arg = (int) getopt (argc, argv, "a:f:d:o:t:sb:u:vh")) != -1) {
       switch (arg) {
          // arg -a + wcam archive base dir, type: string
          // optional, example: /home/pi/pi-ws03/wcam
@@ -132,6 +210,43 @@ void parseargs(int argc, char *argv[]) {
             strncpy(movie_file, optarg, sizeof(movie_file)-1);
             break;
 
+         // arg -t + number of decode threads, type: int
+         // optional, example: 4, default is one per CPU core
+         case 't':
+            if(verbose == 1) printf("Debug: arg -t, value %s\n", optarg);
+            threads = atoi(optarg);
+            if(threads < 1 || threads > MAXTHREAD) {
+               printf("Error: thread count %s must be within 1..%d.\n", optarg, MAXTHREAD);
+               exit(-1);
+            }
+            break;
+
+         // arg -b + min brightness, type: int
+         // optional, example: 16, 0 disables the dark frame check
+         case 'b':
+            if(verbose == 1) printf("Debug: arg -b, value %s\n", optarg);
+            min_bright = atoi(optarg);
+            if(min_bright < 0 || min_bright > 255) {
+               printf("Error: brightness %s must be within 0..255.\n", optarg);
+               exit(-1);
+            }
+            break;
+
+         // arg -u + duplicate frame difference, type: double
+         // optional, example: 0.5, 0 disables the duplicate check
+         case 'u':
+            if(verbose == 1) printf("Debug: arg -u, value %s\n", optarg);
+            max_diff = atof(optarg);
+            if(max_diff < 0) {
+               printf("Error: duplicate difference %s must be >= 0.\n", optarg);
+               exit(-1);
+            }
+            break;
+
+         // arg -s segment mode, type: flag, optional
+         case 's':
+            segment_mode = 1; break;
+
          // arg -v verbose, type: flag, optional
          case 'v':
             verbose = 1; break;
@@ -167,41 +282,748 @@ int filter(const struct dirent *entry) {
    return(0);
 }
 
-/* ------------------------------------------------------- *
- * delete_tmp() cleans up the jpg image files copied here  *
- * ------------------------------------------------------- */
-int delete_tmp(char *dir) {
-   struct dirent *tmpfile_list;
-   DIR *tmp_dir;
-   char file[258];
-   int i=0;
+/* ---------------------------------------------------------- *
+ * read_index() loads the frame list from the day index file, *
+ * line format: <timestamp> <filename> <size> <bright> <ok>   *
+ * Frames marked "bad" are skipped, a frame re-archived under *
+ * the same name is listed only once. The frame brightness is *
+ * kept in bright_list, so it needs no decode. Returns the    *
+ * number of frames, or -1 if the folder has no index file.   *
+ * ---------------------------------------------------------- */
+int read_index(char *dir, char ***list, int **bright_list) {
+   char file[300];
+   char line[256];
+   char name[64];
+   char status[8];
+   long long tstamp;
+   long size;
+   int bright;
+   int count = 0;
+   int max = 0;
+   FILE *fp;
+
+   snprintf(file, sizeof(file), "%s/%s", dir, INDEXFILE);
+   if((fp = fopen(file, "r")) == NULL) return -1;
+
+   *list = NULL;
+   *bright_list = NULL;
+   while(fgets(line, sizeof(line), fp) != NULL) {
+      if(sscanf(line, "%lld %63s %ld %d %7s", &tstamp, name, &size, &bright, status) != 5) continue;
+      if(strcmp(status, "ok") != 0 || size <= 1) continue;
+      if(count > 0 && strcmp((*list)[count-1], name) == 0) continue;
+      if(count == max) {
+         max = (max == 0) ? 1024 : max * 2;
+         *list = realloc(*list, max * sizeof(char *));
+         *bright_list = realloc(*bright_list, max * sizeof(int));
+      }
+      (*bright_list)[count] = bright;
+      (*list)[count++] = strdup(name);
+   }
+   fclose(fp);
+   return count;
+}
+
+/* ---------------------------------------------------------- *
+ * libjpeg error handler: jump back instead of calling exit() *
+ * ---------------------------------------------------------- */
+struct jpeg_jmp_mgr {
+   struct jpeg_error_mgr pub;
+   jmp_buf setjmp_buffer;
+};
+
+void jpeg_jmp_exit(j_common_ptr cinfo) {
+   struct jpeg_jmp_mgr *err = (struct jpeg_jmp_mgr *) cinfo->err;
+   longjmp(err->setjmp_buffer, 1);
+}
+
+/* ---------------------------------------------------------- *
+ * decode_frame() decodes jpg data into a new packed RGB      *
+ * buffer, to be freed by the caller. It is called from the   *
+ * worker threads. Returns 0 on success, -1 on a bad file.    *
+ * ---------------------------------------------------------- */
+int decode_frame(const unsigned char *data, size_t size, unsigned char **buf, int *width, int *height) {
+   struct jpeg_decompress_struct cinfo;
+   struct jpeg_jmp_mgr jerr;
+
+   cinfo.err = jpeg_std_error(&jerr.pub);
+   jerr.pub.error_exit = jpeg_jmp_exit;
+   *buf = NULL;
+   if(setjmp(jerr.setjmp_buffer)) {
+      jpeg_destroy_decompress(&cinfo);
+      free(*buf);
+      *buf = NULL;
+      return -1;
+   }
+   jpeg_create_decompress(&cinfo);
+   jpeg_mem_src(&cinfo, (unsigned char *) data, size);
+   jpeg_read_header(&cinfo, TRUE);
+   cinfo.out_color_space = JCS_RGB;
+   jpeg_start_decompress(&cinfo);
+
+   size_t stride = (size_t) cinfo.output_width * 3;
+   *buf = malloc(stride * cinfo.output_height);
+   while(cinfo.output_scanline < cinfo.output_height) {
+      JSAMPROW row = *buf + cinfo.output_scanline * stride;
+      jpeg_read_scanlines(&cinfo, &row, 1);
+   }
+   *width = cinfo.output_width;
+   *height = cinfo.output_height;
+   jpeg_finish_decompress(&cinfo);
+   jpeg_destroy_decompress(&cinfo);
+   return 0;
+}
+
+/* ---------------------------------------------------------- *
+ * jpg_signature() reads the jpg DC coefficients of the luma  *
+ * channel without the IDCT, and averages them into a grid of *
+ * SIGSIZE x SIGSIZE luma values (0..255) as frame signature. *
+ * Returns the mean brightness 0..255, or -1 on a bad file.   *
+ * ---------------------------------------------------------- */
+int jpg_signature(const unsigned char *data, size_t size, unsigned char *sig) {
+   struct jpeg_decompress_struct cinfo;
+   struct jpeg_jmp_mgr jerr;
+   long sum[SIGSIZE*SIGSIZE];
+   long cnt[SIGSIZE*SIGSIZE];
+   long total = 0;
+   JDIMENSION bx, by;
+   int c;
+
+   cinfo.err = jpeg_std_error(&jerr.pub);
+   jerr.pub.error_exit = jpeg_jmp_exit;
+   if(setjmp(jerr.setjmp_buffer)) {
+      jpeg_destroy_decompress(&cinfo);
+      return -1;
+   }
+   jpeg_create_decompress(&cinfo);
+   jpeg_mem_src(&cinfo, (unsigned char *) data, size);
+   jpeg_read_header(&cinfo, TRUE);
+   jvirt_barray_ptr *coefs = jpeg_read_coefficients(&cinfo);
+
+   /* ---------------------------------------------------------- *
+    * The DC coefficient is 8 x (block mean - 128), quantized by *
+    * the first entry of the component's quantization table.     *
+    * ---------------------------------------------------------- */
+   jpeg_component_info *comp = &cinfo.comp_info[0];
+   int q0 = comp->quant_table->quantval[0];
+   memset(sum, 0, sizeof(sum));
+   memset(cnt, 0, sizeof(cnt));
+
+   for(by = 0; by < comp->height_in_blocks; by++) {
+      JBLOCKARRAY row = (*cinfo.mem->access_virt_barray)
+                        ((j_common_ptr) &cinfo, coefs[0], by, 1, FALSE);
+      int cy = by * SIGSIZE / comp->height_in_blocks;
+      for(bx = 0; bx < comp->width_in_blocks; bx++) {
+         int cx = bx * SIGSIZE / comp->width_in_blocks;
+         sum[cy*SIGSIZE+cx] += row[0][bx][0] * q0;
+         cnt[cy*SIGSIZE+cx]++;
+      }
+   }
+   jpeg_finish_decompress(&cinfo);
+   jpeg_destroy_decompress(&cinfo);
+
+   for(c = 0; c < SIGSIZE*SIGSIZE; c++) {
+      int luma = (cnt[c] > 0) ? (int) (sum[c] / (8 * cnt[c])) + 128 : 0;
+      if(luma < 0) luma = 0;
+      if(luma > 255) luma = 255;
+      sig[c] = luma;
+      total += luma;
+   }
+   return (int) (total / (SIGSIZE*SIGSIZE));
+}
+
+/* ---------------------------------------------------------- *
+ * sig_diff() returns the mean absolute luma difference of    *
+ * two frame signatures, 0 means the frames look the same.    *
+ * ---------------------------------------------------------- */
+double sig_diff(const unsigned char *sig1, const unsigned char *sig2) {
+   long diff = 0;
+   int c;
+   for(c = 0; c < SIGSIZE*SIGSIZE; c++) diff += abs(sig1[c] - sig2[c]);
+   return (double) diff / (SIGSIZE*SIGSIZE);
+}
+
+/* ---------------------------------------------------------- *
+ * imprint_text() draws white text on a half-transparent dark *
+ * box into the lower right corner of the RGB frame, same as  *
+ * mogrify -fill white -undercolor '#00000080' -gravity       *
+ * SouthEast -annotate +20+20 did before. The 5x7 font glyphs *
+ * are scaled up by FONTSCALE to match the old pointsize 20.  *
+ * ---------------------------------------------------------- */
+void imprint_text(unsigned char *img, int width, int height, const char *text) {
+   int len = strlen(text);
+   int box_w = (len * (FONT_W+1) + 1) * FONTSCALE;
+   int box_h = (FONT_H + 2) * FONTSCALE;
+   int box_x = width - TEXTOFFSET - box_w;
+   int box_y = height - TEXTOFFSET - box_h;
+   int x, y, c;
+
+   if(box_x < 0 || box_y < 0) return;    // frame is too small
+
+   /* darken the box area to 50% for the undercolor */
+   for(y = box_y; y < box_y + box_h; y++) {
+      unsigned char *px = img + ((size_t) y * width + box_x) * 3;
+      for(x = 0; x < box_w * 3; x++) px[x] >>= 1;
+   }
+
+   /* set the glyph pixels to white, FONTSCALE x FONTSCALE each */
+   for(c = 0; c < len; c++) {
+      int ch = (unsigned char) text[c];
+      if(ch < FONT_FIRST || ch > FONT_LAST) ch = '?';
+      const unsigned char *glyph = font5x7[ch - FONT_FIRST];
+      int gx = box_x + (c * (FONT_W+1) + 1) * FONTSCALE;
+      int gy = box_y + FONTSCALE;
+
+      for(x = 0; x < FONT_W * FONTSCALE; x++) {
+         unsigned char col = glyph[x / FONTSCALE];
+         for(y = 0; y < FONT_H * FONTSCALE; y++) {
+            if(col & (1 << (y / FONTSCALE)))
+               memset(img + ((size_t) (gy + y) * width + gx + x) * 3, 0xFF, 3);
+         }
+      }
+   }
+}
+
+/* ---------------------------------------------------------- *
+ * The frame pipeline: one reader thread loads the compressed *
+ * jpg files into the input queue, N worker threads decode    *
+ * and imprint them, and the main thread writes the RGB       *
+ * frames to ffmpeg. Workers finish out of order, so the      *
+ * decoded frames go into a reorder buffer keyed by the frame *
+ * sequence number, and the writer takes them out in order.   *
+ * Both queues are bounded, memory use stays at a few frames. *
+ *                                                            *
+ * The reader drops the dark frames by their index brightness *
+ * without reading them. The workers take the frame signature *
+ * and then decide in sequence order, against the last frame  *
+ * kept, if it is a duplicate, before the full decode.        *
+ * ---------------------------------------------------------- */
+typedef struct {
+   int seq;                     // the frame sequence number
+   char name[64];               // the archive file name
+   unsigned char *data;         // the compressed jpg file data
+   size_t size;                 // the jpg data size in bytes
+} jpgbuf_t;
+
+typedef struct {
+   int seq;                     // the frame sequence number, -1 = empty
+   int status;                  // 0 = OK, -1 = frame could not be decoded, 1 = dropped
+   char name[64];               // the archive file name
+   unsigned char *rgb;          // the decoded and imprinted frame
+   int width;                   // the frame width in pixels
+   int height;                  // the frame height in pixels
+} rgbbuf_t;
+
+jpgbuf_t queue[QUEUELEN];
+int q_head = 0;                 // next queue slot to take from
+int q_count = 0;                // number of frames in the queue
+int q_done = 0;                 // set when the reader is done
+int q_total = 0;                // number of frames the reader queued
+pthread_mutex_t q_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t q_notempty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t q_notfull = PTHREAD_COND_INITIALIZER;
+
+rgbbuf_t reorder[2*MAXTHREAD];
+int r_len = 2;                  // reorder slots in use, 2 x threads
+int r_next = 0;                 // the next sequence number to write
+pthread_mutex_t r_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t r_ready = PTHREAD_COND_INITIALIZER;
+pthread_cond_t r_free = PTHREAD_COND_INITIALIZER;
+
+unsigned char last_sig[SIGSIZE*SIGSIZE]; // the signature of the last frame kept
+int have_last = 0;              // 1 once last_sig is set
+int d_next = 0;                 // the next sequence number to decide on
+int dark = 0, dups = 0;         // the number of frames dropped
+pthread_mutex_t d_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t d_turn = PTHREAD_COND_INITIALIZER;
+
+/* ---------------------------------------------------------- *
+ * load_file() reads a complete file into a malloc'ed buffer. *
+ * Empty files return no data, with size set to 0 or 1. The   *
+ * return code is 0 on success, and -1 if the read failed.    *
+ * ---------------------------------------------------------- */
+int load_file(const char *file, unsigned char **data, size_t *size) {
+   struct stat st;
+   size_t got = 0;
+
+   *data = NULL;
+   *size = 0;
+   int fd = open(file, O_RDONLY);
+   if(fd == -1) return -1;
+   if(fstat(fd, &st) == -1) {
+      close(fd);
+      return -1;
+   }
+   if(st.st_size <= 1) {
+      *size = st.st_size;
+      close(fd);
+      return 0;
+   }
+   *data = malloc(st.st_size);
+   while(got < st.st_size) {
+      ssize_t n = read(fd, *data + got, st.st_size - got);
+      if(n <= 0) break;
+      got += n;
+   }
+   close(fd);
+   *size = got;
+   if(got < st.st_size) {
+      free(*data);
+      *data = NULL;
+      return -1;
+   }
+   return 0;
+}
+
+/* ---------------------------------------------------------- *
+ * reader() is the reader thread, it loads the frame files in *
+ * list order into the queue, and waits while it is full.     *
+ * ---------------------------------------------------------- */
+void *reader(void *arg) {
+   char arch_file[525];  // e.g. /home/pi/pi-ws03/wcam/2016/09/10/wcam-20160910_181907.jpg
+   unsigned char *data;
+   size_t size;
+   int i;
+
+   for(i=f_first; i<f_last; i++) {
+      /* ---------------------------------------------------------- *
+       * Drop the frames that are too dark by the index brightness, *
+       * they don't need to be read at all.                         *
+       * ---------------------------------------------------------- */
+      if(min_bright > 0 && imgbright_list != NULL && imgbright_list[i] < min_bright) {
+         pthread_mutex_lock(&d_lock);
+         dark++;
+         pthread_mutex_unlock(&d_lock);
+         continue;
+      }
+      snprintf(arch_file, sizeof(arch_file)-1, "%s/%s", srcimg_dir, imgfile_list[i]);
+      if(load_file(arch_file, &data, &size) != 0) {
+         printf("Error: [%s] cannot be read, skipping frame\n", arch_file);
+         continue;
+      }
+
+      /* ---------------------------------------------------------- *
+       * Check if the img file is empty, if so, we skip processing  *
+       * and delete the file from the archive. Indexed frames were  *
+       * already checked by wcam-archive.                           *
+       * ---------------------------------------------------------- */
+      if(size <= 1) {
+         if(verbose == 1) printf("Error: [%s] size is [%lu] ", arch_file, (unsigned long) size);
+         if(indexed == 0) unlink(arch_file);
+         continue;
+      }
+
+      pthread_mutex_lock(&q_lock);
+      while(q_count == QUEUELEN) pthread_cond_wait(&q_notfull, &q_lock);
+      jpgbuf_t *slot = &queue[(q_head + q_count) % QUEUELEN];
+      slot->seq = q_total++;
+      snprintf(slot->name, sizeof(slot->name), "%s", imgfile_list[i]);
+      slot->data = data;
+      slot->size = size;
+      q_count++;
+      pthread_cond_signal(&q_notempty);
+      pthread_mutex_unlock(&q_lock);
+   }
+
+   pthread_mutex_lock(&q_lock);
+   q_done = 1;
+   pthread_cond_broadcast(&q_notempty);
+   pthread_mutex_unlock(&q_lock);
+
+   /* wake up the writer, in case it waits for a frame never queued */
+   pthread_mutex_lock(&r_lock);
+   pthread_cond_broadcast(&r_ready);
+   pthread_mutex_unlock(&r_lock);
+   return NULL;
+}
+
+/* ---------------------------------------------------------- *
+ * worker() is the decode thread. It takes the next jpg frame *
+ * from the queue, decodes it and adds the time imprint. The  *
+ * result goes into the reorder slot for its sequence number, *
+ * once the writer has advanced close enough to free it.      *
+ * ---------------------------------------------------------- */
+void *worker(void *arg) {
+   jpgbuf_t jpg;
+   char imprint[255];
+   unsigned char sig[SIGSIZE*SIGSIZE];
 
-   tmp_dir = opendir(dir);
    for(;;) {
-      tmpfile_list = readdir(tmp_dir);
-      if(tmpfile_list == NULL) break;
-      if(strstr(tmpfile_list->d_name, ".jpg")) {
-         snprintf(file, sizeof(file)-1, "%s/%s", dir, tmpfile_list->d_name);
-         unlink(file);
-         i++;
+      pthread_mutex_lock(&q_lock);
+      while(q_count == 0 && q_done == 0) pthread_cond_wait(&q_notempty, &q_lock);
+      if(q_count == 0) {
+         pthread_mutex_unlock(&q_lock);
+         break;
+      }
+      jpg = queue[q_head];
+      q_head = (q_head + 1) % QUEUELEN;
+      q_count--;
+      pthread_cond_signal(&q_notfull);
+      pthread_mutex_unlock(&q_lock);
+
+      /* ---------------------------------------------------------- *
+       * Drop frames that are too dark (without index brightness),  *
+       * or look the same as the last frame kept, e.g. from a       *
+       * frozen camera. The signature only needs the DC values,     *
+       * the decision on it is made in frame sequence order.        *
+       * ---------------------------------------------------------- */
+      int status = 0;
+      int bright = 0;
+      int sigcheck = (max_diff > 0 || (min_bright > 0 && imgbright_list == NULL));
+      if(sigcheck) bright = jpg_signature(jpg.data, jpg.size, sig);
+
+      pthread_mutex_lock(&d_lock);
+      while(jpg.seq != d_next) pthread_cond_wait(&d_turn, &d_lock);
+      if(bright < 0) status = -1;
+      else if(sigcheck && imgbright_list == NULL && bright < min_bright) {
+         status = 1;
+         dark++;
+      }
+      else if(max_diff > 0 && have_last == 1 && sig_diff(sig, last_sig) < max_diff) {
+         status = 1;
+         dups++;
+      }
+      else if(max_diff > 0) {
+         memcpy(last_sig, sig, sizeof(sig));
+         have_last = 1;
+      }
+      d_next++;
+      pthread_cond_broadcast(&d_turn);
+      pthread_mutex_unlock(&d_lock);
+
+      unsigned char *rgb = NULL;
+      int width = 0, height = 0;
+      if(status == 0) status = decode_frame(jpg.data, jpg.size, &rgb, &width, &height);
+      free(jpg.data);
+
+      /* ----------------------------------------------------------- *
+       * Add the date and time imprint to the frame image, taken     *
+       * from the file name, e.g. wcam-20160910_181907.jpg -> 18:19  *
+       *  ---------------------------------------------------------- */
+      if(status == 0) {
+         char time_hr[3];
+         int hlen = strlen(jpg.name)-10;
+         strncpy(time_hr, jpg.name+hlen, 2);
+         time_hr[2] = '\0';
+         char time_mn[3];
+         int mlen = strlen(jpg.name)-8;
+         strncpy(time_mn, jpg.name+mlen, 2);
+         time_mn[2] = '\0';
+         snprintf(imprint, sizeof(imprint)-1, "Pi-Weather %s Time: %s:%s", target_day, time_hr, time_mn);
+         imprint_text(rgb, width, height, imprint);
       }
+
+      pthread_mutex_lock(&r_lock);
+      while(jpg.seq >= r_next + r_len) pthread_cond_wait(&r_free, &r_lock);
+      rgbbuf_t *slot = &reorder[jpg.seq % r_len];
+      slot->seq = jpg.seq;
+      slot->status = status;
+      snprintf(slot->name, sizeof(slot->name), "%s", jpg.name);
+      slot->rgb = rgb;
+      slot->width = width;
+      slot->height = height;
+      pthread_cond_broadcast(&r_ready);
+      pthread_mutex_unlock(&r_lock);
    }
-   free(tmpfile_list);
-   return(i);
+   return NULL;
 }
 
 /* ---------------------------------------------------------- *
- * function origin_zip puts the camera jpg image files in a   *
- * .zip file, e.g. # zip -q -m wcam-2016909-jpg *.jpg         *
- * -q = quiet, -m = delete original, -j = strip the path      *
+ * next_frame() returns the next frame in sequence order for  *
+ * the writer, waits until a worker has it ready. Returns 0   *
+ * when all frames are done, the caller must free the RGB.    *
  * ---------------------------------------------------------- */
-void origin_zip(char *dir) {
-   char cmd[255];
-   snprintf(cmd, sizeof(cmd)-1, "%s -q -m -j %s/wcam-%s %s/*.jpg", ZIPBIN, dir, target_day, dir);
-   if(verbose == 1) printf("Debug: cmd [%s]\n", cmd);
-   system(cmd);
+int next_frame(rgbbuf_t *frame) {
+   pthread_mutex_lock(&r_lock);
+   for(;;) {
+      rgbbuf_t *slot = &reorder[r_next % r_len];
+      if(slot->seq == r_next) {
+         *frame = *slot;
+         slot->seq = -1;
+         r_next++;
+         pthread_cond_broadcast(&r_free);
+         pthread_mutex_unlock(&r_lock);
+         return 1;
+      }
+      pthread_mutex_lock(&q_lock);
+      int finished = (q_done == 1 && r_next >= q_total);
+      pthread_mutex_unlock(&q_lock);
+      if(finished) break;
+      pthread_cond_wait(&r_ready, &r_lock);
+   }
+   pthread_mutex_unlock(&r_lock);
+   return 0;
 }
 
+/* ---------------------------------------------------------- *
+ * encode_movie() runs the frame pipeline for the frame list  *
+ * entries first..last-1, and writes the movie to outfile.    *
+ * Decoded frames stream as raw RGB video into ffmpeg. The    *
+ * ffmpeg pipe opens with the first good frame, which sets    *
+ * the video size. Returns the ffmpeg exit code, -1 on error, *
+ * and -2 if no frame was left to encode.                     *
+ * ---------------------------------------------------------- */
+int encode_movie(int first, int last, const char *outfile) {
+   char system_cmd[2048];// shell command string, needs more than 255 for avconv option list
+   char cmd_args[1024];
+   rgbbuf_t rgb;
+   pthread_t reader_thread;
+   pthread_t tid[MAXTHREAD];
+   int width = 0, height = 0;
+   int frames = 0;
+   int av_ret = -1;
+   int i;
+   FILE *av_pipe = NULL;
+
+   /* ---------------------------------------------------------- *
+    * reset the pipeline queues for the new frame range          *
+    * ---------------------------------------------------------- */
+   f_first = first;
+   f_last = last;
+   q_head = q_count = q_done = q_total = 0;
+   r_next = 0;
+   r_len = 2 * threads;
+   d_next = have_last = dark = dups = 0;
+   for(i=0; i<r_len; i++) reorder[i].seq = -1;
+   if(verbose == 1) printf("Debug: Encoding [%d] img files with [%d] threads -> [%s]\n", last-first, threads, outfile);
+
+   if(pthread_create(&reader_thread, NULL, reader, NULL) != 0) {
+      printf("Error: Cannot create reader thread\n");
+      exit(-1);
+   }
+   for(i=0; i<threads; i++) {
+      if(pthread_create(&tid[i], NULL, worker, NULL) != 0) {
+         printf("Error: Cannot create worker thread %d\n", i);
+         exit(-1);
+      }
+   }
+
+   while(next_frame(&rgb) == 1) {
+      /* ---------------------------------------------------------- *
+       * Broken frames and frames that differ in size from the 1st  *
+       * frame are skipped. Once ffmpeg failed, the remaining       *
+       * frames are only drained from the pipeline.                 *
+       * ---------------------------------------------------------- */
+      if(frames < 0) {
+         free(rgb.rgb);
+         continue;
+      }
+      if(rgb.status == 1) continue;
+      if(rgb.status != 0) {
+         printf("Error: [%s] cannot be decoded, skipping frame\n", rgb.name);
+         continue;
+      }
+      if(av_pipe == NULL) {
+         width = rgb.width;
+         height = rgb.height;
+         snprintf(cmd_args, sizeof(cmd_args)-1,
+                  "%s -y -f rawvideo -pix_fmt rgb24 -s %dx%d -r 25 -i - %s -metadata %s -metadata %s -f mp4",
+                  avconv_bin, width, height, avout_args, meta_date, meta_title);
+
+         /* ---------------------------------------------------------- *
+          * Unless verbose, add "quiet mode" silencer args to ffmpeg   *
+          * ---------------------------------------------------------- */
+         if(verbose == 1) snprintf(system_cmd, sizeof(system_cmd)-1, "%s %s", cmd_args, outfile);
+         else snprintf(system_cmd, sizeof(system_cmd)-1, "%s %s %s", cmd_args, avsilencer, outfile);
+
+         if(verbose == 1) printf("Debug: system_cmd [%s]\n", system_cmd);
+         if((av_pipe = popen(system_cmd, "w")) == NULL) {
+            printf("Error: Cannot start ffmpeg: %s\n", strerror(errno));
+            free(rgb.rgb);
+            frames = -1;
+            continue;
+         }
+      }
+      if(rgb.width != width || rgb.height != height) {
+         printf("Error: [%s] size %dx%d != %dx%d, skipping frame\n", rgb.name, rgb.width, rgb.height, width, height);
+         free(rgb.rgb);
+         continue;
+      }
+
+      if(fwrite(rgb.rgb, 3, (size_t) width * height, av_pipe) != (size_t) width * height) {
+         printf("Error: Writing frame [%d] to ffmpeg failed: %s\n", frames, strerror(errno));
+         frames = -1;
+      }
+      else frames++;
+      free(rgb.rgb);
+      if(verbose == 1 && frames > 0) printf("%d ", frames);
+   }
+   pthread_join(reader_thread, NULL);
+   for(i=0; i<threads; i++) pthread_join(tid[i], NULL);
+   if(verbose == 1) printf("-> decode and imprint of [%d] frames complete\n", frames);
+   if(verbose == 1) printf("Debug: skipped [%d] dark and [%d] duplicate frames\n", dark, dups);
+
+   /* ---------------------------------------------------------- *
+    * close the pipe, and wait for ffmpeg to finish the movie    *
+    * ---------------------------------------------------------- */
+   if(av_pipe != NULL) av_ret = pclose(av_pipe);
+   else if(frames == 0) av_ret = -2;
+   return av_ret;
+}
+
+/* ---------------------------------------------------------- *
+ * frame_hour() returns the hour from the frame file name,    *
+ * e.g. wcam-20160910_181907.jpg returns 18                   *
+ * ---------------------------------------------------------- */
+int frame_hour(const char *name) {
+   int len = strlen(name);
+   if(len < 10) return -1;
+   return (name[len-10] - '0') * 10 + (name[len-9] - '0');
+}
+
+/* ---------------------------------------------------------- *
+ * build_segments() encodes the hourly movie segments for all *
+ * hours before endhour that have frames, but no segment file *
+ * yet, e.g. wcam-2017-03-25-06.mp4. New segments are written *
+ * under a temporary name first, so a segment file is always  *
+ * complete. Returns the number of segments for the day.      *
+ * ---------------------------------------------------------- */
+int build_segments(int endhour) {
+   char seg_file[300];
+   char tmp_file[305];
+   struct stat seg_stat;
+   int first = 0;
+   int segments = 0;
+
+   while(first < file_counter) {
+      int hour = frame_hour(imgfile_list[first]);
+      int last = first + 1;
+      while(last < file_counter && frame_hour(imgfile_list[last]) == hour) last++;
+
+      if(hour >= 0 && hour < endhour) {
+         snprintf(seg_file, sizeof(seg_file), "%s/wcam-%s-%02d.mp4", srcimg_dir, target_day, hour);
+         if(stat(seg_file, &seg_stat) == 0) segments++;
+         else {
+            snprintf(tmp_file, sizeof(tmp_file), "%s.part", seg_file);
+            int ret = encode_movie(first, last, tmp_file);
+            if(ret == 0 && rename(tmp_file, seg_file) == 0) {
+               if(verbose == 1) printf("Debug: created segment [%s] from [%d] frames\n", seg_file, last-first);
+               segments++;
+            }
+            else if(ret == -2) {
+               if(verbose == 1) printf("Debug: no frames left for segment [%s]\n", seg_file);
+            }
+            else {
+               printf("Error creating segment %s with ffmpeg, return code %d\n", seg_file, ret);
+               unlink(tmp_file);
+            }
+         }
+      }
+      first = last;
+   }
+   return segments;
+}
+
+/* ---------------------------------------------------------- *
+ * concat_segments() joins the hourly segments of the day     *
+ * into outfile with the ffmpeg concat demuxer, copying the   *
+ * stream without re-encoding. With del = 1, the segment      *
+ * files are removed afterwards. Returns the ffmpeg exit code *
+ * ---------------------------------------------------------- */
+int concat_segments(const char *outfile, int del) {
+   char list_file[300];
+   char seg_file[300];
+   char tmp_file[1030];
+   char system_cmd[2560];
+   struct stat seg_stat;
+   FILE *list;
+   int hour;
+
+   snprintf(list_file, sizeof(list_file), "%s/wcam-segments.txt", srcimg_dir);
+   if((list = fopen(list_file, "w")) == NULL) {
+      printf("Error: Cannot create segment list %s\n", list_file);
+      return -1;
+   }
+   for(hour=0; hour<24; hour++) {
+      snprintf(seg_file, sizeof(seg_file), "%s/wcam-%s-%02d.mp4", srcimg_dir, target_day, hour);
+      if(stat(seg_file, &seg_stat) == 0) fprintf(list, "file 'wcam-%s-%02d.mp4'\n", target_day, hour);
+   }
+   fclose(list);
+
+   /* ---------------------------------------------------------- *
+    * write to a temporary name, so the web server never sends   *
+    * a half written movie, and rename it when ffmpeg is done    *
+    * ---------------------------------------------------------- */
+   snprintf(tmp_file, sizeof(tmp_file), "%s.part", outfile);
+   snprintf(system_cmd, sizeof(system_cmd)-1,
+            "%s -y -f concat -safe 0 -i %s -c copy -metadata %s -metadata %s -f mp4 %s %s",
+            avconv_bin, list_file, meta_date, meta_title, (verbose == 1) ? "" : avsilencer, tmp_file);
+   if(verbose == 1) printf("Debug: system_cmd [%s]\n", system_cmd);
+   int av_ret = system(system_cmd);
+   if(av_ret == 0) rename(tmp_file, outfile);
+   else unlink(tmp_file);
+
+   if(del == 1 && av_ret == 0) {
+      for(hour=0; hour<24; hour++) {
+         snprintf(seg_file, sizeof(seg_file), "%s/wcam-%s-%02d.mp4", srcimg_dir, target_day, hour);
+         unlink(seg_file);
+      }
+   }
+   unlink(list_file);
+   return av_ret;
+}
+
+/* ---------------------------------------------------------- *
+ * function origin_pack puts the camera jpg image files of    *
+ * the day into the indexed frame container wcam-<day>.wpk.   *
+ * The original files are deleted after the index is written, *
+ * the pack stays locked for readers until then.              *
+ * The jpg data is stored as-is, no compression is attempted. *
+ * ---------------------------------------------------------- */
+void origin_pack(char *dir) {
+   char pack[300];
+   char arch_file[525];
+   unsigned char *data;
+   size_t size;
+   int i, packed = 0;
+   wpk_t wpk;
+
+   snprintf(pack, sizeof(pack), "%s/wcam-%s.wpk", dir, target_day);
+   if(verbose == 1) printf("Debug: pack [%d] jpg files -> [%s]\n", file_counter, pack);
+
+   char *done = calloc(file_counter > 0 ? file_counter : 1, 1);
+   if(done == NULL || wpk_open(pack, &wpk) != 0) {
+      printf("Error: Cannot open [%s]\n", pack);
+      free(done);
+      return;
+   }
+
+   for(i=0; i<file_counter; i++) {
+      snprintf(arch_file, sizeof(arch_file)-1, "%s/%s", dir, imgfile_list[i]);
+      if(load_file(arch_file, &data, &size) != 0 || size <= 1) continue;
+
+      /* get the frame time from the name wcam-20160910_181907.jpg */
+      struct tm tm;
+      memset(&tm, 0, sizeof(tm));
+      if(sscanf(imgfile_list[i], "wcam-%4d%2d%2d_%2d%2d%2d", &tm.tm_year, &tm.tm_mon,
+                &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+         free(data);
+         continue;
+      }
+      tm.tm_year -= 1900;
+      tm.tm_mon -= 1;
+      tm.tm_isdst = -1;
+
+      if(wpk_append(&wpk, mktime(&tm), data, size) == 0) {
+         done[i] = 1;
+         packed++;
+      }
+      else printf("Error: Cannot add [%s] to [%s]\n", arch_file, pack);
+      free(data);
+   }
+
+   if(wpk_close(&wpk) != 0) {
+      printf("Error: Cannot write the index of [%s], keeping the jpg files\n", pack);
+      free(done);
+      return;
+   }
+   for(i=0; i<file_counter; i++) {
+      if(done[i] == 0) continue;
+      snprintf(arch_file, sizeof(arch_file)-1, "%s/%s", dir, imgfile_list[i]);
+      unlink(arch_file);
+   }
+   free(done);
+   if(verbose == 1) printf("Debug: packed [%d] jpg files\n", packed);
+}
 
 /* ------------------------------------------------------------ *
  * filecopy() is the cp equivalent to copy files                *
@@ -234,7 +1056,7 @@ int filecopy(char from[],char to[]) {
 }
 
 int main(int argc, char *argv[]) {
-   int ret, bytes;                         // functions return code
+   int bytes;                              // functions return code
    /* ---------------------------------------------------------- *
     * get current time                                           *
     * ---------------------------------------------------------- */
@@ -248,9 +1070,10 @@ int main(int argc, char *argv[]) {
 
   /* ---------------------------------------------------------- *
    * Without a target_day argument, yesterday is the default    *
+   * In segment mode, the default is today.                     *
    * ---------------------------------------------------------- */
    if(strlen(target_day) == 0) {
-      tstamp = tstamp - 86400;                // calculate yesterday
+      if(segment_mode == 0) tstamp = tstamp - 86400; // calculate yesterday
       strftime(target_day, 11, "%Y-%m-%d", localtime(&tstamp));
    }
 
@@ -263,17 +1086,13 @@ int main(int argc, char *argv[]) {
    }
 
    /* ---------------------------------------------------------- *
-    * Check if the system binaries ffmpeg and zip exist          *
+    * Check if the system binary ffmpeg exists                   *
     * ---------------------------------------------------------- */
    struct stat file_stat;
    if(stat(FFMPEGBIN, &file_stat) == -1) {
       printf("Error: %s does not exist\n", FFMPEGBIN);
       exit(-1);
    }
-   if(stat(ZIPBIN, &file_stat) == -1) {
-      printf("Error: %s does not exist\n", ZIPBIN);
-      exit(-1);
-   }
 
    /* ---------------------------------------------------------- *
     * we expect the following archive directory structure:       *
@@ -281,7 +1100,6 @@ int main(int argc, char *argv[]) {
     * ---------------------------------------------------------- */
    int i;
    char buf_day[11];                     /* YYYY/MM/MM + \0 = 11 */
-   char srcimg_dir[268];
 
    /* create a tmp day string, replacing '-' with '/' */
    for(i=0; i<=strlen(target_day); i++) {
@@ -312,142 +1130,98 @@ int main(int argc, char *argv[]) {
    }
 
    /* ---------------------------------------------------------- *
-    * Get the list of .jpg files and sort them by time           *
+    * Get the list of .jpg files from the day index file. If it  *
+    * does not exist, scan the directory and sort them by time.  *
     * ---------------------------------------------------------- */
-   int file_counter=0;
-   struct dirent **imgfile_list;
-
-   file_counter = scandir(srcimg_dir, &imgfile_list, filter, alphasort);
+   file_counter = read_index(srcimg_dir, &imgfile_list, &imgbright_list);
+   if(file_counter >= 0) {
+      if(verbose == 1) printf("Debug: srcimg_dir [%s] - index lists [%d] files.\n", srcimg_dir, file_counter);
+   }
+   else {
+      struct dirent **dirent_list;
+      indexed = 0;
+      file_counter = scandir(srcimg_dir, &dirent_list, filter, alphasort);
       if(verbose == 1) printf("Debug: srcimg_dir [%s] - found [%d] files.\n", srcimg_dir, file_counter);
+      if(file_counter > 0) {
+         imgfile_list = malloc(file_counter * sizeof(char *));
+         for(i=0; i<file_counter; i++) {
+            imgfile_list[i] = strdup(dirent_list[i]->d_name);
+            free(dirent_list[i]);
+         }
+         free(dirent_list);
+      }
+   }
    if(file_counter<=0) {
       printf("Error: srcimg_dir: %s - %d files found\n", srcimg_dir, file_counter);
       exit(-1);
    }
 
-   /* ---------------------------------------------------------- *
-    * Create a temporary work directory, check if it can be used *
-    * The folder should be under pi-ws01/var, because its tmpfs. *
-    * ---------------------------------------------------------- */
-   char tmpdir[271];
-   struct stat tmp_stat;
-   mode_t mode = 0777 & ~umask(0);
-
-   /* Here we track back with ../.. from pi-ws01/web/wcam to var */
-   snprintf(tmpdir, sizeof(tmpdir)-1, "%s/../../var/tmp", archi_home);
-
-   if(stat(tmpdir, &tmp_stat) == -1) {
-      ret = mkdir(tmpdir, mode);
-      if (ret == 0) {
-         if(verbose == 1) printf("Debug: Created temporary folder: [%s]\n", tmpdir);
-      }
-      else {
-         printf("Error: Cannot create temporary folder %s: %s\n", tmpdir, strerror(errno));
-      }
-   }
-
-   src_dir = opendir(tmpdir);
-   if (src_dir == NULL) {
-     printf("Error: Cannot open temporary folder %s\n", tmpdir);
-     exit(-1);
-   }
-
-   /* ---------------------------------------------------------- *
-    * create image work copies in temporary work directory       *
-    * ---------------------------------------------------------- */
-   char arch_file[525];  // e.g. /home/pi/pi-ws03/wcam/2016/09/10/wcam-20160910_181907.jpg
-   char new_file[294];   // e.g. /home/pi/pi-ws03/var/tmp/frame739.jpg
-   struct stat imgstat;  // used to check if the img file size is not zero
-   char system_cmd[2048];// shell command string, needs more than 255 for avconv option list
-
-   if(verbose == 1) printf("Debug: Copying [%d] img files -> [%s]\n", file_counter, tmpdir);
-
-   for(i=0; i<file_counter; i++) {
-      snprintf(arch_file, sizeof(arch_file)-1, "%s/%s", srcimg_dir, imgfile_list[i]->d_name);
-
-      /* ---------------------------------------------------------- *
-       * Check if the img file is empty, if so, we skip processing  *
-       * rewind the counter and delete the file from the archive.   *
-       * ---------------------------------------------------------- */
-      int delcounter = 0;
-      stat(arch_file, &imgstat);
-      if(imgstat.st_size <= 1) {
-         if(verbose == 1) printf("Error: [%s] size is [%lu] ", arch_file, (unsigned long) imgstat.st_size);
-         unlink(arch_file);
-         delcounter++;
-         continue;
-      }
-
-      /* ---------------------------------------------------------- *
-       * Create the temporary frame image file                      *
-       * ---------------------------------------------------------- */
-      snprintf(new_file, sizeof(new_file)-1, "%s/frame%03d.jpg", tmpdir, i-delcounter);
-      bytes=filecopy(arch_file, new_file);
-      if(verbose == 1) printf("%d ", i);
-
-      /* ----------------------------------------------------------- *
-       * Add the date and time imprint to frame images, example:     *
-       * mogrify -font Liberation-Sans -fill white -undercolor \     *
-       * '#00000080' -pointsize 26 -gravity SouthEast -annotate \    *
-       * +10+10 "test" frame001.jpg                                  *
-       *  ---------------------------------------------------------- */
-      char time_hr[3];
-      int hlen = strlen(arch_file)-10;
-      strncpy(time_hr, arch_file+hlen, 2);
-      time_hr[2] = '\0';
-      char time_mn[3];
-      int mlen = strlen(arch_file)-8;
-      strncpy(time_mn, arch_file+mlen, 2);
-      time_mn[2] = '\0';
-      char imprint[255];
-      snprintf(imprint, sizeof(imprint)-1, "Pi-Weather %s Time: %s:%s", target_day, time_hr, time_mn);
-      //if(verbose == 1) printf("imprint str: %s\n", imprint);
-      snprintf(system_cmd, sizeof(system_cmd)-1, "/usr/bin/mogrify -fill white -undercolor '#00000080' -pointsize 20 -gravity SouthEast -annotate +20+20 '%s' %s", imprint, new_file);
-      //if(verbose == 1) printf("system_cmd: %s\n", system_cmd);
-      system(system_cmd);
-   }
-   if(verbose == 1) printf("-> filecopy and mogrify imprint complete\n");
-   free(imgfile_list);
-
    /* ---------------------------------------------------------- *
     * generate video creation time to be embedded as meta data,  *
     * e.g. set the movie creation_date="2017-04-05 22:10:04"     *
     * and set the title="pi-weather 2017-04-04" to image date    *    
     * ---------------------------------------------------------- */
    time_t now = time(NULL);
-   char meta_date[36];
    strftime(meta_date, sizeof(meta_date), "creation_time=\"%Y-%m-%d %T\"", localtime(&now));
-
-   char meta_title[128];
    snprintf(meta_title, sizeof(meta_title)-1, "title=\"Pi-Weather %s\"", target_day);
 
+   signal(SIGPIPE, SIG_IGN);   // a failed ffmpeg returns EPIPE, not a signal
+   if(threads == 0) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+   if(threads < 1) threads = 1;
+   if(threads > MAXTHREAD) threads = MAXTHREAD;
+
    /* ---------------------------------------------------------- *
-    * generate the movie filename for the ffmpeg video package   *
+    * In segment mode, encode all closed hours of the day that   *
+    * have no segment yet. For today, the current hour is still  *
+    * open. With -o, the segments so far are joined into the     *
+    * "today so far" movie for the web page.                     *
     * ---------------------------------------------------------- */
-   char mov_file[268+11];
-   int av_ret;
-
-   snprintf(mov_file, sizeof(mov_file)-1, "%s/wcam-%s.mp4", srcimg_dir, target_day);
-   if(verbose == 1) printf("Debug: create movie_file 1 [%s]\n", mov_file);
+   if(segment_mode == 1) {
+      char today[11];
+      int endhour = 24;
+      strftime(today, sizeof(today), "%Y-%m-%d", localtime(&now));
+      if(strcmp(today, target_day) == 0) endhour = localtime(&now)->tm_hour;
+
+      int segments = build_segments(endhour);
+      if(verbose == 1) printf("Debug: [%d] segments before hour [%d]\n", segments, endhour);
+      if(segments > 0 && strlen(movie_file) != 0) {
+         if(concat_segments(movie_file, 0) != 0) printf("Error creating movie_file %s from segments\n", movie_file);
+         else if(verbose == 1) printf("Debug: created movie_file [%s] from [%d] segments\n", movie_file, segments);
+      }
+      for(i=0; i<file_counter; i++) free(imgfile_list[i]);
+      free(imgfile_list);
+      free(imgbright_list);
+      exit(0);
+   }
 
    /* ---------------------------------------------------------- *
-    * Create the ffmpeg system command with video arguments      *
+    * generate the movie filename for the ffmpeg video package   *
     * ---------------------------------------------------------- */
+   char mov_file[268+11];
+   char system_cmd[2048];// shell command string, needs more than 255 for avconv option list
    char cmd_args[1024];
-   snprintf(cmd_args, sizeof(cmd_args)-1,
-            "%s -i %s/frame%%03d.jpg %s -metadata %s -metadata %s",
-            avconv_bin, tmpdir, avout_args, meta_date, meta_title);
+   int av_ret = -1;
 
-   /* ---------------------------------------------------------- *
-    * Unless verbose, add "quiet mode" silencer args to ffmpeg   *
-    * ---------------------------------------------------------- */
-   if(verbose == 1) snprintf(system_cmd, sizeof(system_cmd)-1, "%s %s", cmd_args, mov_file);
-   else snprintf(system_cmd, sizeof(system_cmd)-1, "%s %s %s", cmd_args, avsilencer, mov_file);
+   snprintf(mov_file, sizeof(mov_file)-1, "%s/wcam-%s.mp4", srcimg_dir, target_day);
+   if(verbose == 1) printf("Debug: create movie_file 1 [%s]\n", mov_file);
 
    /* ---------------------------------------------------------- *
-    * execute the movie generation                               *
+    * If hourly segments were built during the day, encode only  *
+    * the missing hours and join them without re-encoding. Else  *
+    * encode the complete day in one go.                         *
     * ---------------------------------------------------------- */
-   if(verbose == 1) printf("Debug: system_cmd [%s]\n", system_cmd);
-   av_ret = system(system_cmd);
+   int segments = 0;
+   for(i=0; i<24; i++) {
+      char seg_file[300];
+      snprintf(seg_file, sizeof(seg_file), "%s/wcam-%s-%02d.mp4", srcimg_dir, target_day, i);
+      if(stat(seg_file, &file_stat) == 0) segments++;
+   }
+   if(segments > 0) {
+      segments = build_segments(24);
+      if(verbose == 1) printf("Debug: join [%d] hourly segments\n", segments);
+      av_ret = concat_segments(mov_file, 1);
+   }
+   else av_ret = encode_movie(0, file_counter, mov_file);
 
    if(av_ret != 0) printf("Error creating movie_file 1 with ffmpeg, return code %d\n", av_ret);
    else if(verbose == 1) printf("Debug: create movie_file 1 completed, return code [%d]\n", av_ret);
@@ -539,16 +1313,12 @@ int main(int argc, char *argv[]) {
    }
 
    /* ---------------------------------------------------------- *
-    * clean up the temporary frames                              *
+    * If we got a movie, pack the original jpeg files per day    *
     * ---------------------------------------------------------- */
-   int deleted = 0;
-   deleted = delete_tmp(tmpdir);
-   if(verbose == 1) printf("Debug: Deleted [%d] jpeg files in [%s]\n", deleted, tmpdir);
-
-   /* ---------------------------------------------------------- *
-    * If we got a movie, zip up the original jpeg files per day  *
-    * ---------------------------------------------------------- */
-   if(av_ret == 0) origin_zip(srcimg_dir);
+   if(av_ret == 0) origin_pack(srcimg_dir);
+   for(i=0; i<file_counter; i++) free(imgfile_list[i]);
+   free(imgfile_list);
+   free(imgbright_list);
 
    if(verbose == 1) {
       tstamp = time(NULL);
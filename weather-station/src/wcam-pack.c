@@ -0,0 +1,184 @@
+/* ------------------------------------------------------------ *
+ * file:        wcam-pack.c                                     *
+ * purpose:     Indexed frame container for a day of webcam     *
+ *              images, see wcam-pack.h for the file layout.    *
+ *                                                              *
+ * Return Code: Returns 0 on success, and -1 on error.          *
+ *                                                              *
+ * Requires:    wcam-pack.h                                     *
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ *                                                              *
+ * compile: gcc -c wcam-pack.c                                  *
+ * ------------------------------------------------------------ */
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "wcam-pack.h"
+
+/* ------------------------------------------------------------ *
+ * read_trailer() checks the trailer at the end of the pack and *
+ * returns the number of index entries, or -1 if it is broken.  *
+ * ------------------------------------------------------------ */
+static int read_trailer(int fd, off_t fsize, wpk_trailer_t *trl) {
+  if(fsize < (off_t) (sizeof(wpk_header_t) + sizeof(wpk_trailer_t))) return -1;
+  if(pread(fd, trl, sizeof(*trl), fsize - sizeof(*trl)) != sizeof(*trl)) return -1;
+  if(memcmp(trl->magic, WPK_IDXMAGIC, sizeof(trl->magic)) != 0) return -1;
+  if(trl->offset + (uint64_t) trl->count * sizeof(wpk_entry_t) + sizeof(*trl) != (uint64_t) fsize) return -1;
+  return trl->count;
+}
+
+/* ------------------------------------------------------------ *
+ * rebuild_index() walks the frame records after the header and *
+ * recreates the index, e.g. after an append was interrupted.   *
+ * Sets the end of the last complete frame in *end.             *
+ * ------------------------------------------------------------ */
+static wpk_entry_t *rebuild_index(int fd, off_t fsize, uint32_t *count, off_t *end) {
+  wpk_entry_t *index = NULL;
+  wpk_record_t rec;
+  off_t pos = sizeof(wpk_header_t);
+  uint32_t max = 0;
+
+  *count = 0;
+  while(pos + (off_t) sizeof(rec) <= fsize) {
+    if(pread(fd, &rec, sizeof(rec), pos) != sizeof(rec)) break;
+    if(rec.magic != WPK_RECMAGIC) break;
+    if(pos + (off_t) sizeof(rec) + (off_t) WPK_ALIGN(rec.size) > fsize) break;
+    if(*count == max) {
+      max = (max == 0) ? 1024 : max * 2;
+      wpk_entry_t *tmp = realloc(index, max * sizeof(wpk_entry_t));
+      if(tmp == NULL) break;
+      index = tmp;
+    }
+    index[*count].tstamp = rec.tstamp;
+    index[*count].offset = pos + sizeof(rec);
+    index[*count].size = rec.size;
+    index[*count].reserved = 0;
+    (*count)++;
+    pos += sizeof(rec) + WPK_ALIGN(rec.size);
+  }
+  *end = pos;
+  return index;
+}
+
+/* ------------------------------------------------------------ *
+ * wpk_open() opens the pack file for writing, and creates it   *
+ * if needed. The exclusive lock is held until wpk_close(), so  *
+ * readers never see a half written index. The existing index   *
+ * is read into memory, new frames will overwrite it on disk.   *
+ * ------------------------------------------------------------ */
+int wpk_open(const char *file, wpk_t *wpk) {
+  wpk_header_t hdr;
+  wpk_trailer_t trl;
+  struct stat st;
+  off_t end;
+
+  memset(wpk, 0, sizeof(*wpk));
+  wpk->fd = open(file, O_RDWR | O_CREAT, 0644);
+  if(wpk->fd == -1) return -1;
+  if(flock(wpk->fd, LOCK_EX) == -1 || fstat(wpk->fd, &st) == -1) {
+    close(wpk->fd);
+    return -1;
+  }
+
+  if(st.st_size == 0) {
+    /* new pack file, write the header */
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, WPK_MAGIC, sizeof(hdr.magic));
+    hdr.version = WPK_VERSION;
+    if(write(wpk->fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+      close(wpk->fd);
+      return -1;
+    }
+    wpk->pos = sizeof(hdr);
+    return 0;
+  }
+
+  if(pread(wpk->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+     || memcmp(hdr.magic, WPK_MAGIC, sizeof(hdr.magic)) != 0
+     || hdr.version != WPK_VERSION) {
+    close(wpk->fd);
+    return -1;
+  }
+  if(read_trailer(wpk->fd, st.st_size, &trl) >= 0) {
+    wpk->count = wpk->max = trl.count;
+    wpk->index = malloc((trl.count > 0 ? trl.count : 1) * sizeof(wpk_entry_t));
+    if(wpk->index == NULL || pread(wpk->fd, wpk->index, trl.count * sizeof(wpk_entry_t), trl.offset)
+                             != (ssize_t) (trl.count * sizeof(wpk_entry_t))) {
+      free(wpk->index);
+      close(wpk->fd);
+      return -1;
+    }
+    wpk->pos = trl.offset;
+  }
+  else {
+    /* no valid trailer, recover the index from the records */
+    wpk->index = rebuild_index(wpk->fd, st.st_size, &wpk->count, &end);
+    wpk->max = wpk->count;
+    wpk->pos = end;
+  }
+  return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * wpk_append() adds one jpg frame behind the last frame, and   *
+ * keeps its index entry in memory until wpk_close().           *
+ * ------------------------------------------------------------ */
+int wpk_append(wpk_t *wpk, time_t tstamp, const unsigned char *data, uint32_t size) {
+  wpk_record_t rec;
+  static const unsigned char pad[8];
+
+  if(wpk->count == wpk->max) {
+    uint32_t max = (wpk->max == 0) ? 1024 : wpk->max * 2;
+    wpk_entry_t *index = realloc(wpk->index, max * sizeof(wpk_entry_t));
+    if(index == NULL) return -1;
+    wpk->index = index;
+    wpk->max = max;
+  }
+
+  /* write the frame record over the old index, with padding */
+  rec.magic = WPK_RECMAGIC;
+  rec.size = size;
+  rec.tstamp = tstamp;
+  uint32_t padsize = WPK_ALIGN(size) - size;
+  if(pwrite(wpk->fd, &rec, sizeof(rec), wpk->pos) != sizeof(rec)
+     || pwrite(wpk->fd, data, size, wpk->pos + sizeof(rec)) != (ssize_t) size
+     || pwrite(wpk->fd, pad, padsize, wpk->pos + sizeof(rec) + size) != (ssize_t) padsize)
+    return -1;
+
+  wpk->index[wpk->count].tstamp = tstamp;
+  wpk->index[wpk->count].offset = wpk->pos + sizeof(rec);
+  wpk->index[wpk->count].size = size;
+  wpk->index[wpk->count].reserved = 0;
+  wpk->count++;
+  wpk->pos += sizeof(rec) + WPK_ALIGN(size);
+  return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * wpk_close() writes the index and trailer behind the frames,  *
+ * cuts off any leftovers, syncs the file and drops the lock.   *
+ * ------------------------------------------------------------ */
+int wpk_close(wpk_t *wpk) {
+  wpk_trailer_t trl;
+  size_t idxsize = wpk->count * sizeof(wpk_entry_t);
+  int ret = 0;
+
+  memset(&trl, 0, sizeof(trl));
+  memcpy(trl.magic, WPK_IDXMAGIC, sizeof(trl.magic));
+  trl.count = wpk->count;
+  trl.offset = wpk->pos;
+  if((idxsize > 0 && pwrite(wpk->fd, wpk->index, idxsize, wpk->pos) != (ssize_t) idxsize)
+     || pwrite(wpk->fd, &trl, sizeof(trl), wpk->pos + idxsize) != sizeof(trl)
+     || ftruncate(wpk->fd, wpk->pos + idxsize + sizeof(trl)) == -1
+     || fsync(wpk->fd) == -1) ret = -1;
+  close(wpk->fd);
+  free(wpk->index);
+  memset(wpk, 0, sizeof(*wpk));
+  return ret;
+}
@@ -0,0 +1,73 @@
+/* ------------------------------------------------------------ *
+ * file:        wcam-pack.h                                     *
+ * purpose:     Indexed frame container for a day of webcam     *
+ *              images. The .wpk file stores the jpg images     *
+ *              uncompressed, followed by a timestamp index:    *
+ *                                                              *
+ *              header  "WCAMPACK", version, reserved (16 byte) *
+ *              frame   record header (16 byte) + jpg data,     *
+ *                      padded to a multiple of 8 bytes         *
+ *              ...                                             *
+ *              index   one entry per frame (24 byte each)      *
+ *              trailer "WCAMIDX", count, index offset (24 byte)*
+ *                                                              *
+ *              A writer holds an exclusive flock() from open   *
+ *              to close. New frames go over the old index, the *
+ *              index and trailer are written once at close. If *
+ *              a writer died, the record headers allow to      *
+ *              rebuild the index. Readers (web/wcamframe.php)  *
+ *              take a shared flock(), then seek by the index.  *
+ *              All values are stored in little endian byte     *
+ *              order (Raspberry Pi).                           *
+ *                                                              *
+ * Return Code: Returns 0 on success, and -1 on error.          *
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ * ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define WPK_MAGIC     "WCAMPACK"
+#define WPK_IDXMAGIC  "WCAMIDX"
+#define WPK_VERSION   1
+#define WPK_RECMAGIC  0x4d524657    // "WFRM" frame record header
+#define WPK_ALIGN(x)  (((x) + 7) & ~((uint64_t) 7))
+
+typedef struct {
+  char magic[8];                    // WPK_MAGIC
+  uint32_t version;                 // WPK_VERSION
+  uint32_t reserved;
+} wpk_header_t;
+
+typedef struct {
+  uint32_t magic;                   // WPK_RECMAGIC
+  uint32_t size;                    // jpg data size in bytes
+  int64_t tstamp;                   // frame time, seconds since epoch
+} wpk_record_t;
+
+typedef struct {
+  int64_t tstamp;                   // frame time, seconds since epoch
+  uint64_t offset;                  // file offset of the jpg data
+  uint32_t size;                    // jpg data size in bytes
+  uint32_t reserved;
+} wpk_entry_t;
+
+typedef struct {
+  char magic[8];                    // WPK_IDXMAGIC
+  uint32_t count;                   // number of index entries
+  uint32_t reserved;
+  uint64_t offset;                  // file offset of the index
+} wpk_trailer_t;
+
+typedef struct {
+  int fd;                           // the locked pack file
+  wpk_entry_t *index;               // the index, kept in memory
+  uint32_t count;                   // number of frames
+  uint32_t max;                     // allocated index entries
+  uint64_t pos;                     // end of the last frame
+} wpk_t;
+
+int wpk_open(const char *file, wpk_t *wpk);
+int wpk_append(wpk_t *wpk, time_t tstamp, const unsigned char *data, uint32_t size);
+int wpk_close(wpk_t *wpk);
@@ -126,6 +126,12 @@ if($filecount == $cycle) {
 
    echo "</tr></table>\n";
 } // end if movie set is 6
+
+// Show the timelapse of today so far, joined hourly by wcam-mkmovie -s
+$today = "wcam/today.mp4";
+if (file_exists($today) && date('Y-m-d', filemtime($today)) == date('Y-m-d')) {
+   echo "<p>Today so far: <a href=\"$today\">time-lapse movie up to ".date("H:i", filemtime($today))."</a>\n";
+}
 ?>
 <?php include("./daymimax.htm"); ?>
 <p>
@@ -0,0 +1,98 @@
+<?php
+// ------------------------------------------------------------
+// wcamframe.php serves a single webcam frame out of the day's
+// frame container wcam/YYYY/MM/DD/wcam-YYYY-MM-DD.wpk, created
+// by wcam-mkmovie (see src/wcam-pack.h for the file layout).
+// The index at the end of the file gets searched by time, and
+// only the requested jpg is read, without unpacking the file.
+//
+// Usage: wcamframe.php?day=2017-03-25&time=1430
+// returns the last frame taken at or before 14:30 on that day.
+// If the day is not packed yet, the archived jpg is returned,
+// found through the day index wcam-index.txt of wcam-archive.
+// ------------------------------------------------------------
+$day  = isset($_GET['day'])  ? $_GET['day']  : "";
+$time = isset($_GET['time']) ? $_GET['time'] : "1200";
+
+if (! preg_match('/^(\d{4})-(\d{2})-(\d{2})$/', $day, $d) ||
+    ! preg_match('/^(\d{2})(\d{2})$/', $time, $t)) {
+   header("HTTP/1.0 400 Bad Request");
+   exit("Error: use day=YYYY-MM-DD and time=HHMM\n");
+}
+$dir = "wcam/$d[1]/$d[2]/$d[3]";
+$tstamp = mktime($t[1], $t[2], 59, $d[2], $d[3], $d[1]);
+
+// The day is not packed yet: look for the archived jpg file,
+// the last good one in the day index at or before $tstamp.
+// Without index, take the last jpg of that minute.
+$pack = "$dir/wcam-$day.wpk";
+if (! file_exists($pack)) {
+   $file = "";
+   $index = "$dir/wcam-index.txt";
+   if (file_exists($index)) {
+      foreach (file($index, FILE_IGNORE_NEW_LINES) as $line) {
+         $f = explode(" ", $line);
+         if (count($f) == 5 && $f[4] == "ok" && $f[0] <= $tstamp) {
+            $file = "$dir/$f[1]";
+         }
+      }
+   }
+   else {
+      $list = glob("$dir/wcam-$d[1]$d[2]$d[3]_$t[1]$t[2]??.jpg");
+      if (! empty($list)) { $file = end($list); }
+   }
+   if ($file == "" || ! file_exists($file)) {
+      header("HTTP/1.0 404 Not Found");
+      exit("Error: no frame for $day $time\n");
+   }
+   header("Content-Type: image/jpeg");
+   header("Content-Length: ".filesize($file));
+   readfile($file);
+   exit;
+}
+
+// The 64-bit pack values are read as two 32-bit words, the "P"
+// format of unpack() does not exist on 32-bit PHP (armhf).
+function u64($lo, $hi) {
+   return sprintf("%u", $lo) + $hi * 4294967296;
+}
+
+// Read the trailer: magic, frame count, reserved, index offset
+// The shared lock waits for wcam-mkmovie to finish the index.
+$fp = fopen($pack, "rb");
+if ($fp === false || ! flock($fp, LOCK_SH)) {
+   header("HTTP/1.0 500 Internal Server Error");
+   exit("Error: cannot read $pack\n");
+}
+fseek($fp, -24, SEEK_END);
+$trl = unpack("a8magic/Vcount/Vreserved/Voff_lo/Voff_hi", fread($fp, 24));
+$trl['offset'] = u64($trl['off_lo'], $trl['off_hi']);
+if (rtrim($trl['magic'], "\0") != "WCAMIDX" || $trl['count'] == 0) {
+   header("HTTP/1.0 500 Internal Server Error");
+   exit("Error: $pack has no valid index\n");
+}
+
+// Binary search the index for the last frame at or before $tstamp
+// Each index entry: timestamp, data offset, data size, reserved
+$lo = 0;
+$hi = $trl['count'] - 1;
+while ($lo < $hi) {
+   $mid = intdiv($lo + $hi + 1, 2);
+   fseek($fp, $trl['offset'] + $mid * 24);
+   $e = unpack("Vts_lo/Vts_hi", fread($fp, 8));
+   if (u64($e['ts_lo'], $e['ts_hi']) <= $tstamp) { $lo = $mid; }
+   else { $hi = $mid - 1; }
+}
+fseek($fp, $trl['offset'] + $lo * 24);
+$entry = unpack("Vts_lo/Vts_hi/Voff_lo/Voff_hi/Vsize/Vreserved", fread($fp, 24));
+$entry['tstamp'] = u64($entry['ts_lo'], $entry['ts_hi']);
+$entry['offset'] = u64($entry['off_lo'], $entry['off_hi']);
+
+// Send the jpg data straight out of the pack file
+header("Content-Type: image/jpeg");
+header("Content-Length: ".$entry['size']);
+header("Last-Modified: ".gmdate("D, d M Y H:i:s", $entry['tstamp'])." GMT");
+fseek($fp, $entry['offset']);
+echo fread($fp, $entry['size']);
+fclose($fp);
+?>
@@ -114,6 +114,12 @@ if [[ ! -d $DATADIR ]]; then
 else
    echo "Skipping creation, application directory [$DATADIR] exists."
 fi
+# the rrdgraph cache is newer, existing installs need it too
+if [[ ! -d $DATADIR/cache ]]; then
+   echo "Create sub-directory [$DATADIR/cache] for rrdgraph"
+   mkdir $DATADIR/cache
+   chown www-data:www-data $DATADIR/cache
+fi
 echo "Done."
 echo
 
@@ -262,6 +268,14 @@ else
    chmod 644 $DATADIR/etc/pi-web.conf
 fi
 ls -l $DATADIR/etc/pi-web.conf
+
+if [[ -f $DATADIR/etc/jobsched.conf ]]; then
+   echo "Skipping job list copy, $DATADIR/etc/jobsched.conf exists."
+else
+   echo "cp ../etc/jobsched.conf $DATADIR/etc"
+   cp ../etc/jobsched.conf $DATADIR/etc
+   chmod 644 $DATADIR/etc/jobsched.conf
+fi
 echo "Done."
 echo
 
@@ -389,6 +403,47 @@ fi
 echo "Done."
 echo
 
+echo "##########################################################"
+echo "# 18. Map /cgi-bin/rrdgraph to $DATADIR/bin/rrdgraph"
+echo "##########################################################"
+# The station pages load their graphs from the rrdgraph CGI,
+# rrdupdate.sh no longer renders them. It runs as www-data,
+# the web user needs to own the graph cache folder.
+echo "chown www-data:www-data $DATADIR/cache"
+chown www-data:www-data $DATADIR/cache
+if [[ -d /etc/lighttpd/conf-available ]]; then
+   CGICONF=/etc/lighttpd/conf-available/90-pi-web-rrdgraph.conf
+   echo "Creating lighttpd config [$CGICONF]"
+   cat <<EOM >$CGICONF
+# pi-web: station graphs are rendered by rrdgraph, see setup.sh
+\$HTTP["url"] =~ "^/cgi-bin/rrdgraph" {
+   alias.url = ( "/cgi-bin/rrdgraph" => "$DATADIR/bin/rrdgraph" )
+   cgi.assign = ( "" => "" )
+}
+EOM
+   lighty-enable-mod cgi pi-web-rrdgraph
+   service lighttpd force-reload
+elif [[ -d /etc/apache2/conf-available ]]; then
+   CGICONF=/etc/apache2/conf-available/pi-web-rrdgraph.conf
+   echo "Creating apache config [$CGICONF]"
+   cat <<EOM >$CGICONF
+# pi-web: station graphs are rendered by rrdgraph, see setup.sh
+ScriptAlias /cgi-bin/rrdgraph $DATADIR/bin/rrdgraph
+<Directory $DATADIR/bin>
+   <Files "rrdgraph">
+      Require all granted
+   </Files>
+</Directory>
+EOM
+   a2enmod cgi
+   a2enconf pi-web-rrdgraph
+   service apache2 reload
+else
+   echo "Error: no lighttpd or apache2 found. Map the URL /cgi-bin/rrdgraph"
+   echo "to the CGI program $DATADIR/bin/rrdgraph, running as www-data."
+fi
+echo "Done."
+echo
 
 echo "##########################################################"
 echo "# End of Pi-Weather Installation."
@@ -0,0 +1,613 @@
+/* ------------------------------------------------------------ *
+ * file:        jobsched.c                                      *
+ * purpose:     Scheduler for the heavy per-station jobs, e.g.  *
+ *              the monthly/yearly solar graphs and the pvpower *
+ *              tables. Before, all stations started them in    *
+ *              the first minute after midnight, so the server  *
+ *              load came in spikes. Here each job of a station *
+ *              runs at a fixed offset within the job window,   *
+ *              from a hash of the job and station name, and no *
+ *              more than -l jobs run at the same time. Adding  *
+ *              stations spreads out the load, without spikes.  *
+ *                                                              *
+ *              The jobs are in etc/jobsched.conf, one per line *
+ *              <name> <period> <window> <command>              *
+ *              period and window are in seconds, the period is *
+ *              aligned to the station local midnight, %s in    *
+ *              the command is replaced with the station name.  *
+ *                                                              *
+ *              For each job run, the wait time after its due   *
+ *              time and the run time are written to the stats  *
+ *              file (-o), the job output goes into the station *
+ *              log folder as <job>.log. At start, the last run *
+ *              of each task is read back from the stats file,  *
+ *              so a restart does not repeat the days jobs.     *
+ *                                                              *
+ * return:      Returns 0 after SIGTERM, and -1 on errors.      *
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ *                                                              *
+ * compile: gcc jobsched.c -o jobsched                          *
+ * ------------------------------------------------------------ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* ------------------------------------------------------------ *
+ * Max number of config file entries, and their key/value size  *
+ * ------------------------------------------------------------ */
+#define MAXCONF    64
+#define MAXCLEN    256
+/* ------------------------------------------------------------ *
+ * Max number of jobs and stations, and the default job limit   *
+ * ------------------------------------------------------------ */
+#define MAXJOB     16
+#define MAXSTATION 128
+#define MAXRUN     64
+#define RUNLIMIT   2
+
+/* ------------------------------------------------------------ *
+ * Global variables and defaults                                *
+ * ------------------------------------------------------------ */
+int verbose = 0;
+int printonly = 0;                    // 1 = print the schedule and exit
+int runlimit = RUNLIMIT;              // max jobs running at the same time
+char jobfile[MAXCLEN*2];              // the job list, etc/jobsched.conf
+char statfile[MAXCLEN*2];             // the job statistics output file
+char conf_key[MAXCONF][MAXCLEN];      // the config file keys
+char conf_val[MAXCONF][MAXCLEN];      // the config file values
+int conf_cnt = 0;                     // the number of config entries
+volatile sig_atomic_t stop = 0;       // set by SIGTERM and SIGINT
+extern char *optarg;
+extern int optind, opterr, optopt;
+
+/* ------------------------------------------------------------ *
+ * The jobs from jobsched.conf, and the stations from chroot    *
+ * ------------------------------------------------------------ */
+typedef struct {
+   char name[32];          // the job name, used for its log file
+   int period;             // run once per period seconds
+   int window;             // spread the stations over this time
+   char cmd[MAXCLEN*2];    // the command, %s = station name
+} job_t;
+
+typedef struct {
+   char name[32];          // the station name, e.g. pi-ws01
+   char tzs[MAXCLEN];      // the stations timezone string
+   time_t midnight;        // the start of the stations local day
+   time_t tomorrow;        // the start of the next local day
+} station_t;
+
+/* ------------------------------------------------------------ *
+ * A task is one job for one station, with its run statistics   *
+ * ------------------------------------------------------------ */
+typedef struct {
+   job_t *job;
+   station_t *st;
+   int offset;             // seconds after the period start
+   time_t done;            // the period start of the last run
+   time_t due;             // when the current run was due
+   int queued;             // 1 = due, waiting for a free slot
+   pid_t pid;              // the running job, or 0
+   struct timespec start;  // when the current run started
+   long runs;              // the number of finished runs
+   int rc;                 // the last exit code
+   double wait;            // the last wait after due, in seconds
+   double run;             // the last run time, in seconds
+   double sum_run;         // the total run time, for the average
+   double max_run;         // the longest run time
+} task_t;
+
+job_t jobs[MAXJOB];
+int job_cnt = 0;
+station_t stations[MAXSTATION];
+int st_cnt = 0;
+task_t *tasks = NULL;
+int task_cnt = 0;
+int running = 0;
+
+/* ------------------------------------------------------------ *
+ * print_usage() prints the programs commandline instructions.  *
+ * ------------------------------------------------------------ */
+void usage() {
+   static char const usage[] = "Usage: jobsched [-c job-file] [-l limit] [-o stat-file] [-p] [-v]\n\
+   Command line parameters have the following format:\n\
+   -c   job list file, optional, default <bin>/../etc/jobsched.conf\n\
+   -l   max number of jobs running at the same time, optional, default 2\n\
+   -o   job statistics file, optional, default <pi-web-data>/log/jobsched.stat\n\
+   -p   optional, print the schedule of all stations and exit\n\
+   -h   optional, display this message\n\
+   -v   optional, enables debug output\n\
+   Usage examples:\n\
+./jobsched -l 2\n\
+./jobsched -p\n";
+   printf(usage);
+}
+
+/* ------------------------------------------------------------ *
+ * parseargs() checks the commandline arguments with C getopt   *
+ * ------------------------------------------------------------ */
+void parseargs(int argc, char* argv[]) {
+   int arg;
+   opterr = 0;
+
+   while ((arg = (int) getopt (argc, argv, "c:l:o:pvh")) != -1)
+      switch (arg) {
+         // arg -c + job list file, type: string
+         // optional, example: /srv/app/pi-web01/etc/jobsched.conf
+         case 'c':
+            if(verbose == 1) printf("Debug: arg -c, value %s\n", optarg);
+            snprintf(jobfile, sizeof(jobfile), "%s", optarg);
+            break;
+
+         // arg -l + running job limit, type: int
+         // optional, example: 2
+         case 'l':
+            if(verbose == 1) printf("Debug: arg -l, value %s\n", optarg);
+            runlimit = atoi(optarg);
+            if(runlimit < 1 || runlimit > MAXRUN) {
+               printf("Error: Cannot get valid -l limit argument (1..%d).\n", MAXRUN);
+               exit(-1);
+            }
+            break;
+
+         // arg -o + statistics file, type: string
+         // optional, example: /srv/app/pi-web01/log/jobsched.stat
+         case 'o':
+            if(verbose == 1) printf("Debug: arg -o, value %s\n", optarg);
+            snprintf(statfile, sizeof(statfile), "%s", optarg);
+            break;
+
+         // arg -p print schedule, type: flag, optional
+         case 'p':
+            printonly = 1; break;
+
+         // arg -v verbose, type: flag, optional
+         case 'v':
+            verbose = 1; break;
+
+         // arg -h usage, type: flag, optional
+         case 'h':
+            usage(); exit(0);
+
+         case '?':
+            if (isprint (optopt))
+               printf ("Error: Unknown option `-%c'.\n", optopt);
+            else
+               printf ("Error: Unknown option character `\\x%x'.\n", optopt);
+
+         default:
+            usage(); exit(-1);
+    }
+}
+
+/* ------------------------------------------------------------ *
+ * readconfig() loads the key=value lines of a config file.     *
+ * Lines starting with # are comments, quotes are stripped.     *
+ * ------------------------------------------------------------ */
+int readconfig(const char *file) {
+   FILE *fp;
+   char line[MAXCLEN];
+
+   if(! (fp=fopen(file, "r"))) return -1;
+
+   while(fgets(line, sizeof(line), fp) != NULL && conf_cnt < MAXCONF) {
+      if(line[0] == '#') continue;
+      char *val = strchr(line, '=');
+      if(val == NULL || val == line) continue;
+      *val++ = '\0';
+      val[strcspn(val, "\r\n")] = '\0';
+      size_t vlen = strlen(val);
+      if(vlen >= 2 && val[0] == '"' && val[vlen-1] == '"') {
+         val[vlen-1] = '\0';
+         val++;
+      }
+      if(strlen(val) == 0) continue;
+      snprintf(conf_key[conf_cnt], MAXCLEN, "%s", line);
+      snprintf(conf_val[conf_cnt], MAXCLEN, "%s", val);
+      conf_cnt++;
+   }
+   fclose(fp);
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * getconfig() returns the value for key, or NULL if not found  *
+ * ------------------------------------------------------------ */
+const char *getconfig(const char *key) {
+   int i;
+   for(i=0; i<conf_cnt; i++)
+      if(strcmp(conf_key[i], key) == 0) return conf_val[i];
+   return NULL;
+}
+
+/* ------------------------------------------------------------ *
+ * read_jobs() loads the job list: name, period, window and the *
+ * command. The period must divide a day, so that it can align  *
+ * to midnight, and the window must fit into the period.        *
+ * ------------------------------------------------------------ */
+void read_jobs(const char *file) {
+   FILE *fp;
+   char line[MAXCLEN*3];
+   int n, lnum = 0;
+
+   if(! (fp=fopen(file, "r"))) {
+      printf("Error: cannot open job list %s.\n", file);
+      exit(-1);
+   }
+   while(fgets(line, sizeof(line), fp) != NULL) {
+      lnum++;
+      line[strcspn(line, "\r\n")] = '\0';
+      if(line[0] == '#' || strspn(line, " \t") == strlen(line)) continue;
+      if(job_cnt == MAXJOB) {
+         printf("Error: %s has more than %d jobs.\n", file, MAXJOB);
+         exit(-1);
+      }
+      job_t *j = &jobs[job_cnt];
+      if(sscanf(line, "%31s %d %d %n", j->name, &j->period, &j->window, &n) != 3
+         || strlen(line + n) == 0 || j->period < 60 || 86400 % j->period != 0
+         || j->window < 1 || j->window > j->period) {
+         printf("Error: %s line %d: expecting <name> <period> <window> <command>.\n", file, lnum);
+         exit(-1);
+      }
+      snprintf(j->cmd, sizeof(j->cmd), "%s", line + n);
+      if(verbose == 1) printf("Debug: job %s period [%d] window [%d] cmd [%s]\n",
+                              j->name, j->period, j->window, j->cmd);
+      job_cnt++;
+   }
+   fclose(fp);
+   if(job_cnt == 0) {
+      printf("Error: no jobs found in %s.\n", file);
+      exit(-1);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * read_stations() gets the pi-wsXX folders with a station      *
+ * config under chroot, and their timezone.                     *
+ * ------------------------------------------------------------ */
+void read_stations(const char *datadir) {
+   char path[MAXCLEN*2], file[MAXCLEN*4];
+   struct dirent *de;
+   const char *tzs;
+   int globals = conf_cnt;
+
+   snprintf(path, sizeof(path), "%s/chroot", datadir);
+   DIR *dir = opendir(path);
+   if(dir == NULL) {
+      printf("Error: cannot open %s.\n", path);
+      exit(-1);
+   }
+   while((de = readdir(dir)) != NULL && st_cnt < MAXSTATION) {
+      const char *name = de->d_name;
+      if(strncmp(name, "pi-ws", 5) != 0 || strlen(name) != 7
+         || ! isdigit(name[5]) || ! isdigit(name[6])) continue;
+      snprintf(file, sizeof(file), "%s/%s/etc/%s.conf", path, name, name);
+      if(readconfig(file) != 0) continue;
+      station_t *st = &stations[st_cnt++];
+      snprintf(st->name, sizeof(st->name), "%s", name);
+      if((tzs = getconfig("pi-weather-tzs")) != NULL)
+         snprintf(st->tzs, sizeof(st->tzs), "%s", tzs);
+      conf_cnt = globals;
+   }
+   closedir(dir);
+   if(st_cnt == 0) {
+      printf("Error: no stations found in %s.\n", path);
+      exit(-1);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * task_offset() returns the fixed offset of a job for station, *
+ * a FNV-1a hash of both names, so that it stays the same over  *
+ * restarts, and spreads the stations evenly over the window.   *
+ * ------------------------------------------------------------ */
+int task_offset(const job_t *j, const station_t *st) {
+   uint32_t h = 2166136261u;
+   const char *p;
+   for(p = j->name; *p; p++) { h ^= (unsigned char) *p; h *= 16777619u; }
+   h ^= '/'; h *= 16777619u;
+   for(p = st->name; *p; p++) { h ^= (unsigned char) *p; h *= 16777619u; }
+   return (int) (h % (uint32_t) j->window);
+}
+
+/* ------------------------------------------------------------ *
+ * station_day() sets the start of the stations local day, and  *
+ * of the next one. Only then TZ changes, once a day a station. *
+ * ------------------------------------------------------------ */
+void station_day(station_t *st, time_t now) {
+   struct tm lt;
+   if(strlen(st->tzs) > 0) setenv("TZ", st->tzs, 1);
+   else unsetenv("TZ");
+   tzset();
+   localtime_r(&now, &lt);
+   lt.tm_hour = 0; lt.tm_min = 0; lt.tm_sec = 0; lt.tm_isdst = -1;
+   st->midnight = mktime(&lt);
+   lt.tm_mday++; lt.tm_isdst = -1;
+   st->tomorrow = mktime(&lt);
+   unsetenv("TZ");
+   tzset();
+}
+
+/* ------------------------------------------------------------ *
+ * period_start() returns the start of the period at now, the   *
+ * periods are aligned to the station local midnight.           *
+ * ------------------------------------------------------------ */
+time_t period_start(const task_t *t, time_t now) {
+   station_t *st = t->st;
+   if(now >= st->tomorrow || now < st->midnight) station_day(st, now);
+   return st->midnight + ((now - st->midnight) / t->job->period) * t->job->period;
+}
+
+/* ------------------------------------------------------------ *
+ * write_stats() writes the task statistics into the stats file *
+ * ------------------------------------------------------------ */
+void write_stats() {
+   char tmpfile[MAXCLEN*3];
+   int i;
+
+   snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", statfile);
+   FILE *fp = fopen(tmpfile, "w");
+   if(fp == NULL) {
+      printf("jobsched: cannot write %s.\n", tmpfile);
+      return;
+   }
+   fprintf(fp, "# jobsched statistics, updated %lld, limit %d\n", (long long) time(NULL), runlimit);
+   fprintf(fp, "# job station offset runs rc wait_s run_s avg_run_s max_run_s last_due last_period\n");
+   for(i=0; i<task_cnt; i++) {
+      task_t *t = &tasks[i];
+      fprintf(fp, "%s %s %d %ld %d %.1f %.1f %.1f %.1f %lld %lld\n", t->job->name, t->st->name,
+              t->offset, t->runs, t->rc, t->wait, t->run,
+              (t->runs > 0) ? t->sum_run / t->runs : 0.0, t->max_run, (long long) t->due,
+              (long long) t->done);
+   }
+   if(fclose(fp) != 0 || rename(tmpfile, statfile) != 0)
+      printf("jobsched: cannot write %s.\n", statfile);
+}
+
+/* ------------------------------------------------------------ *
+ * read_stats() restores the task statistics and the period of  *
+ * the last run from the stats file of the previous jobsched.   *
+ * Tasks that are no longer in the job list are left out.       *
+ * ------------------------------------------------------------ */
+void read_stats() {
+   char line[MAXCLEN*2], job[32], st[32];
+   long long due, done;
+   double avg;
+   task_t r;
+   int i;
+
+   FILE *fp = fopen(statfile, "r");
+   if(fp == NULL) return;
+   while(fgets(line, sizeof(line), fp) != NULL) {
+      if(line[0] == '#') continue;
+      if(sscanf(line, "%31s %31s %d %ld %d %lf %lf %lf %lf %lld %lld", job, st, &r.offset,
+                &r.runs, &r.rc, &r.wait, &r.run, &avg, &r.max_run, &due, &done) != 11) continue;
+      for(i=0; i<task_cnt; i++) {
+         task_t *t = &tasks[i];
+         if(strcmp(t->job->name, job) != 0 || strcmp(t->st->name, st) != 0) continue;
+         t->runs = r.runs;
+         t->rc = r.rc;
+         t->wait = r.wait;
+         t->run = r.run;
+         t->sum_run = avg * r.runs;
+         t->max_run = r.max_run;
+         t->due = (time_t) due;
+         t->done = (time_t) done;
+         if(verbose == 1) printf("Debug: %s %s last ran for period [%lld]\n", job, st, done);
+      }
+   }
+   fclose(fp);
+}
+
+/* ------------------------------------------------------------ *
+ * start_task() runs the job command for the station through sh *
+ * with its output in <pi-web-data>/chroot/<station>/log        *
+ * ------------------------------------------------------------ */
+void start_task(task_t *t, const char *datadir) {
+   char cmd[MAXCLEN*4], log[MAXCLEN*4];
+   const char *p = t->job->cmd;
+   size_t n = 0;
+
+   /* replace each %s with the station name */
+   while(*p && n < sizeof(cmd) - sizeof(t->st->name)) {
+      if(p[0] == '%' && p[1] == 's') {
+         n += snprintf(cmd + n, sizeof(cmd) - n, "%s", t->st->name);
+         p += 2;
+      }
+      else cmd[n++] = *p++;
+   }
+   cmd[n] = '\0';
+   snprintf(log, sizeof(log), "%s/chroot/%s/log/%s.log", datadir, t->st->name, t->job->name);
+
+   clock_gettime(CLOCK_REALTIME, &t->start);
+   pid_t pid = fork();
+   if(pid == -1) {
+      printf("jobsched: cannot fork for %s %s.\n", t->job->name, t->st->name);
+      return;
+   }
+   if(pid == 0) {
+      int fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if(fd != -1) {
+         dup2(fd, 1);
+         dup2(fd, 2);
+         close(fd);
+      }
+      signal(SIGTERM, SIG_DFL);
+      signal(SIGINT, SIG_DFL);
+      execl("/bin/sh", "sh", "-c", cmd, (char *) NULL);
+      _exit(127);
+   }
+   t->pid = pid;
+   t->queued = 0;
+   t->wait = (t->start.tv_sec - t->due) + t->start.tv_nsec / 1e9;
+   if(t->wait < 0) t->wait = 0;
+   running++;
+   if(verbose == 1) printf("Debug: start %s %s pid [%d] waited [%.1fs]: %s\n",
+                           t->job->name, t->st->name, (int) pid, t->wait, cmd);
+}
+
+/* ------------------------------------------------------------ *
+ * reap_tasks() collects the finished jobs and their run time.  *
+ * With block=1 it waits until all running jobs have finished.  *
+ * ------------------------------------------------------------ */
+void reap_tasks(int block) {
+   pid_t pid;
+   int status, i;
+
+   while(running > 0 && (pid = waitpid(-1, &status, block ? 0 : WNOHANG)) > 0) {
+      struct timespec end;
+      clock_gettime(CLOCK_REALTIME, &end);
+      for(i=0; i<task_cnt; i++) {
+         task_t *t = &tasks[i];
+         if(t->pid != pid) continue;
+         t->pid = 0;
+         t->rc = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+         t->run = (end.tv_sec - t->start.tv_sec) + (end.tv_nsec - t->start.tv_nsec) / 1e9;
+         t->sum_run += t->run;
+         if(t->run > t->max_run) t->max_run = t->run;
+         t->runs++;
+         running--;
+         printf("jobsched: %s %s finished with rc %d, waited %.1fs, ran %.1fs\n",
+                t->job->name, t->st->name, t->rc, t->wait, t->run);
+         fflush(stdout);
+         write_stats();
+      }
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * sig_stop() lets the main loop finish after the running jobs  *
+ * ------------------------------------------------------------ */
+void sig_stop(int sig) {
+   stop = 1;
+}
+
+/* ------------------------------------------------------------ *
+ * sig_child() only wakes up the main loop from sleep(), so the *
+ * finished job is collected and its run time taken right away  *
+ * ------------------------------------------------------------ */
+void sig_child(int sig) {
+}
+
+int main(int argc, char *argv[]) {
+   char exe[MAXCLEN], file[MAXCLEN*4];
+   const char *datadir;
+   int i, k;
+
+   /* ------------------------------------------------------------ *
+    * Process the cmdline parameters, and the global config which  *
+    * is ../etc/pi-web.conf from our bin folder                    *
+    * ------------------------------------------------------------ */
+   parseargs(argc, argv);
+
+   ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe)-1);
+   if(len < 1) {
+      printf("Error: cannot get program path.\n");
+      exit(-1);
+   }
+   exe[len] = '\0';
+   char *bindir = dirname(exe);
+   snprintf(file, sizeof(file), "%s/../etc/pi-web.conf", bindir);
+   if(readconfig(file) != 0 || (datadir = getconfig("pi-web-data")) == NULL) {
+      printf("Error: cannot read %s.\n", file);
+      exit(-1);
+   }
+   if(strlen(jobfile) == 0) snprintf(jobfile, sizeof(jobfile), "%s/../etc/jobsched.conf", bindir);
+   if(strlen(statfile) == 0) snprintf(statfile, sizeof(statfile), "%s/log/jobsched.stat", datadir);
+
+   read_jobs(jobfile);
+   read_stations(datadir);
+
+   /* ------------------------------------------------------------ *
+    * Create one task per job and station, with its fixed offset   *
+    * ------------------------------------------------------------ */
+   tasks = calloc(job_cnt * st_cnt, sizeof(task_t));
+   if(tasks == NULL) {
+      printf("Error: cannot allocate %d tasks.\n", job_cnt * st_cnt);
+      exit(-1);
+   }
+   for(i=0; i<job_cnt; i++) {
+      for(k=0; k<st_cnt; k++) {
+         task_t *t = &tasks[task_cnt++];
+         t->job = &jobs[i];
+         t->st = &stations[k];
+         t->offset = task_offset(t->job, t->st);
+      }
+   }
+   read_stats();
+
+   if(printonly == 1) {
+      time_t now = time(NULL);
+      for(i=0; i<task_cnt; i++) {
+         task_t *t = &tasks[i];
+         time_t due = period_start(t, now) + t->offset;
+         if(due <= now) due += t->job->period;
+         char date[32];
+         struct tm lt;
+         if(strlen(t->st->tzs) > 0) setenv("TZ", t->st->tzs, 1);
+         else unsetenv("TZ");
+         tzset();
+         localtime_r(&due, &lt);
+         strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S %Z", &lt);
+         printf("%-12s %s offset %5ds next %s\n", t->job->name, t->st->name, t->offset, date);
+      }
+      exit(0);
+   }
+
+   struct sigaction sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = sig_child;
+   sigaction(SIGCHLD, &sa, NULL);
+   signal(SIGTERM, sig_stop);
+   signal(SIGINT, sig_stop);
+   printf("jobsched: %d jobs for %d stations, limit %d, stats in %s\n", job_cnt, st_cnt, runlimit, statfile);
+   fflush(stdout);
+
+   /* ------------------------------------------------------------ *
+    * Once per second: queue the tasks that became due in their    *
+    * period, start the longest waiting ones while there is a free *
+    * slot, and collect the finished ones. Tasks whose time passed *
+    * before we started, and did not run in this period yet, are   *
+    * run once at start, within the limit.                         *
+    * ------------------------------------------------------------ */
+   while(! stop) {
+      time_t now = time(NULL);
+      for(i=0; i<task_cnt; i++) {
+         task_t *t = &tasks[i];
+         if(t->queued || t->pid != 0) continue;
+         time_t start = period_start(t, now);
+         if(start == t->done || now < start + t->offset) continue;
+         t->done = start;
+         t->due = start + t->offset;
+         t->queued = 1;
+         if(verbose == 1) printf("Debug: due %s %s at [%lld]\n", t->job->name, t->st->name, (long long) t->due);
+      }
+      while(running < runlimit) {
+         task_t *next = NULL;
+         for(i=0; i<task_cnt; i++)
+            if(tasks[i].queued && (next == NULL || tasks[i].due < next->due)) next = &tasks[i];
+         if(next == NULL) break;
+         start_task(next, datadir);
+         if(next->pid == 0) break;
+      }
+      reap_tasks(0);
+      sleep(1);
+   }
+
+   printf("jobsched: stopping, waiting for %d running jobs\n", running);
+   reap_tasks(1);
+   write_stats();
+   exit(0);
+}
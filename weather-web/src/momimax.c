@@ -18,6 +18,7 @@
 #include <time.h>
 #include <math.h>
 #include <rrd.h>
+#include <rrd_client.h>
 
 /* ------------------------------------------------------------ *
  * Global variables and defaults                                *
@@ -703,6 +704,15 @@ int main(int argc, char *argv[]) {
    parseargs(argc, argv);
    if(verbose == 1) printf("Debug: RRD file=%s\tHTM file=%s\n", rrdfile, htmfile);
 
+   /* ------------------------------------------------------------ *
+    * With RRDCACHED_ADDRESS set, have rrdcombd write the pending  *
+    * updates first, rrd_fetch_r() reads the file directly.        *
+    * ------------------------------------------------------------ */
+   if(rrdc_flush_if_daemon(NULL, rrdfile) != 0) {
+      printf("Error: cannot flush %s: %s\n", rrdfile, rrd_get_error());
+      exit(-1);
+   }
+
    /* ------------------------------------------------------------ *
     * get current time (now), and time 11 months back (start)      *
     * ------------------------------------------------------------ */
@@ -32,6 +32,11 @@
 #include <math.h>
 #include <rrd.h>
 #include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <rrd_client.h>
 #include <rrd_format.h>        // required to get rrd_t object
 
@@ -208,6 +213,59 @@ void rrd_getvalue(time_t ts, int ds) {
    }
 }
 
+/* ------------------------------------------------------------- *
+ * rrd_getpending() asks rrdcombd for the values it has queued   *
+ * for the RRD, and takes the newest one for the ds index as the *
+ * last value. Without it, we would compare against data up to   *
+ * -w seconds old. Returns 0 if a queued value was found.        *
+ * ------------------------------------------------------------- */
+int rrd_getpending(const char *daemon, int ds) {
+   struct sockaddr_un addr;
+   char buf[8192], path[PATH_MAX];
+   size_t len = 0;
+   ssize_t n;
+
+   if(strncmp(daemon, "unix:", 5) == 0) daemon += 5;
+   if(rrdfile[0] == '/') snprintf(path, sizeof(path), "%s", rrdfile);
+   else if(realpath(rrdfile, path) == NULL) return -1;
+
+   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if(fd == -1) return -1;
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strncpy(addr.sun_path, daemon, sizeof(addr.sun_path)-1);
+   if(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) { close(fd); return -1; }
+
+   /* ------------------------------------------------------------- *
+    * The answer is "<n> updates pending", then n "ts:val:val" rows *
+    * ------------------------------------------------------------- */
+   int cmdlen = snprintf(buf, sizeof(buf), "PENDING %s\nQUIT\n", path);
+   if(write(fd, buf, cmdlen) != cmdlen) { close(fd); return -1; }
+   while(len < sizeof(buf)-1 && (n = read(fd, buf+len, sizeof(buf)-1-len)) > 0) len += n;
+   close(fd);
+   buf[len] = '\0';
+
+   int count = atoi(buf);
+   if(verbose == 1) printf("Debug: rrdcombd has [%d] pending values\n", count);
+   if(count < 1) return -1;
+
+   char *save = NULL, *row = strtok_r(buf, "\n", &save), *last = NULL;
+   while((row = strtok_r(NULL, "\n", &save)) != NULL && count-- > 0) last = row;
+   if(last == NULL) return -1;
+
+   /* skip the timestamp, and the values before our ds index */
+   int i;
+   char *val = last;
+   for(i=0; i<=ds && val != NULL; i++) {
+      val = strchr(val, ':');
+      if(val != NULL) val++;
+   }
+   if(val == NULL || *val == 'U') return -1;
+   oldval[1] = strtod(val, NULL);
+   if(verbose == 1) printf("Debug: value pending [%s] data=[%s:%.2f]\n", last, dsname, oldval[1]);
+   return 0;
+}
+
 /* ------------------------------------------------------------- *
  * check_outlier() compares diff of newval vs oldval to limit    *
  * ------------------------------------------------------------- */
@@ -255,6 +313,15 @@ int main(int argc, char *argv[]) {
    rrd_getds(rrdfile, dsname);
    rrd_getvalue(tslast, dsindex);
 
+   /* ------------------------------------------------------------ *
+    * With RRDCACHED_ADDRESS set, the newest value may still be in *
+    * the rrdcombd queue. We ask for it instead of a flush, which  *
+    * each minute would undo the write batching of the daemon.     *
+    * ------------------------------------------------------------ */
+   const char *daemon = getenv("RRDCACHED_ADDRESS");
+   if(daemon != NULL && strlen(daemon) > 0 && rrd_getpending(daemon, dsindex) != 0
+      && verbose == 1) printf("Debug: no pending value from rrdcombd, using the RRD\n");
+
    ret = check_outlier();
    if(verbose == 1) printf("Debug: Return Value %d\n", ret);
    exit(ret);
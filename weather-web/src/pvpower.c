@@ -5,12 +5,33 @@
  *              12-day/month/year table, to be included using   *
  *              e.g. <?php include("./daypower.htm"); ?>.       *
  *                                                              *
+ *              The RRD is read once per resolution: the hourly *
+ *              rows for the 12-day table, and the daily rows   *
+ *              for the month and year tables. Both go into one *
+ *              calendar array of daily energy and balance, all *
+ *              tables are summed up from it. -d, -m and -y can *
+ *              be given together, to write all in one run.     *
+ *              The power is integrated between the sample      *
+ *              times, days with data gaps are estimated from   *
+ *              their covered part, and show their data percent.*
+ *                                                              *
+ *              With -l, the days are kept in a ledger file and *
+ *              only today and yesterday are integrated again.  *
+ *              The month and year totals are prefix sums over  *
+ *              the ledger days.                                *
+ *                                                              *
+ *              With -g and -w, each day gets the performance   *
+ *              ratio of the measured PV energy to the modeled  *
+ *              clear-sky energy of the panel. Days under the   *
+ *              -r threshold are flagged, e.g. for dirty or     *
+ *              shaded panels.                                  *
+ *                                                              *
  * RRD API:     http://oss.oetiker.ch/rrdtool/doc/librrd.en.html*
  *                                                              *
  * author:      04/11/2018 Frank4DD                             *
  *                                                              *
  * compile: gcc -I/srv/app/rrdtool/include pvpower.c -o pvpower *
- *              -L/srv/app/rrdtool/lib -lrrd                    *
+ *              -L/srv/app/rrdtool/lib -lrrd -lm                *
  *                                                              *
  * This code is adopted from pi-weather momimax.c which shows   *
  * the min max temp value tables. Its stil WIP to determine the *
@@ -20,46 +41,118 @@
  * ------------------------------------------------------------ */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <ctype.h>
+#include <unistd.h>
 #include <time.h>
 #include <math.h>
 #include <rrd.h>
+#include <rrd_client.h>
+
+/* ------------------------------------------------------------ *
+ * The solar RRD data sources we use, by their position:        *
+ * bat volts=ds_namv[0], bat cur=ds_namv[1], pv watt=ds_namv[3] *
+ * ------------------------------------------------------------ */
+#define DS_VBAT    0
+#define DS_IBAT    1
+#define DS_PPV     3
+
+/* ------------------------------------------------------------ *
+ * The days integrated again on each run with a ledger: today,  *
+ * and yesterday for late station uploads after midnight.       *
+ * ------------------------------------------------------------ */
+#define LEDGER_REDO 2
+
+/* ------------------------------------------------------------ *
+ * The clear-sky model: the Meinel direct normal irradiance for *
+ * the air mass, plus 10% diffuse light, on a panel tilted by   *
+ * the latitude towards the equator. The performance ratio is   *
+ * the PV energy, divided by the energy of the rated panel watt *
+ * at that irradiance (W/m2 / 1000).                            *
+ * ------------------------------------------------------------ */
+#define SOLAR_CONST 1353.0        // W/m2 outside the atmosphere
+#define CLR_DIFFUSE 0.1           // diffuse part of the direct light
+#define DEF_PRLIMIT 0.6           // flag days under this ratio
+
+#define SUM_PPV    0
+#define SUM_BAL    1
+#define SUM_CLR    2
 
 /* ------------------------------------------------------------ *
  * Global variables and defaults                                *
  * ------------------------------------------------------------ */
 FILE *html;
 int verbose = 0;
-int outtype = 0;
 char rrdfile[256];
-char htmfile[256];
-unsigned long ds_cnt = 0;
-char **ds_namv;
-rrd_value_t *rrddata;
-rrd_value_t *mindata;
-rrd_value_t *maxdata;
+char dayfile[256];                // -d 12-day table output file
+char monfile[256];                // -m 12-month table output file
+char yearfile[256];               // -y 12-year table output file
+char ledfile[256];                // -l daily energy ledger file
+double latitude = NAN;            // -g station latitude
+double longitude = NAN;           // -g station longitude
+double pvwatt = 0;                // -w panel rating in Wp, 0 = no ratio
+double prlimit = DEF_PRLIMIT;     // -r performance ratio threshold
 extern char *optarg;
 extern int optind, opterr, optopt;
 static char mon_name[12][3] = { "Jan", "Feb", "Mar", "Apr",
                                 "May", "Jun", "Jul", "Aug",
                                 "Sep", "Oct", "Nov", "Dec" };
 
+/* ------------------------------------------------------------ *
+ * The calendar: one entry per local day, from the first day of *
+ * the oldest table column until today. cal[cal_days].start is  *
+ * the end of today, so each day ends at the next start. The    *
+ * day length is 23h or 25h on DST change days, and until now   *
+ * for today. ppv_cov and bal_cov are the seconds of the day    *
+ * that had valid samples on both sides to integrate. The sum_* *
+ * prefix sums hold the day estimates before day i.             *
+ * ------------------------------------------------------------ */
+typedef struct {
+   time_t start;           // local midnight of this day
+   time_t len;             // day length in seconds
+   double ppv;             // PV power generation in Wh
+   double chg;             // battery energy charged in Wh
+   double dis;             // battery energy consumed in Wh (<= 0)
+   double vmin;            // lowest battery volts (row average)
+   double vmax;            // highest battery volts (row average)
+   double clr;             // clear-sky model PV energy in Wh
+   time_t ppv_cov;         // seconds integrated for ppv
+   time_t bal_cov;         // seconds integrated for bal
+   int done;               // 1 = day was read from the ledger
+} calday_t;
+
+calday_t *cal = NULL;
+int cal_days = 0;
+double *sum_ppv = NULL;    // prefix sum of the ppv estimate
+double *sum_bal = NULL;    // prefix sum of the balance estimate
+double *sum_cov = NULL;    // prefix sum of the ppv seconds
+double *sum_len = NULL;    // prefix sum of the day lengths
+double *sum_pvm = NULL;    // prefix sum of ppv on modeled days
+double *sum_clr = NULL;    // prefix sum of the clear-sky model
+
 /* ------------------------------------------------------------ *
  * print_usage() prints the programs commandline instructions.  *
  * ------------------------------------------------------------ */
 void usage() {
-   static char const usage[] = "Usage: pvpower -s [rrd-file] -d|-m [html-output] [-v]\n\
+   static char const usage[] = "Usage: pvpower -s [rrd-file] -d|-m|-y [html-output] [-l ledger] [-g lat,lon -w watt] [-v]\n\
    Command line parameters have the following format:\n\
    -s   RRD file and path, Example: -s /home/pi/pi-ws01/rrd/weather.rrd\n\
    -d   create the 12-day power generation output, and write it into HTML file and path\n\
    -m   create the 12-month power generation output, and write it into HTML file and path\n\
    -y   create the 12-year power generation output, and write it into HTML file and path\n\
+   -l   optional, daily energy ledger file, only today and yesterday are calculated again\n\
+   -g   optional, station latitude,longitude for the clear-sky model, Example: -g 35.610381,139.628999\n\
+   -w   optional, PV panel rating in Wp, enables the daily performance ratio, Example: -w 50\n\
+   -r   optional, flag days with a performance ratio under this value, default 0.6\n\
    -h   optional, display this message\n\
    -v   optional, enables debug output\n\
    Usage examples:\n\
 ./pvpower -s /home/pi/pi-solar/rrd/solar.rrd -d /home/pi/pi-solar/web/daypower.htm\n\
 ./pvpower -s /home/pi/pi-solar/rrd/solar.rrd -m /home/pi/pi-solar/web/monpower.htm\n\
-./pvpower -s /home/pi/pi-solar/rrd/solar.rrd -y /home/pi/pi-solar/web/yearpower.htm\n";
+./pvpower -s /home/pi/pi-solar/rrd/solar.rrd -y /home/pi/pi-solar/web/yearpower.htm\n\
+./pvpower -s /home/pi/pi-solar/rrd/solar.rrd -d /tmp/daypower.htm -m /tmp/monpower.htm\n\
+./pvpower -s /home/pi/pi-solar/rrd/solar.rrd -l /home/pi/pi-solar/rrd/solar.ledger -y /tmp/yearpower.htm\n\
+./pvpower -s /home/pi/pi-solar/rrd/solar.rrd -g 35.610381,139.628999 -w 50 -d /tmp/daypower.htm\n";
    printf(usage);
 }
 
@@ -72,37 +165,65 @@ void parseargs(int argc, char* argv[]) {
 
    if(argc == 1) { usage(); exit(-1); }
 
-   while ((arg = (int) getopt (argc, argv, "s:d:m:y:vh")) != -1)
+   while ((arg = (int) getopt (argc, argv, "s:d:m:y:l:g:w:r:vh")) != -1)
       switch (arg) {
          // arg -s + source RRD file, type: string
          // mandatory, example: /opt/raspi/data/weather.rrd
          case 's':
             if(verbose == 1) printf("Debug: arg -s, value %s\n", optarg);
-            strncpy(rrdfile, optarg, sizeof(rrdfile));
+            strncpy(rrdfile, optarg, sizeof(rrdfile)-1);
             break;
 
          // arg -d + dst HTML file, type: string
-         // either -d, -m or -y is mandatory, example: /tmp/t1.htm
+         // one of -d, -m or -y is mandatory, example: /tmp/t1.htm
          case 'd':
-            outtype = 1;
             if(verbose == 1) printf("Debug: arg -d, value %s\n", optarg);
-            strncpy(htmfile, optarg, sizeof(htmfile));
+            strncpy(dayfile, optarg, sizeof(dayfile)-1);
             break;
 
          // arg -m + dst HTML file, type: string
-         // either -d, -m or -y is mandatory, example: /tmp/t1.htm
+         // one of -d, -m or -y is mandatory, example: /tmp/t1.htm
          case 'm':
-            outtype = 2;
             if(verbose == 1) printf("Debug: arg -m, value %s\n", optarg);
-            strncpy(htmfile, optarg, sizeof(htmfile));
+            strncpy(monfile, optarg, sizeof(monfile)-1);
             break;
 
          // arg -y + dst HTML file, type: string
-         // either -d, -m or -y is mandatory, example: /tmp/t1.htm
+         // one of -d, -m or -y is mandatory, example: /tmp/t1.htm
          case 'y':
-            outtype = 3;
             if(verbose == 1) printf("Debug: arg -y, value %s\n", optarg);
-            strncpy(htmfile, optarg, sizeof(htmfile));
+            strncpy(yearfile, optarg, sizeof(yearfile)-1);
+            break;
+
+         // arg -l + ledger file, type: string
+         // optional, example: /tmp/solar.ledger
+         case 'l':
+            if(verbose == 1) printf("Debug: arg -l, value %s\n", optarg);
+            strncpy(ledfile, optarg, sizeof(ledfile)-1);
+            break;
+
+         // arg -g + latitude,longitude, type: double,double
+         // optional, example: 35.610381,139.628999
+         case 'g':
+            if(verbose == 1) printf("Debug: arg -g, value %s\n", optarg);
+            if(sscanf(optarg, "%lf,%lf", &latitude, &longitude) != 2) {
+               printf("Error: Cannot get valid -g latitude,longitude argument.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg -w + panel rating in Wp, type: double
+         // optional, example: 50
+         case 'w':
+            if(verbose == 1) printf("Debug: arg -w, value %s\n", optarg);
+            pvwatt = strtod(optarg, NULL);
+            break;
+
+         // arg -r + performance ratio threshold, type: double
+         // optional, example: 0.6
+         case 'r':
+            if(verbose == 1) printf("Debug: arg -r, value %s\n", optarg);
+            prlimit = strtod(optarg, NULL);
             break;
 
          // arg -v verbose, type: flag, optional
@@ -126,16 +247,411 @@ void parseargs(int argc, char* argv[]) {
        printf("Error: Cannot get valid -s RRD file argument.\n");
        exit(-1);
     }
-    if(outtype == 0) {
-       printf("Error: Cannot get htm file argument, missing -d|-m?.\n");
+    if(strlen(dayfile) == 0 && strlen(monfile) == 0 && strlen(yearfile) == 0) {
+       printf("Error: Cannot get htm file argument, missing -d|-m|-y?.\n");
+       exit(-1);
+    }
+    if ((strlen(dayfile) > 0 && strlen(dayfile) < 3) || (strlen(monfile) > 0 && strlen(monfile) < 3)
+        || (strlen(yearfile) > 0 && strlen(yearfile) < 3)) {
+       printf("Error: Cannot get valid -d|-m|-y htm file argument.\n");
+       exit(-1);
+    }
+    if (strlen(ledfile) > 0 && strlen(ledfile) < 3) {
+       printf("Error: Cannot get valid -l ledger file argument.\n");
        exit(-1);
     }
-    if (strlen(htmfile) < 3) {
-       printf("Error: Cannot get valid -d htm file argument.\n");
+    if (pvwatt < 0 || (pvwatt > 0 && (isnan(latitude) || fabs(latitude) > 90 || fabs(longitude) > 180))) {
+       printf("Error: Cannot get valid -w panel watt with -g latitude,longitude argument.\n");
        exit(-1);
     }
 }
 
+/* ------------------------------------------------------------ *
+ * day_start() returns the local midnight of the day, month and *
+ * year given, mktime() normalizes e.g. month 13 or day 0.      *
+ * ------------------------------------------------------------ */
+time_t day_start(int year, int mon, int mday) {
+   struct tm day_tm;
+   memset(&day_tm, 0, sizeof(day_tm));
+   day_tm.tm_year  = year-1900;
+   day_tm.tm_mon   = mon-1;
+   day_tm.tm_mday  = mday;
+   day_tm.tm_isdst = -1;
+   return mktime(&day_tm);
+}
+
+/* ------------------------------------------------------------ *
+ * make_calendar() creates the day list from tstart until today *
+ * ------------------------------------------------------------ */
+void make_calendar(time_t tstart, time_t tsnow) {
+   struct tm first = * localtime(&tstart);
+   time_t t = tstart;
+   int i;
+
+   for(i=0; t <= tsnow; i++)
+      t = day_start(first.tm_year+1900, first.tm_mon+1, first.tm_mday+i+1);
+   cal_days = i;
+   cal = calloc(cal_days+1, sizeof(calday_t));
+   if(cal == NULL) {
+      printf("Error: cannot allocate %d calendar days.\n", cal_days);
+      exit(-1);
+   }
+   for(i=0; i<=cal_days; i++)
+      cal[i].start = day_start(first.tm_year+1900, first.tm_mon+1, first.tm_mday+i);
+   for(i=0; i<cal_days; i++) {
+      cal[i].len = ((cal[i+1].start < tsnow) ? cal[i+1].start : tsnow) - cal[i].start;
+      cal[i].vmin = NAN;
+      cal[i].vmax = NAN;
+   }
+   if(verbose == 1) printf("Debug: calendar %d days from %s", cal_days, ctime(&tstart));
+}
+
+/* ------------------------------------------------------------ *
+ * clearsky_batch() models the clear-sky PV watt for n samples, *
+ * starting at t0 every step seconds. The sun elevation and the *
+ * panel angle are A + B * cos(hour angle) with A, B fixed for  *
+ * one day. The declination and time equation (Spencer) are set *
+ * once per day of samples, the hour angle advances by rotating *
+ * its cos/sin, so the samples need no trigonometric functions. *
+ * ------------------------------------------------------------ */
+void clearsky_batch(time_t t0, unsigned long step, unsigned long n, double *out) {
+   double lat = latitude * M_PI / 180;
+   double tilt = fabs(lat);
+   double plat = lat - ((lat >= 0) ? tilt : -tilt);   // panel normal latitude
+   double dh = (double) step / 86400 * 2 * M_PI;      // hour angle per step
+   double cdh = cos(dh), sdh = sin(dh);
+   double diffuse = CLR_DIFFUSE * (1 + cos(tilt)) / 2;
+   unsigned long per_day = (step > 0 && step < 86400) ? 86400 / step : 1;
+   unsigned long i, k;
+
+   for(i=0; i<n; i += per_day) {
+      /* ------------------------------------------------------------- *
+       * once per day: declination, time equation and the start angle  *
+       * ------------------------------------------------------------- */
+      time_t t = t0 + i * step;
+      struct tm utc = * gmtime(&t);
+      double hour = utc.tm_hour + utc.tm_min / 60.0 + utc.tm_sec / 3600.0;
+      double g = 2 * M_PI / 365 * (utc.tm_yday + (hour - 12) / 24);
+      double decl = 0.006918 - 0.399912 * cos(g) + 0.070257 * sin(g) - 0.006758 * cos(2*g)
+                  + 0.000907 * sin(2*g) - 0.002697 * cos(3*g) + 0.00148 * sin(3*g);
+      double eqt = 229.18 * (0.000075 + 0.001868 * cos(g) - 0.032077 * sin(g)
+                  - 0.014615 * cos(2*g) - 0.040849 * sin(2*g));
+      double h = ((hour + longitude / 15 + eqt / 60) - 12) * M_PI / 12;
+      double za = sin(lat) * sin(decl), zb = cos(lat) * cos(decl);
+      double pa = sin(plat) * sin(decl), pb = cos(plat) * cos(decl);
+      double ch = cos(h), sh = sin(h);
+
+      for(k=i; k<n && k<i+per_day; k++) {
+         double cosz = za + zb * ch;
+         double cosp = pa + pb * ch;
+         double poa = 0;
+         if(cosz > 0.01) {
+            double dni = SOLAR_CONST * pow(0.7, pow(1 / cosz, 0.678));
+            poa = dni * ((cosp > 0) ? cosp : 0) + dni * diffuse;
+         }
+         out[k] = pvwatt * poa / 1000;
+         double c = ch * cdh - sh * sdh;
+         sh = sh * cdh + ch * sdh;
+         ch = c;
+      }
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * add_trapez() integrates the straight line between samples    *
+ * (t0,p0) and (t1,p1) over the part [a,b) of its interval, and *
+ * adds the Wh and covered seconds to the days it falls into.   *
+ * A battery balance line that crosses zero is split there. The *
+ * clear-sky model has no coverage, it follows the ppv samples. *
+ * ------------------------------------------------------------ */
+static inline void add_trapez(int d, time_t a, time_t b, time_t t0, double p0,
+                              time_t t1, double p1, int which) {
+   double slope = (p1 - p0) / (t1 - t0);
+   int k;
+   for(k=d; k<cal_days && cal[k].start < b; k++) {
+      time_t s = (cal[k].start > a) ? cal[k].start : a;
+      time_t e = (cal[k+1].start < b) ? cal[k+1].start : b;
+      if(e <= s) continue;
+      double ps = p0 + slope * (s - t0);
+      double pe = p0 + slope * (e - t0);
+      if(which == SUM_PPV) {
+         cal[k].ppv += (ps + pe) / 2 * (e - s) / 3600;
+         cal[k].ppv_cov += e - s;
+         continue;
+      }
+      if(which == SUM_CLR) {
+         cal[k].clr += (ps + pe) / 2 * (e - s) / 3600;
+         continue;
+      }
+      /* the balance is split into charge and discharge at zero */
+      if(ps >= 0 && pe >= 0)      cal[k].chg += (ps + pe) / 2 * (e - s) / 3600;
+      else if(ps <= 0 && pe <= 0) cal[k].dis += (ps + pe) / 2 * (e - s) / 3600;
+      else {
+         double tz = (e - s) * ps / (ps - pe);
+         double w1 = ps / 2 * tz / 3600;
+         double w2 = pe / 2 * ((e - s) - tz) / 3600;
+         if(ps > 0) { cal[k].chg += w1; cal[k].dis += w2; }
+         else       { cal[k].dis += w1; cal[k].chg += w2; }
+      }
+      cal[k].bal_cov += e - s;
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * fetch_days() reads the RRD rows between tstart and tend with *
+ * the given resolution once, and integrates the power over the *
+ * days of the calendar, only for the part between from, until. *
+ * A row covers (start+i*step, start+(i+1)*step], its average W *
+ * is taken as the sample at the middle of the row. Between two *
+ * samples the power is integrated as a trapezoid. If a sample  *
+ * is NaN, the intervals on both sides stay uncovered, they are *
+ * not bridged by interpolation. One more row is read on both   *
+ * ends, so the first and last interval have their neighbours.  *
+ * For the hourly rows, the clear-sky model is integrated over  *
+ * the same intervals as the ppv samples.                       *
+ * ------------------------------------------------------------ */
+void fetch_days(time_t tstart, time_t tend, unsigned long step, time_t from, time_t until) {
+   unsigned long ds_cnt = 0, i, n;
+   char **ds_namv;
+   rrd_value_t *rrddata;
+   int d = 0, dv = 0;
+
+   /* ------------------------------------------------------------- *
+    * rrd_fetch_r() gets all RRD values for a specific time range.  *
+    * 8x function args: 5x input, 3x output. Returns 0 for success. *
+    * The start, end and step are adjusted to the RRA it reads.     *
+    * ------------------------------------------------------------- */
+   tstart -= step;
+   tend += step;
+   int ret = rrd_fetch_r(rrdfile, "AVERAGE", &tstart, &tend, &step, &ds_cnt, &ds_namv, &rrddata);
+   if (ret != 0) { printf("Error: cannot fetch data from RRD.\n"); exit(-1); }
+   if (ds_cnt <= DS_PPV) { printf("Error: RRD has only %lu data sources.\n", ds_cnt); exit(-1); }
+   unsigned long rows = (tend - tstart) / step;
+   if(verbose == 1) printf("Debug: rrd_fetch_r step [%lu] rows [%lu] ds count [%lu] %s [%s] %s [%s] %s [%s]\n",
+                           step, rows, ds_cnt, "vbat", ds_namv[DS_VBAT], "ibat", ds_namv[DS_IBAT], "ppv", ds_namv[DS_PPV]);
+
+   double *model = NULL;
+   if(pvwatt > 0 && step <= 3600 && rows > 0) {
+      model = malloc(rows * sizeof(double));
+      if(model == NULL) { printf("Error: cannot allocate %lu model rows.\n", rows); exit(-1); }
+      clearsky_batch(tstart + step/2, step, rows, model);
+   }
+
+   /* ------------------------------------------------------------- *
+    * One pass over the ds_cnt strided rows, carrying the previous  *
+    * sample. The day index only moves forward with the rows.       *
+    * ------------------------------------------------------------- */
+   const rrd_value_t *row = rrddata;
+   time_t t0 = tstart + step/2;
+   double ppv0 = row[DS_PPV];
+   double bal0 = row[DS_VBAT] * row[DS_IBAT];
+   for(i=1, row += ds_cnt; i<rows; i++, row += ds_cnt) {
+      time_t t1 = t0 + step;
+      double ppv1 = row[DS_PPV];
+      double bal1 = row[DS_VBAT] * row[DS_IBAT];
+      time_t a = (t0 > from) ? t0 : from;
+      time_t b = (t1 < until) ? t1 : until;
+
+      if(t1 >= from && t1 < until && ! isnan(row[DS_VBAT])) {
+         while(dv < cal_days && cal[dv+1].start <= t1) dv++;
+         if(isnan(cal[dv].vmin) || row[DS_VBAT] < cal[dv].vmin) cal[dv].vmin = row[DS_VBAT];
+         if(isnan(cal[dv].vmax) || row[DS_VBAT] > cal[dv].vmax) cal[dv].vmax = row[DS_VBAT];
+      }
+      if(a < b) {
+         while(d < cal_days && cal[d+1].start <= a) d++;
+         if(! isnan(ppv0) && ! isnan(ppv1)) {
+            add_trapez(d, a, b, t0, ppv0, t1, ppv1, SUM_PPV);
+            if(model) add_trapez(d, a, b, t0, model[i-1], t1, model[i], SUM_CLR);
+         }
+         if(! isnan(bal0) && ! isnan(bal1)) add_trapez(d, a, b, t0, bal0, t1, bal1, SUM_BAL);
+      }
+      t0 = t1;
+      ppv0 = ppv1;
+      bal0 = bal1;
+   }
+
+   free(model);
+   /* the data and the DS names are allocated by rrd_fetch_r() */
+   for(n=0; n<ds_cnt; n++) free(ds_namv[n]);
+   free(ds_namv);
+   free(rrddata);
+}
+
+/* ------------------------------------------------------------ *
+ * day_index() returns the first calendar day starting at t or  *
+ * later, cal_days if there is none (binary search).            *
+ * ------------------------------------------------------------ */
+int day_index(time_t t) {
+   int lo = 0, hi = cal_days;
+   while(lo < hi) {
+      int mid = (lo + hi) / 2;
+      if(cal[mid].start < t) lo = mid + 1;
+      else hi = mid;
+   }
+   return lo;
+}
+
+/* ------------------------------------------------------------ *
+ * read_ledger() loads the ledger days into the calendar, days  *
+ * with a start that is not a calendar midnight (TZ changed)    *
+ * are dropped, and get integrated again. Returns the count.    *
+ * ------------------------------------------------------------ */
+int read_ledger(const char *file) {
+   char line[256];
+   calday_t day;
+   long long start, len, pcov, bcov;
+   int count = 0;
+
+   FILE *fp = fopen(file, "r");
+   if(fp == NULL) {
+      if(verbose == 1) printf("Debug: no ledger %s, starting a new one\n", file);
+      return 0;
+   }
+   while(fgets(line, sizeof(line), fp) != NULL) {
+      if(line[0] == '#') continue;
+      memset(&day, 0, sizeof(day));
+      if(sscanf(line, "%*s %lld %lld %lf %lf %lf %lf %lf %lld %lld %lf", &start, &len, &day.ppv,
+                &day.chg, &day.dis, &day.vmin, &day.vmax, &pcov, &bcov, &day.clr) < 9) continue;
+      int i = day_index(start);
+      if(i == cal_days || cal[i].start != start || cal[i].len != len) continue;
+      day.start = start;
+      day.len = len;
+      day.ppv_cov = pcov;
+      day.bal_cov = bcov;
+      day.done = 1;
+      cal[i] = day;
+      count++;
+   }
+   fclose(fp);
+   if(verbose == 1) printf("Debug: read %d days from ledger %s\n", count, file);
+   return count;
+}
+
+/* ------------------------------------------------------------ *
+ * ledger_start() returns the first day in the ledger file, or  *
+ * tstart if there is no older day, to extend the calendar.     *
+ * ------------------------------------------------------------ */
+time_t ledger_start(const char *file, time_t tstart) {
+   char line[256];
+   long long start;
+   FILE *fp = fopen(file, "r");
+   if(fp == NULL) return tstart;
+   while(fgets(line, sizeof(line), fp) != NULL) {
+      if(line[0] == '#') continue;
+      if(sscanf(line, "%*s %lld", &start) == 1 && start > 0 && start < tstart) tstart = start;
+      break;
+   }
+   fclose(fp);
+   return tstart;
+}
+
+/* ------------------------------------------------------------ *
+ * write_ledger() saves all calendar days, one line per day. It *
+ * writes a temp file first, and moves it over the old ledger.  *
+ * ------------------------------------------------------------ */
+void write_ledger(const char *file) {
+   char tmpfile[272];
+   char date[16];
+   int i;
+
+   snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", file);
+   FILE *fp = fopen(tmpfile, "w");
+   if(fp == NULL) {
+      printf("Error: cannot create %s.\n", tmpfile);
+      exit(-1);
+   }
+   fprintf(fp, "# date start len ppv_wh chg_wh dis_wh vbat_min vbat_max ppv_cov bal_cov clr_wh\n");
+   for(i=0; i<cal_days; i++) {
+      strftime(date, sizeof(date), "%Y-%m-%d", localtime(&cal[i].start));
+      fprintf(fp, "%s %lld %lld %.2f %.2f %.2f %.2f %.2f %lld %lld %.2f\n", date,
+              (long long) cal[i].start, (long long) cal[i].len, cal[i].ppv, cal[i].chg,
+              cal[i].dis, cal[i].vmin, cal[i].vmax, (long long) cal[i].ppv_cov,
+              (long long) cal[i].bal_cov, cal[i].clr);
+   }
+   if(fclose(fp) != 0 || rename(tmpfile, file) != 0) {
+      printf("Error: cannot write %s.\n", file);
+      unlink(tmpfile);
+      exit(-1);
+   }
+   if(verbose == 1) printf("Debug: wrote %d days to ledger %s\n", cal_days, file);
+}
+
+/* ------------------------------------------------------------ *
+ * make_sums() builds the prefix sums over the calendar days. A *
+ * day with gaps is estimated from its covered part, scaled to  *
+ * the full day length.                                         *
+ * ------------------------------------------------------------ */
+void make_sums() {
+   int i;
+   sum_ppv = calloc(cal_days+1, sizeof(double));
+   sum_bal = calloc(cal_days+1, sizeof(double));
+   sum_cov = calloc(cal_days+1, sizeof(double));
+   sum_len = calloc(cal_days+1, sizeof(double));
+   sum_pvm = calloc(cal_days+1, sizeof(double));
+   sum_clr = calloc(cal_days+1, sizeof(double));
+   if(! sum_ppv || ! sum_bal || ! sum_cov || ! sum_len || ! sum_pvm || ! sum_clr) {
+      printf("Error: cannot allocate %d calendar sums.\n", cal_days);
+      exit(-1);
+   }
+   for(i=0; i<cal_days; i++) {
+      double ppv = 0, bal = 0;
+      if(cal[i].ppv_cov > 0) ppv = cal[i].ppv * cal[i].len / cal[i].ppv_cov;
+      if(cal[i].bal_cov > 0) bal = (cal[i].chg + cal[i].dis) * cal[i].len / cal[i].bal_cov;
+      sum_ppv[i+1] = sum_ppv[i] + ppv;
+      sum_bal[i+1] = sum_bal[i] + bal;
+      sum_cov[i+1] = sum_cov[i] + cal[i].ppv_cov;
+      sum_len[i+1] = sum_len[i] + cal[i].len;
+      sum_pvm[i+1] = sum_pvm[i] + ((cal[i].clr > 0) ? cal[i].ppv : 0);
+      sum_clr[i+1] = sum_clr[i] + cal[i].clr;
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * sum_days() returns the totals of the days between from and   *
+ * until from the prefix sums. pct returns how much of the      *
+ * range had PV data, 0..100. pr returns the performance ratio  *
+ * of the days with a clear-sky model, or -1 without.           *
+ * ------------------------------------------------------------ */
+void sum_days(time_t from, time_t until, double *ppv, double *bal, double *pct, double *pr) {
+   int i = day_index(from);
+   int j = day_index(until);
+   if(j < i) j = i;
+   *ppv = sum_ppv[j] - sum_ppv[i];
+   *bal = sum_bal[j] - sum_bal[i];
+   double len = sum_len[j] - sum_len[i];
+   *pct = (len > 0) ? 100.0 * (sum_cov[j] - sum_cov[i]) / len : 0;
+   double clr = sum_clr[j] - sum_clr[i];
+   *pr = (clr > 0) ? (sum_pvm[j] - sum_pvm[i]) / clr : -1;
+}
+
+/* ------------------------------------------------------------ *
+ * data_cell() writes one table cell with power and balance. If *
+ * data is missing, the value is an estimate, and the completed *
+ * percentage is shown with it. With a performance ratio (pr is *
+ * not -1), it is added, and a low ratio marks the cell.        *
+ * ------------------------------------------------------------ */
+void data_cell(double ppv, double bal, double pct, double pr) {
+   const char *class = (pr >= 0 && pr < prlimit) ? "lowratiocell" : "datacell";
+   if(ppv != 0) {
+      if(ppv >= 1000)
+         fprintf(html, "   <td class=\"%s\">%.1f&thinsp;KW", class, ppv);
+      else
+         fprintf(html, "   <td class=\"%s\">%.1f&thinsp;W", class, ppv);
+   }
+   else  fprintf(html, "   <td class=\"emptycell\">N/A");
+
+   if(ppv != 0 && pct < 99.5) fprintf(html, "&thinsp;~%.0f%%", pct);
+   fprintf(html, " <br> ");
+
+   if((bal >= 1000) || (bal <= -1000))
+      fprintf(html, "%+.1f&thinsp;KW", bal);
+   else
+      fprintf(html, "%+.1f&thinsp;W", bal);
+
+   if(ppv != 0 && pr >= 0) fprintf(html, " <br> PR&thinsp;%.0f%%", pr * 100);
+   fprintf(html, "</td>\n");
+}
+
 void year_headhtml(int year){
    fprintf(html, "<tr><td colspan=12 class=\"monthhead\">Yearly Power Generation and Energy Balance +/-</td></tr>\n");
    fprintf(html, "<tr>\n");
@@ -155,102 +671,18 @@ void year_headhtml(int year){
    fprintf(html, "</tr>\n");
 }
 
-void year_datahtml(int year, time_t ts){
-   int i, j, k = 0;
-   unsigned long step = 86400;
+void year_datahtml(int year){
+   int i;
+   double ppv, bal, pct, pr;
    /* ------------------------------------------------------------- *
-    *  Create the data row for min max values to display            *
+    *  Create the data row, Jan 1st until Jan 1st of the next year  *
     * ------------------------------------------------------------- */
    fprintf(html, "<tr>\n");
    for(i = 11; i >= 0; i--) {
       int show_year = year-i;
-      /* ------------------------------------------------------------- *
-       * Create the start timestamp for rrd fetch, Jan 1st midnight.   *
-       * ------------------------------------------------------------- */
-      struct tm start_tm;
-      start_tm.tm_year = show_year-1900;
-      start_tm.tm_mon  = 0;
-      start_tm.tm_mday = 1;
-      start_tm.tm_hour = 0;
-      start_tm.tm_min  = 0;
-      start_tm.tm_sec  = 0;
-
-      time_t tstart = mktime(&start_tm);
-      if(tstart == -1) printf("Error");
-      if(verbose == 1) printf("Debug: ts=%lld start date=%s", (long long) tstart, ctime(&tstart));
-
-      /* ------------------------------------------------------------- *
-       * Create the end timestamp for rrd fetch, Dec 31st 23:59:59     *
-       * ------------------------------------------------------------- */
-      struct tm end_tm;
-      end_tm.tm_year = show_year-1900;
-      end_tm.tm_mon  = 11;
-      end_tm.tm_mday = 31;
-      end_tm.tm_hour = 23;
-      end_tm.tm_min  = 59;
-      end_tm.tm_sec  = 59;
-
-      time_t tend = mktime(&end_tm);
-      if(tend == -1) printf("Error creating RRD timerange timestamp tend.");
-      if(tend > ts) tend = ts; // if we are at the current date, end at now time
-      if(verbose == 1) printf("Debug: ts=%lld end date=%s", (long long) tend, ctime(&tend));
-
-      /* ------------------------------------------------------------- *
-       * rrd_fetch_r() gets all RRD values for a specific time range.  *
-       * 8x function args: 5x input, 3x output. Returns 0 for success. *
-       * (1) const char *filename,                                     *
-       * (2) const char *consolidation_function,                       *
-       * (3) time_t *start,                                            *
-       * (4) time_t *end,                                              *
-       * (5) unsigned long *step,                                      *
-       * (6) unsigned long *ds_cnt,                                    *
-       * (7) char ***ds_namv,                                          *
-       * (8) rrd_value_t **data);                                      *
-       * ------------------------------------------------------------- */
-      int ret = rrd_fetch_r(rrdfile, "AVERAGE", &tstart, &tend, &step, &ds_cnt, &ds_namv, &rrddata);
-      if (ret != 0) { printf("Error: cannot fetch data from RRD.\n"); exit(-1); }
-      if(verbose == 1) printf("Debug: min rrd_fetch_r return=%d, ds count=%lu\n", ret, ds_cnt);
-
-      k=0;
-      int days = ((tend - tstart) / 86400)-1;
-      if(verbose == 1) printf("Debug: result day count=%d\n", days);
-
-      /* ------------------------------------------------------------- *
-       * Go through the returned dataset. For PPV, create sum of daily *
-       * power intake, divide by 24 to get the (Kilo) Watt hour value. *
-       * For balance, the battery current is pos/neg per power surplus *
-       * creating the pos/neg power value when multiplied with voltage *
-       * The set size is 12 days * 24 hrs (60 mins) * 6 data sources:  *
-       * pv watt=ds_namv[3], bat volts=ds_namv[0], bat cur=ds_namv[1]  *
-       * ------------------------------------------------------------- */
-      double ppvday = 0;
-      double balday = 0;
-
-      for(j=0; j<(days*ds_cnt); j=j+ds_cnt) {
-         k++;
-         if(verbose == 1) printf("Debug: day [%d] value [%d] rrd_fetch_r [%s:%.2f] [%s:%.2f] [%s:%.2f]\n",
-                                  k, j, ds_namv[3], rrddata[j+3], ds_namv[0], rrddata[j], ds_namv[1], rrddata[j+1]);
-         /* since the data is a 24hr avg, we multiply by 24 to get the approx. Watt number */
-         if(! isnan(rrddata[j+3])) ppvday = ppvday + (rrddata[j+3] * 24);
-         if(! isnan(rrddata[j]) && ! isnan(rrddata[j+1])) balday = balday + ((rrddata[j] * rrddata[j+1]) * 24);
-      }
-
-      /* print the solar power values before processing the next day */
-      if(ppvday != 0) {
-         //ppvday = ppvday / 24; /* divide through 24 to get Wh */
-         if(ppvday >= 1000)
-            fprintf(html, "   <td class=\"datacell\">%.1f&thinsp;KW", ppvday);
-         else
-            fprintf(html, "   <td class=\"datacell\">%.1f&thinsp;W", ppvday);
-      }
-      else  fprintf(html, "   <td class=\"emptycell\">N/A");
-
-      fprintf(html, " <br> ");
-
-      if((balday >= 1000) || (balday <= -1000))
-         fprintf(html, "%+.1f&thinsp;KW</td>\n", balday);
-      else
-         fprintf(html, "%+.1f&thinsp;W</td>\n", balday);
+      sum_days(day_start(show_year, 1, 1), day_start(show_year+1, 1, 1), &ppv, &bal, &pct, &pr);
+      if(verbose == 1) printf("Debug: year [%d] ppv [%.2f] balance [%.2f] data [%.1f%%]\n", show_year, ppv, bal, pct);
+      data_cell(ppv, bal, pct, -1);
    }
 }
 
@@ -282,105 +714,17 @@ void month_headhtml(int mon, int year){
    fprintf(html, "</tr>\n");
 }
 
-void month_datahtml(int mon, int year, time_t ts){
-   int i, j, k = 0;
-   unsigned long step = 86400;
+void month_datahtml(int mon, int year){
+   int i;
+   double ppv, bal, pct, pr;
    /* ------------------------------------------------------------- *
-    *  Create the data row for min max values to display            *
+    *  Create the data row, 1st day of month until the next month   *
     * ------------------------------------------------------------- */
    fprintf(html, "<tr>\n");
    for(i = 11; i >= 0; i--) {
-      int show_mon = mon - i;
-      int show_year = year;
-      if (show_mon == 0) { show_mon = 12; show_year = year-1; }
-      if (show_mon < 0) { show_mon = show_mon+12; show_year = year-1; }
-      /* ------------------------------------------------------------- *
-       * Create the start timestamp for rrd fetch, 1st day of month.   *
-       * ------------------------------------------------------------- */
-      struct tm start_tm;
-      start_tm.tm_year = show_year-1900;
-      start_tm.tm_mon  = show_mon-1;
-      start_tm.tm_mday = 1;
-      start_tm.tm_hour = 0;
-      start_tm.tm_min  = 0;
-      start_tm.tm_sec  = 0;
-
-      time_t tstart = mktime(&start_tm);
-      if(tstart == -1) printf("Error");
-      if(verbose == 1) printf("Debug: ts=%lld start date=%s", (long long) tstart, ctime(&tstart));
-
-      /* ------------------------------------------------------------- *
-       * Create the end timestamp for rrd fetch, 1st day of next month *
-       * ------------------------------------------------------------- */
-      struct tm end_tm;
-      end_tm.tm_year = show_year-1900;
-      end_tm.tm_mon  = show_mon;
-      end_tm.tm_mday = 1;
-      end_tm.tm_hour = 0;
-      end_tm.tm_min  = 0;
-      end_tm.tm_sec  = -1;
-
-      time_t tend = mktime(&end_tm);
-      if(tend == -1) printf("Error creating RRD timerange timestamp tend.");
-      if(tend > ts) tend = ts; // if we are at the current month, end at now time
-      if(verbose == 1) printf("Debug: ts=%lld end date=%s", (long long) tend, ctime(&tend));
-
-      /* ------------------------------------------------------------- *
-       * rrd_fetch_r() gets all RRD values for a specific time range.  *
-       * 8x function args: 5x input, 3x output. Returns 0 for success. *
-       * (1) const char *filename,                                     *
-       * (2) const char *consolidation_function,                       *
-       * (3) time_t *start,                                            *
-       * (4) time_t *end,                                              *
-       * (5) unsigned long *step,                                      *
-       * (6) unsigned long *ds_cnt,                                    *
-       * (7) char ***ds_namv,                                          *
-       * (8) rrd_value_t **data);                                      *
-       * ------------------------------------------------------------- */
-      int ret = rrd_fetch_r(rrdfile, "AVERAGE", &tstart, &tend, &step, &ds_cnt, &ds_namv, &rrddata);
-      if (ret != 0) { printf("Error: cannot fetch data from RRD.\n"); exit(-1); }
-      if(verbose == 1) printf("Debug: min rrd_fetch_r return=%d, ds count=%lu\n", ret, ds_cnt);
-
-      k=0;
-      int days = ((tend - tstart) / 86400)-1;
-      if(verbose == 1) printf("Debug: result day count=%d\n", days);
-
-      /* ------------------------------------------------------------- *
-       * Go through the returned dataset. For PPV, create sum of daily *
-       * power intake, divide by 24 to get the (Kilo) Watt hour value. *
-       * For balance, the battery current is pos/neg per power surplus *
-       * creating the pos/neg power value when multiplied with voltage *
-       * The set size is 12 days * 24 hrs (60 mins) * 6 data sources:  *
-       * pv watt=ds_namv[3], bat volts=ds_namv[0], bat cur=ds_namv[1]  *
-       * ------------------------------------------------------------- */
-      double ppvday = 0;
-      double balday = 0;
-
-      for(j=0; j<(days*ds_cnt); j=j+ds_cnt) {
-         k++;
-         if(verbose == 1) printf("Debug: day [%d] value [%d] rrd_fetch_r [%s:%.2f] [%s:%.2f] [%s:%.2f]\n",
-                                  k, j, ds_namv[3], rrddata[j+3], ds_namv[0], rrddata[j], ds_namv[1], rrddata[j+1]);
-         /* since the data is a 24hr avg, we multiply by 24 to get the approx. Watt number */
-         if(! isnan(rrddata[j+3])) ppvday = ppvday + (rrddata[j+3] * 24);
-         if(! isnan(rrddata[j]) && ! isnan(rrddata[j+1])) balday = balday + ((rrddata[j] * rrddata[j+1]) * 24);
-      }
-
-      /* print the solar power values before processing the next day */
-      if(ppvday != 0) {
-         //ppvday = ppvday / 24; /* divide through 24 to get Wh */
-         if(ppvday >= 1000)
-            fprintf(html, "   <td class=\"datacell\">%.1f&thinsp;KW", ppvday);
-         else
-            fprintf(html, "   <td class=\"datacell\">%.1f&thinsp;W", ppvday);
-      }
-      else  fprintf(html, "   <td class=\"emptycell\">N/A");
-
-      fprintf(html, " <br> ");
-
-      if((balday >= 1000) || (balday <= -1000))
-         fprintf(html, "%+.1f&thinsp;KW</td>\n", balday);
-      else
-         fprintf(html, "%+.1f&thinsp;W</td>\n", balday);
+      sum_days(day_start(year, mon-i, 1), day_start(year, mon-i+1, 1), &ppv, &bal, &pct, &pr);
+      if(verbose == 1) printf("Debug: month [%d-%d] ppv [%.2f] balance [%.2f] data [%.1f%%] ratio [%.2f]\n", year, mon-i, ppv, bal, pct, pr);
+      data_cell(ppv, bal, pct, pr);
    }
 }
 
@@ -407,105 +751,55 @@ void day_headhtml(time_t tsnow){
 }
 
 void day_datahtml(time_t tsnow) {
-   unsigned long step = 3600;
+   int i;
+   double ppv, bal, pct, pr;
    /* ------------------------------------------------------------- *
-    *  Create the data row for power values to display              *
+    *  Create the data row for the 12 days before today             *
     * ------------------------------------------------------------- */
-   time_t tstart = tsnow - (86400 * 12);
-   if(verbose == 1) printf("Debug: Create html value row\n");
-   if(verbose == 1) printf("Debug: ts=%lld now date=%s", (long long) tsnow, ctime(&tsnow));
-   if(verbose == 1) printf("Debug: ts=%lld start date=%s", (long long) tstart, ctime(&tstart));
-
-   struct tm start_tm = * localtime(&tstart);   // now-12 days
-   start_tm.tm_hour = 0;
-   start_tm.tm_min  = 0;
-   start_tm.tm_sec  = 0;
-   tstart = mktime(&start_tm);
-   if(tstart == -1) printf("Error creating tstart timestamp for day_datahtml");
-   if(verbose == 1) printf("Debug: ts=%lld start date=%s", (long long) tstart, ctime(&tstart));
-
-   struct tm end_tm = * localtime(&tsnow);   // now
-   end_tm.tm_hour = 0;
-   end_tm.tm_min  = 0;
-   end_tm.tm_sec  = 0;
-   time_t tend = mktime(&end_tm);
-   //time_t tend = tsnow;
-   if(tend == -1) printf("Error creating tend timestamp for day_datahtml");
-   if(verbose == 1) printf("Debug: ts=%lld end date=%s", (long long) tend, ctime(&tend));
-
-   /* ------------------------------------------------------------- *
-    * rrd_fetch_r() gets all RRD values for a specific time range.  *
-    * 8x function args: 5x input, 3x output. Returns 0 for success. *
-    * (1) const char *filename,                                     *
-    * (2) const char *consolidation_function,                       *
-    * (3) time_t *start,                                            *
-    * (4) time_t *end,                                              *
-    * (5) unsigned long *step,                                      *
-    * (6) unsigned long *ds_cnt,                                    *
-    * (7) char ***ds_namv,                                          *
-    * (8) rrd_value_t **data);                                      *
-    * ------------------------------------------------------------- */
-   int ret = rrd_fetch_r(rrdfile, "AVERAGE", &tstart, &tend, &step, &ds_cnt, &ds_namv, &rrddata);
-   if (ret != 0) { printf("Error: cannot fetch data from RRD.\n"); exit(-1); }
-   if(verbose == 1) printf("Debug: min rrd_fetch_r return=%d, ds count=%lu\n", ret, ds_cnt);
-
+   struct tm now_tm = * localtime(&tsnow);
    fprintf(html, "<tr>\n");
-
-   int i, j=0, k=0;
-      double ppvday = 0;
-      double balday = 0;
-      /* ------------------------------------------------------------- *
-       * Go through the returned dataset. For PPV, create sum of daily *
-       * power intake, divide by 24 to get the (Kilo) Watt hour value. *
-       * For balance, the battery current is pos/neg per power surplus *
-       * creating the pos/neg power value when multiplied with voltage *
-       * The set size is 12 days * 24 hrs (60 mins) * 6 data sources:  *
-       * pv watt=ds_namv[3], bat volts=ds_namv[0], bat cur=ds_namv[1]  *
-       * ------------------------------------------------------------- */
-   for(i=0; i<(288*ds_cnt); i=i+ds_cnt) {
-
-      if(verbose == 1) printf("Debug: day [%2d] hour [%2d] %s [%.2f] %s [%.2f] %s [%.2f]\n",
-                               k, j, ds_namv[3], rrddata[i+3], ds_namv[0],  rrddata[i], ds_namv[1],  rrddata[i+1]);
-      if(! isnan(rrddata[i+3])) ppvday = ppvday + rrddata[i+3];
-      if(! isnan(rrddata[i]) && ! isnan(rrddata[i+1])) balday = balday + (rrddata[i] * rrddata[i+1]);
-      j++;
-      if(j==24) {
-         k++; j=0;
-
-         if(verbose == 1) printf("Debug: day [%2d] %s [%.2f] balance [%.2f]\n",
-                               k-1, ds_namv[3], ppvday, balday);
-         /* print the solar power values before processing the next day */
-         if(ppvday != 0) {
-            //ppvday = ppvday / 24; /* divide through 24 to get Wh */
-            if(ppvday >= 1000)
-               fprintf(html, "   <td class=\"datacell\">%.1f&thinsp;KW", ppvday);
-            else
-               fprintf(html, "   <td class=\"datacell\">%.1f&thinsp;W", ppvday);
-         }
-         else  fprintf(html, "   <td class=\"emptycell\">N/A");
-
-         fprintf(html, " <br> ");
-
-         /* print the balance values before processing the next day */
-         if((balday >= 1000) || (balday <= -1000))
-            fprintf(html, "%+.1f&thinsp;KW</td>\n", balday);
-         else
-            fprintf(html, "%+.1f&thinsp;W</td>\n", balday);
-
-         /* Reset the values before processing the next day */
-         ppvday = 0;
-         balday = 0;
-      }
+   for(i = 12; i > 0; i--) {
+      time_t from = day_start(now_tm.tm_year+1900, now_tm.tm_mon+1, now_tm.tm_mday-i);
+      time_t until = day_start(now_tm.tm_year+1900, now_tm.tm_mon+1, now_tm.tm_mday-i+1);
+      sum_days(from, until, &ppv, &bal, &pct, &pr);
+      if(verbose == 1) printf("Debug: day [%2d] ppv [%.2f] balance [%.2f] data [%.1f%%] ratio [%.2f]\n", i, ppv, bal, pct, pr);
+      data_cell(ppv, bal, pct, pr);
    }
    if(verbose == 1) printf("Debug: Finished html value row\n");
 }
 
+/* ------------------------------------------------------------ *
+ * open_table() and close_table() write the html table frame    *
+ * ------------------------------------------------------------ */
+void open_table(const char *file) {
+   if(! (html=fopen(file, "w"))) {
+      printf("Error open %s for writing.\n", file);
+      exit(-1);
+   }
+   fprintf(html, "<table class=\"dmovtable\">\n");
+}
+
+void close_table() {
+   fprintf(html, "</tr>\n");
+   fprintf(html, "</table>\n");
+   fclose(html);
+}
+
 int main(int argc, char *argv[]) {
    /* ------------------------------------------------------------ *
     * Process the cmdline parameters                               *
     * ------------------------------------------------------------ */
    parseargs(argc, argv);
-   if(verbose == 1) printf("Debug: RRD file=%s\tHTM file=%s\n", rrdfile, htmfile);
+   if(verbose == 1) printf("Debug: RRD file=%s\tHTM files=%s %s %s\n", rrdfile, dayfile, monfile, yearfile);
+
+   /* ------------------------------------------------------------ *
+    * With RRDCACHED_ADDRESS set, have rrdcombd write the pending  *
+    * updates first, rrd_fetch_r() reads the file directly.        *
+    * ------------------------------------------------------------ */
+   if(rrdc_flush_if_daemon(NULL, rrdfile) != 0) {
+      printf("Error: cannot flush %s: %s\n", rrdfile, rrd_get_error());
+      exit(-1);
+   }
 
    /* ------------------------------------------------------------ *
     * get current time (now), and time 11 months back (start)      *
@@ -518,43 +812,100 @@ int main(int argc, char *argv[]) {
    if(verbose == 1) printf("Debug: date=%s", ctime(&tsnow));
    if(verbose == 1) printf("Debug: start year-month=%d-%d\n", this_year, this_mon);
 
-   /* ----------------------------------------------------------- *
-    *  Open the html file for writing the table data              *
-    * ----------------------------------------------------------- */
-   if(! (html=fopen(htmfile, "w")))
-      printf("Error open %s for writing.\n", htmfile);
+   /* ------------------------------------------------------------ *
+    * The calendar starts at the oldest day any table needs, or at *
+    * the first ledger day. Today and the 12 days before come from *
+    * the hourly rows, all other days from the daily rows.         *
+    * ------------------------------------------------------------ */
+   time_t dstart = day_start(this_year, this_mon, now.tm_mday-12);
+   time_t tstart = dstart;
+   if(strlen(monfile) > 0) tstart = day_start(this_year, this_mon-11, 1);
+   if(strlen(yearfile) > 0) tstart = day_start(this_year-11, 1, 1);
 
-   fprintf(html, "<table class=\"dmovtable\">\n");
+   if(strlen(ledfile) > 0) tstart = ledger_start(ledfile, tstart);
+   make_calendar(tstart, tsnow);
+
+   /* ------------------------------------------------------------ *
+    * With a ledger, integrate only the days after the last ledger *
+    * day, and at least today and yesterday again.                 *
+    * ------------------------------------------------------------ */
+   int redo = 0;
+   if(strlen(ledfile) > 0 && read_ledger(ledfile) > 0) {
+      while(redo < cal_days && cal[redo].done == 1) redo++;
+      if(redo > cal_days - LEDGER_REDO) redo = cal_days - LEDGER_REDO;
+      if(redo < 0) redo = 0;
+      int i;
+      for(i=redo; i<cal_days; i++) {
+         time_t start = cal[i].start, len = cal[i].len;
+         memset(&cal[i], 0, sizeof(calday_t));
+         cal[i].start = start;
+         cal[i].len = len;
+         cal[i].vmin = NAN;
+         cal[i].vmax = NAN;
+      }
+   }
+   time_t rstart = cal[redo].start;
+   if(verbose == 1) printf("Debug: integrate %d days from %s", cal_days - redo, ctime(&rstart));
+
+   time_t hstart = (dstart > rstart) ? dstart : rstart;
+   if(rstart < hstart) fetch_days(rstart, hstart, 86400, rstart, hstart);
+   fetch_days(hstart, tsnow, 3600, hstart, tsnow);
+
+   if(strlen(ledfile) > 0) write_ledger(ledfile);
+   make_sums();
+
+   /* ------------------------------------------------------------ *
+    * With the clear-sky model, flag the past days with a low      *
+    * performance ratio in the output, for the script log.         *
+    * ------------------------------------------------------------ */
+   if(pvwatt > 0) {
+      int i;
+      for(i = day_index(dstart); i < cal_days - 1; i++) {
+         if(cal[i].clr <= 0) continue;
+         double pr = cal[i].ppv / cal[i].clr;
+         if(pr >= prlimit) continue;
+         char date[16];
+         strftime(date, sizeof(date), "%Y-%m-%d", localtime(&cal[i].start));
+         printf("pvpower: %s performance ratio %.2f under %.2f (%.0f Wh of %.0f Wh clear-sky)\n",
+                date, pr, prlimit, cal[i].ppv, cal[i].clr);
+      }
+   }
 
    /* ------------------------------------------------------------ *
     * If we received -d, create the daily html table data          *
     * ------------------------------------------------------------ */
-   if(outtype == 1) {
+   if(strlen(dayfile) > 0) {
+      open_table(dayfile);
       day_headhtml(tsnow);
       day_datahtml(tsnow);
+      close_table();
    }
 
    /* ------------------------------------------------------------ *
     * If we received -m, create the monthly html table data        *
     * ------------------------------------------------------------ */
-   if(outtype == 2) {
+   if(strlen(monfile) > 0) {
+      open_table(monfile);
       month_headhtml(this_mon, this_year);
-      month_datahtml(this_mon, this_year, tsnow);
+      month_datahtml(this_mon, this_year);
+      close_table();
    }
 
    /* ------------------------------------------------------------ *
     * If we received -y, create the yearly html table data         *
     * ------------------------------------------------------------ */
-   if(outtype == 3) {
+   if(strlen(yearfile) > 0) {
+      open_table(yearfile);
       year_headhtml(this_year);
-      year_datahtml(this_year, tsnow);
+      year_datahtml(this_year);
+      close_table();
    }
-
-   fprintf(html, "</tr>\n");
-   fprintf(html, "</table>\n");
-   /* ------------------------------------------------------------ *
-    *  Close the html file                                         *
-    * ------------------------------------------------------------ */
-   fclose(html);
+   free(sum_ppv);
+   free(sum_bal);
+   free(sum_cov);
+   free(sum_len);
+   free(sum_pvm);
+   free(sum_clr);
+   free(cal);
    exit(0);
 }
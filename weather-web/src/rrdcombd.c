@@ -0,0 +1,702 @@
+/* ------------------------------------------------------------ *
+ * file:        rrdcombd.c                                      *
+ * purpose:     RRD write-combining daemon. It listens on a     *
+ *              unix socket and speaks the rrdcached protocol,  *
+ *              so rrdtool and librrd send their updates to it  *
+ *              when RRDCACHED_ADDRESS is set. The updates are  *
+ *              appended to a journal and kept in memory, and   *
+ *              each RRD file is written in one batch once its  *
+ *              oldest pending value is older than -w seconds.  *
+ *              With one station update per minute, this turns  *
+ *              60 random writes per hour into one per -w 3600. *
+ *                                                              *
+ *              FLUSH <file> writes the file right away, librrd *
+ *              sends it before graphing (rrdgraph cache miss), *
+ *              and the daily momimax and pvpower tables send   *
+ *              it before they read. outlier gets the values of *
+ *              the queue with PENDING <file>, without a write. *
+ *              After a crash the journal is replayed on start. *
+ *                                                              *
+ * commands:    UPDATE, LAST, FLUSH, FLUSHALL, PENDING, FORGET, *
+ *              STATS, BATCH, PING, HELP, QUIT (rrdcached man). *
+ *              LAST answers from the queue, so "rrdtool last"  *
+ *              in rrdupdate.sh does not force a write.         *
+ *                                                              *
+ * return:      Returns 0 on success, and -1 on errors.         *
+ *                                                              *
+ * RRD API:     http://oss.oetiker.ch/rrdtool/doc/librrd.en.html*
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ *                                                              *
+ * compile: gcc rrdcombd.c -o rrdcombd -lrrd                    *
+ * ------------------------------------------------------------ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <grp.h>
+#include <rrd.h>
+
+/* ------------------------------------------------------------ *
+ * Defaults for the socket, the journal and the flush interval  *
+ * ------------------------------------------------------------ */
+#define SOCKFILE   "/run/rrdcombd.sock"
+#define JOURNAL    "/srv/app/pi-web01/log/rrdcombd.journal"
+#define BASEDIR    "/srv/app/pi-web01/chroot"
+#define FLUSHWAIT  3600
+/* ------------------------------------------------------------ *
+ * Max number of connected clients, and the max request length  *
+ * ------------------------------------------------------------ */
+#define MAXCLIENT  32
+#define MAXLINE    4096
+
+/* ------------------------------------------------------------ *
+ * Global variables and defaults                                *
+ * ------------------------------------------------------------ */
+int verbose = 0;
+char sockfile[108] = SOCKFILE;        // the unix socket we listen on
+char journal[256] = JOURNAL;          // the update journal file
+char basedir[256] = BASEDIR;          // only RRD files below this dir
+int flushwait = FLUSHWAIT;            // max seconds a value is pending
+char sockgroup[64] = "";              // group allowed to use the socket
+int jfd = -1;                         // the journal file descriptor
+volatile sig_atomic_t stop = 0;       // set by SIGTERM and SIGINT
+extern char *optarg;
+extern int optind, opterr, optopt;
+
+/* ------------------------------------------------------------ *
+ * The pending updates of one RRD file                          *
+ * ------------------------------------------------------------ */
+typedef struct {
+   char *file;             // the RRD file name and path
+   char **values;          // the pending "ts:val:val" strings
+   int count;              // the number of pending values
+   int size;               // the allocated size of values[]
+   time_t first;           // when the oldest pending value came in
+   time_t last_ts;         // the last timestamp enqueued or written
+} rrdq_t;
+
+rrdq_t *queue = NULL;                 // the list of known RRD files
+int qcount = 0;                       // the number of files in queue
+/* ------------------------------------------------------------ *
+ * Statistics, reported by the STATS command                    *
+ * ------------------------------------------------------------ */
+long st_received = 0;                 // update values received
+long st_written = 0;                  // update values written
+long st_flushes = 0;                  // rrd_update_r() batch calls
+long st_journal = 0;                  // bytes written to journal
+
+/* ------------------------------------------------------------ *
+ * The connected clients, each with its own line buffer         *
+ * ------------------------------------------------------------ */
+typedef struct {
+   int fd;                 // the client socket, -1 if unused
+   char buf[MAXLINE];      // received data, not yet a full line
+   int len;                // number of bytes in buf
+   int batch;              // 1 = inside BATCH, until "."
+   int bcmd;               // the command number within the batch
+   int berr;               // the number of errors within the batch
+   char *berrs;            // the batch error lines, sent at the end
+} client_t;
+
+client_t clients[MAXCLIENT];
+
+/* ------------------------------------------------------------ *
+ * print_usage() prints the programs commandline instructions.  *
+ * ------------------------------------------------------------ */
+void usage() {
+   static char const usage[] = "Usage: rrdcombd [-s socket] [-g group] [-j journal] [-b basedir] [-w seconds] [-v]\n\
+   Command line parameters have the following format:\n\
+   -s   unix socket file, optional, default " SOCKFILE "\n\
+   -g   socket group, e.g. www-data for the rrdgraph CGI, optional\n\
+   -j   update journal file, optional, default " JOURNAL "\n\
+   -b   base directory, only RRD files below it are accepted,\n\
+        optional, default " BASEDIR "\n\
+   -w   max seconds an update stays pending before it is written,\n\
+        optional, default 3600\n\
+   -h   optional, display this message\n\
+   -v   optional, enables debug output\n\
+   Usage examples:\n\
+./rrdcombd -s /run/rrdcombd.sock -g www-data -w 1800 -v\n\
+export RRDCACHED_ADDRESS=unix:/run/rrdcombd.sock; rrdtool update ...\n";
+   printf(usage);
+}
+
+/* ------------------------------------------------------------ *
+ * parseargs() checks the commandline arguments with C getopt   *
+ * ------------------------------------------------------------ */
+void parseargs(int argc, char* argv[]) {
+   int arg;
+   opterr = 0;
+
+   while ((arg = (int) getopt (argc, argv, "s:g:j:b:w:vh")) != -1)
+      switch (arg) {
+         // arg -s + unix socket file, type: string
+         // optional, example: /run/rrdcombd.sock
+         case 's':
+            if(verbose == 1) printf("Debug: arg -s, value %s\n", optarg);
+            if(strlen(optarg) >= sizeof(sockfile)) {
+               printf("Error: socket file path %s is too long.\n", optarg);
+               exit(-1);
+            }
+            snprintf(sockfile, sizeof(sockfile), "%s", optarg);
+            break;
+
+         // arg -g + socket group name, type: string
+         // optional, example: www-data
+         case 'g':
+            if(verbose == 1) printf("Debug: arg -g, value %s\n", optarg);
+            snprintf(sockgroup, sizeof(sockgroup), "%s", optarg);
+            break;
+
+         // arg -j + journal file, type: string
+         // optional, example: /srv/app/pi-web01/log/rrdcombd.journal
+         case 'j':
+            if(verbose == 1) printf("Debug: arg -j, value %s\n", optarg);
+            snprintf(journal, sizeof(journal), "%s", optarg);
+            break;
+
+         // arg -b + base directory, type: string
+         // optional, example: /srv/app/pi-web01/chroot
+         case 'b':
+            if(verbose == 1) printf("Debug: arg -b, value %s\n", optarg);
+            snprintf(basedir, sizeof(basedir), "%s", optarg);
+            break;
+
+         // arg -w + flush wait time in seconds, type: int
+         // optional, example: 1800
+         case 'w':
+            if(verbose == 1) printf("Debug: arg -w, value %s\n", optarg);
+            flushwait = atoi(optarg);
+            if(flushwait < 1 || flushwait > 86400) {
+               printf("Error: Cannot get valid -w flush wait argument.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg -v verbose, type: flag, optional
+         case 'v':
+            verbose = 1; break;
+
+         // arg -h usage, type: flag, optional
+         case 'h':
+            usage(); exit(0);
+
+         case '?':
+            if (isprint (optopt))
+               printf ("Error: Unknown option `-%c'.\n", optopt);
+            else
+               printf ("Error: Unknown option character `\\x%x'.\n", optopt);
+
+         default:
+            usage(); exit(-1);
+    }
+}
+
+/* ------------------------------------------------------------ *
+ * find_rrd() returns the queue entry for file. With create=1   *
+ * a new entry is added. Files outside basedir, or not existing *
+ * are refused, this daemon runs as root.                       *
+ * ------------------------------------------------------------ */
+rrdq_t *find_rrd(const char *file, int create) {
+   struct stat st;
+   int i;
+
+   for(i=0; i<qcount; i++)
+      if(strcmp(queue[i].file, file) == 0) return &queue[i];
+   if(create == 0) return NULL;
+
+   size_t blen = strlen(basedir);
+   if(strncmp(file, basedir, blen) != 0 || file[blen] != '/'
+      || strstr(file, "/../") != NULL || stat(file, &st) != 0 || ! S_ISREG(st.st_mode))
+      return NULL;
+
+   rrdq_t *q = realloc(queue, (qcount+1) * sizeof(rrdq_t));
+   if(q == NULL) return NULL;
+   queue = q;
+   q = &queue[qcount++];
+   memset(q, 0, sizeof(rrdq_t));
+   q->file = strdup(file);
+   q->last_ts = rrd_last_r(file);
+   rrd_clear_error();
+   return q;
+}
+
+/* ------------------------------------------------------------ *
+ * enqueue() adds one "ts:val:val" value to a files queue. An N *
+ * timestamp is set to now, so a journal replay stays correct.  *
+ * Returns 0 on success, -1 for old or broken values.           *
+ * ------------------------------------------------------------ */
+int enqueue(rrdq_t *q, const char *value, time_t now) {
+   char buf[MAXLINE];
+   char *end;
+
+   if(value[0] == 'N' && value[1] == ':') {
+      snprintf(buf, sizeof(buf), "%lld%s", (long long) now, value+1);
+      value = buf;
+   }
+   long long ts = strtoll(value, &end, 10);
+   if(end == value || *end != ':') return -1;
+   if(ts <= q->last_ts) return -1;
+
+   if(q->count == q->size) {
+      int nsize = q->size ? q->size * 2 : 64;
+      char **nv = realloc(q->values, nsize * sizeof(char *));
+      if(nv == NULL) return -1;
+      q->values = nv;
+      q->size = nsize;
+   }
+   q->values[q->count++] = strdup(value);
+   if(q->count == 1) q->first = now;
+   q->last_ts = ts;
+   st_received++;
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * flush_rrd() writes all pending values of a file in a single  *
+ * rrd_update_r() call. If the batch fails, the values are sent *
+ * one by one, so a single bad value does not drop the rest.    *
+ * ------------------------------------------------------------ */
+int flush_rrd(rrdq_t *q) {
+   int ret = 0, i;
+
+   if(q->count == 0) return 0;
+   if(verbose == 1) printf("Debug: flush %d values to %s\n", q->count, q->file);
+
+   if(rrd_update_r(q->file, NULL, q->count, (const char **) q->values) != 0) {
+      printf("Error: batch update %s failed: %s\n", q->file, rrd_get_error());
+      rrd_clear_error();
+      time_t last = rrd_last_r(q->file);
+      for(i=0; i<q->count; i++) {
+         if(strtoll(q->values[i], NULL, 10) <= last) continue;
+         if(rrd_update_r(q->file, NULL, 1, (const char **) &q->values[i]) != 0) {
+            printf("Error: update %s %s failed: %s\n", q->file, q->values[i], rrd_get_error());
+            rrd_clear_error();
+            ret = -1;
+         }
+         else st_written++;
+      }
+   }
+   else st_written += q->count;
+   st_flushes++;
+
+   for(i=0; i<q->count; i++) free(q->values[i]);
+   q->count = 0;
+   return ret;
+}
+
+/* ------------------------------------------------------------ *
+ * journal_rotate() compacts the journal after a flush: it puts *
+ * the values still pending into a new file, and renames it     *
+ * over the old journal, the same way rrdcached rotates it. The *
+ * journal never holds more than the values not written yet.    *
+ * ------------------------------------------------------------ */
+void journal_rotate() {
+   char tmpfile[sizeof(journal)+8];
+   char line[MAXLINE+256];
+   int i, j, len, fd, ok = 1;
+
+   if(jfd == -1) return;
+   snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", journal);
+   fd = open(tmpfile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+   if(fd == -1) {
+      printf("Error: cannot create journal %s: %s\n", tmpfile, strerror(errno));
+      return;
+   }
+   for(i=0; i<qcount && ok; i++) {
+      for(j=0; j<queue[i].count && ok; j++) {
+         len = snprintf(line, sizeof(line), "update %s %s\n", queue[i].file, queue[i].values[j]);
+         if(len >= (int) sizeof(line)) continue;
+         if(write(fd, line, len) != len) ok = 0;
+      }
+   }
+   if(ok == 1 && fdatasync(fd) != 0) ok = 0;
+   if(close(fd) != 0) ok = 0;
+   if(ok == 0 || rename(tmpfile, journal) != 0) {
+      printf("Error: cannot rotate journal %s: %s\n", journal, strerror(errno));
+      unlink(tmpfile);
+      return;
+   }
+   /* the old descriptor still points to the replaced file */
+   close(jfd);
+   jfd = open(journal, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+   if(jfd == -1)
+      printf("Error: cannot open journal %s: %s\n", journal, strerror(errno));
+}
+
+/* ------------------------------------------------------------ *
+ * flush_due() writes the files whose oldest pending value has  *
+ * waited flushwait seconds. Each file has its own start time,  *
+ * so the writes of many stations spread out over the interval. *
+ * ------------------------------------------------------------ */
+void flush_due(time_t now) {
+   int i, flushed = 0;
+   for(i=0; i<qcount; i++) {
+      if(queue[i].count > 0 && now - queue[i].first >= flushwait) {
+         flush_rrd(&queue[i]);
+         flushed++;
+      }
+   }
+   if(flushed > 0) journal_rotate();
+}
+
+/* ------------------------------------------------------------ *
+ * flush_all() writes all files, and compacts the journal.      *
+ * ------------------------------------------------------------ */
+void flush_all() {
+   int i;
+   for(i=0; i<qcount; i++) flush_rrd(&queue[i]);
+   journal_rotate();
+}
+
+/* ------------------------------------------------------------ *
+ * journal_write() appends one update line to the journal with  *
+ * a single write(). The UPDATE handler syncs it to disk before *
+ * the client gets the confirmation.                            *
+ * ------------------------------------------------------------ */
+void journal_write(const char *file, const char *value) {
+   char line[MAXLINE+256];
+   if(jfd == -1) return;
+   int len = snprintf(line, sizeof(line), "update %s %s\n", file, value);
+   if(len >= (int) sizeof(line)) return;
+   if(write(jfd, line, len) != len)
+      printf("Error: cannot write journal %s: %s\n", journal, strerror(errno));
+   else st_journal += len;
+}
+
+/* ------------------------------------------------------------ *
+ * journal_replay() reads the journal left from a crash back in *
+ * to the queue. Values already in the RRD file are skipped by  *
+ * enqueue(), they have been written before the crash.          *
+ * ------------------------------------------------------------ */
+void journal_replay() {
+   FILE *fp;
+   char line[MAXLINE+256];
+   char file[MAXLINE], value[MAXLINE];
+   int count = 0;
+
+   if(! (fp=fopen(journal, "r"))) return;
+   while(fgets(line, sizeof(line), fp) != NULL) {
+      if(sscanf(line, "update %4095s %4095s", file, value) != 2) continue;
+      rrdq_t *q = find_rrd(file, 1);
+      if(q != NULL && enqueue(q, value, time(NULL)) == 0) count++;
+   }
+   fclose(fp);
+   printf("rrdcombd: replayed %d journal values from %s\n", count, journal);
+   /* write the replayed values, the journal starts empty */
+   flush_all();
+}
+
+/* ------------------------------------------------------------ *
+ * reply() sends a response line to the client, or collects the *
+ * error lines inside a BATCH for the end of batch response.    *
+ * ------------------------------------------------------------ */
+void reply(client_t *c, int status, const char *msg) {
+   char line[MAXLINE+64];
+
+   if(c->batch == 1) {
+      if(status >= 0) return;
+      c->berr++;
+      int len = snprintf(line, sizeof(line), "%d %s\n", c->bcmd, msg);
+      size_t olen = c->berrs ? strlen(c->berrs) : 0;
+      char *n = realloc(c->berrs, olen + len + 1);
+      if(n == NULL) return;
+      memcpy(n + olen, line, len + 1);
+      c->berrs = n;
+      return;
+   }
+   int len = snprintf(line, sizeof(line), "%d %s\n", status, msg);
+   if(len > (int) sizeof(line)-1) len = sizeof(line)-1;
+   if(write(c->fd, line, len) != len && verbose == 1)
+      printf("Debug: client write failed: %s\n", strerror(errno));
+}
+
+/* ------------------------------------------------------------ *
+ * cmd_stats() sends the STATS response with its counter lines  *
+ * ------------------------------------------------------------ */
+void cmd_stats(client_t *c) {
+   char buf[1024];
+   long pending = 0;
+   int i;
+   for(i=0; i<qcount; i++) pending += queue[i].count;
+   int len = snprintf(buf, sizeof(buf), "6 Statistics follow\n"
+                      "QueueLength: %ld\nUpdatesReceived: %ld\nDataSetsWritten: %ld\n"
+                      "UpdatesWritten: %ld\nTreeNodesNumber: %d\nJournalBytes: %ld\n",
+                      pending, st_received, st_written, st_flushes, qcount, st_journal);
+   if(write(c->fd, buf, len) != len && verbose == 1)
+      printf("Debug: client write failed: %s\n", strerror(errno));
+}
+
+/* ------------------------------------------------------------ *
+ * cmd_pending() sends the PENDING response with the values     *
+ * ------------------------------------------------------------ */
+void cmd_pending(client_t *c, rrdq_t *q) {
+   char line[MAXLINE+64];
+   int i, len;
+   len = snprintf(line, sizeof(line), "%d updates pending\n", q ? q->count : 0);
+   if(write(c->fd, line, len) != len) return;
+   for(i=0; q && i<q->count; i++) {
+      len = snprintf(line, sizeof(line), "%s\n", q->values[i]);
+      if(write(c->fd, line, len) != len) return;
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * handle_line() runs one protocol command. Returns -1 if the   *
+ * client connection should be closed (QUIT).                   *
+ * ------------------------------------------------------------ */
+int handle_line(client_t *c, char *line) {
+   char msg[MAXLINE+64];
+   char *save = NULL;
+   time_t now = time(NULL);
+
+   /* ------------------------------------------------------------ *
+    * Inside a batch, "." ends it and sends the collected errors   *
+    * ------------------------------------------------------------ */
+   if(c->batch == 1 && strcmp(line, ".") == 0) {
+      c->batch = 0;
+      snprintf(msg, sizeof(msg), "%d errors\n", c->berr);
+      if(write(c->fd, msg, strlen(msg)) < 0 && verbose == 1)
+         printf("Debug: client write failed: %s\n", strerror(errno));
+      if(c->berrs && write(c->fd, c->berrs, strlen(c->berrs)) < 0 && verbose == 1)
+         printf("Debug: client write failed: %s\n", strerror(errno));
+      free(c->berrs);
+      c->berrs = NULL;
+      return 0;
+   }
+   if(c->batch == 1) c->bcmd++;
+
+   char *cmd = strtok_r(line, " ", &save);
+   if(cmd == NULL) return 0;
+   char *file = strtok_r(NULL, " ", &save);
+
+   if(strcasecmp(cmd, "UPDATE") == 0) {
+      rrdq_t *q = file ? find_rrd(file, 1) : NULL;
+      if(q == NULL) { reply(c, -1, "No such file or not allowed"); return 0; }
+      int ok = 0, err = 0;
+      char *val;
+      while((val = strtok_r(NULL, " ", &save)) != NULL) {
+         if(enqueue(q, val, now) == 0) {
+            journal_write(q->file, q->values[q->count-1]);
+            ok++;
+         }
+         else err++;
+      }
+      if(ok > 0 && jfd != -1 && fdatasync(jfd) != 0)
+         printf("Error: cannot sync journal %s: %s\n", journal, strerror(errno));
+      if(err > 0) {
+         snprintf(msg, sizeof(msg), "illegal or old update value(s) for %s", q->file);
+         reply(c, -1, msg);
+      }
+      else {
+         snprintf(msg, sizeof(msg), "errors, enqueued %d value(s).", ok);
+         reply(c, 0, msg);
+      }
+   }
+   else if(strcasecmp(cmd, "LAST") == 0) {
+      rrdq_t *q = file ? find_rrd(file, 1) : NULL;
+      if(q == NULL) { reply(c, -1, "No such file or not allowed"); return 0; }
+      snprintf(msg, sizeof(msg), "%lld", (long long) q->last_ts);
+      reply(c, 0, msg);
+   }
+   else if(strcasecmp(cmd, "FLUSH") == 0) {
+      rrdq_t *q = file ? find_rrd(file, 0) : NULL;
+      if(q != NULL && flush_rrd(q) != 0) { reply(c, -1, "Flush failed"); return 0; }
+      journal_rotate();
+      snprintf(msg, sizeof(msg), "Successfully flushed %s.", file ? file : "");
+      reply(c, 0, msg);
+   }
+   else if(strcasecmp(cmd, "FLUSHALL") == 0) {
+      flush_all();
+      reply(c, 0, "Started flush.");
+   }
+   else if(strcasecmp(cmd, "PENDING") == 0) {
+      cmd_pending(c, file ? find_rrd(file, 0) : NULL);
+   }
+   else if(strcasecmp(cmd, "FORGET") == 0) {
+      rrdq_t *q = file ? find_rrd(file, 0) : NULL;
+      if(q == NULL) { reply(c, -1, "No such file"); return 0; }
+      int i;
+      for(i=0; i<q->count; i++) free(q->values[i]);
+      q->count = 0;
+      q->last_ts = rrd_last_r(q->file);
+      rrd_clear_error();
+      journal_rotate();
+      reply(c, 0, "Gone!");
+   }
+   else if(strcasecmp(cmd, "STATS") == 0) {
+      cmd_stats(c);
+   }
+   else if(strcasecmp(cmd, "BATCH") == 0) {
+      reply(c, 0, "Go ahead.  End with dot '.' on its own line.");
+      c->batch = 1; c->bcmd = 0; c->berr = 0;
+   }
+   else if(strcasecmp(cmd, "PING") == 0) {
+      reply(c, 0, "PONG");
+   }
+   else if(strcasecmp(cmd, "HELP") == 0) {
+      reply(c, 0, "Commands: UPDATE LAST FLUSH FLUSHALL PENDING FORGET STATS BATCH PING QUIT");
+   }
+   else if(strcasecmp(cmd, "QUIT") == 0) {
+      return -1;
+   }
+   else reply(c, -1, "Unknown command");
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * client_close() ends a client connection                      *
+ * ------------------------------------------------------------ */
+void client_close(client_t *c) {
+   close(c->fd);
+   free(c->berrs);
+   memset(c, 0, sizeof(client_t));
+   c->fd = -1;
+}
+
+/* ------------------------------------------------------------ *
+ * client_read() reads client data and runs each complete line  *
+ * ------------------------------------------------------------ */
+void client_read(client_t *c) {
+   ssize_t n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len - 1);
+   if(n <= 0) { client_close(c); return; }
+   c->len += n;
+   c->buf[c->len] = '\0';
+
+   char *start = c->buf, *nl;
+   while((nl = strchr(start, '\n')) != NULL) {
+      *nl = '\0';
+      if(nl > start && *(nl-1) == '\r') *(nl-1) = '\0';
+      if(handle_line(c, start) != 0) { client_close(c); return; }
+      start = nl + 1;
+   }
+   c->len -= (start - c->buf);
+   memmove(c->buf, start, c->len);
+
+   /* a line longer than our buffer is not a valid request */
+   if(c->len >= (int) sizeof(c->buf) - 1) client_close(c);
+}
+
+/* ------------------------------------------------------------ *
+ * sig_stop() ends the daemon loop on SIGTERM and SIGINT        *
+ * ------------------------------------------------------------ */
+void sig_stop(int sig) {
+   stop = 1;
+}
+
+int main(int argc, char *argv[]) {
+   struct sockaddr_un addr;
+   struct pollfd pfd[MAXCLIENT+1];
+   int i;
+
+   parseargs(argc, argv);
+
+   /* ------------------------------------------------------------ *
+    * Open the journal, and replay what a crash may have left      *
+    * ------------------------------------------------------------ */
+   jfd = open(journal, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+   if(jfd == -1) {
+      printf("Error: cannot open journal %s: %s\n", journal, strerror(errno));
+      exit(-1);
+   }
+   journal_replay();
+
+   /* ------------------------------------------------------------ *
+    * Create the unix socket, only owner and group can connect     *
+    * ------------------------------------------------------------ */
+   int sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if(sfd == -1) {
+      printf("Error: cannot create socket: %s\n", strerror(errno));
+      exit(-1);
+   }
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   memcpy(addr.sun_path, sockfile, sizeof(addr.sun_path));
+   unlink(sockfile);
+   mode_t oldmask = umask(0117);
+   if(bind(sfd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(sfd, 16) != 0) {
+      printf("Error: cannot listen on %s: %s\n", sockfile, strerror(errno));
+      exit(-1);
+   }
+   umask(oldmask);
+   if(strlen(sockgroup) > 0) {
+      struct group *grp = getgrnam(sockgroup);
+      if(grp == NULL || chown(sockfile, -1, grp->gr_gid) != 0) {
+         printf("Error: cannot set socket group %s\n", sockgroup);
+         exit(-1);
+      }
+   }
+
+   struct sigaction sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = sig_stop;
+   sigaction(SIGTERM, &sa, NULL);
+   sigaction(SIGINT, &sa, NULL);
+   signal(SIGPIPE, SIG_IGN);
+
+   for(i=0; i<MAXCLIENT; i++) clients[i].fd = -1;
+   printf("rrdcombd: listening on [%s], journal [%s], flush after %ds\n", sockfile, journal, flushwait);
+   fflush(stdout);
+
+   /* ------------------------------------------------------------ *
+    * The main loop: serve the clients, and check once per second  *
+    * for files that are due to be written.                        *
+    * ------------------------------------------------------------ */
+   while(stop == 0) {
+      int n = 0;
+      pfd[n].fd = sfd; pfd[n].events = POLLIN; n++;
+      for(i=0; i<MAXCLIENT; i++) {
+         if(clients[i].fd == -1) continue;
+         pfd[n].fd = clients[i].fd; pfd[n].events = POLLIN; n++;
+      }
+
+      int ret = poll(pfd, n, 1000);
+      if(ret == -1 && errno != EINTR) {
+         printf("Error: poll failed: %s\n", strerror(errno));
+         break;
+      }
+
+      if(ret > 0) {
+         for(i=1; i<n; i++) {
+            if(! (pfd[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            int j;
+            for(j=0; j<MAXCLIENT; j++)
+               if(clients[j].fd == pfd[i].fd) { client_read(&clients[j]); break; }
+         }
+         if(pfd[0].revents & POLLIN) {
+            int cfd = accept(sfd, NULL, NULL);
+            if(cfd != -1) {
+               fcntl(cfd, F_SETFD, FD_CLOEXEC);
+               for(i=0; i<MAXCLIENT && clients[i].fd != -1; i++);
+               if(i == MAXCLIENT) close(cfd);
+               else clients[i].fd = cfd;
+            }
+         }
+      }
+      flush_due(time(NULL));
+      fflush(stdout);
+   }
+
+   /* ------------------------------------------------------------ *
+    * On stop, write everything so the journal can stay empty      *
+    * ------------------------------------------------------------ */
+   printf("rrdcombd: stopping, flushing %d files\n", qcount);
+   flush_all();
+   for(i=0; i<MAXCLIENT; i++) if(clients[i].fd != -1) client_close(&clients[i]);
+   close(sfd);
+   unlink(sockfile);
+   close(jfd);
+   exit(0);
+}
@@ -0,0 +1,69 @@
+/* ------------------------------------------------------------ *
+ * file:        rrddelta.h                                      *
+ * purpose:     Binary RRD delta file, written by rrddelta on   *
+ *              the station and applied by rrdmerge on the web  *
+ *              server. It holds the RRA rows that changed      *
+ *              after a given time, for each RRA of the RRD:    *
+ *                                                              *
+ *              header  "RRDDELTA", version, ds/rra count, step *
+ *                      since and last update time (40 byte)    *
+ *              dsname  ds_cnt names of 20 byte each            *
+ *              rra     block header: CF, pdp_cnt, row count,   *
+ *                      time of the first row (40 byte),        *
+ *                      followed by row_cnt * ds_cnt doubles,   *
+ *                      oldest row first, one row per RRA step  *
+ *              ...                                             *
+ *              trailer "RDLEND", CRC32 of all bytes before     *
+ *                                                              *
+ *              A day of minute data is about 50KB, instead of  *
+ *              the full XML dump. All values are stored in     *
+ *              little endian byte order (Raspberry Pi).        *
+ *              Keep in sync with the copy in weather-station.  *
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ * ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stddef.h>
+
+#define RDL_MAGIC     "RRDDELTA"
+#define RDL_ENDMAGIC  "RDLEND"
+#define RDL_VERSION   1
+#define RDL_NAMSIZE   20            // same as DS_NAM_SIZE, CF_NAM_SIZE
+
+typedef struct {
+  char magic[8];                    // RDL_MAGIC
+  uint32_t version;                 // RDL_VERSION
+  uint32_t ds_cnt;                  // number of data sources
+  uint32_t rra_cnt;                 // number of rra blocks
+  uint32_t pdp_step;                // RRD base step in seconds
+  int64_t since;                    // rows after this time are included
+  int64_t last_up;                  // RRD last update time at export
+} rdl_header_t;
+
+typedef struct {
+  char cf_nam[RDL_NAMSIZE];         // consolidation function, e.g. AVERAGE
+  uint32_t pdp_cnt;                 // primary data points per row
+  uint32_t row_cnt;                 // number of rows in this block
+  uint32_t reserved;
+  int64_t first;                    // time of the first (oldest) row
+} rdl_rra_t;
+
+typedef struct {
+  char magic[8];                    // RDL_ENDMAGIC
+  uint32_t crc;                     // CRC32 of the file before trailer
+  uint32_t reserved;
+} rdl_trailer_t;
+
+/* ------------------------------------------------------------ *
+ * rdl_crc32() updates a CRC32 (IEEE 802.3) over len bytes      *
+ * ------------------------------------------------------------ */
+static inline uint32_t rdl_crc32(uint32_t crc, const void *data, size_t len) {
+  const unsigned char *p = data;
+  int k;
+  crc = ~crc;
+  while(len--) {
+    crc ^= *p++;
+    for(k=0; k<8; k++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
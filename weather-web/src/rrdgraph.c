@@ -0,0 +1,489 @@
+/* ------------------------------------------------------------ *
+ * file:        rrdgraph.c                                      *
+ * purpose:     CGI program that renders a stations RRD graph   *
+ *              on request, instead of pre-rendering all graphs *
+ *              every minute in rrdupdate.sh. The PNG is cached *
+ *              in <pi-web-data>/cache/<station>, keyed by the  *
+ *              graph name and the RRD last update time, and is *
+ *              served from cache until new data arrives. The   *
+ *              graphs ending at midnight are keyed by midnight *
+ *              since later data is not part of their window.   *
+ *                                                              *
+ * request:     /cgi-bin/rrdgraph?station=pi-ws01&graph=X where *
+ *              X is e.g. daily_temp, monthly_humi, twyear_bmpr *
+ *                                                              *
+ * return:      image/png, or 304 Not Modified if the browser   *
+ *              has this version already (ETag = the cache key) *
+ *                                                              *
+ * install:     The web server maps /cgi-bin/rrdgraph to the    *
+ *              program in <pi-web-data>/bin, it runs as the    *
+ *              web user, which needs write access to cache/.   *
+ *              install/setup.sh step 18 writes the lighttpd or *
+ *              apache config for it, see the top readme.md.    *
+ *                                                              *
+ * RRD API:     http://oss.oetiker.ch/rrdtool/doc/librrd.en.html*
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ *                                                              *
+ * compile: gcc rrdgraph.c -o rrdgraph -lrrd                    *
+ * ------------------------------------------------------------ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <rrd.h>
+#include <rrd_client.h>
+
+/* ------------------------------------------------------------ *
+ * Max number of config file entries, and their key/value size  *
+ * ------------------------------------------------------------ */
+#define MAXCONF    64
+#define MAXCLEN    256
+/* ------------------------------------------------------------ *
+ * Max number of arguments we hand to rrd_graph_v()             *
+ * ------------------------------------------------------------ */
+#define MAXGARGS   64
+/* ------------------------------------------------------------ *
+ * Browser cache time in seconds for the graph response         *
+ * ------------------------------------------------------------ */
+#define MAXAGE     60
+
+/* ------------------------------------------------------------ *
+ * Global variables and defaults                                *
+ * ------------------------------------------------------------ */
+char conf_key[MAXCONF][MAXCLEN];      // the config file keys
+char conf_val[MAXCONF][MAXCLEN];      // the config file values
+int conf_cnt = 0;                     // the number of config entries
+char station[32];                     // the station name, e.g. pi-ws01
+char gname[32];                       // the graph name, e.g. daily_temp
+char rrdfile[MAXCLEN*3];              // the stations RRD file and path
+char cachedir[MAXCLEN*3];             // the stations graph cache dir
+
+/* ------------------------------------------------------------ *
+ * RRDtool default parameters for graph image creation          *
+ * --slope-mode -> smoothens the default stair case curves      *
+ * --units-exponent=0 -->No y-axis value scaling (Kilo/Mega)    *
+ * this is only important for hPa not showing as 1.014k         *
+ * ------------------------------------------------------------ */
+const char *graph_params[] = {
+   "--imgformat", "PNG", "--no-gridfit", "--slope-mode",
+   "--width=1119", "--height=147",
+   "--font", "AXIS:12:", "--font", "TITLE:15:",
+   "--font", "LEGEND:14:", "--font", "WATERMARK:10:",
+   "--units-exponent=0", "--border=1",
+   "--color", "SHADEA#000000", "--color", "SHADEB#000000", NULL
+};
+
+/* ------------------------------------------------------------ *
+ * The graph list. DEF: args get the RRD file set in for %s.    *
+ * ------------------------------------------------------------ */
+typedef struct {
+   const char *name;       // the graph name in the request
+   int tomidnight;         // 1 = graph ends at 00:00, 0 = at now
+   const char *args[32];   // the graph specific args
+} graph_t;
+
+graph_t graphs[] = {
+   { "daily_temp", 0, {
+     "--start", "-16h", "--title=Temperature", "--step=60s",
+     "DEF:temp1=%s:temp:AVERAGE", "DEF:dayt1=%s:dayt:AVERAGE",
+     "CDEF:dayt2=dayt1,0,GT,INF,UNKN,IF", "AREA:dayt2#cfcfcf",
+     "CDEF:tneg1=dayt1,0,GT,NEGINF,UNKN,IF", "AREA:tneg1#cfcfcf",
+     "CDEF:tminus=temp1,0,LE,temp1,UNKN,IF",
+     "CDEF:tnull=temp1,0,EQ,temp1,UNKN,IF",
+     "CDEF:tplus=temp1,0,GE,temp1,UNKN,IF",
+     "AREA:tminus#004477:", "AREA:tnull#004477:",
+     "AREA:tplus#99001F:Temperature in °C",
+     "GPRINT:temp1:MIN:Min\\: %3.2lf", "GPRINT:temp1:MAX:Max\\: %3.2lf",
+     "GPRINT:temp1:LAST:Last\\: %3.2lf", NULL } },
+   { "daily_humi", 0, {
+     "--start", "-16h", "--title=Relative Humidity", "--step=60s",
+     "--upper-limit=100", "--lower-limit=0",
+     "DEF:humi1=%s:humi:AVERAGE", "DEF:dayt1=%s:dayt:AVERAGE",
+     "CDEF:dayt2=dayt1,0,GT,INF,UNKN,IF", "AREA:dayt2#cfcfcf",
+     "AREA:humi1#004477:Humidity in percent",
+     "GPRINT:humi1:MIN:Min\\: %3.2lf", "GPRINT:humi1:MAX:Max\\: %3.2lf",
+     "GPRINT:humi1:LAST:Last\\: %3.2lf", NULL } },
+   { "daily_bmpr", 0, {
+     "--start", "-16h", "--title=Barometric Pressure", "--step=60s",
+     "--alt-autoscale", "--alt-y-grid",
+     "DEF:bmpr1=%s:bmpr:AVERAGE", "DEF:dayt1=%s:dayt:AVERAGE",
+     "CDEF:bmpr2=bmpr1,100,/",
+     "CDEF:dayt2=dayt1,0,GT,INF,UNKN,IF", "AREA:dayt2#cfcfcf",
+     "AREA:bmpr2#007744:Barometric Pressure in hPa",
+     "GPRINT:bmpr2:MIN:Min\\: %3.2lf", "GPRINT:bmpr2:MAX:Max\\: %3.2lf",
+     "GPRINT:bmpr2:LAST:Last\\: %3.2lf", NULL } },
+   { "monthly_temp", 1, {
+     "--start", "end-21d", "--end", "00:00",
+     "--title=Temperature, 3 Weeks",
+     "--x-grid", "HOUR:8:DAY:1:DAY:1:86400:%d",
+     "DEF:temp1=%s:temp:AVERAGE",
+     "CDEF:tplus=temp1,0,GE,temp1,UNKN,IF",
+     "CDEF:tminus=temp1,0,LE,temp1,UNKN,IF",
+     "AREA:tplus#99001F:Temperature in °C", "AREA:tminus#004477:",
+     "GPRINT:temp1:MIN:Min\\: %3.2lf", "GPRINT:temp1:MAX:Max\\: %3.2lf",
+     "GPRINT:temp1:LAST:Last\\: %3.2lf", NULL } },
+   { "monthly_humi", 1, {
+     "--start", "end-21d", "--end", "00:00",
+     "--title=Relative Humidity, 3 Weeks",
+     "--x-grid", "HOUR:8:DAY:1:DAY:1:86400:%d",
+     "--upper-limit=100", "--lower-limit=0",
+     "DEF:humi1=%s:humi:AVERAGE",
+     "AREA:humi1#004477:Humidity in percent",
+     "GPRINT:humi1:MIN:Min\\: %3.2lf", "GPRINT:humi1:MAX:Max\\: %3.2lf",
+     "GPRINT:humi1:LAST:Last\\: %3.2lf", NULL } },
+   { "monthly_bmpr", 1, {
+     "--start", "end-21d", "--end", "00:00",
+     "--title=Barometric Pressure, 3 Weeks",
+     "--x-grid", "HOUR:8:DAY:1:DAY:1:86400:%d",
+     "--alt-autoscale", "--alt-y-grid",
+     "DEF:bmpr1=%s:bmpr:AVERAGE", "CDEF:bmpr2=bmpr1,100,/",
+     "AREA:bmpr2#007744:Barometric Pressure in hPa",
+     "GPRINT:bmpr2:MIN:Min\\: %3.2lf", "GPRINT:bmpr2:MAX:Max\\: %3.2lf",
+     "GPRINT:bmpr2:LAST:Last\\: %3.2lf", NULL } },
+   { "yearly_temp", 1, {
+     "--start", "end-18mon", "--end", "00:00",
+     "--x-grid", "MONTH:1:YEAR:1:MONTH:1:2592000:%b",
+     "--title=Temperature, Yearly View",
+     "DEF:temp1=%s:temp:AVERAGE",
+     "CDEF:tminus=temp1,0,LE,temp1,UNKN,IF",
+     "CDEF:tplus=temp1,0,GE,temp1,UNKN,IF",
+     "AREA:tminus#004477:", "AREA:tplus#99001F:Temperature in °C",
+     "GPRINT:temp1:MIN:Min\\: %3.2lf", "GPRINT:temp1:MAX:Max\\: %3.2lf",
+     "GPRINT:temp1:LAST:Last\\: %3.2lf", NULL } },
+   { "yearly_humi", 1, {
+     "--start", "end-18mon", "--end", "00:00",
+     "--x-grid", "MONTH:1:YEAR:1:MONTH:1:2592000:%b",
+     "--title=Relative Humidity, Yearly View",
+     "--upper-limit=100", "--lower-limit=0",
+     "DEF:humi1=%s:humi:AVERAGE",
+     "AREA:humi1#004477:Humidity in percent",
+     "GPRINT:humi1:MIN:Min\\: %3.2lf", "GPRINT:humi1:MAX:Max\\: %3.2lf",
+     "GPRINT:humi1:LAST:Last\\: %3.2lf", NULL } },
+   { "yearly_bmpr", 1, {
+     "--start", "end-18mon", "--end", "00:00",
+     "--x-grid", "MONTH:1:YEAR:1:MONTH:1:2592000:%b",
+     "--title=Barometric Pressure, Yearly View",
+     "--alt-autoscale", "--alt-y-grid",
+     "DEF:bmpr1=%s:bmpr:AVERAGE", "CDEF:bmpr2=bmpr1,100,/",
+     "AREA:bmpr2#007744:Barometric Pressure in hPa",
+     "GPRINT:bmpr2:MIN:Min\\: %3.2lf", "GPRINT:bmpr2:MAX:Max\\: %3.2lf",
+     "GPRINT:bmpr2:LAST:Last\\: %3.2lf", NULL } },
+   { "twyear_temp", 1, {
+     "--start", "end-18years", "--end", "00:00",
+     "--x-grid", "YEAR:1:YEAR:10:YEAR:1:31536000:%Y",
+     "--title=Temperature, 18-Year View",
+     "DEF:temp1=%s:temp:AVERAGE",
+     "CDEF:tminus=temp1,0,LE,temp1,UNKN,IF",
+     "CDEF:tplus=temp1,0,GE,temp1,UNKN,IF",
+     "AREA:tminus#004477:", "AREA:tplus#99001F:Temperature in °C",
+     "GPRINT:temp1:MIN:Min\\: %3.2lf", "GPRINT:temp1:MAX:Max\\: %3.2lf",
+     "GPRINT:temp1:LAST:Last\\: %3.2lf", NULL } },
+   { "twyear_humi", 1, {
+     "--start", "end-18years", "--end", "00:00",
+     "--x-grid", "YEAR:1:YEAR:10:YEAR:1:31536000:%Y",
+     "--title=Humidity, 18-Year View",
+     "--upper-limit=100", "--lower-limit=0",
+     "DEF:humi1=%s:humi:AVERAGE",
+     "AREA:humi1#004477:Humidity in percent",
+     "GPRINT:humi1:MIN:Min\\: %3.2lf", "GPRINT:humi1:MAX:Max\\: %3.2lf",
+     "GPRINT:humi1:LAST:Last\\: %3.2lf", NULL } },
+   { "twyear_bmpr", 1, {
+     "--start", "end-18years", "--end", "00:00",
+     "--x-grid", "YEAR:1:YEAR:10:YEAR:1:31536000:%Y",
+     "--title=Barometric Pressure, 18-Year View",
+     "--alt-autoscale", "--alt-y-grid",
+     "DEF:bmpr1=%s:bmpr:AVERAGE", "CDEF:bmpr2=bmpr1,100,/",
+     "AREA:bmpr2#007744:Barometric Pressure in hPa",
+     "GPRINT:bmpr2:MIN:Min\\: %3.2lf", "GPRINT:bmpr2:MAX:Max\\: %3.2lf",
+     "GPRINT:bmpr2:LAST:Last\\: %3.2lf", NULL } },
+   { NULL, 0, { NULL } }
+};
+
+/* ------------------------------------------------------------ *
+ * http_error() sends a CGI status with a text message and ends *
+ * ------------------------------------------------------------ */
+void http_error(const char *status, const char *msg) {
+   printf("Status: %s\r\nContent-Type: text/plain\r\n\r\n", status);
+   printf("Error: %s\n", msg);
+   exit(-1);
+}
+
+/* ------------------------------------------------------------ *
+ * readconfig() loads the key=value lines of a config file.     *
+ * Lines starting with # are comments, quotes are stripped.     *
+ * ------------------------------------------------------------ */
+int readconfig(const char *file) {
+   FILE *fp;
+   char line[MAXCLEN];
+
+   if(! (fp=fopen(file, "r"))) return -1;
+
+   while(fgets(line, sizeof(line), fp) != NULL && conf_cnt < MAXCONF) {
+      if(line[0] == '#') continue;
+      char *val = strchr(line, '=');
+      if(val == NULL || val == line) continue;
+      *val++ = '\0';
+      val[strcspn(val, "\r\n")] = '\0';
+      size_t vlen = strlen(val);
+      if(vlen >= 2 && val[0] == '"' && val[vlen-1] == '"') {
+         val[vlen-1] = '\0';
+         val++;
+      }
+      if(strlen(val) == 0) continue;
+      snprintf(conf_key[conf_cnt], MAXCLEN, "%s", line);
+      snprintf(conf_val[conf_cnt], MAXCLEN, "%s", val);
+      conf_cnt++;
+   }
+   fclose(fp);
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * getconfig() returns the value for key, or NULL if not found  *
+ * ------------------------------------------------------------ */
+const char *getconfig(const char *key) {
+   int i;
+   for(i=0; i<conf_cnt; i++)
+      if(strcmp(conf_key[i], key) == 0) return conf_val[i];
+   return NULL;
+}
+
+/* ------------------------------------------------------------ *
+ * parsequery() gets station and graph from QUERY_STRING. Both  *
+ * are checked against a strict format, there is no URL decode. *
+ * ------------------------------------------------------------ */
+graph_t *parsequery() {
+   char query[MAXCLEN];
+   char *tok, *save = NULL;
+   int i;
+
+   const char *qs = getenv("QUERY_STRING");
+   if(qs == NULL) http_error("400 Bad Request", "missing query string");
+   snprintf(query, sizeof(query), "%s", qs);
+
+   for(tok = strtok_r(query, "&", &save); tok; tok = strtok_r(NULL, "&", &save)) {
+      if(strncmp(tok, "station=", 8) == 0) snprintf(station, sizeof(station), "%s", tok+8);
+      if(strncmp(tok, "graph=", 6) == 0) snprintf(gname, sizeof(gname), "%s", tok+6);
+   }
+
+   /* station format is pi-wsXX, same check as in rrdupdate.sh */
+   if(strlen(station) != 7 || strncmp(station, "pi-ws", 5) != 0
+      || ! isdigit((unsigned char) station[5]) || ! isdigit((unsigned char) station[6]))
+      http_error("400 Bad Request", "wrong station format, expecting pi-wsXX");
+
+   for(i=0; graphs[i].name != NULL; i++)
+      if(strcmp(graphs[i].name, gname) == 0) return &graphs[i];
+
+   http_error("404 Not Found", "unknown graph name");
+   return NULL;
+}
+
+/* ------------------------------------------------------------ *
+ * send_png() writes the CGI header and the PNG data to stdout  *
+ * ------------------------------------------------------------ */
+void send_png(const unsigned char *data, size_t size, const char *etag) {
+   printf("Content-Type: image/png\r\n");
+   printf("Content-Length: %zu\r\n", size);
+   printf("Cache-Control: max-age=%d\r\n", MAXAGE);
+   printf("ETag: \"%s\"\r\n\r\n", etag);
+   fflush(stdout);
+   fwrite(data, 1, size, stdout);
+}
+
+/* ------------------------------------------------------------ *
+ * send_cached() sends the cache file if it exists, returns 0   *
+ * on success and -1 if the file is not there (a cache miss).   *
+ * ------------------------------------------------------------ */
+int send_cached(const char *file, const char *etag) {
+   FILE *fp;
+   struct stat st;
+
+   if(! (fp=fopen(file, "r"))) return -1;
+   if(fstat(fileno(fp), &st) != 0 || st.st_size == 0) { fclose(fp); return -1; }
+
+   unsigned char *data = malloc(st.st_size);
+   if(data == NULL || fread(data, 1, st.st_size, fp) != (size_t) st.st_size) {
+      free(data); fclose(fp); return -1;
+   }
+   fclose(fp);
+   send_png(data, st.st_size, etag);
+   free(data);
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * cache_store() writes the PNG into the cache through a temp   *
+ * file and rename, then removes older versions of this graph.  *
+ * Failures go to stderr, the web server error log, the graph   *
+ * is still sent, just rendered again on the next request.      *
+ * ------------------------------------------------------------ */
+void cache_store(const char *file, const unsigned char *data, size_t size) {
+   char tmpfile[MAXCLEN*6];
+   FILE *fp;
+
+   snprintf(tmpfile, sizeof(tmpfile), "%s.%d", file, (int) getpid());
+   if(! (fp=fopen(tmpfile, "w"))) {
+      fprintf(stderr, "rrdgraph: cannot create %s: %s\n", tmpfile, strerror(errno));
+      return;
+   }
+   size_t len = fwrite(data, 1, size, fp);
+   if(fclose(fp) != 0 || len != size) {
+      fprintf(stderr, "rrdgraph: cannot write %s: %s\n", tmpfile, strerror(errno));
+      unlink(tmpfile);
+      return;
+   }
+   if(rename(tmpfile, file) != 0) {
+      fprintf(stderr, "rrdgraph: cannot rename %s: %s\n", tmpfile, strerror(errno));
+      unlink(tmpfile);
+      return;
+   }
+
+   DIR *dir = opendir(cachedir);
+   if(dir == NULL) return;
+   struct dirent *ent;
+   char prefix[34];
+   char old[MAXCLEN*6];
+   snprintf(prefix, sizeof(prefix), "%s-", gname);
+   while((ent = readdir(dir)) != NULL) {
+      if(strncmp(ent->d_name, prefix, strlen(prefix)) != 0) continue;
+      snprintf(old, sizeof(old), "%s/%s", cachedir, ent->d_name);
+      if(strcmp(old, file) != 0) unlink(old);
+   }
+   closedir(dir);
+}
+
+/* ------------------------------------------------------------ *
+ * render() creates the graph in memory through rrd_graph_v(),  *
+ * with "-" as file name librrd returns the PNG as image blob.  *
+ * ------------------------------------------------------------ */
+rrd_info_t *render(graph_t *g, unsigned char **data, size_t *size) {
+   char *argv[MAXGARGS];
+   char defs[4][MAXCLEN*4];
+   int argc = 0, ndef = 0, i;
+
+   argv[argc++] = "graph";
+   argv[argc++] = "-";
+   for(i=0; graph_params[i] != NULL; i++) argv[argc++] = (char *) graph_params[i];
+   for(i=0; g->args[i] != NULL && argc < MAXGARGS-1; i++) {
+      if(strncmp(g->args[i], "DEF:", 4) == 0 && ndef < 4) {
+         snprintf(defs[ndef], sizeof(defs[ndef]), g->args[i], rrdfile);
+         argv[argc++] = defs[ndef++];
+      }
+      else argv[argc++] = (char *) g->args[i];
+   }
+   argv[argc] = NULL;
+
+   rrd_info_t *info = rrd_graph_v(argc, argv);
+   if(info == NULL) return NULL;
+
+   rrd_info_t *walk;
+   for(walk = info; walk != NULL; walk = walk->next) {
+      if(strcmp(walk->key, "image") == 0 && walk->type == RD_I_BLO) {
+         *data = walk->value.u_blo.ptr;
+         *size = walk->value.u_blo.size;
+         return info;
+      }
+   }
+   rrd_info_free(info);
+   return NULL;
+}
+
+int main(int argc, char *argv[]) {
+   char exe[MAXCLEN], file[MAXCLEN*4], etag[MAXCLEN];
+   const char *datadir, *tzs, *daemon;
+   struct stat st;
+
+   /* ------------------------------------------------------------ *
+    * Check the request, and read the global and station config.   *
+    * The global config is ../etc/pi-web.conf from our bin folder. *
+    * ------------------------------------------------------------ */
+   graph_t *g = parsequery();
+
+   ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe)-1);
+   if(len < 1) http_error("500 Internal Server Error", "cannot get program path");
+   exe[len] = '\0';
+   snprintf(file, sizeof(file), "%s/../etc/pi-web.conf", dirname(exe));
+   if(readconfig(file) != 0 || (datadir = getconfig("pi-web-data")) == NULL)
+      http_error("500 Internal Server Error", "cannot read pi-web.conf");
+
+   /* ------------------------------------------------------------ *
+    * If the updates go through rrdcombd, librrd talks to it, and  *
+    * rrd_graph_v() flushes the RRD file through it before reading *
+    * ------------------------------------------------------------ */
+   if((daemon = getconfig("pi-web-rrdcd")) != NULL)
+      setenv("RRDCACHED_ADDRESS", daemon, 1);
+
+   snprintf(rrdfile, sizeof(rrdfile), "%s/chroot/%s/rrd/%s.rrd", datadir, station, station);
+   snprintf(cachedir, sizeof(cachedir), "%s/cache/%s", datadir, station);
+   snprintf(file, sizeof(file), "%s/chroot/%s/etc/%s.conf", datadir, station, station);
+   if(stat(rrdfile, &st) != 0 || readconfig(file) != 0)
+      http_error("404 Not Found", "unknown station");
+
+   /* ------------------------------------------------------------ *
+    * Set the station timezone, same as rrdupdate.sh, so 00:00 is  *
+    * the stations local midnight.                                 *
+    * ------------------------------------------------------------ */
+   if((tzs = getconfig("pi-weather-tzs")) != NULL) {
+      setenv("TZ", tzs, 1);
+      tzset();
+   }
+
+   /* ------------------------------------------------------------ *
+    * Build the cache key: the RRD last update, or midnight for    *
+    * graphs that end at 00:00 and don't change until tomorrow.    *
+    * With rrdcombd, LAST includes the pending values, and answers *
+    * without a write. Only a cache miss flushes, in rrd_graph_v().*
+    * ------------------------------------------------------------ */
+   time_t key;
+   if(daemon != NULL) {
+      if(rrdc_connect(daemon) != 0)
+         http_error("500 Internal Server Error", "cannot connect to rrdcombd");
+      key = rrdc_last(rrdfile);
+   }
+   else key = rrd_last_r(rrdfile);
+   if(key <= 0) http_error("500 Internal Server Error", "cannot get RRD last update");
+   if(g->tomidnight) {
+      struct tm lt;
+      time_t now = time(NULL);
+      localtime_r(&now, &lt);
+      lt.tm_hour = 0; lt.tm_min = 0; lt.tm_sec = 0; lt.tm_isdst = -1;
+      key = mktime(&lt);
+   }
+   snprintf(etag, sizeof(etag), "%s-%s-%lld", station, gname, (long long) key);
+   snprintf(file, sizeof(file), "%s/%s-%lld.png", cachedir, gname, (long long) key);
+
+   /* ------------------------------------------------------------ *
+    * The browser already has this version: 304 Not Modified       *
+    * ------------------------------------------------------------ */
+   const char *inm = getenv("HTTP_IF_NONE_MATCH");
+   if(inm != NULL && strstr(inm, etag) != NULL) {
+      printf("Status: 304 Not Modified\r\nETag: \"%s\"\r\n\r\n", etag);
+      exit(0);
+   }
+
+   /* ------------------------------------------------------------ *
+    * Serve from cache, or render the graph and store it           *
+    * ------------------------------------------------------------ */
+   if(send_cached(file, etag) == 0) exit(0);
+
+   unsigned char *data;
+   size_t size;
+   rrd_info_t *info = render(g, &data, &size);
+   if(info == NULL) {
+      rrd_clear_error();
+      http_error("500 Internal Server Error", "cannot render graph");
+   }
+   if(stat(cachedir, &st) != 0 && mkdir(cachedir, 0755) != 0)
+      fprintf(stderr, "rrdgraph: cannot create %s: %s\n", cachedir, strerror(errno));
+   cache_store(file, data, size);
+   send_png(data, size, etag);
+   rrd_info_free(info);
+   exit(0);
+}
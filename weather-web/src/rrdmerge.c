@@ -0,0 +1,476 @@
+/* ------------------------------------------------------------ *
+ * file:        rrdmerge.c                                      *
+ * purpose:     Merge a station RRD delta file (from rrddelta)  *
+ *              or a second RRD file into the stations RRD on   *
+ *              the web server, in place. It replaces the full  *
+ *              "rrdtool restore" of the stations XML dump.     *
+ *                                                              *
+ *              The target RRD is memory-mapped, and each delta *
+ *              row is written to the RRA row with the same CF, *
+ *              resolution and time. Rows outside of the target *
+ *              RRA window, and unknown (NaN) delta values are  *
+ *              skipped, values that are equal are not written, *
+ *              so only the pages of changed rows get dirty.    *
+ *              The RRD header (last update, row pointers) is   *
+ *              not changed, data newer than the delta stays.   *
+ *                                                              *
+ *              With -g (gap-fill), only unknown target values  *
+ *              are filled, the data the server got itself is   *
+ *              kept. A source RRD (-r) is then only read for   *
+ *              the target rows that have a gap.                *
+ *                                                              *
+ * return:      Returns 0 on success, and -1 on errors.         *
+ *                                                              *
+ * RRD API:     http://oss.oetiker.ch/rrdtool/doc/librrd.en.html*
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ *                                                              *
+ * compile: gcc rrdmerge.c -o rrdmerge -lrrd                    *
+ * ------------------------------------------------------------ */
+#define HAVE_STDINT_H
+#define RRD_EXPORT_DEPRECATED  // required to include rrd_format.h
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <rrd.h>
+#include <rrd_client.h>
+#include <rrd_format.h>        // required to get rrd_t object
+#include "rrddelta.h"
+
+/* ------------------------------------------------------------ *
+ * Global variables and defaults                                *
+ * ------------------------------------------------------------ */
+#define RRD_READONLY    (1<<0)
+int verbose = 0;
+char rrdfile[256];                // the target rrd file name and path
+char deltafile[256];              // the delta file from rrddelta
+char srcfile[256];                // or the source rrd file to merge
+int gapfill = 0;                  // 1 = only fill unknown target values
+long written = 0;                 // values written into the target
+long equal = 0;                   // values that were already the same
+long kept = 0;                    // known target values, not changed
+long skipped = 0;                 // rows outside the target RRA window
+extern char *optarg;
+extern int optind, opterr, optopt;
+
+rrd_file_t *rrd_open(const char *const file_name, rrd_t *rrd, unsigned rdwr);
+void rrd_init(rrd_t *rrd);
+void rrd_free(rrd_t *rrd);
+int rrd_close(rrd_file_t *rrd_file);
+
+/* ------------------------------------------------------------ *
+ * A memory-mapped RRD file, with the offset of each RRA        *
+ * ------------------------------------------------------------ */
+typedef struct {
+   int fd;                        // the open RRD file
+   unsigned char *map;            // the mmap'ed RRD file
+   size_t mapsize;                // the mmap'ed length
+   rrd_t rrd;                     // the RRD header from rrd_open()
+   rrd_file_t *rrdf;              // the librrd file handle
+   size_t *rra_off;               // the file offset of each RRA
+} rrdmap_t;
+
+/* ------------------------------------------------------------ *
+ * print_usage() prints the programs commandline instructions.  *
+ * ------------------------------------------------------------ */
+void usage() {
+   static char const usage[] = "Usage: rrdmerge -s [rrd-file] -d [delta-file] | -r [rrd-file] [-g] [-v]\n\
+   Command line parameters have the following format:\n\
+   -s   target RRD file and path, Example: -s /srv/app/pi-web01/chroot/pi-ws01/rrd/pi-ws01.rrd\n\
+   -d   delta file from rrddelta, Example: -d /srv/app/pi-web01/chroot/pi-ws01/var/rrdcopy.delta\n\
+   -r   or a source RRD file, Example: -r /srv/app/pi-web01/chroot/pi-ws01/var/rrdcopy.rrd\n\
+   -g   optional, gap-fill: only fill unknown values in the target RRD\n\
+   -h   optional, display this message\n\
+   -v   optional, enables debug output\n\
+   Usage examples:\n\
+./rrdmerge -s /srv/app/pi-web01/chroot/pi-ws01/rrd/pi-ws01.rrd -d /srv/app/pi-web01/chroot/pi-ws01/var/rrdcopy.delta\n\
+./rrdmerge -g -s /srv/app/pi-web01/chroot/pi-ws01/rrd/pi-ws01.rrd -r /srv/app/pi-web01/chroot/pi-ws01/var/rrdcopy.rrd\n";
+   printf(usage);
+}
+
+/* ------------------------------------------------------------ *
+ * parseargs() checks the commandline arguments with C getopt   *
+ * ------------------------------------------------------------ */
+void parseargs(int argc, char* argv[]) {
+   int arg;
+   opterr = 0;
+
+   if(argc == 1) {
+      usage();
+      exit(-1);
+   }
+
+   while ((arg = (int) getopt (argc, argv, "s:d:r:gvh")) != -1)
+      switch (arg) {
+         // arg -s + target RRD file, type: string
+         // mandatory, example: /srv/app/pi-web01/chroot/pi-ws01/rrd/pi-ws01.rrd
+         case 's':
+            if(verbose == 1) printf("Debug: arg -s, value %s\n", optarg);
+            snprintf(rrdfile, sizeof(rrdfile), "%s", optarg);
+            break;
+
+         // arg -d + delta file, type: string
+         // mandatory, example: /srv/app/pi-web01/chroot/pi-ws01/var/rrdcopy.delta
+         case 'd':
+            if(verbose == 1) printf("Debug: arg -d, value %s\n", optarg);
+            snprintf(deltafile, sizeof(deltafile), "%s", optarg);
+            break;
+
+         // arg -r + source RRD file, type: string
+         // optional instead of -d, example: /srv/app/pi-web01/chroot/pi-ws01/var/rrdcopy.rrd
+         case 'r':
+            if(verbose == 1) printf("Debug: arg -r, value %s\n", optarg);
+            snprintf(srcfile, sizeof(srcfile), "%s", optarg);
+            break;
+
+         // arg -g gap-fill, type: flag, optional
+         case 'g':
+            gapfill = 1; break;
+
+         // arg -v verbose, type: flag, optional
+         case 'v':
+            verbose = 1; break;
+
+         // arg -h usage, type: flag, optional
+         case 'h':
+            usage(); exit(0);
+
+         case '?':
+            if (isprint (optopt))
+               printf ("Error: Unknown option `-%c'.\n", optopt);
+            else
+               printf ("Error: Unknown option character `\\x%x'.\n", optopt);
+
+         default:
+            usage(); exit(-1);
+    }
+    if (strlen(rrdfile) < 3) {
+       printf("Error: Cannot get valid -s RRD file argument.\n");
+       exit(-1);
+    }
+    if ((strlen(deltafile) < 3) == (strlen(srcfile) < 3)) {
+       printf("Error: Cannot get valid -d delta file or -r RRD file argument.\n");
+       exit(-1);
+    }
+}
+
+/* ------------------------------------------------------------ *
+ * load_delta() reads the delta file, and checks the header,    *
+ * the block sizes and the CRC. Returns the file data, or NULL. *
+ * ------------------------------------------------------------ */
+unsigned char *load_delta(const char *file, size_t *len) {
+   struct stat st;
+   FILE *fp;
+
+   if(stat(file, &st) != 0 || ! (fp = fopen(file, "r"))) {
+      printf("Error: cannot open delta file %s.\n", file);
+      return NULL;
+   }
+   unsigned char *data = malloc(st.st_size);
+   if(data == NULL || fread(data, 1, st.st_size, fp) != (size_t) st.st_size) {
+      printf("Error: cannot read delta file %s.\n", file);
+      fclose(fp);
+      return NULL;
+   }
+   fclose(fp);
+   *len = st.st_size;
+
+   if(*len < sizeof(rdl_header_t) + sizeof(rdl_trailer_t)) {
+      printf("Error: %s is not a RRD delta file.\n", file);
+      return NULL;
+   }
+   rdl_header_t *hdr = (rdl_header_t *) data;
+   rdl_trailer_t *trl = (rdl_trailer_t *) (data + *len - sizeof(rdl_trailer_t));
+   if(memcmp(hdr->magic, RDL_MAGIC, sizeof(hdr->magic)) != 0
+      || hdr->version != RDL_VERSION
+      || memcmp(trl->magic, RDL_ENDMAGIC, sizeof(RDL_ENDMAGIC)) != 0) {
+      printf("Error: %s is not a RRD delta file.\n", file);
+      return NULL;
+   }
+   if(rdl_crc32(0, data, *len - sizeof(rdl_trailer_t)) != trl->crc) {
+      printf("Error: %s has a bad CRC, incomplete upload?\n", file);
+      return NULL;
+   }
+
+   /* walk the blocks, their sizes must add up to the file size */
+   size_t pos = sizeof(rdl_header_t) + hdr->ds_cnt * RDL_NAMSIZE;
+   uint32_t i;
+   for(i=0; i<hdr->rra_cnt && pos + sizeof(rdl_rra_t) <= *len; i++) {
+      rdl_rra_t *blk = (rdl_rra_t *) (data + pos);
+      pos += sizeof(rdl_rra_t) + (size_t) blk->row_cnt * hdr->ds_cnt * sizeof(double);
+   }
+   if(i != hdr->rra_cnt || pos + sizeof(rdl_trailer_t) != *len) {
+      printf("Error: %s has a bad RRA block size.\n", file);
+      return NULL;
+   }
+   return data;
+}
+
+/* ------------------------------------------------------------ *
+ * rrdmap_open() opens and maps a RRD file, read-only or with   *
+ * write access. For write, it takes the same fcntl() lock as   *
+ * rrd_update() before reading the header, so no update can     *
+ * move the RRA row pointers while we merge.                    *
+ * ------------------------------------------------------------ */
+int rrdmap_open(const char *file, int rw, rrdmap_t *m) {
+   struct stat st;
+   unsigned long i;
+
+   memset(m, 0, sizeof(rrdmap_t));
+   m->fd = open(file, rw ? O_RDWR : O_RDONLY);
+   if(m->fd == -1 || fstat(m->fd, &st) != 0) {
+      printf("Error: cannot open %s.\n", file);
+      return -1;
+   }
+   if(rw) {
+      struct flock lock;
+      memset(&lock, 0, sizeof(lock));
+      lock.l_type = F_WRLCK;
+      lock.l_whence = SEEK_SET;
+      if(fcntl(m->fd, F_SETLKW, &lock) != 0) {
+         printf("Error: cannot lock %s.\n", file);
+         return -1;
+      }
+   }
+
+   rrd_init(&m->rrd);
+   m->rrdf = rrd_open(file, &m->rrd, RRD_READONLY);
+   if(m->rrdf == NULL) {
+      printf("Error: cannot open %s: %s\n", file, rrd_get_error());
+      return -1;
+   }
+
+   /* the RRA data follows the header, one RRA after the other */
+   size_t rowsize = m->rrd.stat_head->ds_cnt * sizeof(rrd_value_t);
+   m->rra_off = malloc(m->rrd.stat_head->rra_cnt * sizeof(size_t));
+   size_t off = m->rrdf->header_len;
+   for(i=0; i<m->rrd.stat_head->rra_cnt; i++) {
+      m->rra_off[i] = off;
+      off += m->rrd.rra_def[i].row_cnt * rowsize;
+   }
+   if(off > (size_t) st.st_size) {
+      printf("Error: %s is shorter than its RRA definitions.\n", file);
+      return -1;
+   }
+
+   m->mapsize = st.st_size;
+   m->map = mmap(NULL, m->mapsize, rw ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m->fd, 0);
+   if(m->map == MAP_FAILED) {
+      printf("Error: cannot mmap %s.\n", file);
+      return -1;
+   }
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * rrdmap_close() writes back the changed pages, and unlocks    *
+ * ------------------------------------------------------------ */
+void rrdmap_close(rrdmap_t *m, int rw) {
+   if(rw && msync(m->map, m->mapsize, MS_SYNC) != 0)
+      printf("Error: msync failed, RRD data may be incomplete.\n");
+   munmap(m->map, m->mapsize);
+   rrd_close(m->rrdf);
+   rrd_free(&m->rrd);
+   free(m->rra_off);
+   close(m->fd);                  // releases the fcntl() lock
+}
+
+/* ------------------------------------------------------------ *
+ * rra_row() returns a pointer to the row of RRA i for time ts, *
+ * or NULL if the time is outside of the RRA window. The row at *
+ * cur_row holds rra_end, same as in rrd_fetch().               *
+ * ------------------------------------------------------------ */
+rrd_value_t *rra_row(rrdmap_t *m, unsigned long i, time_t ts) {
+   rra_def_t *rra = &m->rrd.rra_def[i];
+   time_t rra_step = m->rrd.stat_head->pdp_step * rra->pdp_cnt;
+   time_t rra_end = m->rrd.live_head->last_up - (m->rrd.live_head->last_up % rra_step);
+
+   if(ts > rra_end || ts % rra_step != 0) return NULL;
+   unsigned long back = (rra_end - ts) / rra_step;
+   if(back >= rra->row_cnt) return NULL;
+   unsigned long row = (m->rrd.rra_ptr[i].cur_row + rra->row_cnt - back) % rra->row_cnt;
+   return (rrd_value_t *) (m->map + m->rra_off[i]) + row * m->rrd.stat_head->ds_cnt;
+}
+
+/* ------------------------------------------------------------ *
+ * find_rra() returns the index of the target RRA with the same *
+ * consolidation function and resolution, or -1 if none.        *
+ * ------------------------------------------------------------ */
+int find_rra(rrdmap_t *m, const char *cf, unsigned long pdp_cnt) {
+   unsigned long i;
+   for(i=0; i<m->rrd.stat_head->rra_cnt; i++)
+      if(m->rrd.rra_def[i].pdp_cnt == pdp_cnt && strcmp(m->rrd.rra_def[i].cf_nam, cf) == 0)
+         return i;
+   return -1;
+}
+
+/* ------------------------------------------------------------ *
+ * merge_row() writes one source row into a target row. With -g *
+ * only unknown (NaN) target values are filled, live data that  *
+ * the server received itself is never overwritten.             *
+ * ------------------------------------------------------------ */
+void merge_row(rrd_value_t *row, const double *src, unsigned long ds_cnt) {
+   unsigned long k;
+   for(k=0; k<ds_cnt; k++) {
+      if(isnan(src[k])) continue;
+      if(gapfill == 1 && ! isnan(row[k])) { kept++; continue; }
+      if(memcmp(&row[k], &src[k], sizeof(double)) == 0) { equal++; continue; }
+      row[k] = src[k];
+      written++;
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * has_gap() returns 1 if one of the row values is unknown      *
+ * ------------------------------------------------------------ */
+int has_gap(const rrd_value_t *row, unsigned long ds_cnt) {
+   unsigned long k;
+   for(k=0; k<ds_cnt; k++) if(isnan(row[k])) return 1;
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * check_ds() tests that both sides have the same data sources  *
+ * ------------------------------------------------------------ */
+void check_ds(rrdmap_t *dst, unsigned long ds_cnt, unsigned long step, const char *names, size_t nlen) {
+   unsigned long k;
+   if(ds_cnt != dst->rrd.stat_head->ds_cnt || step != dst->rrd.stat_head->pdp_step) {
+      printf("Error: source ds count %lu step %lu does not match %s.\n", ds_cnt, step, rrdfile);
+      exit(-1);
+   }
+   for(k=0; k<ds_cnt; k++) {
+      if(strncmp(names + k * nlen, dst->rrd.ds_def[k].ds_nam, RDL_NAMSIZE) != 0) {
+         printf("Error: source ds [%lu] name does not match %s.\n", k, rrdfile);
+         exit(-1);
+      }
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * merge_delta() writes each delta row into the target RRA row  *
+ * with the same time. Target rows without a gap are skipped in *
+ * gap-fill mode before the delta values are compared.          *
+ * ------------------------------------------------------------ */
+void merge_delta(rrdmap_t *dst, unsigned char *delta) {
+   rdl_header_t *hdr = (rdl_header_t *) delta;
+   uint32_t i, j;
+
+   check_ds(dst, hdr->ds_cnt, hdr->pdp_step, (const char *) (delta + sizeof(rdl_header_t)), RDL_NAMSIZE);
+
+   size_t pos = sizeof(rdl_header_t) + hdr->ds_cnt * RDL_NAMSIZE;
+   for(i=0; i<hdr->rra_cnt; i++) {
+      rdl_rra_t *blk = (rdl_rra_t *) (delta + pos);
+      const double *src = (const double *) (blk + 1);
+      pos += sizeof(rdl_rra_t) + (size_t) blk->row_cnt * hdr->ds_cnt * sizeof(double);
+
+      int r = find_rra(dst, blk->cf_nam, blk->pdp_cnt);
+      if(verbose == 1) printf("Debug: delta rra [%u] %s pdp_cnt [%u] rows [%u] target rra [%d]\n",
+                              i, blk->cf_nam, blk->pdp_cnt, blk->row_cnt, r);
+      if(r == -1) {
+         skipped += blk->row_cnt;
+         continue;
+      }
+      time_t rra_step = (time_t) hdr->pdp_step * blk->pdp_cnt;
+
+      for(j=0; j<blk->row_cnt; j++, src += hdr->ds_cnt) {
+         rrd_value_t *row = rra_row(dst, r, blk->first + (time_t) j * rra_step);
+         if(row == NULL) { skipped++; continue; }
+         if(gapfill == 1 && has_gap(row, hdr->ds_cnt) == 0) { kept += hdr->ds_cnt; continue; }
+         merge_row(row, src, hdr->ds_cnt);
+      }
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * merge_rrd() walks each target RRA once in file order, and    *
+ * looks up the source row for the same time in the source RRA  *
+ * with the same CF and resolution. In gap-fill mode the source *
+ * is only read for target rows with a gap, so the source pages *
+ * that are read, and the target pages written, scale with the  *
+ * gaps, not with the RRD size.                                 *
+ * ------------------------------------------------------------ */
+void merge_rrd(rrdmap_t *dst, rrdmap_t *src) {
+   unsigned long ds_cnt = dst->rrd.stat_head->ds_cnt;
+   unsigned long i, j, k;
+
+   char *names = malloc(src->rrd.stat_head->ds_cnt * DS_NAM_SIZE);
+   for(k=0; k<src->rrd.stat_head->ds_cnt; k++)
+      memcpy(names + k * DS_NAM_SIZE, src->rrd.ds_def[k].ds_nam, DS_NAM_SIZE);
+   check_ds(dst, src->rrd.stat_head->ds_cnt, src->rrd.stat_head->pdp_step, names, DS_NAM_SIZE);
+   free(names);
+
+   for(i=0; i<dst->rrd.stat_head->rra_cnt; i++) {
+      rra_def_t *rra = &dst->rrd.rra_def[i];
+      int s = find_rra(src, rra->cf_nam, rra->pdp_cnt);
+      if(verbose == 1) printf("Debug: target rra [%lu] %s pdp_cnt [%lu] rows [%lu] source rra [%d]\n",
+                              i, rra->cf_nam, rra->pdp_cnt, rra->row_cnt, s);
+      if(s == -1) continue;
+
+      time_t rra_step = dst->rrd.stat_head->pdp_step * rra->pdp_cnt;
+      time_t rra_end = dst->rrd.live_head->last_up - (dst->rrd.live_head->last_up % rra_step);
+      unsigned long cur_row = dst->rrd.rra_ptr[i].cur_row;
+      rrd_value_t *row = (rrd_value_t *) (dst->map + dst->rra_off[i]);
+
+      for(j=0; j<rra->row_cnt; j++, row += ds_cnt) {
+         if(gapfill == 1 && has_gap(row, ds_cnt) == 0) continue;
+         time_t ts = rra_end - (time_t) ((cur_row + rra->row_cnt - j) % rra->row_cnt) * rra_step;
+         rrd_value_t *srow = rra_row(src, s, ts);
+         if(srow == NULL) { skipped++; continue; }
+         merge_row(row, srow, ds_cnt);
+      }
+   }
+}
+
+int main(int argc, char *argv[]) {
+   rrdmap_t dst, src;
+   unsigned char *delta = NULL;
+   size_t dlen;
+
+   /* ------------------------------------------------------------ *
+    * Process the cmdline parameters                               *
+    * ------------------------------------------------------------ */
+   parseargs(argc, argv);
+
+   if(strlen(deltafile) > 0) {
+      delta = load_delta(deltafile, &dlen);
+      if(delta == NULL) exit(-1);
+      rdl_header_t *hdr = (rdl_header_t *) delta;
+      if(verbose == 1) printf("Debug: delta ds count [%u] rra count [%u] step [%u] since [%lld] last update [%lld]\n",
+                              hdr->ds_cnt, hdr->rra_cnt, hdr->pdp_step, (long long) hdr->since, (long long) hdr->last_up);
+   }
+   else if(rrdmap_open(srcfile, 0, &src) != 0) exit(-1);
+
+   /* ------------------------------------------------------------ *
+    * With RRDCACHED_ADDRESS set, have rrdcombd write the pending  *
+    * updates first, we write the RRD file directly.               *
+    * ------------------------------------------------------------ */
+   if(rrdc_flush_if_daemon(NULL, rrdfile) != 0) {
+      printf("Error: cannot flush %s: %s\n", rrdfile, rrd_get_error());
+      exit(-1);
+   }
+
+   if(rrdmap_open(rrdfile, 1, &dst) != 0) exit(-1);
+
+   if(delta != NULL) {
+      merge_delta(&dst, delta);
+      free(delta);
+   }
+   else {
+      merge_rrd(&dst, &src);
+      rrdmap_close(&src, 0);
+   }
+   rrdmap_close(&dst, 1);
+
+   printf("rrdmerge: %s: %ld values written, %ld equal, %ld kept, %ld rows outside RRA window\n",
+          rrdfile, written, equal, kept, skipped);
+   exit(0);
+}
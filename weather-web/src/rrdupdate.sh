@@ -4,13 +4,14 @@
 # 
 # This script runs in 1-min intervals through cron. It
 # it processes the independently generated sensor data file,
-# updates the RRD database, and generates the graph images.
+# updates the RRD database. The graph images are rendered
+# on request by the rrdgraph CGI program.
 #
 # It also handles the files that are created once per day:
 # 1) pick up the timelapse movie received after midnight
-# 2) pickup and import the daily RRD XML export file that
-# was send from the weather station (this helps filling any
-# data gaps created by network outages).
+# 2) pickup and merge the daily RRD delta file (or the old
+# XML export file) that was send from the weather station
+# (this helps filling any data gaps from network outages).
 #
 # This script requires the station name as single argument
 # and attempts to process the received data from the path
@@ -23,28 +24,6 @@ pushd `dirname $0` > /dev/null
 SCRIPTPATH=`pwd -P`
 popd > /dev/null
 
-##########################################################
-# RRDtool default parameters for graph image creation
-# --slope-mode -> smoothens the default stair case curves
-# --units-exponent=0 -->No y-axis value scaling (Kilo/Mega)
-# this is only important for hPa not showing as 1.014k
-##########################################################
-GRAPH_PARAMS="
-  --imgformat PNG 
-  --no-gridfit
-  --slope-mode
-  --width=1119
-  --height=147
-  --font AXIS:12:
-  --font TITLE:15:
-  --font LEGEND:14:
-  --font WATERMARK:10:
-  --units-exponent=0
-  --border=1
-  --color SHADEA#000000
-  --color SHADEB#000000
-"
-
 ##########################################################
 # readconfig() function to read the config file variables
 ##########################################################
@@ -77,8 +56,30 @@ readconfig GLOBALCFG < "$GLOBALCONFIG"
 
 DAYTCALC="${GLOBALCFG[pi-web-data]}/bin/daytcalc"
 OUTLIER="${GLOBALCFG[pi-web-data]}/bin/outlier"
+RRDMERGE="${GLOBALCFG[pi-web-data]}/bin/rrdmerge"
+WSINGEST="${GLOBALCFG[pi-web-data]}/bin/wsingest"
 RRDTOOL="/usr/bin/rrdtool"
 
+##########################################################
+# If set, send the RRD updates through the rrdcombd daemon
+# rrdtool and our programs use it with RRDCACHED_ADDRESS
+##########################################################
+if [[ -n ${GLOBALCFG[pi-web-rrdcd]} ]]; then
+   export RRDCACHED_ADDRESS=${GLOBALCFG[pi-web-rrdcd]}
+   echo "Using rrdcombd [$RRDCACHED_ADDRESS]"
+fi
+
+##########################################################
+# If set, the wsingest daemon writes the sensor frames of
+# all stations into the RRD as they arrive, we only do the
+# web page and daily file updates here, and the RRD update
+# for stations the daemon has no frames from.
+##########################################################
+if [[ ${GLOBALCFG[pi-web-ingestd]} == "yes" ]]; then
+   INGESTD=1
+   echo "Using wsingest daemon for RRD updates"
+fi
+
 ##########################################################
 # Check for the station argument, and test if it exists
 ##########################################################
@@ -158,7 +159,11 @@ fi
 # Get last RRD database update timestamp
 ##########################################################
 OLDTIME=`$RRDTOOL last $RRD`
-if [ "$TIME" = "$OLDTIME" ]; then
+if [[ -n $INGESTD ]] && [ "$OLDTIME" -ge "$TIME" ]; then
+  # the daemon has written it already, and logs outages
+  INGESTED=1
+  OLDTIME=$TIME
+elif [ "$TIME" = "$OLDTIME" ]; then
   echo "Error no new sensor data: last update from: `date -d @$TIME`"
   exit
 else
@@ -261,24 +266,70 @@ else
 fi
 
 ##########################################################
-# Import any sensor-send database XML file before updates
+# Merge any sensor-send database delta file before updates
 ##########################################################
-if [ -f $VARPATH/rrdcopy.xml.gz ]; then
-   echo "Found sensor RRD XML export file, restoring DB."
-   gunzip $VARPATH/rrdcopy.xml.gz
-   mv $RRD $RRD.orig
-   $RRDTOOL restore $VARPATH/rrdcopy.xml $RRD
-   rm $VARPATH/rrdcopy.xml
-   rm $LOGPATH/outage.log
-   rm $LOGPATH/resync.flag
-   REPROCESS=1 # Force recreation of monthly/yearly pngs
+if [ -f $VARPATH/rrdcopy.delta ]; then
+   echo "Found sensor RRD delta file, filling DB gaps."
+   if $RRDMERGE -g -s $RRD -d $VARPATH/rrdcopy.delta; then
+      rm $VARPATH/rrdcopy.delta
+      rm -f $LOGPATH/outage.log
+      rm -f $LOGPATH/resync.flag
+      # Force recreation of the cached graph images
+      rm -f ${GLOBALCFG[pi-web-data]}/cache/$STATION/*.png
+   else
+      # keep the delta for a manual merge, the outage stays logged
+      echo "Error merging $VARPATH/rrdcopy.delta, kept as rrdcopy.delta.failed"
+      echo "`date`: rrdmerge failed, delta kept as rrdcopy.delta.failed" >> $OUTAGELOG
+      mv -f $VARPATH/rrdcopy.delta $VARPATH/rrdcopy.delta.failed
+   fi
 fi
 
 ##########################################################
-# write new data into the RRD DB
+# Import any sensor-send database XML file before updates
+# from stations that did not yet upgrade to rrddelta. It
+# is restored into a temporary RRD, and only fills gaps,
+# the data received after the export is not overwritten.
 ##########################################################
-echo "$RRDTOOL update $RRD $TIME:$TEMP:$HUMI:$BMPR:$DAYT"
-$RRDTOOL updatev $RRD "$TIME:$TEMP:$HUMI:$BMPR:$DAYT"
+if [ -f $VARPATH/rrdcopy.xml.gz ]; then
+   echo "Found sensor RRD XML export file, filling DB gaps."
+   gunzip -f $VARPATH/rrdcopy.xml.gz
+   rm -f $VARPATH/rrdcopy.rrd
+   if $RRDTOOL restore $VARPATH/rrdcopy.xml $VARPATH/rrdcopy.rrd &&
+      $RRDMERGE -g -s $RRD -r $VARPATH/rrdcopy.rrd; then
+      rm $VARPATH/rrdcopy.xml $VARPATH/rrdcopy.rrd
+      rm -f $LOGPATH/outage.log
+      rm -f $LOGPATH/resync.flag
+      # Force recreation of the cached graph images
+      rm -f ${GLOBALCFG[pi-web-data]}/cache/$STATION/*.png
+   else
+      # keep the export for a manual merge, the outage stays logged
+      echo "Error merging $VARPATH/rrdcopy.xml, kept as rrdcopy.xml.failed"
+      echo "`date`: rrdmerge failed, export kept as rrdcopy.xml.failed" >> $OUTAGELOG
+      mv -f $VARPATH/rrdcopy.xml $VARPATH/rrdcopy.xml.failed
+      rm -f $VARPATH/rrdcopy.rrd
+   fi
+fi
+
+##########################################################
+# write new data into the RRD DB. Stations that send the
+# binary sensor frames are updated by wsingest, including
+# any frames left over from a network outage. The others
+# use sensor.txt, rrdcombd only queues the data and has no
+# updatev to return the RRA values. With the daemon, the
+# sensor.txt update stays for stations without frame files
+# (*.wsf), their "rrdtool last" does not move past $TIME.
+##########################################################
+if [[ -n $INGESTED ]]; then
+   echo "RRD $RRD is updated by the wsingest daemon."
+elif [[ -z $INGESTD ]] && [ -x $WSINGEST ] && $WSINGEST -s $STATION; then
+   echo "wsingest updated $RRD from the sensor frames."
+elif [[ -n $RRDCACHED_ADDRESS ]]; then
+   echo "$RRDTOOL update $RRD $TIME:$TEMP:$HUMI:$BMPR:$DAYT"
+   $RRDTOOL update $RRD "$TIME:$TEMP:$HUMI:$BMPR:$DAYT"
+else
+   echo "$RRDTOOL updatev $RRD $TIME:$TEMP:$HUMI:$BMPR:$DAYT"
+   $RRDTOOL updatev $RRD "$TIME:$TEMP:$HUMI:$BMPR:$DAYT"
+fi
 
 ##########################################################
 # Write the sensor data into web format to web folder
@@ -339,292 +390,11 @@ fi
 
 
 ##########################################################
-# Create the daily graph images
-##########################################################
-TEMPPNG="$IMGPATH/daily_temp.png"
-HUMIPNG="$IMGPATH/daily_humi.png"
-BMPRPNG="$IMGPATH/daily_bmpr.png"
-
-echo -n "Creating image $TEMPPNG... "
-
-$RRDTOOL graph $TEMPPNG $GRAPH_PARAMS \
-  --start -16h \
-  --title='Temperature' \
-  --step=60s  \
-  DEF:temp1=$RRD:temp:AVERAGE \
-  DEF:dayt1=$RRD:dayt:AVERAGE \
-  'CDEF:dayt2=dayt1,0,GT,INF,UNKN,IF' \
-  'AREA:dayt2#cfcfcf' \
-  'CDEF:tneg1=dayt1,0,GT,NEGINF,UNKN,IF' \
-  'AREA:tneg1#cfcfcf' \
-  'CDEF:tminus=temp1,0,LE,temp1,UNKN,IF' \
-  'CDEF:tnull=temp1,0,EQ,temp1,UNKN,IF' \
-  'CDEF:tplus=temp1,0,GE,temp1,UNKN,IF' \
-  'AREA:tminus#004477:' \
-  'AREA:tnull#004477:' \
-  'AREA:tplus#99001F:Temperature in °C' \
-  'GPRINT:temp1:MIN:Min\: %3.2lf' \
-  'GPRINT:temp1:MAX:Max\: %3.2lf' \
-  'GPRINT:temp1:LAST:Last\: %3.2lf'
-
-echo -n "Creating image $HUMIPNG... "
-
-$RRDTOOL graph $HUMIPNG $GRAPH_PARAMS \
-  --start -16h \
-  --title='Relative Humidity' \
-  --step=60s  \
-  --upper-limit=100 \
-  --lower-limit=0 \
-  DEF:humi1=$RRD:humi:AVERAGE \
-  DEF:dayt1=$RRD:dayt:AVERAGE \
-  'CDEF:dayt2=dayt1,0,GT,INF,UNKN,IF' \
-  'AREA:dayt2#cfcfcf' \
-  'AREA:humi1#004477:Humidity in percent' \
-  'GPRINT:humi1:MIN:Min\: %3.2lf' \
-  'GPRINT:humi1:MAX:Max\: %3.2lf' \
-  'GPRINT:humi1:LAST:Last\: %3.2lf'
-
-echo -n "Creating image $BMPRPNG... "
-
-$RRDTOOL graph $BMPRPNG $GRAPH_PARAMS \
-  --start -16h \
-  --title='Barometric Pressure' \
-  --step=60s  \
-  --alt-autoscale \
-  --alt-y-grid \
-  DEF:bmpr1=$RRD:bmpr:AVERAGE \
-  DEF:dayt1=$RRD:dayt:AVERAGE \
-  'CDEF:bmpr2=bmpr1,100,/' \
-  'CDEF:dayt2=dayt1,0,GT,INF,UNKN,IF' \
-  'AREA:dayt2#cfcfcf' \
-  'AREA:bmpr2#007744:Barometric Pressure in hPa' \
-  'GPRINT:bmpr2:MIN:Min\: %3.2lf' \
-  'GPRINT:bmpr2:MAX:Max\: %3.2lf' \
-  'GPRINT:bmpr2:LAST:Last\: %3.2lf'
-
-##########################################################
-# Create the monthly graph images
-##########################################################
-MTEMPPNG=$IMGPATH/monthly_temp.png
-MHUMIPNG=$IMGPATH/monthly_humi.png
-MBMPRPNG=$IMGPATH/monthly_bmpr.png
-
-##########################################################
-# Check if monthly temp file has already
-# been updated today, otherwise generate.
+# The graph images are no longer created here. The CGI
+# program rrdgraph renders them on request from the web
+# pages, and caches them until new data arrives. Idle
+# stations don't need any graph rendering this way.
 ##########################################################
-midnight=$(date -d "00:00" +%s)
-if [ -f $MTEMPPNG ]; then FILEAGE=$(date -r $MTEMPPNG +%s); fi
-if [ ! -f $MTEMPPNG ] || [[ "$FILEAGE" < "$midnight" ]] || [ -v REPROCESS ]; then
-  echo -n "Creating image $MTEMPPNG... "
-
-  # --------------------------------------- #
-  # --x-grid defines the x-axis spacing.    #
-  # format: GTM:GST:MTM:MST:LTM:LST:LPR:LFM #
-  # GTM:GST base grid (Unit:How Many)       #
-  # MTM:MST major grid (Unit:How Many)      #
-  # LTM:LST how often labels are placed     #
-  # --------------------------------------- #
-  $RRDTOOL graph $MTEMPPNG $GRAPH_PARAMS \
-  --start end-21d --end 00:00 \
-  --title='Temperature, 3 Weeks' \
-  --x-grid HOUR:8:DAY:1:DAY:1:86400:%d \
-  DEF:temp1=$RRD:temp:AVERAGE \
-  'CDEF:tplus=temp1,0,GE,temp1,UNKN,IF' \
-  'CDEF:tminus=temp1,0,LE,temp1,UNKN,IF' \
-  'AREA:tplus#99001F:Temperature in °C' \
-  'AREA:tminus#004477:' \
-  'GPRINT:temp1:MIN:Min\: %3.2lf' \
-  'GPRINT:temp1:MAX:Max\: %3.2lf' \
-  'GPRINT:temp1:LAST:Last\: %3.2lf'
-fi
-
-##########################################################
-# Check if monthly humi file has already
-# been updated today, otherwise generate.
-##########################################################
-if [ -f $MHUMIPNG ]; then FILEAGE=$(date -r $MHUMIPNG +%s); fi
-if [ ! -f $MHUMIPNG ] || [[ "$FILEAGE" < "$midnight" ]] || [ -v REPROCESS ]; then
-  echo -n "Creating image $MHUMIPNG... "
-
-  $RRDTOOL graph $MHUMIPNG $GRAPH_PARAMS \
-  --start end-21d --end 00:00 \
-  --title='Relative Humidity, 3 Weeks' \
-  --x-grid HOUR:8:DAY:1:DAY:1:86400:%d \
-  --upper-limit=100 \
-  --lower-limit=0 \
-  DEF:humi1=$RRD:humi:AVERAGE \
-  'AREA:humi1#004477:Humidity in percent' \
-  'GPRINT:humi1:MIN:Min\: %3.2lf' \
-  'GPRINT:humi1:MAX:Max\: %3.2lf' \
-  'GPRINT:humi1:LAST:Last\: %3.2lf'
-fi
-
-##########################################################
-# Check if monthly bmpr file has already
-# been updated today, otherwise generate.
-##########################################################
-if [ -f $MBMPRPNG ]; then FILEAGE=$(date -r $MBMPRPNG +%s); fi
-if [ ! -f $MBMPRPNG ] || [[ "$FILEAGE" < "$midnight" ]] || [ -v REPROCESS ]; then
-  echo -n "Creating image $MBMPRPNG... "
-
-  $RRDTOOL graph $MBMPRPNG $GRAPH_PARAMS \
-  --start end-21d --end 00:00 \
-  --title='Barometric Pressure, 3 Weeks' \
-  --x-grid HOUR:8:DAY:1:DAY:1:86400:%d \
-  --alt-autoscale \
-  --alt-y-grid \
-  DEF:bmpr1=$RRD:bmpr:AVERAGE \
-  'CDEF:bmpr2=bmpr1,100,/' \
-  'AREA:bmpr2#007744:Barometric Pressure in hPa' \
-  'GPRINT:bmpr2:MIN:Min\: %3.2lf' \
-  'GPRINT:bmpr2:MAX:Max\: %3.2lf' \
-  'GPRINT:bmpr2:LAST:Last\: %3.2lf'
-fi
-
-##########################################################
-# Create the yearly graph images
-##########################################################
-YTEMPPNG=$IMGPATH/yearly_temp.png
-YHUMIPNG=$IMGPATH/yearly_humi.png
-YBMPRPNG=$IMGPATH/yearly_bmpr.png
-
-##########################################################
-# Check if yearly temp file has already 
-# been updated today, otherwise generate
-##########################################################
-if [ -f $YTEMPPNG ]; then FILEAGE=$(date -r $YTEMPPNG +%s); fi
-if [ ! -f $YTEMPPNG ] || [[ "$FILEAGE" < "$midnight" ]] || [ -v REPROCESS ]; then
-  echo -n "Creating image $YTEMPPNG... "
-
-  $RRDTOOL graph $YTEMPPNG $GRAPH_PARAMS \
-  --start end-18mon --end 00:00 \
-  --x-grid MONTH:1:YEAR:1:MONTH:1:2592000:%b \
-  --title='Temperature, Yearly View' \
-  DEF:temp1=$RRD:temp:AVERAGE \
-  'CDEF:tminus=temp1,0,LE,temp1,UNKN,IF' \
-  'CDEF:tplus=temp1,0,GE,temp1,UNKN,IF' \
-  'AREA:tminus#004477:' \
-  'AREA:tplus#99001F:Temperature in °C' \
-  'GPRINT:temp1:MIN:Min\: %3.2lf' \
-  'GPRINT:temp1:MAX:Max\: %3.2lf' \
-  'GPRINT:temp1:LAST:Last\: %3.2lf'
-fi
-
-##########################################################
-# Check if yearly humi file has already
-# been updated today, otherwise generate
-##########################################################
-if [ -f $YHUMIPNG ]; then FILEAGE=$(date -r $YHUMIPNG +%s); fi
-if [ ! -f $YHUMIPNG ] || [[ "$FILEAGE" < "$midnight" ]] || [ -v REPROCESS ]; then
-  echo -n "Creating image $YHUMIPNG... "
-
-  $RRDTOOL graph $YHUMIPNG $GRAPH_PARAMS \
-  --start end-18mon --end 00:00 \
-  --x-grid MONTH:1:YEAR:1:MONTH:1:2592000:%b \
-  --title='Relative Humidity, Yearly View' \
-  --upper-limit=100 \
-  --lower-limit=0 \
-  DEF:humi1=$RRD:humi:AVERAGE \
-  'AREA:humi1#004477:Humidity in percent' \
-  'GPRINT:humi1:MIN:Min\: %3.2lf' \
-  'GPRINT:humi1:MAX:Max\: %3.2lf' \
-  'GPRINT:humi1:LAST:Last\: %3.2lf'
-fi
-
-##########################################################
-# Check if yearly bmpr file has already
-# been updated today, otherwise generate
-##########################################################
-if [ -f $YBMPRPNG ]; then FILEAGE=$(date -r $YBMPRPNG +%s); fi
-if [ ! -f $YBMPRPNG ] || [[ "$FILEAGE" < "$midnight" ]] || [ -v REPROCESS ]; then
-  echo -n "Creating image $YBMPRPNG... "
-
-  $RRDTOOL graph $YBMPRPNG $GRAPH_PARAMS \
-  --start end-18mon --end 00:00 \
-  --x-grid MONTH:1:YEAR:1:MONTH:1:2592000:%b \
-  --title='Barometric Pressure, Yearly View' \
-  --alt-autoscale \
-  --alt-y-grid \
-  DEF:bmpr1=$RRD:bmpr:AVERAGE \
-  'CDEF:bmpr2=bmpr1,100,/' \
-  'AREA:bmpr2#007744:Barometric Pressure in hPa' \
-  'GPRINT:bmpr2:MIN:Min\: %3.2lf' \
-  'GPRINT:bmpr2:MAX:Max\: %3.2lf' \
-  'GPRINT:bmpr2:LAST:Last\: %3.2lf'
-fi
-
-##########################################################
-# Create the 18-year graph images
-##########################################################
-TWYTEMPPNG=$IMGPATH/twyear_temp.png
-TWYHUMIPNG=$IMGPATH/twyear_humi.png
-TWYBMPRPNG=$IMGPATH/twyear_bmpr.png
-
-##########################################################
-# Check if the 18-year temp file has already
-# been updated today, otherwise generate it.
-##########################################################
-if [ -f $TWYTEMPPNG ]; then FILEAGE=$(date -r $TWYTEMPPNG +%s); fi
-if [ ! -f $TWYTEMPPNG ] || [[ "$FILEAGE" < "$midnight" ]] || [ -v REPROCESS ]; then
-  echo -n "Creating image $TWYTEMPPNG... "
-
-  $RRDTOOL graph $TWYTEMPPNG $GRAPH_PARAMS \
-  --start end-18years --end 00:00 \
-  --x-grid YEAR:1:YEAR:10:YEAR:1:31536000:%Y \
-  --title='Temperature, 18-Year View' \
-  DEF:temp1=$RRD:temp:AVERAGE \
-  'CDEF:tminus=temp1,0,LE,temp1,UNKN,IF' \
-  'CDEF:tplus=temp1,0,GE,temp1,UNKN,IF' \
-  'AREA:tminus#004477:' \
-  'AREA:tplus#99001F:Temperature in °C' \
-  'GPRINT:temp1:MIN:Min\: %3.2lf' \
-  'GPRINT:temp1:MAX:Max\: %3.2lf' \
-  'GPRINT:temp1:LAST:Last\: %3.2lf'
-fi
-
-##########################################################
-# Check if the 18-year humi file has already
-# been updated today, otherwise generate it.
-##########################################################
-if [ -f $TWYHUMIPNG ]; then FILEAGE=$(date -r $TWYHUMIPNG +%s); fi
-if [ ! -f $TWYHUMIPNG ] || [[ "$FILEAGE" < "$midnight" ]] || [ -v REPROCESS ]; then
-  echo -n "Creating image $TWYHUMIPNG... "
-
-  $RRDTOOL graph $TWYHUMIPNG $GRAPH_PARAMS \
-  --start end-18years --end 00:00 \
-  --x-grid YEAR:1:YEAR:10:YEAR:1:31536000:%Y \
-  --title='Humidity, 18-Year View' \
-  --upper-limit=100 \
-  --lower-limit=0 \
-  DEF:humi1=$RRD:humi:AVERAGE \
-  'AREA:humi1#004477:Humidity in percent' \
-  'GPRINT:humi1:MIN:Min\: %3.2lf' \
-  'GPRINT:humi1:MAX:Max\: %3.2lf' \
-  'GPRINT:humi1:LAST:Last\: %3.2lf'
-fi
-
-##########################################################
-# Check if the 18-year bmpr file has already
-# been updated today, otherwise generate it.
-##########################################################
-if [ -f $TWYBMPRPNG ]; then FILEAGE=$(date -r $TWYBMPRPNG +%s); fi
-if [ ! -f $TWYBMPRPNG ] || [[ "$FILEAGE" < "$midnight" ]] || [ -v REPROCESS ]; then
-  echo -n "Creating image $TWYBMPRPNG... "
-
-  $RRDTOOL graph $TWYBMPRPNG $GRAPH_PARAMS \
-  --start end-18years --end 00:00 \
-  --x-grid YEAR:1:YEAR:10:YEAR:1:31536000:%Y \
-  --title='Barometric Pressure, 18-Year View' \
-  --alt-autoscale \
-  --alt-y-grid \
-  DEF:bmpr1=$RRD:bmpr:AVERAGE \
-  'CDEF:bmpr2=bmpr1,100,/' \
-  'AREA:bmpr2#007744:Barometric Pressure in hPa' \
-  'GPRINT:bmpr2:MIN:Min\: %3.2lf' \
-  'GPRINT:bmpr2:MAX:Max\: %3.2lf' \
-  'GPRINT:bmpr2:LAST:Last\: %3.2lf'
-fi
 
 ##########################################################
 # Daily update of the 12-year Min/Max Temperature htm file
@@ -722,6 +492,7 @@ fi
 # Daily update of the sunrise/sunset data file
 ##########################################################
 DAYTIMEFILE=$WEBPATH/daytime.htm
+midnight=$(date -d "00:00" +%s)
 
 if [ -f $DAYTIMEFILE ]; then FILEAGE=$(date -r $DAYTIMEFILE +%s); fi
 if [ ! -f $DAYTIMEFILE ] || [[ "$FILEAGE" < "$midnight" ]]; then
@@ -0,0 +1,315 @@
+#!/bin/bash
+##########################################################
+# solardaily.sh 20261019 Frank4DD
+#
+# This script creates the monthly and yearly solar graph
+# images, and the 12-day power generation table with
+# pvpower. These are the heavy parts of solarupdate.sh,
+# they only need to run once per day after midnight.
+#
+# This script requires the station name as single argument.
+# It is called by the jobsched daemon at a fixed per-station
+# offset after midnight (see etc/jobsched.conf), so that not
+# all stations render at the same minute. Without jobsched
+# (pi-web-jobsched not set), solarupdate.sh calls it.
+##########################################################
+echo "solardaily.sh: Run at `date`"
+pushd `dirname $0` > /dev/null
+SCRIPTPATH=`pwd -P`
+popd > /dev/null
+
+##########################################################
+# readconfig() function to read the config file variables
+##########################################################
+readconfig() {
+   local ARRAY="$1"
+   local KEY VALUE
+   local IFS='='
+   declare -g -A "$ARRAY"
+   while read; do
+      # here assumed that comments may not be indented
+      [[ $REPLY == [^#]*[^$IFS]${IFS}[^$IFS]* ]] && {
+          read KEY VALUE <<< "$REPLY"
+          [[ -n $KEY ]] || continue
+          eval "$ARRAY[$KEY]=\"\$VALUE\""
+      }
+   done
+}
+
+##########################################################
+# Check for the global config file, and source it
+##########################################################
+GLOBALCONFIG="$SCRIPTPATH/../etc/pi-web.conf"
+
+if [[ ! -f $GLOBALCONFIG ]]; then
+  echo "Error - cannot find config file [$GLOBALCONFIG]" >&2
+  exit 1
+fi
+readconfig GLOBALCFG < "$GLOBALCONFIG"
+
+PVPOWER="${GLOBALCFG[pi-web-data]}/bin/pvpower"
+RRDTOOL="/usr/bin/rrdtool"
+
+##########################################################
+# Check for the station argument, and test if it exists
+##########################################################
+if [[ $1 =~ ^pi-ws[0-9]{2}$ ]]; then
+   STATION=$1
+else
+   echo "Error - wrong station format, expecting pi-wsXX"
+   exit 1
+fi
+
+##########################################################
+# Stations without solar integration have nothing to do
+##########################################################
+SOLARCONF=${GLOBALCFG[pi-web-data]}/chroot/$STATION/etc/pi-solar.conf
+RRD="${GLOBALCFG[pi-web-data]}/chroot/$STATION/rrd/solar.rrd"
+
+if [ ! -f $SOLARCONF ] || [ ! -e $RRD ]; then
+   echo "solardaily.sh: No solar data for [$STATION]"
+   exit 0
+fi
+
+##########################################################
+# Set the station timezone, midnight is the local one
+##########################################################
+LOCALCONFIG="${GLOBALCFG[pi-web-data]}/chroot/$STATION/etc/$STATION.conf"
+readconfig LOCALCFG < "$LOCALCONFIG"
+eval TZ=${LOCALCFG[pi-weather-tzs]}
+export TZ
+echo "Using timezone [$TZ]"
+
+IMGPATH="${GLOBALCFG[pi-web-html]}/$STATION/images"
+##########################################################
+# Create the monthly graph images
+##########################################################
+MVPNLPNG=$IMGPATH/monthly_vpnl.png
+MVBATPNG=$IMGPATH/monthly_vbat.png
+MPBALPNG=$IMGPATH/monthly_pbal.png
+midnight=$(date -d "00:00" +%s)
+
+##########################################################
+# Check if monthly panel file has already
+# been updated today, otherwise generate.
+##########################################################
+if [ -f $MVPNLPNG ]; then FILEAGE=$(date -r $MVPNLPNG +%s); fi
+if [ ! -f $MVPNLPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
+  echo -n "Creating image $MVPNLPNG... "
+
+  # --------------------------------------- #
+  # --x-grid defines the x-axis spacing.    #
+  # format: GTM:GST:MTM:MST:LTM:LST:LPR:LFM #
+  # GTM:GST base grid (Unit:How Many)       #
+  # MTM:MST major grid (Unit:How Many)      #
+  # LTM:LST how often labels are placed     #
+  # --------------------------------------- #
+  $RRDTOOL graph $MVPNLPNG -a PNG \
+  --start end-21d --end 00:00 \
+  --x-grid HOUR:8:DAY:1:DAY:1:86400:%d \
+  --title='Panel Voltage, 3 Weeks' \
+  --width=619 \
+  --height=77 \
+  --border=1  \
+  --slope-mode \
+  --color SHADEA#000000 \
+  --color SHADEB#000000 \
+  DEF:opcs1=$RRD:opcs:AVERAGE \
+  DEF:vpnl1=$RRD:vpnl:AVERAGE \
+  AREA:vpnl1#00447755:'Volt Off' \
+  CDEF:v1=opcs1,0,GT,vpnl1,UNKN,IF \
+  AREA:v1#00447799:'Volt Charging' \
+  LINE1:vpnl1#004477FF:''  \
+  GPRINT:vpnl1:MIN:'Min\: %3.2lf %sV' \
+  GPRINT:vpnl1:MAX:'Max\: %3.2lf %sV' \
+  GPRINT:vpnl1:LAST:'Last\: %3.2lf %sV'
+fi
+
+##########################################################
+# Check if monthly battery file has already
+# been updated today, otherwise generate.
+##########################################################
+if [ -f $MVBATPNG ]; then FILEAGE=$(date -r $MVBATPNG +%s); fi
+if [ ! -f $MVBATPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
+  echo -n "Creating image $MVBATPNG... "
+
+  $RRDTOOL graph $MVBATPNG -a PNG \
+  --start end-21d --end 00:00 \
+  --title='Battery Voltage, 3 Weeks' \
+  --x-grid HOUR:8:DAY:1:DAY:1:86400:%d \
+  --alt-autoscale \
+  --lower-limit=12.0 \
+  --width=619 \
+  --height=77 \
+  --border=1  \
+  --slope-mode \
+  --color SHADEA#000000 \
+  --color SHADEB#000000 \
+  DEF:vbat1=$RRD:vbat:AVERAGE \
+  AREA:vbat1#99001F55:'' \
+  LINE1:vbat1#99001FFF:'Volt' \
+  GPRINT:vbat1:MIN:'Min\: %3.2lf V' \
+  GPRINT:vbat1:MAX:'Max\: %3.2lf V' \
+  GPRINT:vbat1:LAST:'Last\: %3.2lf V'
+fi
+
+##########################################################
+# Check if monthly power file has already
+# been updated today, otherwise generate.
+##########################################################
+if [ -f $MPBALPNG ]; then FILEAGE=$(date -r $MPBALPNG +%s); fi
+if [ ! -f $MPBALPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
+  echo -n "Creating image $MPBALPNG... "
+
+  $RRDTOOL graph $MPBALPNG -a PNG \
+  --start end-21d --end 00:00 \
+  --x-grid HOUR:8:DAY:1:DAY:1:86400:%d \
+  --title='Power Balance, 3 Weeks' \
+  --width=619 \
+  --height=77 \
+  --border=1  \
+  --slope-mode \
+  --color SHADEA#000000 \
+  --color SHADEB#000000 \
+  DEF:vb1=$RRD:vbat:AVERAGE \
+  DEF:ib1=$RRD:ibat:AVERAGE \
+  CDEF:pbat=vb1,ib1,* \
+  CDEF:psur=pbat,0,GE,pbat,UNKN,IF \
+  CDEF:pdef=pbat,0,LT,pbat,UNKN,IF \
+  AREA:psur#00994455:'' \
+  LINE1:psur#009944FF:'Watt Surplus' \
+  AREA:pdef#99001F55:'' \
+  LINE1:pdef#99001FFF:'Watt Deficit' \
+  GPRINT:pbat:MIN:'Min\: %3.2lf %sW' \
+  GPRINT:pbat:MAX:'Max\: %3.2lf %sW' \
+  GPRINT:pbat:LAST:'Last\: %3.2lf %sW'
+fi
+
+##########################################################
+# Create the yearly graph images
+##########################################################
+YVPNLPNG=$IMGPATH/yearly_vpnl.png
+YVBATPNG=$IMGPATH/yearly_vbat.png
+YPBALPNG=$IMGPATH/yearly_pbal.png
+
+##########################################################
+# Check if yearly VPNL file has already
+# been updated today, otherwise generate
+##########################################################
+if [ -f $YVPNLPNG ]; then FILEAGE=$(date -r $YVPNLPNG +%s); fi
+if [ ! -f $YVPNLPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
+  echo -n "Creating image $YVPNLPNG... "
+
+  $RRDTOOL graph $YVPNLPNG -a PNG \
+  --start end-18mon --end 00:00 \
+  --x-grid MONTH:1:YEAR:1:MONTH:1:2592000:%b \
+  --title='Panel Voltage, Yearly View' \
+  --width=619 \
+  --height=77 \
+  --border=1  \
+  --slope-mode \
+  --color SHADEA#000000 \
+  --color SHADEB#000000 \
+  DEF:vpnl1=$RRD:vpnl:AVERAGE \
+  AREA:vpnl1#00447799:'' \
+  LINE1:vpnl1#004477FF:'Volt'  \
+  GPRINT:vpnl1:MIN:'Min\: %3.2lf %sV' \
+  GPRINT:vpnl1:MAX:'Max\: %3.2lf %sV' \
+  GPRINT:vpnl1:LAST:'Last\: %3.2lf %sV'
+fi
+
+##########################################################
+# Check if yearly VBAT file has already
+# been updated today, otherwise generate
+##########################################################
+if [ -f $YVBATPNG ]; then FILEAGE=$(date -r $YVBATPNG +%s); fi
+if [ ! -f $YVBATPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
+  echo -n "Creating image $YVBATPNG... "
+
+  $RRDTOOL graph $YVBATPNG -a PNG \
+  --start end-18mon --end 00:00 \
+  --x-grid MONTH:1:YEAR:1:MONTH:1:2592000:%b \
+  --title='Battery Voltage, Yearly View' \
+  --alt-autoscale \
+  --lower-limit=11.0 \
+  --left-axis-format "%2.1lf" \
+  --width=619 \
+  --height=77 \
+  --border=1  \
+  --slope-mode \
+  --color SHADEA#000000 \
+  --color SHADEB#000000 \
+  DEF:vbat1=$RRD:vbat:AVERAGE \
+  AREA:vbat1#99001F55:'' \
+  LINE1:vbat1#99001FFF:'Volt' \
+  GPRINT:vbat1:MIN:'Min\: %3.2lf V' \
+  GPRINT:vbat1:MAX:'Max\: %3.2lf V' \
+  GPRINT:vbat1:LAST:'Last\: %3.2lf V'
+fi
+
+##########################################################
+# Check if yearly power file has already
+# been updated today, otherwise generate
+##########################################################
+if [ -f $YPBALPNG ]; then FILEAGE=$(date -r $YPBALPNG +%s); fi
+if [ ! -f $YPBALPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
+  echo -n "Creating image $YLOADPNG... "
+
+  $RRDTOOL graph $YPBALPNG -a PNG \
+  --start end-18mon --end 00:00 \
+  --x-grid MONTH:1:YEAR:1:MONTH:1:2592000:%b \
+  --title='Power Balance, Yearly View' \
+  --width=619 \
+  --height=77 \
+  --border=1  \
+  --slope-mode \
+  --color SHADEA#000000 \
+  --color SHADEB#000000 \
+  DEF:vb1=$RRD:vbat:AVERAGE \
+  DEF:ib1=$RRD:ibat:AVERAGE \
+  CDEF:pbat=vb1,ib1,* \
+  CDEF:psur=pbat,0,GE,pbat,UNKN,IF \
+  CDEF:pdef=pbat,0,LT,pbat,UNKN,IF \
+  AREA:psur#00994455:'' \
+  LINE1:psur#009944FF:'Watt Surplus' \
+  AREA:pdef#99001F55:'' \
+  LINE1:pdef#99001FFF:'Watt Deficit' \
+  GPRINT:pbat:MIN:'Min\: %3.2lf %sW' \
+  GPRINT:pbat:MAX:'Max\: %3.2lf %sW' \
+  GPRINT:pbat:LAST:'Last\: %3.2lf %sW'
+fi
+
+##########################################################
+# Daily update of the 12-days and 12-months power tables.
+# pvpower reads the RRD once, and writes both htm files.
+# The ledger keeps the daily energy, only today and the
+# day before are calculated again from the RRD.
+##########################################################
+DAYHTMFILE="${GLOBALCFG[pi-web-html]}/$STATION/daypower.htm"
+MONHTMFILE="${GLOBALCFG[pi-web-html]}/$STATION/monpower.htm"
+LEDGER="${GLOBALCFG[pi-web-data]}/chroot/$STATION/rrd/solar.ledger"
+
+##########################################################
+# With the panel rating (e.g. pi-solar-pvrate=50W) and the
+# station position, pvpower adds the daily performance
+# ratio against the clear-sky model, and flags low days.
+##########################################################
+readconfig SOLARCFG < "$SOLARCONF"
+PVRATIO=""
+if [[ ${SOLARCFG[pi-solar-pvrate]} =~ ([0-9.]+)[[:space:]]*[Ww] ]] && \
+   [ -n "${LOCALCFG[pi-weather-lat]}" ] && [ -n "${LOCALCFG[pi-weather-lon]}" ]; then
+  PVRATIO="-g ${LOCALCFG[pi-weather-lat]},${LOCALCFG[pi-weather-lon]} -w ${BASH_REMATCH[1]}"
+fi
+
+if [ -f $DAYHTMFILE ]; then FILEAGE=$(date -r $DAYHTMFILE +%s); fi
+if [ ! -f $DAYHTMFILE ] || [ ! -f $MONHTMFILE ] || [[ "$FILEAGE" < "$midnight" ]]; then
+  echo -n "Creating $DAYHTMFILE $MONHTMFILE... "
+  $PVPOWER -s $RRD -l $LEDGER $PVRATIO -d $DAYHTMFILE -m $MONHTMFILE
+  echo " Done."
+fi
+
+unset TZ
+echo "solardaily.sh: End of script at `date`"
+##########################################################
+# End of solardaily.sh
+##########################################################
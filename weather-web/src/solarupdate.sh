@@ -51,7 +51,6 @@ fi
 echo "Using global cfg [$GLOBALCONFIG]"
 readconfig GLOBALCFG < "$GLOBALCONFIG"
 
-PVPOWER="${GLOBALCFG[pi-web-data]}/bin/pvpower"
 DAYTCALC="${GLOBALCFG[pi-web-data]}/bin/daytcalc"
 RRDTOOL="/usr/bin/rrdtool"
 
@@ -286,213 +285,12 @@ $RRDTOOL graph $PBALPNG -a PNG \
   GPRINT:pbat:LAST:'Last\: %3.2lf %sW'
 
 ##########################################################
-# Create the monthly graph images
+# The monthly/yearly graphs and the power table are made
+# once per day by solardaily.sh. With pi-web-jobsched=yes
+# the jobsched daemon runs it, staggered per station.
 ##########################################################
-MVPNLPNG=$IMGPATH/monthly_vpnl.png
-MVBATPNG=$IMGPATH/monthly_vbat.png
-MPBALPNG=$IMGPATH/monthly_pbal.png
-midnight=$(date -d "00:00" +%s)
-
-##########################################################
-# Check if monthly panel file has already
-# been updated today, otherwise generate.
-##########################################################
-if [ -f $MVPNLPNG ]; then FILEAGE=$(date -r $MVPNLPNG +%s); fi
-if [ ! -f $MVPNLPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
-  echo -n "Creating image $MVPNLPNG... "
-
-  # --------------------------------------- #
-  # --x-grid defines the x-axis spacing.    #
-  # format: GTM:GST:MTM:MST:LTM:LST:LPR:LFM #
-  # GTM:GST base grid (Unit:How Many)       #
-  # MTM:MST major grid (Unit:How Many)      #
-  # LTM:LST how often labels are placed     #
-  # --------------------------------------- #
-  $RRDTOOL graph $MVPNLPNG -a PNG \
-  --start end-21d --end 00:00 \
-  --x-grid HOUR:8:DAY:1:DAY:1:86400:%d \
-  --title='Panel Voltage, 3 Weeks' \
-  --width=619 \
-  --height=77 \
-  --border=1  \
-  --slope-mode \
-  --color SHADEA#000000 \
-  --color SHADEB#000000 \
-  DEF:opcs1=$RRD:opcs:AVERAGE \
-  DEF:vpnl1=$RRD:vpnl:AVERAGE \
-  AREA:vpnl1#00447755:'Volt Off' \
-  CDEF:v1=opcs1,0,GT,vpnl1,UNKN,IF \
-  AREA:v1#00447799:'Volt Charging' \
-  LINE1:vpnl1#004477FF:''  \
-  GPRINT:vpnl1:MIN:'Min\: %3.2lf %sV' \
-  GPRINT:vpnl1:MAX:'Max\: %3.2lf %sV' \
-  GPRINT:vpnl1:LAST:'Last\: %3.2lf %sV'
-fi
-
-##########################################################
-# Check if monthly battery file has already
-# been updated today, otherwise generate.
-##########################################################
-if [ -f $MVBATPNG ]; then FILEAGE=$(date -r $MVBATPNG +%s); fi
-if [ ! -f $MVBATPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
-  echo -n "Creating image $MVBATPNG... "
-
-  $RRDTOOL graph $MVBATPNG -a PNG \
-  --start end-21d --end 00:00 \
-  --title='Battery Voltage, 3 Weeks' \
-  --x-grid HOUR:8:DAY:1:DAY:1:86400:%d \
-  --alt-autoscale \
-  --lower-limit=12.0 \
-  --width=619 \
-  --height=77 \
-  --border=1  \
-  --slope-mode \
-  --color SHADEA#000000 \
-  --color SHADEB#000000 \
-  DEF:vbat1=$RRD:vbat:AVERAGE \
-  AREA:vbat1#99001F55:'' \
-  LINE1:vbat1#99001FFF:'Volt' \
-  GPRINT:vbat1:MIN:'Min\: %3.2lf V' \
-  GPRINT:vbat1:MAX:'Max\: %3.2lf V' \
-  GPRINT:vbat1:LAST:'Last\: %3.2lf V'
-fi
-
-##########################################################
-# Check if monthly power file has already
-# been updated today, otherwise generate.
-##########################################################
-if [ -f $MPBALPNG ]; then FILEAGE=$(date -r $MPBALPNG +%s); fi
-if [ ! -f $MPBALPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
-  echo -n "Creating image $MPBALPNG... "
-
-  $RRDTOOL graph $MPBALPNG -a PNG \
-  --start end-21d --end 00:00 \
-  --x-grid HOUR:8:DAY:1:DAY:1:86400:%d \
-  --title='Power Balance, 3 Weeks' \
-  --width=619 \
-  --height=77 \
-  --border=1  \
-  --slope-mode \
-  --color SHADEA#000000 \
-  --color SHADEB#000000 \
-  DEF:vb1=$RRD:vbat:AVERAGE \
-  DEF:ib1=$RRD:ibat:AVERAGE \
-  CDEF:pbat=vb1,ib1,* \
-  CDEF:psur=pbat,0,GE,pbat,UNKN,IF \
-  CDEF:pdef=pbat,0,LT,pbat,UNKN,IF \
-  AREA:psur#00994455:'' \
-  LINE1:psur#009944FF:'Watt Surplus' \
-  AREA:pdef#99001F55:'' \
-  LINE1:pdef#99001FFF:'Watt Deficit' \
-  GPRINT:pbat:MIN:'Min\: %3.2lf %sW' \
-  GPRINT:pbat:MAX:'Max\: %3.2lf %sW' \
-  GPRINT:pbat:LAST:'Last\: %3.2lf %sW'
-fi
-
-##########################################################
-# Create the yearly graph images
-##########################################################
-YVPNLPNG=$IMGPATH/yearly_vpnl.png
-YVBATPNG=$IMGPATH/yearly_vbat.png
-YPBALPNG=$IMGPATH/yearly_pbal.png
-
-##########################################################
-# Check if yearly VPNL file has already
-# been updated today, otherwise generate
-##########################################################
-if [ -f $YVPNLPNG ]; then FILEAGE=$(date -r $YVPNLPNG +%s); fi
-if [ ! -f $YVPNLPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
-  echo -n "Creating image $YVPNLPNG... "
-
-  $RRDTOOL graph $YVPNLPNG -a PNG \
-  --start end-18mon --end 00:00 \
-  --x-grid MONTH:1:YEAR:1:MONTH:1:2592000:%b \
-  --title='Panel Voltage, Yearly View' \
-  --width=619 \
-  --height=77 \
-  --border=1  \
-  --slope-mode \
-  --color SHADEA#000000 \
-  --color SHADEB#000000 \
-  DEF:vpnl1=$RRD:vpnl:AVERAGE \
-  AREA:vpnl1#00447799:'' \
-  LINE1:vpnl1#004477FF:'Volt'  \
-  GPRINT:vpnl1:MIN:'Min\: %3.2lf %sV' \
-  GPRINT:vpnl1:MAX:'Max\: %3.2lf %sV' \
-  GPRINT:vpnl1:LAST:'Last\: %3.2lf %sV'
-fi
-
-##########################################################
-# Check if yearly VBAT file has already
-# been updated today, otherwise generate
-##########################################################
-if [ -f $YVBATPNG ]; then FILEAGE=$(date -r $YVBATPNG +%s); fi
-if [ ! -f $YVBATPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
-  echo -n "Creating image $YVBATPNG... "
-
-  $RRDTOOL graph $YVBATPNG -a PNG \
-  --start end-18mon --end 00:00 \
-  --x-grid MONTH:1:YEAR:1:MONTH:1:2592000:%b \
-  --title='Battery Voltage, Yearly View' \
-  --alt-autoscale \
-  --lower-limit=11.0 \
-  --left-axis-format "%2.1lf" \
-  --width=619 \
-  --height=77 \
-  --border=1  \
-  --slope-mode \
-  --color SHADEA#000000 \
-  --color SHADEB#000000 \
-  DEF:vbat1=$RRD:vbat:AVERAGE \
-  AREA:vbat1#99001F55:'' \
-  LINE1:vbat1#99001FFF:'Volt' \
-  GPRINT:vbat1:MIN:'Min\: %3.2lf V' \
-  GPRINT:vbat1:MAX:'Max\: %3.2lf V' \
-  GPRINT:vbat1:LAST:'Last\: %3.2lf V'
-fi
-
-##########################################################
-# Check if yearly power file has already
-# been updated today, otherwise generate
-##########################################################
-if [ -f $YPBALPNG ]; then FILEAGE=$(date -r $YPBALPNG +%s); fi
-if [ ! -f $YPBALPNG ] || [[ "$FILEAGE" < "$midnight" ]]; then
-  echo -n "Creating image $YLOADPNG... "
-
-  $RRDTOOL graph $YPBALPNG -a PNG \
-  --start end-18mon --end 00:00 \
-  --x-grid MONTH:1:YEAR:1:MONTH:1:2592000:%b \
-  --title='Power Balance, Yearly View' \
-  --width=619 \
-  --height=77 \
-  --border=1  \
-  --slope-mode \
-  --color SHADEA#000000 \
-  --color SHADEB#000000 \
-  DEF:vb1=$RRD:vbat:AVERAGE \
-  DEF:ib1=$RRD:ibat:AVERAGE \
-  CDEF:pbat=vb1,ib1,* \
-  CDEF:psur=pbat,0,GE,pbat,UNKN,IF \
-  CDEF:pdef=pbat,0,LT,pbat,UNKN,IF \
-  AREA:psur#00994455:'' \
-  LINE1:psur#009944FF:'Watt Surplus' \
-  AREA:pdef#99001F55:'' \
-  LINE1:pdef#99001FFF:'Watt Deficit' \
-  GPRINT:pbat:MIN:'Min\: %3.2lf %sW' \
-  GPRINT:pbat:MAX:'Max\: %3.2lf %sW' \
-  GPRINT:pbat:LAST:'Last\: %3.2lf %sW'
-fi
-
-##########################################################
-# Daily update of the 12-days power generation htm file
-##########################################################
-DAYHTMFILE="${GLOBALCFG[pi-web-html]}/$STATION/daypower.htm"
-
-if [ -f $DAYHTMFILE ]; then FILEAGE=$(date -r $DAYHTMFILE +%s); fi
-if [ ! -f $DAYHTMFILE ] || [[ "$FILEAGE" < "$midnight" ]]; then
-  echo -n "Creating $DAYHTMFILE... "
-  $PVPOWER -s $RRD -d $DAYHTMFILE
-  echo " Done."
+if [[ ${GLOBALCFG[pi-web-jobsched]} != "yes" ]]; then
+   $SCRIPTPATH/solardaily.sh $STATION
 fi
 
 unset TZ
@@ -0,0 +1,66 @@
+/* ------------------------------------------------------------ *
+ * file:        wsframe.h                                       *
+ * purpose:     Binary sensor frame, written by getsensor -f on *
+ *              the station, and decoded by wsingest on the web *
+ *              server into RRD updates. One frame is 48 bytes: *
+ *                                                              *
+ *              magic "PWSF", version, ds count, flags,         *
+ *              station ID, timestamp, ds values as float, and  *
+ *              the CRC32 of the frame bytes before the CRC.    *
+ *                                                              *
+ *              Frames are appended to one file, so a station   *
+ *              that was offline sends its backlog in a single  *
+ *              upload. A broken frame is skipped by its CRC.   *
+ *              All values are stored in little endian byte     *
+ *              order (Raspberry Pi).                           *
+ *              Keep in sync with the copy in weather-station.  *
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ * ------------------------------------------------------------ */
+#include <stdint.h>
+#include <stddef.h>
+
+#define WSF_MAGIC     0x46535750    // "PWSF" frame magic
+#define WSF_VERSION   1
+#define WSF_MAXDS     4             // temp, humi, bmpr, (reserved)
+#define WSF_SIDSIZE   8             // station ID, e.g. "pi-ws01"
+
+#define WSF_F_BME280  0x0001        // values from a BME280 sensor
+#define WSF_F_AM2302  0x0002        // values from a AM2302 + BMP180
+#define WSF_F_CALIB   0x0004        // calibration offsets are applied
+
+typedef struct {
+  uint32_t magic;                   // WSF_MAGIC
+  uint8_t version;                  // WSF_VERSION
+  uint8_t ds_cnt;                   // number of used values
+  uint16_t flags;                   // WSF_F_* flags
+  char station[WSF_SIDSIZE];        // station ID, NUL padded
+  int64_t tstamp;                   // reading time, seconds since epoch
+  float value[WSF_MAXDS];           // temp (C), humi (%), bmpr (Pa)
+  uint32_t crc;                     // CRC32 of the bytes above
+  uint32_t reserved;
+} wsf_frame_t;
+
+/* ------------------------------------------------------------ *
+ * wsf_crc32() updates a CRC32 (IEEE 802.3) over len bytes      *
+ * ------------------------------------------------------------ */
+static inline uint32_t wsf_crc32(uint32_t crc, const void *data, size_t len) {
+  const unsigned char *p = data;
+  int k;
+  crc = ~crc;
+  while(len--) {
+    crc ^= *p++;
+    for(k=0; k<8; k++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+/* ------------------------------------------------------------ *
+ * wsf_check() returns 0 if the frame is valid, -1 if not       *
+ * ------------------------------------------------------------ */
+static inline int wsf_check(const wsf_frame_t *f) {
+  if(f->magic != WSF_MAGIC || f->version != WSF_VERSION) return -1;
+  if(f->ds_cnt == 0 || f->ds_cnt > WSF_MAXDS) return -1;
+  if(f->station[WSF_SIDSIZE-1] != '\0') return -1;
+  return (wsf_crc32(0, f, offsetof(wsf_frame_t, crc)) == f->crc) ? 0 : -1;
+}
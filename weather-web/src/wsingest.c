@@ -0,0 +1,828 @@
+/* ------------------------------------------------------------ *
+ * file:        wsingest.c                                      *
+ * purpose:     Decode the binary sensor frames uploaded by the *
+ *              station (getsensor -f, see wsframe.h) straight  *
+ *              into RRD updates. All frame files found in the  *
+ *              stations var folder are read, the frames sorted *
+ *              by time, and the ones newer than the RRD last   *
+ *              update are written in one batch update, so the  *
+ *              backlog after a network outage is not lost. The *
+ *              daytime DS is calculated per frame, same as     *
+ *              daytcalc does it, in the station timezone.      *
+ *                                                              *
+ *              With -d it runs as daemon for all stations. It  *
+ *              watches the var folders with inotify, and hands *
+ *              the stations with new uploads to a pool of one  *
+ *              worker thread per CPU. Stations whose data just *
+ *              arrived go before the periodic rescan of the    *
+ *              others, which catches anything inotify missed.  *
+ *              The station UTC offsets are looked up per day   *
+ *              while no worker runs, they never change TZ. The *
+ *              daemon reloads the stations and their offsets   *
+ *              each day, on SIGHUP, and when a station folder  *
+ *              is added under chroot.                          *
+ *                                                              *
+ * return:      Returns 0 if new frames were written to the RRD *
+ *              1 if there were no new frames, -1 on errors.    *
+ *              In daemon mode, returns 0 after SIGTERM.        *
+ *                                                              *
+ * RRD API:     http://oss.oetiker.ch/rrdtool/doc/librrd.en.html*
+ *                                                              *
+ * author:      20261019 Frank4DD                               *
+ *                                                              *
+ * compile: gcc wsingest.c -o wsingest -lrrd -lm -lpthread      *
+ * ------------------------------------------------------------ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <math.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <rrd.h>
+#include <rrd_client.h>
+#include "wsframe.h"
+
+/* ------------------------------------------------------------ *
+ * Max number of config file entries, and their key/value size  *
+ * ------------------------------------------------------------ */
+#define MAXCONF    64
+#define MAXCLEN    256
+/* ------------------------------------------------------------ *
+ * Sunrise/sunset calculation, same values as in daytcalc.c     *
+ * ------------------------------------------------------------ */
+#define PI 3.141592
+#define ZENITH -.83
+/* ------------------------------------------------------------ *
+ * Daemon mode: max stations, max workers, and the rescan time  *
+ * in seconds for stations without inotify events.              *
+ * ------------------------------------------------------------ */
+#define MAXSTATION 128
+#define MAXWORKER  32
+#define RESCAN     60
+#define TZBACK     31                 // tz table days before start
+#define TZDAYS     64                 // tz table days, reloaded daily
+
+/* ------------------------------------------------------------ *
+ * Global variables and defaults                                *
+ * ------------------------------------------------------------ */
+int verbose = 0;
+char conf_key[MAXCONF][MAXCLEN];      // the config file keys
+char conf_val[MAXCONF][MAXCLEN];      // the config file values
+int conf_cnt = 0;                     // the number of config entries
+char stname[32];                      // the station name, e.g. pi-ws01
+int dmode = 0;                        // 1 = run as daemon for all stations
+int workers = 0;                      // worker threads, 0 = one per CPU
+volatile sig_atomic_t stop = 0;       // set by SIGTERM/SIGINT
+volatile sig_atomic_t reload = 0;     // set by SIGHUP
+pthread_mutex_t rclock = PTHREAD_MUTEX_INITIALIZER;  // guards rrdc_*
+extern char *optarg;
+extern int optind, opterr, optopt;
+
+/* ------------------------------------------------------------ *
+ * The station data we need for decoding its frames             *
+ * ------------------------------------------------------------ */
+typedef struct {
+   char name[32];                     // the station name, e.g. pi-ws01
+   char rrdfile[MAXCLEN*3];           // the stations RRD file and path
+   char vardir[MAXCLEN*3];            // the stations upload folder
+   char tzs[MAXCLEN];                 // the stations timezone string
+   char logdir[MAXCLEN*3];            // the stations log folder
+   float latitude;                    // the stations position for the
+   float longitude;                   // daytime calculation
+   time_t tzday0;                     // UTC start day of tzoff[0]
+   int tzoff[TZDAYS];                 // UTC offset in s, at noon/day
+   int queued;                        // daemon queue state, protected
+   int urgent;                        // by qlock: queued, new data,
+   int busy;                          // a worker has it, and the
+   unsigned long seq;                 // queue order
+} station_t;
+
+/* ------------------------------------------------------------ *
+ * The daemon station list and its work queue                   *
+ * ------------------------------------------------------------ */
+station_t stations[MAXSTATION];
+int st_cnt = 0;
+unsigned long qseq = 0;
+pthread_mutex_t qlock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t qcond = PTHREAD_COND_INITIALIZER;
+int hold = 0;                         // 1 = no new work, stations reload
+time_t loadday = 0;                   // the UTC day the stations loaded
+time_t chroot_mtime = 0;              // the chroot folder time at load
+const char *rrdcd = NULL;             // the rrdcombd address, or NULL
+
+/* ------------------------------------------------------------ *
+ * print_usage() prints the programs commandline instructions.  *
+ * ------------------------------------------------------------ */
+void usage() {
+   static char const usage[] = "Usage: wsingest -s [station] | -d [-n workers] [-v]\n\
+   Command line parameters have the following format:\n\
+   -s   station name, frames are read from <pi-web-data>/chroot/<station>/var\n\
+   -d   run as daemon for all stations under <pi-web-data>/chroot\n\
+        kill -HUP reloads the stations, e.g. after adding a station\n\
+   -n   optional, number of worker threads with -d, default: one per CPU\n\
+   -h   optional, display this message\n\
+   -v   optional, enables debug output\n\
+   Usage examples:\n\
+./wsingest -s pi-ws01\n\
+./wsingest -d -n 4\n";
+   printf(usage);
+}
+
+/* ------------------------------------------------------------ *
+ * valid_station() returns 1 if name has the pi-wsXX format     *
+ * ------------------------------------------------------------ */
+int valid_station(const char *name) {
+   return (strncmp(name, "pi-ws", 5) == 0 && strlen(name) == 7
+           && isdigit(name[5]) && isdigit(name[6]));
+}
+
+/* ------------------------------------------------------------ *
+ * parseargs() checks the commandline arguments with C getopt   *
+ * ------------------------------------------------------------ */
+void parseargs(int argc, char* argv[]) {
+   int arg;
+   opterr = 0;
+
+   if(argc == 1) {
+      usage();
+      exit(-1);
+   }
+
+   while ((arg = (int) getopt (argc, argv, "s:dn:vh")) != -1)
+      switch (arg) {
+         // arg -s + station name, type: string
+         // mandatory, example: pi-ws01
+         case 's':
+            if(verbose == 1) printf("Debug: arg -s, value %s\n", optarg);
+            snprintf(stname, sizeof(stname), "%s", optarg);
+            break;
+
+         // arg -d daemon mode, type: flag
+         case 'd':
+            dmode = 1; break;
+
+         // arg -n + worker threads, type: int
+         // optional, example: 4
+         case 'n':
+            if(verbose == 1) printf("Debug: arg -n, value %s\n", optarg);
+            workers = atoi(optarg);
+            if(workers < 1 || workers > MAXWORKER) {
+               printf("Error: Cannot get valid -n worker argument (1..%d).\n", MAXWORKER);
+               exit(-1);
+            }
+            break;
+
+         // arg -v verbose, type: flag, optional
+         case 'v':
+            verbose = 1; break;
+
+         // arg -h usage, type: flag, optional
+         case 'h':
+            usage(); exit(0);
+
+         case '?':
+            if (isprint (optopt))
+               printf ("Error: Unknown option `-%c'.\n", optopt);
+            else
+               printf ("Error: Unknown option character `\\x%x'.\n", optopt);
+
+         default:
+            usage(); exit(-1);
+    }
+    if (dmode == 1 && strlen(stname) > 0) {
+       printf("Error: Use either -s station, or -d for all stations.\n");
+       exit(-1);
+    }
+    if (dmode == 0 && ! valid_station(stname)) {
+       printf("Error: Cannot get valid -s station argument, expecting pi-wsXX.\n");
+       exit(-1);
+    }
+}
+
+/* ------------------------------------------------------------ *
+ * readconfig() loads the key=value lines of a config file.     *
+ * Lines starting with # are comments, quotes are stripped.     *
+ * ------------------------------------------------------------ */
+int readconfig(const char *file) {
+   FILE *fp;
+   char line[MAXCLEN];
+
+   if(! (fp=fopen(file, "r"))) return -1;
+
+   while(fgets(line, sizeof(line), fp) != NULL && conf_cnt < MAXCONF) {
+      if(line[0] == '#') continue;
+      char *val = strchr(line, '=');
+      if(val == NULL || val == line) continue;
+      *val++ = '\0';
+      val[strcspn(val, "\r\n")] = '\0';
+      size_t vlen = strlen(val);
+      if(vlen >= 2 && val[0] == '"' && val[vlen-1] == '"') {
+         val[vlen-1] = '\0';
+         val++;
+      }
+      if(strlen(val) == 0) continue;
+      snprintf(conf_key[conf_cnt], MAXCLEN, "%s", line);
+      snprintf(conf_val[conf_cnt], MAXCLEN, "%s", val);
+      conf_cnt++;
+   }
+   fclose(fp);
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * getconfig() returns the value for key, or NULL if not found  *
+ * ------------------------------------------------------------ */
+const char *getconfig(const char *key) {
+   int i;
+   for(i=0; i<conf_cnt; i++)
+      if(strcmp(conf_key[i], key) == 0) return conf_val[i];
+   return NULL;
+}
+
+/* ------------------------------------------------------------ *
+ * load_station() fills st from the station config file. The    *
+ * station entries are dropped again after reading, so that the *
+ * global config stays valid for the next station.              *
+ * ------------------------------------------------------------ */
+int load_station(const char *datadir, const char *name, station_t *st) {
+   char file[MAXCLEN*4];
+   const char *val;
+   struct stat sb;
+   int globals = conf_cnt, i;
+
+   memset(st, 0, sizeof(station_t));
+   snprintf(st->name, sizeof(st->name), "%s", name);
+   snprintf(st->rrdfile, sizeof(st->rrdfile), "%s/chroot/%s/rrd/%s.rrd", datadir, name, name);
+   snprintf(st->vardir, sizeof(st->vardir), "%s/chroot/%s/var", datadir, name);
+   snprintf(st->logdir, sizeof(st->logdir), "%s/chroot/%s/log", datadir, name);
+   snprintf(file, sizeof(file), "%s/chroot/%s/etc/%s.conf", datadir, name, name);
+   if(stat(st->rrdfile, &sb) != 0 || readconfig(file) != 0) return -1;
+
+   if((val = getconfig("pi-weather-tzs")) != NULL)
+      snprintf(st->tzs, sizeof(st->tzs), "%s", val);
+   if((val = getconfig("pi-weather-lat")) != NULL) st->latitude = strtof(val, NULL);
+   if((val = getconfig("pi-weather-lon")) != NULL) st->longitude = strtof(val, NULL);
+   conf_cnt = globals;
+
+   /* ------------------------------------------------------------ *
+    * TZ is process wide, and librrd reads the environment. It is  *
+    * only set here, before any worker runs, to get the station    *
+    * UTC offset for each day from TZBACK days ago up to TZDAYS.   *
+    * ------------------------------------------------------------ */
+   char *oldtz = getenv("TZ") ? strdup(getenv("TZ")) : NULL;
+   if(strlen(st->tzs) > 0) setenv("TZ", st->tzs, 1);
+   else unsetenv("TZ");
+   tzset();
+   st->tzday0 = (time(NULL) / 86400 - TZBACK) * 86400;
+   for(i=0; i<TZDAYS; i++) {
+      struct tm lt;
+      time_t noon = st->tzday0 + i * 86400 + 43200;
+      localtime_r(&noon, &lt);
+      st->tzoff[i] = lt.tm_gmtoff;
+   }
+   if(oldtz != NULL) setenv("TZ", oldtz, 1);
+   else unsetenv("TZ");
+   tzset();
+   free(oldtz);
+
+   if(verbose == 1) printf("Debug: station %s tz [%s] offset [%d] lat [%f] lon [%f]\n",
+                           st->name, st->tzs, st->tzoff[TZBACK], st->latitude, st->longitude);
+   return 0;
+}
+
+/* ------------------------------------------------------------ *
+ * sun_event() is calculateSunrise()/calculateSunset() from     *
+ * daytcalc.c, returns the local time in hours. rising=1 gets   *
+ * the sunrise, rising=0 the sunset.                            *
+ * ------------------------------------------------------------ */
+float sun_event(int day, float lat, float lng, int rising, long tzoffset) {
+   float lngHour = lng / 15.0;
+   float t = day + (((rising ? 6 : 18) - lngHour) / 24);
+   float M = (0.9856 * t) - 3.289;
+   float L = fmod(M + (1.916 * sin((PI/180)*M)) + (0.020 * sin(2 *(PI/180) * M)) + 282.634,360.0);
+   float RA = fmod(180/PI*atan(0.91764 * tan((PI/180)*L)),360.0);
+   float Lquadrant  = floor( L/90) * 90;
+   float RAquadrant = floor(RA/90) * 90;
+   RA = RA + (Lquadrant - RAquadrant);
+   RA = RA / 15;
+   float sinDec = 0.39782 * sin((PI/180)*L);
+   float cosDec = cos(asin(sinDec));
+   float cosH = (sin((PI/180)*ZENITH) - (sinDec * sin((PI/180)*lat))) / (cosDec * cos((PI/180)*lat));
+   float H = (180/PI)*acos(cosH);
+   if(rising) H = 360 - H;
+   H = H / 15;
+   float T = H + RA - (0.06571 * t) - 6.622;
+   float UT = fmod(T - lngHour,24.0);
+   UT = UT + (((float) tzoffset)/3600);
+   return UT;
+}
+
+/* ------------------------------------------------------------ *
+ * get_dayt() returns 1 for nighttime, 0 for daytime at ts. The *
+ * tzoffset is the station timezone offset at ts, in seconds.   *
+ * ------------------------------------------------------------ */
+int get_dayt(const station_t *st, time_t ts, long tzoffset) {
+   struct tm ev[2];
+   double hr, min;
+   int i;
+
+   time_t ttz = ts + tzoffset;
+   struct tm calc_tm;
+   gmtime_r(&ttz, &calc_tm);
+
+   for(i=0; i<2; i++) {
+      float ut = sun_event(calc_tm.tm_yday+1, st->latitude, st->longitude, i == 0, tzoffset);
+      min = modf(fmod(24+ut,24.0), &hr)*60;
+      memset(&ev[i], 0, sizeof(struct tm));
+      ev[i].tm_year = calc_tm.tm_year;
+      ev[i].tm_mon = calc_tm.tm_mon;
+      ev[i].tm_mday = calc_tm.tm_mday;
+      ev[i].tm_hour = (int) hr;
+      ev[i].tm_min = (int) (min+0.5);
+   }
+   return (ttz < timegm(&ev[0]) || ttz > timegm(&ev[1])) ? 1 : 0;
+}
+
+/* ------------------------------------------------------------ *
+ * cmp_frame() sorts frames by their timestamp for qsort()      *
+ * ------------------------------------------------------------ */
+int cmp_frame(const void *a, const void *b) {
+   int64_t ta = ((const wsf_frame_t *) a)->tstamp;
+   int64_t tb = ((const wsf_frame_t *) b)->tstamp;
+   return (ta > tb) - (ta < tb);
+}
+
+/* ------------------------------------------------------------ *
+ * read_frames() appends the valid frames of file to *frames.   *
+ * Frames with a bad CRC, or from another station are skipped.  *
+ * Returns the number of skipped frames, or -1 on read errors.  *
+ * ------------------------------------------------------------ */
+int read_frames(const char *file, const char *name, wsf_frame_t **frames, int *cnt, int *max) {
+   wsf_frame_t f;
+   ssize_t len;
+   int bad = 0;
+
+   int fd = open(file, O_RDONLY);
+   if(fd == -1) return -1;
+   while((len = read(fd, &f, sizeof(f))) == sizeof(f)) {
+      if(wsf_check(&f) != 0 || f.ds_cnt < 3 || strcmp(f.station, name) != 0) {
+         bad++;
+         continue;
+      }
+      if(*cnt == *max) {
+         int newmax = (*max == 0) ? 256 : *max * 2;
+         wsf_frame_t *tmp = realloc(*frames, newmax * sizeof(wsf_frame_t));
+         if(tmp == NULL) { close(fd); return -1; }
+         *frames = tmp;
+         *max = newmax;
+      }
+      (*frames)[(*cnt)++] = f;
+   }
+   close(fd);
+   if(len != 0) bad++;          // a partial frame at the end
+   return bad;
+}
+
+/* ------------------------------------------------------------ *
+ * tz_offset() returns the station UTC offset for the day of ts *
+ * from the table. Days outside of it use the nearest entry, an *
+ * hour off only moves the daytime calculation by one day when  *
+ * ts is close to midnight, the sun times hardly change.        *
+ * ------------------------------------------------------------ */
+long tz_offset(const station_t *st, time_t ts) {
+   long day = (ts - st->tzday0) / 86400;
+   if(ts < st->tzday0) day = 0;
+   if(day >= TZDAYS) day = TZDAYS - 1;
+   return st->tzoff[day];
+}
+
+/* ------------------------------------------------------------ *
+ * log_outage() writes the outage.log line and the resync.tag   *
+ * the same way rrdupdate.sh does it for sensor.txt updates.    *
+ * ------------------------------------------------------------ */
+void log_outage(const station_t *st, time_t gap) {
+   char file[MAXCLEN*4], date[64];
+   long off = tz_offset(st, time(NULL));
+   time_t now = time(NULL) + off;
+   struct tm lt;
+   FILE *fp;
+
+   printf("wsingest: %s: recovered from approx. %lld seconds network outage.\n", st->name, (long long) gap);
+   gmtime_r(&now, &lt);
+   lt.tm_gmtoff = off;
+   strftime(date, sizeof(date), "%a %b %e %H:%M:%S %z %Y", &lt);
+   snprintf(file, sizeof(file), "%s/outage.log", st->logdir);
+   if((fp = fopen(file, "a")) != NULL) {
+      fprintf(fp, "%s: Recovered from approx. %lld seconds network outage.\n", date, (long long) gap);
+      fclose(fp);
+   }
+   snprintf(file, sizeof(file), "%s/resync.tag", st->logdir);
+   if((fp = fopen(file, "a")) != NULL) fclose(fp);
+}
+
+/* ------------------------------------------------------------ *
+ * ingest_station() writes all new frames of station st into    *
+ * its RRD, and removes the processed frame files. The update   *
+ * goes through rrdcombd if daemon is set. Returns 0 if frames  *
+ * were written, 1 if there was nothing new, and -1 on errors.  *
+ * ------------------------------------------------------------ */
+int ingest_station(const station_t *st, const char *daemon) {
+   char file[MAXCLEN*4];
+   char (*done)[MAXCLEN] = NULL;
+   wsf_frame_t *frames = NULL;
+   int cnt = 0, max = 0, files = 0, bad = 0, ret = 1;
+   int i, n;
+   struct dirent *de;
+
+   /* ------------------------------------------------------------ *
+    * Collect the frames from all finished *.wsf uploads. Partial  *
+    * uploads are named *.wsf.tmp and skipped until renamed.       *
+    * ------------------------------------------------------------ */
+   DIR *dir = opendir(st->vardir);
+   if(dir == NULL) {
+      printf("Error: cannot open %s.\n", st->vardir);
+      return -1;
+   }
+   while((de = readdir(dir)) != NULL) {
+      size_t nlen = strlen(de->d_name);
+      if(nlen < 5 || strcmp(de->d_name + nlen - 4, ".wsf") != 0) continue;
+      snprintf(file, sizeof(file), "%s/%s", st->vardir, de->d_name);
+      int skip = read_frames(file, st->name, &frames, &cnt, &max);
+      if(skip < 0) {
+         printf("Error: cannot read frames from %s.\n", file);
+         continue;
+      }
+      if(verbose == 1) printf("Debug: %s: %d frames total, %d skipped\n", file, cnt, skip);
+      bad += skip;
+      char (*tmp)[MAXCLEN] = realloc(done, (files+1) * sizeof(*done));
+      if(tmp == NULL) break;
+      done = tmp;
+      snprintf(done[files++], MAXCLEN, "%s", de->d_name);
+   }
+   closedir(dir);
+   if(files == 0) return 1;
+
+   /* ------------------------------------------------------------ *
+    * Sort the frames, and drop the ones the RRD already has, plus *
+    * duplicates from uploads that were repeated after an outage.  *
+    * ------------------------------------------------------------ */
+   qsort(frames, cnt, sizeof(wsf_frame_t), cmp_frame);
+   time_t last;
+   if(daemon != NULL) {
+      /* rrdcombd answers LAST from its queue, no flush needed */
+      pthread_mutex_lock(&rclock);
+      last = (rrdc_connect(daemon) == 0) ? rrdc_last(st->rrdfile) : -1;
+      pthread_mutex_unlock(&rclock);
+   }
+   else last = rrd_last_r(st->rrdfile);
+   if(last < 0) {
+      printf("Error: cannot get last update of %s: %s\n", st->rrdfile, rrd_get_error());
+      rrd_clear_error();
+      free(frames); free(done);
+      return -1;
+   }
+
+   char **values = malloc((cnt > 0 ? cnt : 1) * sizeof(char *));
+   char *vbuf = malloc((cnt > 0 ? cnt : 1) * 64);
+   if(values == NULL || vbuf == NULL) {
+      printf("Error: cannot allocate %d update values.\n", cnt);
+      exit(-1);
+   }
+
+   /* ------------------------------------------------------------ *
+    * The daytime DS needs the station local time of each frame,   *
+    * the UTC offset comes from the station table, not from TZ.    *
+    * ------------------------------------------------------------ */
+   time_t prev = last, first = 0;
+
+   n = 0;
+   for(i=0; i<cnt; i++) {
+      time_t ts = (time_t) frames[i].tstamp;
+      if(ts <= last) continue;
+      last = ts;
+      if(n == 0) first = ts;
+      values[n] = vbuf + n * 64;
+      snprintf(values[n], 64, "%lld:%.2f:%.2f:%.2f:%d", (long long) ts, frames[i].value[0],
+               frames[i].value[1], frames[i].value[2], get_dayt(st, ts, tz_offset(st, ts)));
+      if(verbose == 1) printf("Debug: update %s %s\n", st->rrdfile, values[n]);
+      n++;
+   }
+
+   /* ------------------------------------------------------------ *
+    * One update call for the whole backlog, through rrdcombd it   *
+    * is queued as a single batch for the file.                    *
+    * ------------------------------------------------------------ */
+   if(n > 0) {
+      int err;
+      if(daemon != NULL) {
+         pthread_mutex_lock(&rclock);
+         err = rrdc_connect(daemon);
+         if(err == 0) err = rrdc_update(st->rrdfile, n, (const char * const *) values);
+         pthread_mutex_unlock(&rclock);
+      }
+      else err = rrd_update_r(st->rrdfile, NULL, n, (const char **) values);
+      if(err != 0) {
+         printf("Error: cannot update %s: %s\n", st->rrdfile, rrd_get_error());
+         rrd_clear_error();
+         ret = -1;
+      }
+      else ret = 0;
+   }
+
+   /* ------------------------------------------------------------ *
+    * In daemon mode, rrdupdate.sh no longer sees the gap between  *
+    * the RRD and the new data, so we write its outage log here.   *
+    * ------------------------------------------------------------ */
+   if(ret == 0 && dmode == 1 && prev > 0 && first - prev > 90)
+      log_outage(st, first - prev);
+
+   /* ------------------------------------------------------------ *
+    * Remove the processed files, unless the update failed, then   *
+    * the next run tries again with the same frames.               *
+    * ------------------------------------------------------------ */
+   if(ret != -1) {
+      for(i=0; i<files; i++) {
+         snprintf(file, sizeof(file), "%s/%s", st->vardir, done[i]);
+         unlink(file);
+      }
+      printf("wsingest: %s: %d frames in %d files, %d written, %d old, %d invalid\n",
+             st->name, cnt, files, n, cnt - n, bad);
+   }
+   free(values); free(vbuf); free(frames); free(done);
+   return ret;
+}
+
+/* ------------------------------------------------------------ *
+ * enqueue() queues station i for a worker. urgent=1 is for new *
+ * data from inotify, it goes before the rescan entries. If a   *
+ * worker has the station already, it is queued again so that   *
+ * the new file is not missed.                                  *
+ * ------------------------------------------------------------ */
+void enqueue(int i, int urgent) {
+   pthread_mutex_lock(&qlock);
+   station_t *st = &stations[i];
+   if(st->queued == 0) st->seq = qseq++;
+   st->queued = 1;
+   if(urgent) st->urgent = 1;
+   pthread_cond_signal(&qcond);
+   pthread_mutex_unlock(&qlock);
+}
+
+/* ------------------------------------------------------------ *
+ * dequeue() waits for the next queued station that no worker   *
+ * has: urgent ones first, then in queue order. Returns -1 when *
+ * the daemon stops.                                            *
+ * ------------------------------------------------------------ */
+int dequeue() {
+   int i, next;
+   pthread_mutex_lock(&qlock);
+   for(;;) {
+      next = -1;
+      if(stop) break;
+      for(i=0; i<st_cnt && hold == 0; i++) {
+         station_t *st = &stations[i];
+         if(st->queued == 0 || st->busy == 1) continue;
+         if(next == -1 || st->urgent > stations[next].urgent
+            || (st->urgent == stations[next].urgent && st->seq < stations[next].seq)) next = i;
+      }
+      if(next != -1) break;
+      pthread_cond_wait(&qcond, &qlock);
+   }
+   if(next != -1) {
+      stations[next].queued = 0;
+      stations[next].urgent = 0;
+      stations[next].busy = 1;
+   }
+   pthread_mutex_unlock(&qlock);
+   return next;
+}
+
+/* ------------------------------------------------------------ *
+ * worker() is the worker thread, it ingests queued stations    *
+ * ------------------------------------------------------------ */
+void *worker(void *arg) {
+   int i;
+   while((i = dequeue()) != -1) {
+      struct timespec t0, t1;
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      int ret = ingest_station(&stations[i], rrdcd);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      if(verbose == 1) printf("Debug: %s: worker %ld done in %.1f ms, return %d\n", stations[i].name, (long) arg,
+                              (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6, ret);
+      fflush(stdout);
+      pthread_mutex_lock(&qlock);
+      stations[i].busy = 0;
+      pthread_cond_broadcast(&qcond);
+      pthread_mutex_unlock(&qlock);
+   }
+   return NULL;
+}
+
+/* ------------------------------------------------------------ *
+ * sighandler() lets the daemon main loop stop the workers      *
+ * ------------------------------------------------------------ */
+void sighandler(int sig) {
+   if(sig == SIGHUP) reload = 1;
+   else stop = 1;
+}
+
+/* ------------------------------------------------------------ *
+ * load_stations() loads the pi-wsXX folders with config and    *
+ * RRD under chroot, and sets their inotify watches. It is also *
+ * the only place that changes TZ, so the caller makes sure no  *
+ * worker runs. Returns the number of stations.                 *
+ * ------------------------------------------------------------ */
+int load_stations(const char *datadir, int ifd, int *wd) {
+   char path[MAXCLEN*2];
+   struct dirent *de;
+   struct stat sb;
+   int i;
+
+   for(i=0; i<st_cnt; i++) if(wd[i] != -1) inotify_rm_watch(ifd, wd[i]);
+   st_cnt = 0;
+   snprintf(path, sizeof(path), "%s/chroot", datadir);
+   if(stat(path, &sb) == 0) chroot_mtime = sb.st_mtime;
+   loadday = time(NULL) / 86400;
+
+   DIR *dir = opendir(path);
+   if(dir == NULL) {
+      printf("Error: cannot open %s.\n", path);
+      return 0;
+   }
+   while((de = readdir(dir)) != NULL && st_cnt < MAXSTATION) {
+      if(! valid_station(de->d_name)) continue;
+      if(load_station(datadir, de->d_name, &stations[st_cnt]) != 0) {
+         printf("wsingest: skip %s, cannot find its RRD or config.\n", de->d_name);
+         continue;
+      }
+      st_cnt++;
+   }
+   closedir(dir);
+
+   for(i=0; i<st_cnt; i++) {
+      wd[i] = inotify_add_watch(ifd, stations[i].vardir, IN_MOVED_TO | IN_CLOSE_WRITE);
+      if(wd[i] == -1) printf("wsingest: cannot watch %s, rescan only.\n", stations[i].vardir);
+   }
+   return st_cnt;
+}
+
+/* ------------------------------------------------------------ *
+ * run_daemon() loads all stations under chroot, watches their  *
+ * var folders and feeds the worker pool until SIGTERM/SIGINT.  *
+ * ------------------------------------------------------------ */
+void run_daemon(const char *datadir) {
+   char path[MAXCLEN*2];
+   int wd[MAXSTATION];
+   pthread_t tid[MAXWORKER];
+   struct stat sb;
+   int i;
+
+   /* ------------------------------------------------------------ *
+    * The stations are the pi-wsXX folders with config and RRD     *
+    * ------------------------------------------------------------ */
+   int ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if(ifd == -1) {
+      printf("Error: cannot initialize inotify.\n");
+      exit(-1);
+   }
+   snprintf(path, sizeof(path), "%s/chroot", datadir);
+   if(load_stations(datadir, ifd, wd) == 0) {
+      printf("Error: no stations found in %s.\n", path);
+      exit(-1);
+   }
+
+   /* ------------------------------------------------------------ *
+    * Start the workers, one per CPU unless set with -n            *
+    * ------------------------------------------------------------ */
+   if(workers == 0) {
+      workers = sysconf(_SC_NPROCESSORS_ONLN);
+      if(workers < 1) workers = 1;
+      if(workers > MAXWORKER) workers = MAXWORKER;
+   }
+   if(workers > st_cnt) workers = st_cnt;
+   signal(SIGTERM, sighandler);
+   signal(SIGINT, sighandler);
+   signal(SIGHUP, sighandler);
+   signal(SIGPIPE, SIG_IGN);
+   for(i=0; i<workers; i++) {
+      if(pthread_create(&tid[i], NULL, worker, (void *) (long) i) != 0) {
+         printf("Error: cannot start worker thread %d.\n", i);
+         exit(-1);
+      }
+   }
+   printf("wsingest: watching %d stations with %d workers, rescan every %ds\n", st_cnt, workers, RESCAN);
+   fflush(stdout);
+
+   /* ------------------------------------------------------------ *
+    * Queue a station when a frame file is renamed into its var    *
+    * folder, and all stations at start and at every rescan.       *
+    * ------------------------------------------------------------ */
+   time_t rescan = 0;
+   while(! stop) {
+      char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+      time_t now = time(NULL);
+
+      /* ------------------------------------------------------------ *
+       * Reload the stations on SIGHUP, for a new station folder, and *
+       * each day to move the UTC offset tables along. The workers    *
+       * finish their station first, and take no new one meanwhile.   *
+       * ------------------------------------------------------------ */
+      if(reload == 1 || now / 86400 != loadday
+         || (stat(path, &sb) == 0 && sb.st_mtime != chroot_mtime)) {
+         reload = 0;
+         pthread_mutex_lock(&qlock);
+         hold = 1;
+         for(i=0; i<st_cnt; i++) {
+            if(stations[i].busy == 0) continue;
+            pthread_cond_wait(&qcond, &qlock);
+            i = -1;
+         }
+         load_stations(datadir, ifd, wd);
+         hold = 0;
+         pthread_mutex_unlock(&qlock);
+         printf("wsingest: reloaded %d stations\n", st_cnt);
+         fflush(stdout);
+         rescan = 0;
+      }
+
+      if(now >= rescan) {
+         for(i=0; i<st_cnt; i++) enqueue(i, 0);
+         rescan = now + RESCAN;
+      }
+
+      struct pollfd pfd = { ifd, POLLIN, 0 };
+      if(poll(&pfd, 1, 1000) < 1) continue;
+      ssize_t len = read(ifd, buf, sizeof(buf));
+      char *p = buf;
+      while(len > 0 && p < buf + len) {
+         struct inotify_event *ev = (struct inotify_event *) p;
+         size_t nlen = (ev->len > 0) ? strlen(ev->name) : 0;
+         if(nlen > 4 && strcmp(ev->name + nlen - 4, ".wsf") == 0) {
+            for(i=0; i<st_cnt; i++) {
+               if(wd[i] != ev->wd) continue;
+               if(verbose == 1) printf("Debug: %s: new file %s\n", stations[i].name, ev->name);
+               enqueue(i, 1);
+            }
+         }
+         p += sizeof(struct inotify_event) + ev->len;
+      }
+   }
+
+   /* ------------------------------------------------------------ *
+    * Let the workers finish the station they have, then stop.     *
+    * ------------------------------------------------------------ */
+   printf("wsingest: stopping %d workers\n", workers);
+   pthread_mutex_lock(&qlock);
+   pthread_cond_broadcast(&qcond);
+   pthread_mutex_unlock(&qlock);
+   for(i=0; i<workers; i++) pthread_join(tid[i], NULL);
+   close(ifd);
+}
+
+int main(int argc, char *argv[]) {
+   char exe[MAXCLEN], file[MAXCLEN*4];
+   const char *datadir;
+   station_t st;
+
+   /* ------------------------------------------------------------ *
+    * Process the cmdline parameters                               *
+    * ------------------------------------------------------------ */
+   parseargs(argc, argv);
+
+   /* ------------------------------------------------------------ *
+    * The global config is ../etc/pi-web.conf from our bin folder  *
+    * ------------------------------------------------------------ */
+   ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe)-1);
+   if(len < 1) {
+      printf("Error: cannot get program path.\n");
+      exit(-1);
+   }
+   exe[len] = '\0';
+   snprintf(file, sizeof(file), "%s/../etc/pi-web.conf", dirname(exe));
+   if(readconfig(file) != 0 || (datadir = getconfig("pi-web-data")) == NULL) {
+      printf("Error: cannot read %s.\n", file);
+      exit(-1);
+   }
+   rrdcd = getconfig("pi-web-rrdcd");
+
+   if(dmode == 1) {
+      run_daemon(datadir);
+      exit(0);
+   }
+
+   if(load_station(datadir, stname, &st) != 0) {
+      printf("Error: cannot find station %s RRD or config.\n", stname);
+      exit(-1);
+   }
+   exit(ingest_station(&st, rrdcd));
+}
@@ -23,4 +23,8 @@ function getRRD($station) {
    $rrdpath = $datapath."/chroot/".$station."/rrd/".$station.".rrd";
    return $rrdpath;
 }
+// get the URL of a graph, rendered on request by the rrdgraph CGI
+function graphURL($station, $graph) {
+   return "/cgi-bin/rrdgraph?station=".$station."&amp;graph=".$graph;
+}
 ?>
@@ -65,9 +65,9 @@ echo "<hr />\n";
 include("./getsensor.htm");
 ?>
 
-<div class="fullgraph"><img src="images/daily_temp.png" alt="Current Temperature Graph"></div>
-<div class="fullgraph"><img src="images/daily_humi.png" alt="Current Humidity Graph"></div>
-<div class="fullgraph"><img src="images/daily_bmpr.png" alt="Current Pressure Graph"></div>
+<div class="fullgraph"><img src="<?php echo graphURL($station, "daily_temp"); ?>" alt="Current Temperature Graph"></div>
+<div class="fullgraph"><img src="<?php echo graphURL($station, "daily_humi"); ?>" alt="Current Humidity Graph"></div>
+<div class="fullgraph"><img src="<?php echo graphURL($station, "daily_bmpr"); ?>" alt="Current Pressure Graph"></div>
 <div class="copyright"><a href="javascript:elementHideShow('weekly');">Expand or Hide Shortterm Details</a></div>
 <h3>Shortterm View:</h3>
 <hr />
@@ -108,27 +108,27 @@ if($filecount>5) {
 include("./daymimax.htm");
 ?>
 <p>
-<div class="fullgraph"> <img src="images/monthly_temp.png" alt="Weekly Temperature Graph"> </div>
-<div class="fullgraph"> <img src="images/monthly_humi.png" alt="Weekly Humidity Graph"> </div>
-<div class="fullgraph"> <img src="images/monthly_bmpr.png" alt="Weekly Pressure Graph"> </div>
+<div class="fullgraph"> <img src="<?php echo graphURL($station, "monthly_temp"); ?>" alt="Weekly Temperature Graph"> </div>
+<div class="fullgraph"> <img src="<?php echo graphURL($station, "monthly_humi"); ?>" alt="Weekly Humidity Graph"> </div>
+<div class="fullgraph"> <img src="<?php echo graphURL($station, "monthly_bmpr"); ?>" alt="Weekly Pressure Graph"> </div>
 </div>
 <div class="copyright"><a href="javascript:elementHideShow('yearly');">Expand or Hide Midterm Details</a></div>
 <h3>Midterm View:</h3>
 <hr />
 <div class="showext" id="yearly" style="display: none;">
 <?php include("./momimax.htm"); ?>
-<div class="fullgraph"> <img src="images/yearly_temp.png" alt="Temperature Graph"> </div>
-<div class="fullgraph"> <img src="images/yearly_humi.png" alt="Humidity Graph"> </div>
-<div class="fullgraph"> <img src="images/yearly_bmpr.png" alt="Pressure Graph"> </div>
+<div class="fullgraph"> <img src="<?php echo graphURL($station, "yearly_temp"); ?>" alt="Temperature Graph"> </div>
+<div class="fullgraph"> <img src="<?php echo graphURL($station, "yearly_humi"); ?>" alt="Humidity Graph"> </div>
+<div class="fullgraph"> <img src="<?php echo graphURL($station, "yearly_bmpr"); ?>" alt="Pressure Graph"> </div>
 </div>
 <div class="copyright"><a href="javascript:elementHideShow('l_term');">Expand or Hide Longterm Details</a></div>
 <h3>Longterm View:</h3>
 <hr />
 <div class="showext" id="l_term" style="display: none;">
 <?php include("./yearmimax.htm"); ?>
-<div class="fullgraph"> <img src="images/twyear_temp.png" alt="Temperature Graph"> </div>
-<div class="fullgraph"> <img src="images/twyear_humi.png" alt="Humidity Graph"> </div>
-<div class="fullgraph"> <img src="images/twyear_bmpr.png" alt="Pressure Graph"> </div>
+<div class="fullgraph"> <img src="<?php echo graphURL($station, "twyear_temp"); ?>" alt="Temperature Graph"> </div>
+<div class="fullgraph"> <img src="<?php echo graphURL($station, "twyear_humi"); ?>" alt="Humidity Graph"> </div>
+<div class="fullgraph"> <img src="<?php echo graphURL($station, "twyear_bmpr"); ?>" alt="Pressure Graph"> </div>
 <?php include("./allmimax.htm"); ?>
 </div>
 </div>